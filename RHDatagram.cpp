@@ -36,9 +36,9 @@ bool RHDatagram::sendto(uint8_t* buf, uint8_t len, uint8_t address)
     return _driver.send(buf, len);
 }
 
-bool RHDatagram::recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
+bool RHDatagram::recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags, RHGenericDriver::RxMetadata* metadata)
 {
-    if (_driver.recv(buf, len))
+    if (_driver.recv(buf, len, metadata))
     {
 	if (from)  *from =  headerFrom();
 	if (to)    *to =    headerTo();
@@ -84,8 +84,10 @@ public:
     /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
     /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
     /// (not just those addressed to this node).
+    /// \param[out] metadata If present and not NULL, set to the RSSI, SNR, timestamp and frequency error of 
+    /// the message, as captured by the driver. See RHGenericDriver::RxMetadata
     /// \return true if a valid message was copied to buf
-    bool recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
+    bool recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL, RHGenericDriver::RxMetadata* metadata = NULL);
 
     /// Tests whether a new message is available
     /// from the Driver.
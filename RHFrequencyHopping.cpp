@@ -0,0 +1,245 @@
+// RHFrequencyHopping.cpp
+//
+// Copyright (C) 2017 Mike McCauley
+
+#include <RHFrequencyHopping.h>
+
+////////////////////////////////////////////////////////////////////
+// Constructors
+RHFrequencyHopping::RHFrequencyHopping(RHGenericDriver& driver, uint8_t thisAddress)
+    : RHDatagram(driver, thisAddress)
+{
+    _numChannels = 0;
+    _dwellTime = 0;
+    _guardTime = 0;
+    _master = false;
+    _synchronised = false;
+    _sentThisHop = false;
+    _hop = 0;
+    _channel = RH_FH_MAX_CHANNELS;
+    _hopStart = 0;
+    _lastHeard = 0;
+    _txLatency = 0;
+}
+
+////////////////////////////////////////////////////////////////////
+// Public methods
+bool RHFrequencyHopping::setHopping(uint8_t numChannels, uint32_t key, uint16_t dwellTime, uint32_t guardTime)
+{
+    if (   numChannels == 0
+	|| numChannels > RH_FH_MAX_CHANNELS
+	|| dwellTime == 0
+	|| dwellTime > 16000
+	|| guardTime >= (uint32_t)dwellTime * 1000)
+	return false;
+
+    // Shuffle the channels with a xorshift generator seeded from the key, so every node derives
+    // the same sequence
+    uint32_t x = key ? key : 0x2545f491;
+    uint8_t i;
+    for (i = 0; i < numChannels; i++)
+	_sequence[i] = i;
+    for (i = numChannels - 1; i > 0; i--)
+    {
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	uint8_t j = x % (i + 1);
+	uint8_t tmp = _sequence[i];
+	_sequence[i] = _sequence[j];
+	_sequence[j] = tmp;
+    }
+
+    _numChannels = numChannels;
+    _dwellTime = (uint32_t)dwellTime * 1000;
+    _guardTime = guardTime;
+    _synchronised = _master;
+    _hop = 0;
+    _hopStart = micros();
+    _channel = RH_FH_MAX_CHANNELS;
+    poll();
+    return true;
+}
+
+void RHFrequencyHopping::setMaster()
+{
+    _master = true;
+    _synchronised = true;
+    _hop = 0;
+    _hopStart = micros();
+    _sentThisHop = false;
+}
+
+bool RHFrequencyHopping::sendto(uint8_t* buf, uint8_t len, uint8_t address)
+{
+    if (   !_numChannels
+	|| len > RH_FH_MAX_MESSAGE_LEN
+	|| len + RH_FH_HEADER_LEN > _driver.maxMessageLength())
+	return false;
+    uint32_t airtime = _driver.timeOnAir(len + RH_FH_HEADER_LEN);
+    if (airtime + _guardTime >= _dwellTime)
+	return false; // Will never fit in a hop
+
+    // Wait for a hop with room for the message, including any channel access backoff
+    unsigned long start = millis();
+    while (true)
+    {
+	poll();
+	if (!_synchronised || millis() - start > 2 * _dwellTime / 1000)
+	    return false;
+	if (!fitsInHop(airtime))
+	{
+	    YIELD;
+	    continue;
+	}
+	_driver.waitCAD();
+	poll();
+	if (fitsInHop(airtime))
+	    break;
+    }
+    memcpy(_buf + RH_FH_HEADER_LEN, buf, len);
+    return sendHop(len, address);
+}
+
+bool RHFrequencyHopping::available()
+{
+    poll();
+    while (_driver.available())
+    {
+	if (!(_driver.headerFlags() & RH_FLAGS_CONTROL))
+	    return true;
+	uint8_t len = sizeof(_buf);
+	RHGenericDriver::RxMetadata metadata;
+	if (_driver.recv(_buf, &len, &metadata) && len >= RH_FH_SYNC_LEN && _buf[0] == RH_CONTROL_HOP_SYNC)
+	    handleHop(len, &metadata, 1);
+	poll();
+    }
+    return false;
+}
+
+bool RHFrequencyHopping::recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags, RHGenericDriver::RxMetadata* metadata)
+{
+    if (!available())
+	return false;
+    uint8_t rxLen = sizeof(_buf);
+    RHGenericDriver::RxMetadata rxMetadata;
+    if (!_driver.recv(_buf, &rxLen, &rxMetadata) || rxLen < RH_FH_HEADER_LEN)
+	return false;
+    handleHop(rxLen, &rxMetadata);
+
+    if (from)     *from =     headerFrom();
+    if (to)       *to =       headerTo();
+    if (id)       *id =       headerId();
+    if (flags)    *flags =    headerFlags();
+    if (metadata) *metadata = rxMetadata;
+    rxLen -= RH_FH_HEADER_LEN;
+    if (*len > rxLen)
+	*len = rxLen;
+    memcpy(buf, _buf + RH_FH_HEADER_LEN, *len);
+    return true;
+}
+
+void RHFrequencyHopping::poll()
+{
+    if (!_numChannels)
+	return;
+    uint32_t now = micros();
+    if (_synchronised)
+    {
+	uint32_t hops = (now - _hopStart) / _dwellTime;
+	if (hops)
+	{
+	    // Next hop, or later if we have not been called for a while
+	    _hopStart += hops * _dwellTime;
+	    _hop = (_hop + hops) % _numChannels;
+	    _sentThisHop = false;
+	}
+	if (!_master && now - _lastHeard > (uint32_t)RH_FH_SYNC_TIMEOUT * _dwellTime)
+	    _synchronised = false; // Lost the master: wait for it on the first channel
+    }
+
+    uint8_t channel = _synchronised ? _sequence[_hop] : _sequence[0];
+    if (channel != _channel)
+    {
+	_driver.setChannel(channel);
+	_channel = channel;
+    }
+
+    // The master keeps everyone in step. The sync waits until late in the hop (the last quarter of a
+    // dwell time in which it still fits), so that any other message the master sends in the hop does instead
+    if (_master && !_sentThisHop)
+    {
+	uint32_t airtime = _driver.timeOnAir(RH_FH_SYNC_LEN);
+	if (fitsInHop(airtime) && !fitsInHop(airtime + _dwellTime / 4))
+	    sendSync();
+    }
+}
+
+bool RHFrequencyHopping::synchronised()
+{
+    return _synchronised;
+}
+
+uint8_t RHFrequencyHopping::channel()
+{
+    return _channel;
+}
+
+////////////////////////////////////////////////////////////////////
+// Protected methods
+void RHFrequencyHopping::sendSync()
+{
+    _buf[0] = RH_CONTROL_HOP_SYNC;
+    setHeaderFlags(RH_FLAGS_CONTROL);
+    sendHop(0, RH_BROADCAST_ADDRESS, 1);
+    setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_CONTROL);
+}
+
+bool RHFrequencyHopping::sendHop(uint8_t len, uint8_t address, uint8_t timing)
+{
+    uint32_t start = micros();
+    uint32_t offset = start + _txLatency - _hopStart;
+    _buf[timing] = _hop;
+    _buf[timing + 1] = offset;
+    _buf[timing + 2] = offset >> 8;
+    _buf[timing + 3] = offset >> 16;
+    len += timing + RH_FH_HEADER_LEN;
+    bool sent = RHDatagram::sendto(_buf, len, address);
+    _driver.waitPacketSent();
+    _sentThisHop = true;
+
+    // Measure how long it took to start transmitting, for the next stamp
+    uint32_t txTime = _driver.lastTxTime();
+    uint32_t airtime = _driver.timeOnAir(len);
+    if (sent && txTime && txTime - start < _dwellTime && txTime - start >= airtime)
+    {
+	uint32_t latency = txTime - start - airtime;
+	_txLatency = _txLatency ? (3 * _txLatency + latency) / 4 : latency;
+    }
+    return sent;
+}
+
+void RHFrequencyHopping::handleHop(uint8_t len, RHGenericDriver::RxMetadata* metadata, uint8_t timing)
+{
+    if (_master || len < timing + RH_FH_HEADER_LEN || !_numChannels)
+	return;
+    // When did it start?
+    uint32_t rxTime = (metadata->valid & RH_RX_METADATA_TIMESTAMP) ? metadata->timestamp : micros();
+    rxTime -= _driver.timeOnAir(len);
+
+    uint8_t hop = _buf[timing];
+    uint32_t offset = (uint32_t)_buf[timing + 1] | ((uint32_t)_buf[timing + 2] << 8) | ((uint32_t)_buf[timing + 3] << 16);
+    if (hop >= _numChannels || offset >= _dwellTime)
+	return; // Not from our network
+    _hop = hop;
+    _hopStart = rxTime - offset;
+    _lastHeard = micros();
+    _synchronised = true;
+}
+
+bool RHFrequencyHopping::fitsInHop(uint32_t airtime)
+{
+    uint32_t inHop = micros() - _hopStart;
+    uint32_t halfGuard = _guardTime / 2;
+    return _synchronised && inHop >= halfGuard && inHop + _txLatency + airtime + halfGuard <= _dwellTime;
+}
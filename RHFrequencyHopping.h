@@ -0,0 +1,226 @@
+// RHFrequencyHopping.h
+//
+// Copyright (C) 2017 Mike McCauley
+
+#ifndef RHFrequencyHopping_h
+#define RHFrequencyHopping_h
+
+#include <RHDatagram.h>
+
+// Maximum number of channels in the hop sequence. Each costs 1 octet of RAM
+#ifndef RH_FH_MAX_CHANNELS
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_FH_MAX_CHANNELS 32
+ #else
+  #define RH_FH_MAX_CHANNELS 128
+ #endif
+#endif
+
+// Length of the hop timing prepended to every message
+#define RH_FH_HEADER_LEN 4
+
+// Length of a sync message: the control message type followed by the hop timing
+#define RH_FH_SYNC_LEN (1 + RH_FH_HEADER_LEN)
+
+// Longest message that can be sent by RHFrequencyHopping::sendto(). It must also fit in the
+// driver maxMessageLength() with the RH_FH_HEADER_LEN octets of hop timing
+#ifndef RH_FH_MAX_MESSAGE_LEN
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_FH_MAX_MESSAGE_LEN 60
+ #else
+  #define RH_FH_MAX_MESSAGE_LEN (RH_MAX_MESSAGE_LEN - RH_FH_HEADER_LEN)
+ #endif
+#endif
+
+// Default guard time at the ends of each dwell in microseconds, half at each end, to allow for clock drift,
+// timestamping jitter and the time to change channel
+#define RH_FH_DEFAULT_GUARD_TIME 2000
+
+// Number of dwell times without hearing anything after which a node stops transmitting and waits
+// on the first channel of the sequence to hear the master again
+#define RH_FH_SYNC_TIMEOUT 8
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHFrequencyHopping RHFrequencyHopping.h <RHFrequencyHopping.h>
+/// \brief RHDatagram subclass for frequency hopping spread spectrum (FHSS) messages
+///
+/// Manager class that extends RHDatagram to hop all the nodes in a network together around a set of
+/// channels, so that a narrowband interferer on one channel only costs the messages sent during the hops
+/// on that channel, and several networks with different keys can share the same channels with few collisions.
+///
+/// Time is divided into hops of a fixed dwell time. In each hop, all the nodes are tuned to the same
+/// channel, taken from a pseudo-random sequence in which each channel appears once. The sequence is derived
+/// from a network key, so all the nodes in a network must use the same number of channels, key and dwell time
+/// (see setHopping()). One node, the master, keeps the hop timing. Every message carries the hop it was sent in
+/// and how far into the hop it was sent, so every node that hears a message learns the hop timing from it
+/// (from the time the driver latched when it arrived, see RHGenericDriver::lastRxTime()).
+/// The master also sends a short sync message in every hop in which it has sent nothing else. The sync waits
+/// until late in the hop, in the last quarter of a dwell time before it would no longer fit, so it is only
+/// sent if the master has had nothing else to send for most of the hop.
+///
+/// Nodes that hear nothing for RH_FH_SYNC_TIMEOUT hops stop transmitting, and wait on the first channel in
+/// the sequence, where they will hear the master within one cycle of the sequence.
+///
+/// sendto() waits until there is time left in the current hop for the message, so that messages
+/// never cross a hop boundary. Messages longer than the dwell time (less the guard time) cannot be sent.
+/// This uses RHGenericDriver::timeOnAir(). With drivers that cannot compute it, make the guard time longer than
+/// the longest message.
+///
+/// \par Channels
+///
+/// Channels are selected with RHGenericDriver::setChannel(). With RH_RF95, RH_RF69, RH_RF24 and RH_RF22, call
+/// RHGenericDriver::setChannels() on the driver first, to set the frequency of channel 0 and the channel spacing.
+/// RH_RF22 then uses its own frequency hopping registers. RH_NRF24 uses its own channel numbers.
+/// Caution: the channels, dwell time and transmitter power must meet the rules for frequency hopping
+/// systems in your area (such as FCC 15.247 in the US).
+///
+/// \par Usage
+///
+/// RHFrequencyHopping is not interrupt or thread driven: call available() (or recvfrom()) frequently,
+/// such as every time round loop(), and at least several times per hop (the master at least several times
+/// per quarter hop, so it does not miss the time for its sync). These change the channel and send the
+/// master's sync messages. sendto() blocks for up to one dwell time.
+///
+/// \code
+/// driver.setChannels(915.0, 0.2); // RH_RF95: channel 0 at 915MHz, 200kHz apart
+/// RHFrequencyHopping manager(driver, MY_ADDRESS);
+/// manager.init();
+/// manager.setHopping(25, 0x12345678, 400);
+/// if (MY_ADDRESS == MASTER_ADDRESS)
+///   manager.setMaster();
+/// ...
+/// void loop()
+/// {
+///   if (manager.recvfrom(buf, &len, &from))
+///   ...
+/// }
+/// \endcode
+///
+/// The simulator sketch examples/simulator/simulator_frequency_hopping runs a master and nodes hopping
+/// over 4 channels, each simulated by its own ether simulator (see RH_TCP).
+///
+/// \par Headers
+///
+/// Every message starts with RH_FH_HEADER_LEN octets of hop timing, which are removed by recvfrom():
+/// - index of the hop in the sequence (1 octet)
+/// - time from the start of the hop to the start of transmission in microseconds (3 octets, least significant first)
+///
+/// Sync messages are broadcast with the RH_FLAGS_CONTROL bit set in the FLAGS header. They have only the control
+/// message type RH_CONTROL_HOP_SYNC (1 octet) followed by the hop timing. They are handled by RHFrequencyHopping
+/// and never returned by recvfrom(), nor are other manager control messages.
+class RHFrequencyHopping : public RHDatagram
+{
+public:
+    /// Constructor.
+    /// \param[in] driver The RadioHead driver to use to transport messages.
+    /// \param[in] thisAddress The address to assign to this node. Defaults to 0
+    RHFrequencyHopping(RHGenericDriver& driver, uint8_t thisAddress = 0);
+
+    /// Sets the hop sequence and timing. Must be the same on all the nodes in the network.
+    /// Until it is called, nothing can be sent.
+    /// \param[in] numChannels Number of channels to hop over, channels 0 to numChannels-1, up to RH_FH_MAX_CHANNELS
+    /// \param[in] key Network key, from which the order of the channels is derived
+    /// \param[in] dwellTime Time on each channel in milliseconds, up to 16000
+    /// \param[in] guardTime Time in microseconds at the ends of each hop in which nothing is sent,
+    /// half at each end
+    /// \return true if the parameters are valid
+    bool setHopping(uint8_t numChannels, uint32_t key, uint16_t dwellTime, uint32_t guardTime = RH_FH_DEFAULT_GUARD_TIME);
+
+    /// Makes this node the master, which keeps the hop timing for the network.
+    /// Call after setHopping(). There should be only one master.
+    void setMaster();
+
+    /// Sends a message in the current hop, or the next one if there is not enough time left in the current hop.
+    /// Blocks until the message has been sent.
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send, up to RH_FH_MAX_MESSAGE_LEN and the driver maxMessageLength()
+    /// less RH_FH_HEADER_LEN
+    /// \param[in] address The address to send the message to
+    /// \return true if the message was sent. false if it is too long, or this node is not synchronised
+    bool sendto(uint8_t* buf, uint8_t len, uint8_t address);
+
+    /// Follows the hop sequence, and tests whether a new message is available. Sync messages are handled here.
+    /// \return true if a new message is available to be retrieved by recvfrom()
+    bool available();
+
+    /// Follows the hop sequence, and if there is a valid message available for this node, copies it to buf
+    /// without the hop timing and returns true. Arguments are as for RHDatagram::recvfrom().
+    /// \return true if a valid message was copied to buf
+    bool recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL, RHGenericDriver::RxMetadata* metadata = NULL);
+
+    /// Follows the hop sequence without receiving anything: changes channel at the end of each hop, and
+    /// sends the master's sync messages. Called by available().
+    void poll();
+
+    /// Tests whether this node is following the hop timing of the master. The master is always synchronised.
+    /// \return true if synchronised
+    bool synchronised();
+
+    /// Returns the channel the radio is tuned to
+    /// \return The channel number
+    uint8_t channel();
+
+protected:
+    /// Broadcasts a sync message with the hop timing
+    void sendSync();
+
+    /// Sends a message with the hop timing prepended, and measures the transmit latency
+    /// \param[in] len Number of octets in _buf after the hop timing
+    /// \param[in] address The address to send the message to
+    /// \param[in] timing Offset of the hop timing in _buf
+    /// \return true if the message was sent
+    bool sendHop(uint8_t len, uint8_t address, uint8_t timing = 0);
+
+    /// Learns the hop timing from a received message in _buf
+    /// \param[in] len Length of the message in _buf, including the hop timing
+    /// \param[in] metadata Metadata for the message from the driver
+    /// \param[in] timing Offset of the hop timing in _buf
+    void handleHop(uint8_t len, RHGenericDriver::RxMetadata* metadata, uint8_t timing = 0);
+
+    /// Tests whether a message would end before the guard time at the end of the current hop if sent now
+    /// \param[in] airtime Time on air of the message in microseconds
+    /// \return true if it fits
+    bool fitsInHop(uint32_t airtime);
+
+private:
+    /// The hop sequence: the channel for each hop
+    uint8_t             _sequence[RH_FH_MAX_CHANNELS];
+
+    /// Number of channels in the sequence, 0 until setHopping()
+    uint8_t             _numChannels;
+
+    /// Time on each channel in microseconds
+    uint32_t            _dwellTime;
+
+    /// Guard time in microseconds, half at each end of each hop
+    uint32_t            _guardTime;
+
+    /// True if this node is the master
+    bool                _master;
+
+    /// True if we know the hop timing
+    bool                _synchronised;
+
+    /// True if the master has sent something in the current hop
+    bool                _sentThisHop;
+
+    /// Index in _sequence of the current hop
+    uint8_t             _hop;
+
+    /// The channel the radio is tuned to, RH_FH_MAX_CHANNELS if not yet set
+    uint8_t             _channel;
+
+    /// micros() at the start of the current hop
+    uint32_t            _hopStart;
+
+    /// micros() when we last learned the hop timing
+    uint32_t            _lastHeard;
+
+    /// Measured delay from calling send() to the start of transmission in microseconds
+    uint32_t            _txLatency;
+
+    /// Message being sent or received, with the hop timing
+    uint8_t             _buf[RH_FH_HEADER_LEN + RH_FH_MAX_MESSAGE_LEN];
+};
+
+#endif
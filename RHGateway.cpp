@@ -0,0 +1,352 @@
+// RHGateway.cpp
+//
+// Copyright (C) 2017 Mike McCauley
+
+#include <RHGateway.h>
+
+////////////////////////////////////////////////////////////////////
+// Constructors
+RHGateway::RHGateway(uint8_t thisAddress)
+{
+    _numRadios = 0;
+    _numNodes = 0;
+    _queueLen = 0;
+    _thisAddress = thisAddress;
+    _window = RH_GATEWAY_DEFAULT_WINDOW;
+    _windowStart = 0;
+    _firstWindow = true;
+    uint8_t i;
+    for (i = 0; i < RH_GATEWAY_QUEUE_LEN; i++)
+	_queue[i].used = false;
+}
+
+////////////////////////////////////////////////////////////////////
+// Public methods
+uint8_t RHGateway::addRadio(RHGenericDriver& driver, uint8_t channel, uint8_t config, uint8_t pool)
+{
+    if (_numRadios >= RH_GATEWAY_MAX_RADIOS)
+	return RH_GATEWAY_MAX_RADIOS;
+    driver.setThisAddress(_thisAddress);
+    driver.setHeaderFrom(_thisAddress);
+    Radio* r = &_radios[_numRadios];
+    r->driver = &driver;
+    r->channel = channel;
+    r->config = config;
+    r->pool = pool;
+    r->busy = 0;
+    r->load = 0;
+    r->ownBusy = 0;
+    r->own = 0;
+    if (_numRadios == 0)
+	_windowStart = millis();
+    return _numRadios++;
+}
+
+void RHGateway::setWindow(uint32_t window)
+{
+    if (window)
+	_window = window;
+}
+
+bool RHGateway::available()
+{
+    poll();
+    return _queueLen > 0;
+}
+
+bool RHGateway::recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags, uint8_t* radio, RHGenericDriver::RxMetadata* metadata)
+{
+    if (!available())
+	return false;
+
+    // The message that was received first, whichever radio received it
+    Message* m = NULL;
+    uint8_t i;
+    for (i = 0; i < RH_GATEWAY_QUEUE_LEN; i++)
+	if (_queue[i].used && (!m || (int32_t)(_queue[i].time - m->time) < 0))
+	    m = &_queue[i];
+
+    if (from)     *from =     m->from;
+    if (to)       *to =       m->to;
+    if (id)       *id =       m->id;
+    if (flags)    *flags =    m->flags;
+    if (radio)    *radio =    m->radio;
+    if (metadata) *metadata = m->metadata;
+    if (*len > m->len)
+	*len = m->len;
+    memcpy(buf, m->buf, *len);
+    m->used = false;
+    _queueLen--;
+    return true;
+}
+
+bool RHGateway::sendto(uint8_t* buf, uint8_t len, uint8_t address)
+{
+    // Send where the node was last heard, and on its own radio if it is being steered there
+    uint8_t node;
+    for (node = 0; node < _numNodes; node++)
+	if (_nodes[node].address == address)
+	    break;
+
+    bool sent = false;
+    uint8_t r;
+    for (r = 0; r < _numRadios; r++)
+    {
+	if (   node < _numNodes
+	    && r != _nodes[node].radio
+	    && r != _nodes[node].heardOn)
+	    continue;
+	_radios[r].driver->setHeaderTo(address);
+	if (_radios[r].driver->send(buf, len))
+	{
+	    _radios[r].busy += airtime(r, len);
+	    sent = true;
+	}
+    }
+    return sent;
+}
+
+void RHGateway::poll()
+{
+    uint8_t r;
+    for (r = 0; r < _numRadios && _queueLen < RH_GATEWAY_QUEUE_LEN; r++)
+	if (_radios[r].driver->available())
+	    collect(r);
+
+    if (_numRadios && millis() - _windowStart >= _window)
+    {
+	_windowStart = millis();
+	rebalance();
+    }
+}
+
+bool RHGateway::assign(uint8_t address, uint8_t radio)
+{
+    if (radio >= _numRadios)
+	return false;
+    uint8_t node = findNode(address, radio, 0);
+    if (node >= _numNodes)
+	return false;
+    _nodes[node].radio = radio;
+    return true;
+}
+
+uint8_t RHGateway::radioFor(uint8_t address)
+{
+    uint8_t i;
+    for (i = 0; i < _numNodes; i++)
+	if (_nodes[i].address == address)
+	    return _nodes[i].radio;
+    return RH_GATEWAY_MAX_RADIOS;
+}
+
+uint16_t RHGateway::occupancy(uint8_t radio)
+{
+    if (radio >= _numRadios)
+	return 0;
+    // Microseconds per window of milliseconds is parts per thousand
+    uint32_t occupancy = _radios[radio].load / _window;
+    return occupancy > 1000 ? 1000 : occupancy;
+}
+
+uint8_t RHGateway::numRadios()
+{
+    return _numRadios;
+}
+
+uint8_t RHGateway::numNodes()
+{
+    return _numNodes;
+}
+
+////////////////////////////////////////////////////////////////////
+// Protected methods
+void RHGateway::collect(uint8_t radio)
+{
+    uint8_t i;
+    for (i = 0; i < RH_GATEWAY_QUEUE_LEN; i++)
+	if (!_queue[i].used)
+	    break;
+    if (i >= RH_GATEWAY_QUEUE_LEN)
+	return; // Leave it in the driver until there is room
+
+    Message* m = &_queue[i];
+    RHGenericDriver* driver = _radios[radio].driver;
+    uint8_t len = sizeof(m->buf);
+    if (!driver->recv(m->buf, &len, &m->metadata))
+	return;
+    m->time = (m->metadata.valid & RH_RX_METADATA_TIMESTAMP) ? m->metadata.timestamp : micros();
+    m->radio = radio;
+    m->from = driver->headerFrom();
+    m->to = driver->headerTo();
+    m->id = driver->headerId();
+    m->flags = driver->headerFlags();
+    m->len = len;
+    _radios[radio].busy += airtime(radio, len);
+
+    if (m->flags & RH_FLAGS_CONTROL)
+	return; // Another gateway steering its nodes, or some other manager's control message
+
+    // Schedule the nodes that send to us, and steer them if they are on the wrong radio
+    if (   (m->to == _thisAddress || m->to == RH_BROADCAST_ADDRESS)
+	&& m->from != _thisAddress
+	&& m->from != RH_BROADCAST_ADDRESS)
+    {
+	uint8_t node = findNode(m->from, radio, len);
+	if (node < _numNodes)
+	{
+	    Node* n = &_nodes[node];
+	    _radios[radio].ownBusy += airtime(radio, len);
+	    n->heardOn = radio;
+	    n->length = (3 * (uint16_t)n->length + len) / 4;
+	    if (n->count < 0xffff)
+		n->count++;
+	    if (n->radio != radio && millis() - n->lastSteer >= RH_GATEWAY_STEER_INTERVAL)
+		sendSteer(node);
+	}
+    }
+
+    m->used = true;
+    _queueLen++;
+}
+
+void RHGateway::sendSteer(uint8_t node)
+{
+    Node* n = &_nodes[node];
+    Radio* target = &_radios[n->radio];
+    if (target->channel == RH_GATEWAY_NO_CHANGE && target->config == RH_GATEWAY_NO_CHANGE)
+	return; // Nothing we can tell it
+
+    uint8_t buf[RH_GATEWAY_STEER_LEN];
+    buf[0] = RH_CONTROL_GATEWAY_STEER;
+    buf[1] = target->channel;
+    buf[2] = target->config;
+    RHGenericDriver* driver = _radios[n->heardOn].driver;
+    driver->setHeaderTo(n->address);
+    driver->setHeaderFlags(RH_FLAGS_CONTROL);
+    if (driver->send(buf, sizeof(buf)))
+    {
+	_radios[n->heardOn].busy += airtime(n->heardOn, sizeof(buf));
+	_radios[n->heardOn].ownBusy += airtime(n->heardOn, sizeof(buf));
+    }
+    driver->setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_CONTROL);
+    n->lastSteer = millis();
+}
+
+void RHGateway::rebalance()
+{
+    uint8_t r, i;
+    for (r = 0; r < _numRadios; r++)
+    {
+	_radios[r].load = _firstWindow ? _radios[r].busy : (_radios[r].load + _radios[r].busy) / 2;
+	_radios[r].own = _firstWindow ? _radios[r].ownBusy : (_radios[r].own + _radios[r].ownBusy) / 2;
+	_radios[r].busy = 0;
+	_radios[r].ownBusy = 0;
+    }
+    for (i = 0; i < _numNodes; i++)
+    {
+	_nodes[i].rate = _firstWindow ? _nodes[i].count : ((uint32_t)_nodes[i].rate + _nodes[i].count + 1) / 2;
+	_nodes[i].count = 0;
+    }
+    _firstWindow = false;
+
+    uint32_t expected[RH_GATEWAY_MAX_RADIOS];
+    for (r = 0; r < _numRadios; r++)
+	expected[r] = expectedLoad(r);
+
+    // Find the move that most reduces the occupancy of the busier radio
+    uint32_t bestGain = (uint32_t)RH_GATEWAY_HYSTERESIS * _window; // us
+    uint8_t bestNode = RH_GATEWAY_MAX_NODES;
+    uint8_t bestRadio = 0;
+    for (i = 0; i < _numNodes; i++)
+    {
+	uint8_t from = _nodes[i].radio;
+	if (!_nodes[i].rate || _nodes[i].heardOn != from)
+	    continue; // Silent, or still being steered
+	uint32_t leaving = nodeLoad(i, from);
+	if (leaving > expected[from])
+	    leaving = expected[from];
+	for (r = 0; r < _numRadios; r++)
+	{
+	    if (r == from || _radios[r].pool != _radios[from].pool)
+		continue;
+	    uint32_t busier = expected[r] + nodeLoad(i, r);
+	    if (busier < expected[from] - leaving)
+		busier = expected[from] - leaving;
+	    if (busier < expected[from] && expected[from] - busier >= bestGain)
+	    {
+		bestGain = expected[from] - busier;
+		bestNode = i;
+		bestRadio = r;
+	    }
+	}
+    }
+    // It is steered next time it is heard
+    if (bestNode < _numNodes)
+	_nodes[bestNode].radio = bestRadio;
+}
+
+uint8_t RHGateway::findNode(uint8_t address, uint8_t radio, uint8_t len)
+{
+    uint8_t i;
+    for (i = 0; i < _numNodes; i++)
+	if (_nodes[i].address == address)
+	    return i;
+    if (_numNodes >= RH_GATEWAY_MAX_NODES)
+	return RH_GATEWAY_MAX_NODES;
+
+    Node* n = &_nodes[_numNodes];
+    n->address = address;
+    n->heardOn = radio;
+    n->length = len;
+    n->count = 0;
+    n->rate = 1;
+    n->lastSteer = millis() - RH_GATEWAY_STEER_INTERVAL;
+    n->radio = RH_GATEWAY_MAX_RADIOS; // Not counted below
+    _numNodes++;
+
+    // Give it the radio in the same pool that would be least occupied with it,
+    // preferring the one it was heard on
+    uint32_t least = 0xffffffff;
+    uint8_t best = radio;
+    uint8_t r;
+    for (r = 0; r < _numRadios; r++)
+    {
+	if (_radios[r].pool != _radios[radio].pool)
+	    continue;
+	uint32_t expected = expectedLoad(r) + nodeLoad(_numNodes - 1, r);
+	if (expected < least || (expected == least && r == radio))
+	{
+	    least = expected;
+	    best = r;
+	}
+    }
+    n->radio = best;
+    return _numNodes - 1;
+}
+
+uint32_t RHGateway::expectedLoad(uint8_t radio)
+{
+    // Our nodes as they are now scheduled, rather than where they were heard during the
+    // last few windows, plus everything else on the channel
+    uint32_t expected = 0;
+    uint8_t i;
+    for (i = 0; i < _numNodes; i++)
+	if (_nodes[i].radio == radio)
+	    expected += nodeLoad(i, radio);
+    if (_radios[radio].load > _radios[radio].own)
+	expected += _radios[radio].load - _radios[radio].own;
+    return expected;
+}
+
+uint32_t RHGateway::nodeLoad(uint8_t node, uint8_t radio)
+{
+    uint16_t rate = _nodes[node].rate ? _nodes[node].rate : 1;
+    return rate * airtime(radio, _nodes[node].length);
+}
+
+uint32_t RHGateway::airtime(uint8_t radio, uint8_t len)
+{
+    uint32_t airtime = _radios[radio].driver->timeOnAir(len);
+    return airtime ? airtime : 1000;
+}
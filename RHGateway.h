@@ -0,0 +1,310 @@
+// RHGateway.h
+//
+// Copyright (C) 2017 Mike McCauley
+
+#ifndef RHGateway_h
+#define RHGateway_h
+
+#include <RHGenericDriver.h>
+
+// Maximum number of radios in a gateway
+#ifndef RH_GATEWAY_MAX_RADIOS
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_GATEWAY_MAX_RADIOS 2
+ #else
+  #define RH_GATEWAY_MAX_RADIOS 8
+ #endif
+#endif
+
+// Maximum number of nodes the gateway schedules. Each costs 12 octets of RAM
+#ifndef RH_GATEWAY_MAX_NODES
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_GATEWAY_MAX_NODES 16
+ #else
+  #define RH_GATEWAY_MAX_NODES 128
+ #endif
+#endif
+
+// Number of received messages the gateway can hold, from all the radios together
+#ifndef RH_GATEWAY_QUEUE_LEN
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_GATEWAY_QUEUE_LEN 2
+ #else
+  #define RH_GATEWAY_QUEUE_LEN 16
+ #endif
+#endif
+
+// Longest message that can be held in the queue
+#ifndef RH_GATEWAY_MAX_MESSAGE_LEN
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_GATEWAY_MAX_MESSAGE_LEN 60
+ #else
+  #define RH_GATEWAY_MAX_MESSAGE_LEN 255
+ #endif
+#endif
+
+// Channel or configuration in a steer message that the node should not change
+#define RH_GATEWAY_NO_CHANGE 0xff
+
+// Length of a steer message, including the control message type
+#define RH_GATEWAY_STEER_LEN 3
+
+// Default interval in milliseconds over which the occupancy of each radio is measured,
+// and after which the load may be rebalanced
+#define RH_GATEWAY_DEFAULT_WINDOW 60000
+
+// Minimum time in milliseconds between steer messages to the same node
+#define RH_GATEWAY_STEER_INTERVAL 5000
+
+// A node is only moved if that reduces the occupancy of the busier radio by at least this much,
+// in parts per thousand, so that the load does not swing back and forth on measurement noise
+#define RH_GATEWAY_HYSTERESIS 10
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHGateway RHGateway.h <RHGateway.h>
+/// \brief Gateway for several radios, that spreads the nodes across them and merges what they receive
+///
+/// A gateway fitted with several radio modules, each on its own channel (and for RH_RF95, perhaps
+/// its own spreading factor), can receive from all of them at once. RHGateway schedules the nodes across
+/// those radios so that the capacity of the gateway grows with the number of modules fitted:
+/// - it measures the occupancy of each radio: the time on air of everything it receives or sends
+///   over a window (see setWindow()), from RHGenericDriver::timeOnAir()
+/// - it gives each node a radio: new nodes go to the radio that would be least occupied with them,
+///   and at the end of each window one node may be moved from a busy radio to a quieter one
+/// - it steers each node to its radio with a short steer message, telling the node the channel
+///   and modem configuration of that radio (see RHGatewayNode)
+/// - it merges the messages received by all the radios into one stream, in the order they were received
+///
+/// Nodes start on the channel of one radio (typically the first), and are steered from there.
+/// Steer messages are sent in reply to a message from the node, when it is most likely to be listening,
+/// and repeated (at most every RH_GATEWAY_STEER_INTERVAL ms) for as long as the node is heard on the
+/// wrong radio, so lost steer messages and reset nodes are recovered from.
+///
+/// Each radio belongs to a pool. Nodes are only moved between radios in the same pool, so radios that
+/// nodes cannot move between (eg RH_RF95 and RH_RF69, or different bands) go in different pools.
+///
+/// The radios are configured by the application (frequency, modem configuration, power etc).
+/// addRadio() tells RHGateway what to tell the nodes about each one. All the radios share the same
+/// address. With RHGenericDriver::setPromiscuous(), the occupancy includes traffic for other gateways
+/// on the same channels, which gives a better measure of how busy each channel really is.
+/// Only nodes that send to this gateway (or broadcast) are scheduled, but all the messages received are
+/// returned by recvfrom().
+///
+/// \par Usage
+///
+/// RHGateway is not interrupt or thread driven: call available() (or recvfrom()) frequently.
+/// They collect the messages from all the radios, send the steer messages and rebalance the load.
+///
+/// \code
+/// rf95_1.setChannels(868.1, 0.2);
+/// rf95_1.setChannel(0);
+/// rf95_2.setChannels(868.1, 0.2);
+/// rf95_2.setChannel(1);
+/// RHGateway gateway(GATEWAY_ADDRESS);
+/// gateway.addRadio(rf95_1, 0, RH_RF95::Bw125Cr45Sf128);
+/// gateway.addRadio(rf95_2, 1, RH_RF95::Bw125Cr45Sf128);
+/// ...
+/// if (gateway.recvfrom(buf, &len, &from, NULL, NULL, NULL, &radio))
+///   ...
+/// \endcode
+///
+/// The simulator sketch examples/simulator/simulator_gateway runs a gateway with 2 radios on different
+/// channels, and watches it spread its nodes between them.
+///
+/// \par Headers
+///
+/// Steer messages are sent with the RH_FLAGS_CONTROL bit set in the FLAGS header. They contain:
+/// - control message type RH_CONTROL_GATEWAY_STEER (1 octet)
+/// - channel, for RHGenericDriver::setChannel(), or RH_GATEWAY_NO_CHANGE (1 octet)
+/// - modem configuration, such as an RH_RF95::ModemConfigChoice, or RH_GATEWAY_NO_CHANGE (1 octet)
+class RHGateway
+{
+public:
+    /// Constructor.
+    /// \param[in] thisAddress The address of the gateway, on all its radios. Defaults to 0
+    RHGateway(uint8_t thisAddress = 0);
+
+    /// Adds a radio to the gateway. Initialise and configure the driver first. The radio is given the
+    /// gateway address.
+    /// \param[in] driver The driver for the radio
+    /// \param[in] channel The channel the radio is on, as nodes select it with RHGenericDriver::setChannel(),
+    /// or RH_GATEWAY_NO_CHANGE if nodes are not to change channel to reach it
+    /// \param[in] config The modem configuration the radio uses, as nodes select it with
+    /// RHGenericDriver::setModemConfigIndex() (such as an RH_RF95::ModemConfigChoice), or RH_GATEWAY_NO_CHANGE
+    /// \param[in] pool Nodes are only moved between radios in the same pool
+    /// \return The index of the radio, or RH_GATEWAY_MAX_RADIOS if there are too many
+    uint8_t addRadio(RHGenericDriver& driver, uint8_t channel = RH_GATEWAY_NO_CHANGE, uint8_t config = RH_GATEWAY_NO_CHANGE, uint8_t pool = 0);
+
+    /// Sets the interval over which the occupancy of each radio is measured. At the end of each window,
+    /// at most one node is moved. Longer windows give steadier measurements but react more slowly.
+    /// \param[in] window The window in milliseconds. Defaults to RH_GATEWAY_DEFAULT_WINDOW
+    void setWindow(uint32_t window);
+
+    /// Collects any messages from the radios, and tests whether a message is available
+    /// \return true if a message is available to be retrieved by recvfrom()
+    bool available();
+
+    /// If there is a message available from any radio, copies the one that was received first to buf
+    /// and returns true. Steer messages from other gateways, and other manager control messages, are never returned.
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Pointer to available space in buf. Set to the actual number of octets copied.
+    /// \param[in] from If present and not NULL, the referenced uint8_t will be set to the FROM address
+    /// \param[in] to If present and not NULL, the referenced uint8_t will be set to the TO address
+    /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
+    /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
+    /// \param[in] radio If present and not NULL, the referenced uint8_t will be set to the index of the
+    /// radio that received the message
+    /// \param[in] metadata If present and not NULL, set to the reception details of the message
+    /// \return true if a valid message was copied to buf
+    bool recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL, uint8_t* radio = NULL, RHGenericDriver::RxMetadata* metadata = NULL);
+
+    /// Sends a message to a node on the radio it has been given. If the node was last heard on another
+    /// radio (it has not followed its steer message yet), the message is sent on that radio too.
+    /// Messages to nodes that the gateway has not scheduled, and broadcasts, are sent on all the radios.
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send
+    /// \param[in] address The address to send the message to
+    /// \return true if the message was sent on at least one radio
+    bool sendto(uint8_t* buf, uint8_t len, uint8_t address);
+
+    /// Collects any messages from the radios, sends steer messages, and rebalances the load at the end
+    /// of each window. Called by available().
+    void poll();
+
+    /// Gives a node a radio, overriding the load balancing until the next rebalance.
+    /// The node is steered to it the next time it is heard.
+    /// \param[in] address The address of the node
+    /// \param[in] radio Index of the radio
+    /// \return true if the node was given the radio. false if the radio does not exist,
+    /// or there are already RH_GATEWAY_MAX_NODES nodes
+    bool assign(uint8_t address, uint8_t radio);
+
+    /// Returns the radio a node has been given
+    /// \param[in] address The address of the node
+    /// \return The index of the radio, or RH_GATEWAY_MAX_RADIOS if the node has not been scheduled
+    uint8_t radioFor(uint8_t address);
+
+    /// Returns the measured occupancy of a radio: the proportion of the time that something
+    /// it received or sent was on the air, averaged over the last few windows. 0 until the end of the first window
+    /// \param[in] radio Index of the radio
+    /// \return The occupancy in parts per thousand
+    uint16_t occupancy(uint8_t radio);
+
+    /// Returns the number of radios added by addRadio()
+    /// \return The number of radios
+    uint8_t numRadios();
+
+    /// Returns the number of nodes being scheduled
+    /// \return The number of nodes
+    uint8_t numNodes();
+
+protected:
+    /// Collects a message from a radio into the queue, and schedules the node that sent it
+    /// \param[in] radio Index of the radio with a message available
+    void collect(uint8_t radio);
+
+    /// Sends a steer message to a node on the radio it was heard on, telling it how to reach its radio
+    /// \param[in] node Index of the node
+    void sendSteer(uint8_t node);
+
+    /// Ends the occupancy window, and moves the node that most reduces the occupancy of a busy radio
+    void rebalance();
+
+    /// Finds a node, and adds it if it is new
+    /// \param[in] address The address of the node
+    /// \param[in] radio The radio the node was heard on
+    /// \param[in] len Length of the message it sent, to estimate its load on each radio
+    /// \return The index of the node, or RH_GATEWAY_MAX_NODES if it is new and the table is full
+    uint8_t findNode(uint8_t address, uint8_t radio, uint8_t len);
+
+    /// Estimates the time on air a radio will be used per window: the estimated load of the nodes
+    /// it has been given, plus the measured time on air of everything else it hears
+    /// \param[in] radio Index of the radio
+    /// \return The time on air in microseconds per window
+    uint32_t expectedLoad(uint8_t radio);
+
+    /// Estimates the time on air a node uses on a radio per window, at its measured message rate
+    /// \param[in] node Index of the node
+    /// \param[in] radio Index of the radio
+    /// \return The time on air in microseconds per window
+    uint32_t nodeLoad(uint8_t node, uint8_t radio);
+
+    /// Time on air of a message on a radio. Drivers that cannot compute it count 1ms per message
+    /// \param[in] radio Index of the radio
+    /// \param[in] len Length of the message
+    /// \return The time on air in microseconds
+    uint32_t airtime(uint8_t radio, uint8_t len);
+
+private:
+    /// A radio in the gateway
+    typedef struct
+    {
+	RHGenericDriver* driver;      ///< The driver
+	uint8_t          channel;     ///< Channel the nodes are told to use
+	uint8_t          config;      ///< Modem configuration the nodes are told to use
+	uint8_t          pool;        ///< Nodes are only moved between radios in the same pool
+	uint32_t         busy;        ///< Time on air in this window in microseconds
+	uint32_t         load;        ///< Average time on air per window in microseconds
+	uint32_t         ownBusy;     ///< Time on air of our nodes and steer messages in this window
+	uint32_t         own;         ///< Average of ownBusy per window
+    } Radio;
+
+    /// A node scheduled by the gateway
+    typedef struct
+    {
+	uint8_t          address;     ///< Node address
+	uint8_t          radio;       ///< Index of the radio the node has been given
+	uint8_t          heardOn;     ///< Index of the radio the node was last heard on
+	uint8_t          length;      ///< Average length of its messages
+	uint16_t         count;       ///< Messages received from it in this window
+	uint16_t         rate;        ///< Average messages per window
+	unsigned long    lastSteer;   ///< millis() when it was last sent a steer message
+    } Node;
+
+    /// A received message waiting to be collected by recvfrom()
+    typedef struct
+    {
+	bool             used;        ///< This entry holds a message
+	uint8_t          radio;       ///< Index of the radio that received it
+	uint8_t          from;        ///< FROM header
+	uint8_t          to;          ///< TO header
+	uint8_t          id;          ///< ID header
+	uint8_t          flags;       ///< FLAGS header
+	uint8_t          len;         ///< Length of the message
+	uint32_t         time;        ///< micros() when it was received
+	RHGenericDriver::RxMetadata metadata; ///< Reception details from the driver
+	uint8_t          buf[RH_GATEWAY_MAX_MESSAGE_LEN]; ///< The message
+    } Message;
+
+    /// The radios
+    Radio               _radios[RH_GATEWAY_MAX_RADIOS];
+
+    /// Number of radios in _radios
+    uint8_t             _numRadios;
+
+    /// The nodes being scheduled
+    Node                _nodes[RH_GATEWAY_MAX_NODES];
+
+    /// Number of nodes in _nodes
+    uint8_t             _numNodes;
+
+    /// Received messages, in no particular order
+    Message             _queue[RH_GATEWAY_QUEUE_LEN];
+
+    /// Number of messages in _queue
+    uint8_t             _queueLen;
+
+    /// Gateway address
+    uint8_t             _thisAddress;
+
+    /// Occupancy window in ms
+    uint32_t            _window;
+
+    /// millis() at the start of the current window
+    unsigned long       _windowStart;
+
+    /// True until the end of the first window, when there is no average yet
+    bool                _firstWindow;
+};
+
+#endif
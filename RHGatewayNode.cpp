@@ -0,0 +1,64 @@
+// RHGatewayNode.cpp
+//
+// Copyright (C) 2017 Mike McCauley
+
+#include <RHGatewayNode.h>
+
+////////////////////////////////////////////////////////////////////
+// Constructors
+RHGatewayNode::RHGatewayNode(RHGenericDriver& driver, uint8_t thisAddress)
+    : RHDatagram(driver, thisAddress)
+{
+    _channel = RH_GATEWAY_NO_CHANGE;
+    _config = RH_GATEWAY_NO_CHANGE;
+}
+
+////////////////////////////////////////////////////////////////////
+// Public methods
+bool RHGatewayNode::available()
+{
+    while (_driver.available())
+    {
+	if (!(_driver.headerFlags() & RH_FLAGS_CONTROL))
+	    return true;
+	uint8_t buf[RH_GATEWAY_STEER_LEN];
+	uint8_t len = sizeof(buf);
+	if (   _driver.recv(buf, &len)
+	    && len == RH_GATEWAY_STEER_LEN
+	    && buf[0] == RH_CONTROL_GATEWAY_STEER
+	    && _driver.headerTo() == _thisAddress)
+	{
+	    _channel = buf[1];
+	    _config = buf[2];
+	    handleSteer(buf[1], buf[2]);
+	}
+    }
+    return false;
+}
+
+bool RHGatewayNode::recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags, RHGenericDriver::RxMetadata* metadata)
+{
+    if (!available())
+	return false;
+    return RHDatagram::recvfrom(buf, len, from, to, id, flags, metadata);
+}
+
+uint8_t RHGatewayNode::channel()
+{
+    return _channel;
+}
+
+uint8_t RHGatewayNode::config()
+{
+    return _config;
+}
+
+////////////////////////////////////////////////////////////////////
+// Protected methods
+void RHGatewayNode::handleSteer(uint8_t channel, uint8_t config)
+{
+    if (config != RH_GATEWAY_NO_CHANGE)
+	_driver.setModemConfigIndex(config);
+    if (channel != RH_GATEWAY_NO_CHANGE)
+	_driver.setChannel(channel);
+}
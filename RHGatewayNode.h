@@ -0,0 +1,71 @@
+// RHGatewayNode.h
+//
+// Copyright (C) 2017 Mike McCauley
+
+#ifndef RHGatewayNode_h
+#define RHGatewayNode_h
+
+#include <RHDatagram.h>
+#include <RHGateway.h>
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHGatewayNode RHGatewayNode.h <RHGatewayNode.h>
+/// \brief RHDatagram subclass for nodes that are steered between the radios of an RHGateway
+///
+/// Manager class that extends RHDatagram to follow the steer messages sent by an RHGateway, which
+/// spreads its nodes across the several radios it has fitted. A steer message tells the node the channel
+/// (see RHGenericDriver::setChannel()) and modem configuration of the radio it should use.
+///
+/// Start each node on the channel and modem configuration of the gateway radio that new nodes should use.
+/// The gateway steers nodes in reply to messages they send, so after sending, listen for a while
+/// (such as waiting for an acknowledgement or reply). Steer messages are handled by available() and
+/// recvfrom() and never returned.
+///
+/// handleSteer() selects the modem configuration with RHGenericDriver::setModemConfigIndex() (for RH_RF95
+/// the config is a RH_RF95::ModemConfigChoice) and the channel with RHGenericDriver::setChannel().
+/// Subclass RHGatewayNode and override handleSteer() to do something else, such as for drivers that do not
+/// support setModemConfigIndex().
+///
+/// Nodes that stop hearing from the gateway (eg no acknowledgements for a long time) should return to the
+/// starting channel and modem configuration, where the gateway will steer them again.
+class RHGatewayNode : public RHDatagram
+{
+public:
+    /// Constructor.
+    /// \param[in] driver The RadioHead driver to use to transport messages.
+    /// \param[in] thisAddress The address to assign to this node. Defaults to 0
+    RHGatewayNode(RHGenericDriver& driver, uint8_t thisAddress = 0);
+
+    /// Tests whether a new message is available. Steer messages are handled here.
+    /// \return true if a new message is available to be retrieved by recvfrom()
+    bool available();
+
+    /// If there is a valid message available for this node, copies it to buf and returns true.
+    /// Steer messages are handled here. Arguments are as for RHDatagram::recvfrom().
+    /// \return true if a valid message was copied to buf
+    bool recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL, RHGenericDriver::RxMetadata* metadata = NULL);
+
+    /// Returns the channel the node was last steered to
+    /// \return The channel, or RH_GATEWAY_NO_CHANGE if it has not been steered
+    uint8_t channel();
+
+    /// Returns the modem configuration the node was last steered to
+    /// \return The modem configuration, or RH_GATEWAY_NO_CHANGE if it has not been steered
+    uint8_t config();
+
+protected:
+    /// Called when the gateway steers this node to another radio. Selects the modem configuration
+    /// and the channel, unless they are RH_GATEWAY_NO_CHANGE.
+    /// \param[in] channel The channel to use, or RH_GATEWAY_NO_CHANGE
+    /// \param[in] config The modem configuration to use, or RH_GATEWAY_NO_CHANGE
+    virtual void handleSteer(uint8_t channel, uint8_t config);
+
+private:
+    /// Channel we were last steered to
+    uint8_t             _channel;
+
+    /// Modem configuration we were last steered to
+    uint8_t             _config;
+};
+
+#endif
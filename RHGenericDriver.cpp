@@ -5,6 +5,72 @@
 
 #include <RHGenericDriver.h>
 
+#ifdef RH_HAVE_EVENT_WAIT
+#include <time.h>
+#include <errno.h>
+
+// The clock for waitEvent() deadlines
+#define RH_EVENT_CLOCK CLOCK_MONOTONIC
+#endif
+
+#ifdef RH_HAVE_PIN_INTERRUPTS
+// One low level interrupt routine for each possible interrupt pin
+void (* const RHGenericDriver::_isrForSlot[RH_MAX_INTERRUPT_PINS])() =
+{
+    isr<0>,
+#if RH_MAX_INTERRUPT_PINS > 1
+    isr<1>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 2
+    isr<2>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 3
+    isr<3>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 4
+    isr<4>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 5
+    isr<5>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 6
+    isr<6>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 7
+    isr<7>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 8
+    isr<8>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 9
+    isr<9>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 10
+    isr<10>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 11
+    isr<11>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 12
+    isr<12>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 13
+    isr<13>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 14
+    isr<14>,
+#endif
+#if RH_MAX_INTERRUPT_PINS > 15
+    isr<15>,
+#endif
+};
+uint8_t RHGenericDriver::_interruptPins[RH_MAX_INTERRUPT_PINS];
+uint8_t RHGenericDriver::_interruptModes[RH_MAX_INTERRUPT_PINS];
+uint8_t RHGenericDriver::_interruptPinCount = 0;
+RHGenericDriver* volatile RHGenericDriver::_interruptDevices[RH_MAX_INTERRUPT_DEVICES];
+volatile uint8_t RHGenericDriver::_interruptDeviceSlots[RH_MAX_INTERRUPT_DEVICES];
+#endif
+
 RHGenericDriver::RHGenericDriver()
     :
     _mode(RHModeInitialising),
@@ -13,11 +79,59 @@ RHGenericDriver::RHGenericDriver()
     _txHeaderFrom(RH_BROADCAST_ADDRESS),
     _txHeaderId(0),
     _txHeaderFlags(0),
+    _rxTime(0),
+    _txTime(0),
     _rxBad(0),
     _rxGood(0),
     _txGood(0),
-    _cad_timeout(0)
+    _cad_timeout(0),
+    _channelBase(0.0),
+    _channelSpacing(0.0),
+    _lplInterval(0),
+    _wakeupPreamble(0),
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    _frequency(0.0),
+#endif
+    _csmaState(CsmaIdle),
+    _csmaBackoffEnd(0),
+    _csmaStart(0),
+    _cw(RH_CSMA_CW_MIN),
+    _cwMin(RH_CSMA_CW_MIN),
+    _cwMax(RH_CSMA_CW_MAX),
+    _ccaThreshold(0),
+    _ccaMargin(RH_CCA_DEFAULT_MARGIN),
+    _noiseFloor(0),
+    _noiseFloorValid(false)
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    ,
+    _dutyCycleMaxDefer(0),
+    _txStartTime(0),
+    _txFrequency(0.0)
+#endif
+#if RH_ENABLE_ENERGY_ACCOUNTING
+    ,
+    _modeStartMicros(0),
+    _modeStartMillis(0)
+#endif
 {
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    memset(_dutyCycleBands, 0, sizeof(_dutyCycleBands));
+#endif
+#if RH_ENABLE_ENERGY_ACCOUNTING
+    // Time until the first mode change is accounted to RHModeInitialising
+    memset(_modeTime, 0, sizeof(_modeTime));
+    memset(_modeTimeMicros, 0, sizeof(_modeTimeMicros));
+    memset(_modeCurrent, 0, sizeof(_modeCurrent));
+#endif
+#ifdef RH_HAVE_EVENT_WAIT
+    _eventCount = 0;
+    pthread_mutex_init(&_eventLock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, RH_EVENT_CLOCK);
+    pthread_cond_init(&_eventCond, &attr);
+    pthread_condattr_destroy(&attr);
+#endif
 }
 
 bool RHGenericDriver::init()
@@ -28,8 +142,13 @@ bool RHGenericDriver::init()
 // Blocks until a valid message is received
 void RHGenericDriver::waitAvailable()
 {
-    while (!available())
-	YIELD;
+    while (1)
+    {
+	uint32_t count = eventCount();
+	if (available())
+	    return;
+	waitEvent(count, RH_EVENT_POLL_INTERVAL);
+    }
 }
 
 // Blocks until a valid message is received or timeout expires
@@ -38,64 +157,372 @@ void RHGenericDriver::waitAvailable()
 bool RHGenericDriver::waitAvailableTimeout(uint16_t timeout)
 {
     unsigned long starttime = millis();
-    while ((millis() - starttime) < timeout)
+    unsigned long elapsed;
+    while ((elapsed = millis() - starttime) < timeout)
     {
+	uint32_t count = eventCount();
         if (available())
 	{
            return true;
 	}
-	YIELD;
+	waitEvent(count, timeout - elapsed);
     }
     return false;
 }
 
 bool RHGenericDriver::waitPacketSent()
 {
-    while (_mode == RHModeTx)
-	YIELD; // Wait for any previous transmit to finish
-    return true;
+    while (1)
+    {
+	uint32_t count = eventCount();
+	if (_mode != RHModeTx)
+	    return true; // Any previous transmit finished
+	waitEvent(count, RH_EVENT_POLL_INTERVAL);
+    }
 }
 
 bool RHGenericDriver::waitPacketSent(uint16_t timeout)
 {
     unsigned long starttime = millis();
-    while ((millis() - starttime) < timeout)
+    unsigned long elapsed;
+    while ((elapsed = millis() - starttime) < timeout)
     {
+	uint32_t count = eventCount();
         if (_mode != RHModeTx) // Any previous transmit finished?
            return true;
-	YIELD;
+	waitEvent(count, timeout - elapsed);
     }
     return false;
 }
 
+// Subclasses that use interrupts are expected to override
+void RHGenericDriver::handleInterrupt()
+{
+}
+
+bool RHGenericDriver::attachInterruptHandler(uint8_t interruptPin, int mode)
+{
+#ifdef RH_HAVE_PIN_INTERRUPTS
+    // Determine the interrupt number that corresponds to the interruptPin
+    int interruptNumber = digitalPinToInterrupt(interruptPin);
+    if (interruptNumber == NOT_AN_INTERRUPT)
+	return false;
+#ifdef RH_ATTACHINTERRUPT_TAKES_PIN_NUMBER
+    interruptNumber = interruptPin;
+#endif
+
+    // Find the slot for this pin, or allocate a new one
+    uint8_t slot;
+    for (slot = 0; slot < _interruptPinCount; slot++)
+	if (_interruptPins[slot] == interruptPin)
+	    break;
+    bool newPin = (slot == _interruptPinCount);
+    if (newPin && slot >= RH_MAX_INTERRUPT_PINS)
+	return false; // Too many pins, not enough interrupt vectors
+    if (!newPin && _interruptModes[slot] != mode)
+	return false; // Shared pins must all use the same mode
+
+    // Find our entry for this pin from a previous call, or a free one
+    uint8_t i;
+    uint8_t freeEntry = RH_MAX_INTERRUPT_DEVICES;
+    for (i = 0; i < RH_MAX_INTERRUPT_DEVICES; i++)
+    {
+	if (_interruptDevices[i] == this && _interruptDeviceSlots[i] == slot)
+	    break;
+	if (!_interruptDevices[i] && freeEntry == RH_MAX_INTERRUPT_DEVICES)
+	    freeEntry = i;
+    }
+    if (i == RH_MAX_INTERRUPT_DEVICES)
+    {
+	if (freeEntry == RH_MAX_INTERRUPT_DEVICES)
+	    return false; // Too many devices
+	i = freeEntry;
+    }
+
+    ATOMIC_BLOCK_START;
+    _interruptDeviceSlots[i] = slot;
+    _interruptDevices[i] = this;
+    ATOMIC_BLOCK_END;
+
+    if (newPin)
+    {
+	_interruptPins[slot] = interruptPin;
+	_interruptModes[slot] = mode;
+	_interruptPinCount++;
+	attachInterrupt(interruptNumber, _isrForSlot[slot], mode);
+    }
+    return true;
+#else
+    (void)interruptPin;
+    (void)mode;
+    return false;
+#endif
+}
+
+void RHGenericDriver::detachInterruptHandler()
+{
+#ifdef RH_HAVE_PIN_INTERRUPTS
+    for (uint8_t i = 0; i < RH_MAX_INTERRUPT_DEVICES; i++)
+    {
+	if (_interruptDevices[i] == this)
+	{
+	    ATOMIC_BLOCK_START;
+	    _interruptDevices[i] = NULL;
+	    ATOMIC_BLOCK_END;
+	}
+    }
+#endif
+}
+
+#ifdef RH_HAVE_PIN_INTERRUPTS
+// Called in interrupt context by the low level interrupt routine for a pin.
+// If the pin is shared by several radios, keep calling their handlers while the
+// line is still active, in case another radio interrupted while we were busy, 
+// since we would not get another edge for it
+void RHGenericDriver::dispatchInterrupt(uint8_t slot)
+{
+    uint8_t tries = RH_MAX_INTERRUPT_DEVICES;
+    bool shared;
+    do
+    {
+	uint8_t handlers = 0;
+	for (uint8_t i = 0; i < RH_MAX_INTERRUPT_DEVICES; i++)
+	{
+	    RHGenericDriver* device = _interruptDevices[i];
+	    if (device && _interruptDeviceSlots[i] == slot)
+	    {
+		device->handleInterrupt();
+		device->signalEvent();
+		handlers++;
+	    }
+	}
+	shared = handlers > 1;
+    } while (shared
+	     && --tries
+	     && _interruptModes[slot] != CHANGE
+	     && digitalRead(_interruptPins[slot]) == (_interruptModes[slot] == RISING ? HIGH : LOW));
+}
+#endif
+
+#ifdef RH_HAVE_EVENT_WAIT
+void RHGenericDriver::signalEvent()
+{
+    pthread_mutex_lock(&_eventLock);
+    _eventCount++;
+    pthread_cond_broadcast(&_eventCond);
+    pthread_mutex_unlock(&_eventLock);
+}
+
+uint32_t RHGenericDriver::eventCount()
+{
+    pthread_mutex_lock(&_eventLock);
+    uint32_t count = _eventCount;
+    pthread_mutex_unlock(&_eventLock);
+    return count;
+}
+
+void RHGenericDriver::waitEvent(uint32_t count, unsigned long timeout)
+{
+    if (timeout > RH_EVENT_POLL_INTERVAL)
+	timeout = RH_EVENT_POLL_INTERVAL;
+
+    struct timespec deadline;
+    clock_gettime(RH_EVENT_CLOCK, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+	deadline.tv_sec++;
+	deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&_eventLock);
+    while (_eventCount == count)
+	if (pthread_cond_timedwait(&_eventCond, &_eventLock, &deadline) == ETIMEDOUT)
+	    break;
+    pthread_mutex_unlock(&_eventLock);
+}
+#else
+uint32_t RHGenericDriver::eventCount()
+{
+    return 0;
+}
+
+void RHGenericDriver::waitEvent(uint32_t /*count*/, unsigned long timeout)
+{
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) || (RH_PLATFORM == RH_PLATFORM_UNIX)
+    // Nothing to wake us up, but at least dont spin
+    delay(timeout < RH_EVENT_POLL_INTERVAL ? timeout : RH_EVENT_POLL_INTERVAL);
+#else
+    (void)timeout;
+    YIELD;
+#endif
+}
+#endif
+
 // Wait until no channel activity detected or timeout
 bool RHGenericDriver::waitCAD()
+{
+    CsmaStatus status;
+    while ((status = csmaPoll()) == CsmaWait)
+    {
+	// Sleep for the rest of the backoff where the platform can
+	uint32_t count = eventCount();
+	int32_t left = _csmaBackoffEnd - (uint32_t)micros();
+	waitEvent(count, left > 1000 ? left / 1000 : 0);
+    }
+    // Used up the grant
+    _csmaState = CsmaIdle;
+    return status == CsmaClear;
+}
+
+// CSMA/CA as in the IEEE 802.11 DCF, but sensing the channel only at the end of each backoff
+RHGenericDriver::CsmaStatus RHGenericDriver::csmaPoll()
 {
     if (!_cad_timeout)
-	return true;
+	return CsmaClear;
 
-    // Wait for any channel activity to finish or timeout
-    // Sophisticated DCF function...
-    // DCF : BackoffTime = random() x aSlotTime
-    // 100 - 1000 ms
-    // 10 sec timeout
-    unsigned long t = millis();
-    while (isChannelActive())
+    uint32_t now = micros();
+    if (_csmaState == CsmaGranted)
+    {
+	// Still good if we have not waited more than a slot since we looked
+	if (now - _csmaBackoffEnd <= slotTime())
+	    return CsmaClear;
+	_csmaState = CsmaIdle;
+    }
+    if (_csmaState == CsmaRetry)
     {
-         if (millis() - t > _cad_timeout) 
-	     return false;
-         delay(random(1, 10) * 100); // Should these values be configurable? Macros?
+	// Backing off after a failure. If there was no retry, this may be long over, and micros() may
+	// have wrapped since, so also give up on it after the longest possible backoff
+	if (   (int32_t)(now - _csmaBackoffEnd) < 0
+	    && millis() - _csmaStart <= ((uint32_t)_cwMax + 1) * (slotTime() / 1000 + 1))
+	    return CsmaWait;
+	_csmaState = CsmaIdle;
     }
+    if (_csmaState == CsmaIdle)
+	_csmaStart = millis(); // New access attempt
+    else if ((int32_t)(now - _csmaBackoffEnd) < 0)
+	return CsmaWait; // Still backing off
 
-    return true;
+    if (isChannelActive())
+    {
+	if (millis() - _csmaStart > _cad_timeout)
+	{
+	    _csmaState = CsmaIdle;
+	    return CsmaTimeout;
+	}
+	// Busy. Back off for longer next time
+	_cw = (_cw < _cwMax / 2) ? (2 * _cw + 1) : _cwMax;
+	csmaBackoff();
+	return CsmaWait;
+    }
+
+    // Clear. Go now
+    _cw = (_cw / 2 > _cwMin) ? (_cw / 2) : _cwMin;
+    _csmaState = CsmaGranted;
+    _csmaBackoffEnd = (uint32_t)micros();
+    return CsmaClear;
 }
 
-// subclasses are expected to override if CAD is available for that radio
+void RHGenericDriver::csmaBackoff()
+{
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) // use standard library random(), bugs in random(min, max)
+    uint32_t slots = random() % (_cw + 1);
+#else
+    uint32_t slots = random(0, _cw + 1);
+#endif
+    _csmaState = CsmaBackoff;
+    _csmaBackoffEnd = (uint32_t)micros() + slots * slotTime();
+}
+
+void RHGenericDriver::csmaResult(bool success)
+{
+    if (!_cad_timeout)
+	return;
+    if (success)
+	_cw = _cwMin;
+    else
+    {
+	// Probably a collision. Make the retry back off first. Its access attempt, and so its CAD timeout,
+	// only begins at the end of the backoff
+	_cw = (_cw < _cwMax / 2) ? (2 * _cw + 1) : _cwMax;
+	csmaBackoff();
+	_csmaState = CsmaRetry;
+	_csmaStart = millis();
+    }
+}
+
+void RHGenericDriver::setContentionWindow(uint16_t cwMin, uint16_t cwMax)
+{
+    _cwMin = cwMin;
+    _cwMax = cwMax < cwMin ? cwMin : cwMax;
+    _cw = _cwMin;
+}
+
+uint32_t RHGenericDriver::slotTime()
+{
+    return RH_CSMA_DEFAULT_SLOT_TIME;
+}
+
+// subclasses are expected to override if CAD is available for that radio, or to provide
+// readChannelRssi() for RSSI clear channel assessment
 bool RHGenericDriver::isChannelActive()
 {
+    int8_t rssi;
+    if (!readChannelRssi(&rssi))
+	return false;
+
+    if (!_noiseFloorValid)
+    {
+	// Quietest of several samples, in case someone is transmitting now
+	uint8_t i;
+	for (i = 1; i < RH_CCA_CALIBRATION_SAMPLES; i++)
+	{
+	    int8_t sample;
+	    if (readChannelRssi(&sample) && sample < rssi)
+		rssi = sample;
+	}
+	_noiseFloor = rssi * 16;
+	_noiseFloorValid = true;
+    }
+
+    int16_t threshold = _ccaThreshold ? _ccaThreshold : (_noiseFloor / 16 + _ccaMargin);
+    if (rssi > threshold)
+	return true;
+
+    // Clear. Follow the noise floor down quickly, and up slowly, so that other transmitters
+    // do not drag it up
+    if (rssi * 16 < _noiseFloor)
+	_noiseFloor = (_noiseFloor + rssi * 16) / 2;
+    else
+	_noiseFloor += (rssi * 16 - _noiseFloor) / 16;
+    return false;
+}
+
+bool RHGenericDriver::readChannelRssi(int8_t* rssi)
+{
+    (void)rssi;
     return false;
 }
 
+void RHGenericDriver::setCCAThreshold(int8_t threshold, uint8_t margin)
+{
+    _ccaThreshold = threshold;
+    _ccaMargin = margin;
+}
+
+int8_t RHGenericDriver::noiseFloor()
+{
+    return _noiseFloorValid ? _noiseFloor / 16 : 0;
+}
+
+void RHGenericDriver::waitMicros(uint32_t us)
+{
+    uint32_t start = micros();
+    while ((uint32_t)micros() - start < us)
+	YIELD;
+}
+
 void RHGenericDriver::setPromiscuous(bool promiscuous)
 {
     _promiscuous = promiscuous;
@@ -152,6 +579,35 @@ int8_t RHGenericDriver::lastRssi()
     return _lastRssi;
 }
 
+bool RHGenericDriver::recv(uint8_t* buf, uint8_t* len, RxMetadata* metadata)
+{
+    if (!available())
+	return false;
+    // The message stays in the driver until recv() collects it, so its details are still there too
+    if (metadata)
+	rxMetadata(metadata);
+    return recv(buf, len);
+}
+
+void RHGenericDriver::rxMetadata(RxMetadata* metadata)
+{
+    memset(metadata, 0, sizeof(*metadata));
+    metadata->rssi = _lastRssi;
+    metadata->timestamp = _rxTime;
+    if (metadata->timestamp)
+	metadata->valid |= RH_RX_METADATA_TIMESTAMP;
+}
+
+uint32_t RHGenericDriver::lastRxTime()
+{
+    return _rxTime;
+}
+
+uint32_t RHGenericDriver::lastTxTime()
+{
+    return _txTime;
+}
+
 RHGenericDriver::RHMode  RHGenericDriver::mode()
 {
     return _mode;
@@ -159,14 +615,310 @@ RHGenericDriver::RHMode  RHGenericDriver::mode()
 
 void  RHGenericDriver::setMode(RHMode mode)
 {
+#if RH_ENABLE_ENERGY_ACCOUNTING || (RH_DUTY_CYCLE_MAX_BANDS > 0)
+    ATOMIC_BLOCK_START;
+#endif
+#if RH_ENABLE_ENERGY_ACCOUNTING
+    accountModeTime();
+#endif
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    if (mode == RHModeTx && _mode != RHModeTx)
+    {
+	// Transmitter turned on
+	_txStartTime = millis();
+	_txFrequency = _frequency;
+    }
+    else if (mode != RHModeTx && _mode == RHModeTx)
+    {
+	// Transmitter turned off. Round up, so short packets are not under-counted
+	DutyCycleBand* band = dutyCycleBand(_txFrequency);
+	if (band)
+	{
+	    dutyCycleUsed(band); // Move on to the current slot
+	    band->used[band->slot] += millis() - _txStartTime + 1;
+	}
+    }
+#endif
     _mode = mode;
+#if RH_ENABLE_ENERGY_ACCOUNTING || (RH_DUTY_CYCLE_MAX_BANDS > 0)
+    ATOMIC_BLOCK_END;
+#endif
+}
+
+#if RH_ENABLE_ENERGY_ACCOUNTING
+void RHGenericDriver::accountModeTime()
+{
+    unsigned long nowMicros = micros();
+    unsigned long nowMillis = millis();
+    uint32_t elapsedMillis = nowMillis - _modeStartMillis;
+    if (elapsedMillis > 3600000)
+    {
+	// micros() wraps after about 71 minutes, so long periods are accounted in ms
+	_modeTime[_mode] += elapsedMillis;
+    }
+    else
+    {
+	uint32_t elapsed = (uint32_t)(nowMicros - _modeStartMicros) + _modeTimeMicros[_mode];
+	_modeTime[_mode] += elapsed / 1000;
+	_modeTimeMicros[_mode] = elapsed % 1000;
+    }
+    _modeStartMicros = nowMicros;
+    _modeStartMillis = nowMillis;
+}
+
+uint32_t RHGenericDriver::modeTime(RHMode mode)
+{
+    if (mode >= RH_NUM_MODES)
+	return 0;
+    ATOMIC_BLOCK_START;
+    accountModeTime();
+    ATOMIC_BLOCK_END;
+    return _modeTime[mode];
+}
+
+void RHGenericDriver::setModeCurrent(RHMode mode, float current)
+{
+    if (mode < RH_NUM_MODES)
+	_modeCurrent[mode] = current;
+}
+
+float RHGenericDriver::modeCurrent(RHMode mode)
+{
+    return mode < RH_NUM_MODES ? _modeCurrent[mode] : 0.0;
+}
+
+float RHGenericDriver::chargeUsed()
+{
+    ATOMIC_BLOCK_START;
+    accountModeTime();
+    ATOMIC_BLOCK_END;
+    float charge = 0.0;
+    uint8_t i;
+    for (i = 0; i < RH_NUM_MODES; i++)
+	charge += _modeCurrent[i] * _modeTime[i];
+    return charge / 3600000.0; // mA ms to mAh
 }
 
+void RHGenericDriver::clearModeTimes()
+{
+    ATOMIC_BLOCK_START;
+    memset(_modeTime, 0, sizeof(_modeTime));
+    memset(_modeTimeMicros, 0, sizeof(_modeTimeMicros));
+    _modeStartMicros = micros();
+    _modeStartMillis = millis();
+    ATOMIC_BLOCK_END;
+}
+#else
+uint32_t RHGenericDriver::modeTime(RHMode mode)
+{
+    (void)mode;
+    return 0;
+}
+
+void RHGenericDriver::setModeCurrent(RHMode mode, float current)
+{
+    (void)mode;
+    (void)current;
+}
+
+float RHGenericDriver::modeCurrent(RHMode mode)
+{
+    (void)mode;
+    return 0.0;
+}
+
+float RHGenericDriver::chargeUsed()
+{
+    return 0.0;
+}
+
+void RHGenericDriver::clearModeTimes()
+{
+}
+#endif
+
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+bool RHGenericDriver::setDutyCycle(float minFrequency, float maxFrequency, float percent, uint32_t window)
+{
+    if (percent < 100.0 && _frequency == 0.0)
+	return false; // Cannot be enforced: the driver does not know its frequency
+
+    DutyCycleBand* band = NULL;
+    uint8_t i;
+    for (i = 0; i < RH_DUTY_CYCLE_MAX_BANDS; i++)
+    {
+	if (   _dutyCycleBands[i].maxFrequency != 0.0
+	    && _dutyCycleBands[i].minFrequency == minFrequency 
+	    && _dutyCycleBands[i].maxFrequency == maxFrequency)
+	{
+	    band = &_dutyCycleBands[i]; // Change the existing limit
+	    break;
+	}
+	if (!band && _dutyCycleBands[i].maxFrequency == 0.0)
+	    band = &_dutyCycleBands[i]; // First free entry
+    }
+    if (!band)
+	return percent >= 100.0; // No room, but OK if removing the limit
+
+    ATOMIC_BLOCK_START;
+    memset(band, 0, sizeof(*band));
+    if (percent < 100.0)
+    {
+	band->minFrequency = minFrequency;
+	band->maxFrequency = maxFrequency;
+	band->budget = window * (percent / 100.0);
+	// Slots are only forgotten when all of the slot is more than one window old
+	band->slotLength = window / (RH_DUTY_CYCLE_SLOTS - 1);
+	if (!band->slotLength)
+	    band->slotLength = 1;
+	band->slotStart = millis();
+    }
+    ATOMIC_BLOCK_END;
+    return true;
+}
+
+void RHGenericDriver::setDutyCycleMaxDefer(uint32_t maxDefer)
+{
+    _dutyCycleMaxDefer = maxDefer;
+}
+
+uint32_t RHGenericDriver::dutyCycleRemaining()
+{
+    uint32_t remaining = 0xffffffff;
+    ATOMIC_BLOCK_START;
+    DutyCycleBand* band = dutyCycleBand(_frequency);
+    if (band)
+    {
+	uint32_t used = dutyCycleUsed(band);
+	remaining = used < band->budget ? band->budget - used : 0;
+    }
+    ATOMIC_BLOCK_END;
+    return remaining;
+}
+
+bool RHGenericDriver::waitDutyCycle(uint8_t len)
+{
+    DutyCycleBand* band = dutyCycleBand(_frequency);
+    if (!band)
+	return true; // No limit
+    uint32_t needed = (timeOnAir(len) + 999) / 1000;
+    if (needed > band->budget)
+	return false; // Will never fit
+
+    unsigned long start = millis();
+    uint32_t remaining;
+    while ((remaining = dutyCycleRemaining()) == 0 || remaining < needed)
+    {
+	if (millis() - start >= _dutyCycleMaxDefer)
+	    return false;
+	waitEvent(eventCount(), RH_EVENT_POLL_INTERVAL);
+    }
+    return true;
+}
+
+RHGenericDriver::DutyCycleBand* RHGenericDriver::dutyCycleBand(float frequency)
+{
+    uint8_t i;
+    for (i = 0; i < RH_DUTY_CYCLE_MAX_BANDS; i++)
+	if (   _dutyCycleBands[i].maxFrequency != 0.0
+	    && frequency >= _dutyCycleBands[i].minFrequency
+	    && frequency <= _dutyCycleBands[i].maxFrequency)
+	    return &_dutyCycleBands[i];
+    return NULL;
+}
+
+uint32_t RHGenericDriver::dutyCycleUsed(DutyCycleBand* band)
+{
+    unsigned long now = millis();
+    if (now - band->slotStart >= band->slotLength * RH_DUTY_CYCLE_SLOTS)
+    {
+	// Nothing sent for a whole window
+	memset(band->used, 0, sizeof(band->used));
+	band->slotStart = now;
+    }
+    while (now - band->slotStart >= band->slotLength)
+    {
+	band->slot = (band->slot + 1) % RH_DUTY_CYCLE_SLOTS;
+	band->used[band->slot] = 0;
+	band->slotStart += band->slotLength;
+    }
+    uint32_t used = 0;
+    uint8_t i;
+    for (i = 0; i < RH_DUTY_CYCLE_SLOTS; i++)
+	used += band->used[i];
+    return used;
+}
+#else
+bool RHGenericDriver::setDutyCycle(float minFrequency, float maxFrequency, float percent, uint32_t window)
+{
+    (void)minFrequency;
+    (void)maxFrequency;
+    (void)window;
+    return percent >= 100.0; // No room, but OK if removing the limit
+}
+
+void RHGenericDriver::setDutyCycleMaxDefer(uint32_t maxDefer)
+{
+    (void)maxDefer;
+}
+
+uint32_t RHGenericDriver::dutyCycleRemaining()
+{
+    return 0xffffffff;
+}
+
+bool RHGenericDriver::waitDutyCycle(uint8_t len)
+{
+    (void)len;
+    return true;
+}
+#endif
+
 bool  RHGenericDriver::sleep()
 {
     return false;
 }
 
+bool RHGenericDriver::setLowPowerListening(uint16_t interval)
+{
+    return interval == 0;
+}
+
+bool RHGenericDriver::setWakeupPreamble(uint16_t duration)
+{
+    return duration == 0;
+}
+
+bool RHGenericDriver::setChannels(float base, float spacing)
+{
+    _channelBase = base;
+    _channelSpacing = spacing;
+    return true;
+}
+
+bool RHGenericDriver::setChannel(uint8_t channel)
+{
+    (void)channel;
+    return false;
+}
+
+bool RHGenericDriver::setModemConfigIndex(uint8_t index)
+{
+    (void)index;
+    return false;
+}
+
+bool RHGenericDriver::hardwareAcknowledgement()
+{
+    return false;
+}
+
+uint32_t RHGenericDriver::timeOnAir(uint8_t len)
+{
+    (void)len; // Not used
+    return 0;
+}
+
 // Diagnostic help
 void RHGenericDriver::printBuffer(const char* prompt, const uint8_t* buf, uint8_t len)
 {
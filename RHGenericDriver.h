@@ -14,9 +14,123 @@
 #define RH_FLAGS_APPLICATION_SPECIFIC     0x0f
 #define RH_FLAGS_NONE                     0
 
+// Manager control messages (TDMA beacons, time sync, hop sync and gateway steer messages) are sent with
+// the RH_FLAGS_CONTROL bit set in the FLAGS header. The first octet of the payload is the type of
+// control message, so managers can tell their own from the others and ignore the rest
+#define RH_FLAGS_CONTROL                  0x40
+#define RH_CONTROL_TDMA_BEACON            1
+#define RH_CONTROL_TIMESYNC               2
+#define RH_CONTROL_HOP_SYNC               3
+#define RH_CONTROL_GATEWAY_STEER          4
+
 // Default timeout for waitCAD() in ms
 #define RH_CAD_DEFAULT_TIMEOUT            10000
 
+// Default CSMA/CA contention window limits, in slots. The backoff before sensing the channel again
+// is a random number of slots between 0 and the contention window, which starts at RH_CSMA_CW_MIN,
+// and doubles (plus one) each time the channel is busy or a message is not acknowledged
+#ifndef RH_CSMA_CW_MIN
+ #define RH_CSMA_CW_MIN                   7
+#endif
+#ifndef RH_CSMA_CW_MAX
+ #define RH_CSMA_CW_MAX                   127
+#endif
+
+// Default CSMA/CA slot time in microseconds, for drivers that do not know better
+#define RH_CSMA_DEFAULT_SLOT_TIME         1000
+
+// Bit times an FSK receiver needs after RH_CCA_SETTLE_TIME to measure RSSI and turn around to transmit.
+// FSK drivers add this many bits at their current bit rate to RH_CCA_SETTLE_TIME for their slot time
+#define RH_CSMA_SLOT_BITS                 16
+
+// Default RSSI clear channel assessment margin above the noise floor in dB
+#define RH_CCA_DEFAULT_MARGIN             10
+
+// Number of RSSI samples taken to find the initial noise floor
+#define RH_CCA_CALIBRATION_SAMPLES        8
+
+// Time in microseconds for the receiver to start and measure RSSI before a clear channel assessment.
+// You may need more at very low bit rates
+#ifndef RH_CCA_SETTLE_TIME
+ #define RH_CCA_SETTLE_TIME               1000
+#endif
+
+// With Linux interrupts, the blocking wait functions sleep on a per-driver condition variable
+// that is signalled by the interrupt handlers (on the IRQ thread), instead of spinning on available()
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) && defined(RH_LINUX_IRQ)
+ #define RH_HAVE_EVENT_WAIT
+ #include <pthread.h>
+#endif
+
+// Platforms where drivers can connect to pin interrupts with attachInterrupt()
+#if (RH_PLATFORM != RH_PLATFORM_UNIX) && ((RH_PLATFORM != RH_PLATFORM_RASPI) || defined(RH_LINUX_IRQ))
+ #define RH_HAVE_PIN_INTERRUPTS
+#endif
+
+// Maximum number of driver instances (of any type) that can be connected to interrupts at the same time
+#ifndef RH_MAX_INTERRUPT_DEVICES
+ #define RH_MAX_INTERRUPT_DEVICES          8
+#endif
+
+// Maximum number of different interrupt pins that can be used. Several driver instances can 
+// share one interrupt pin. Each pin needs a low level interrupt routine, and there are at most 16 of them
+#ifndef RH_MAX_INTERRUPT_PINS
+ #define RH_MAX_INTERRUPT_PINS             RH_MAX_INTERRUPT_DEVICES
+#endif
+#if RH_MAX_INTERRUPT_PINS > 16
+ #error RH_MAX_INTERRUPT_PINS must be 16 or less
+#endif
+
+// Longest time in ms that the blocking wait functions sleep between checks of the
+// driver state when there is no event from the interrupt handler. Drivers without interrupts
+// (eg IRQLESS builds) rely on this to poll.
+#ifndef RH_EVENT_POLL_INTERVAL
+ #define RH_EVENT_POLL_INTERVAL            1
+#endif
+
+// Maximum number of frequency bands that can have a duty cycle limit, see RHGenericDriver::setDutyCycle().
+// Define as 0 to leave out duty cycle limits and their transmit time accounting altogether
+#ifndef RH_DUTY_CYCLE_MAX_BANDS
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_DUTY_CYCLE_MAX_BANDS          1
+ #else
+  #define RH_DUTY_CYCLE_MAX_BANDS          4
+ #endif
+#endif
+
+// Number of slots used to account transmit time in each duty cycle band. Transmit time is accounted to
+// the current slot, and a slot is forgotten when all of it is more than one window old, so the window slides
+// in steps of window / (RH_DUTY_CYCLE_SLOTS - 1). Must be at least 2
+#ifndef RH_DUTY_CYCLE_SLOTS
+ #define RH_DUTY_CYCLE_SLOTS               6
+#endif
+#if RH_DUTY_CYCLE_SLOTS < 2
+ #error RH_DUTY_CYCLE_SLOTS must be at least 2
+#endif
+
+// Number of RHGenericDriver::RHMode operating modes, for the time and current in each mode
+#define RH_NUM_MODES                       6
+
+// Whether RHGenericDriver accounts the time spent in each mode, for modeTime() and chargeUsed().
+// Costs about 70 octets of RAM per driver, so it is off by default on AVR. Define as 0 to leave it out,
+// or as 1 to have it on AVR
+#ifndef RH_ENABLE_ENERGY_ACCOUNTING
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_ENABLE_ENERGY_ACCOUNTING      0
+ #else
+  #define RH_ENABLE_ENERGY_ACCOUNTING      1
+ #endif
+#endif
+
+// Default duty cycle window in ms (1 hour, as used by ETSI EN 300 220)
+#define RH_DUTY_CYCLE_DEFAULT_WINDOW      3600000UL
+
+// Bits in RHGenericDriver::RxMetadata::valid, saying which fields the driver was able to fill in.
+// rssi is always filled in
+#define RH_RX_METADATA_SNR                0x01
+#define RH_RX_METADATA_TIMESTAMP          0x02
+#define RH_RX_METADATA_FREQUENCY_ERROR    0x04
+
 /////////////////////////////////////////////////////////////////////
 /// \class RHGenericDriver RHGenericDriver.h <RHGenericDriver.h>
 /// \brief Abstract base class for a RadioHead driver.
@@ -38,6 +152,27 @@
 /// -ID A message ID, distinct (over short time scales) for each message sent by a particilar node
 /// -FLAGS A bitmask of flags. The most significant 4 bits are reserved for use by RadioHead. The least
 /// significant 4 bits are reserved for applications.
+///
+/// \par Interrupts
+///
+/// Drivers that are interrupt driven call attachInterruptHandler() from their init() to have their 
+/// handleInterrupt() called when their interrupt pin signals. Up to RH_MAX_INTERRUPT_DEVICES driver instances, 
+/// of any types, and up to RH_MAX_INTERRUPT_PINS different interrupt pins are supported. Both can be increased
+/// at compile time. Several radios can share one interrupt pin, provided their interrupt outputs are
+/// wired so the line is active when any of them is interrupting: when the pin interrupts, 
+/// handleInterrupt() is called for each driver on that pin, and each driver checks its own radio's status 
+/// registers to see if it has anything to do. While the shared line remains active, the handlers are called again.
+///
+/// \par Blocking waits
+///
+/// waitAvailable(), waitAvailableTimeout() and waitPacketSent() loop until the driver state changes.
+/// On most platforms they spin, calling YIELD. On RH_PLATFORM_RASPI built with RH_LINUX_IRQ they
+/// instead sleep on a condition variable belonging to the driver, which is signalled through signalEvent()
+/// when the IRQ thread calls the driver's interrupt handler, and at most every
+/// RH_EVENT_POLL_INTERVAL milliseconds. On RH_PLATFORM_UNIX, and on RH_PLATFORM_RASPI without
+/// RH_LINUX_IRQ, nothing can wake a waiting thread, so they sleep-poll: they sleep for
+/// RH_EVENT_POLL_INTERVAL milliseconds between checks. This allows many drivers to run 
+/// in one process or on one host without using a CPU core each.
 class RHGenericDriver
 {
 public:
@@ -55,6 +190,28 @@ public:
 	RHModeCad               ///< Transport is in the process of detecting channel activity (if supported)
     } RHMode;
 
+    /// \brief Result of csmaPoll()
+    typedef enum
+    {
+	CsmaClear = 0,          ///< The channel is clear, send now
+	CsmaWait,               ///< Backing off or the channel is busy, call csmaPoll() again later
+	CsmaTimeout             ///< The channel has not been clear for the CAD timeout, give up
+    } CsmaStatus;
+
+    /// \brief Reception details of a single received message
+    ///
+    /// Filled in by recv(buf, len, metadata) for the message it returns. Drivers capture these when
+    /// the message is received, so they belong to that message even if more messages have been received
+    /// (and perhaps queued) since. Fields the driver cannot measure are 0, and their bit in valid is clear.
+    typedef struct
+    {
+	int8_t          rssi;           ///< RSSI of the message in dBm (in some transport specific units on some drivers, see lastRssi())
+	int8_t          snr;            ///< Signal to noise ratio of the message in dB, if RH_RX_METADATA_SNR
+	uint8_t         valid;          ///< Which of the other fields are valid: RH_RX_METADATA_* bits
+	uint32_t        timestamp;      ///< micros() when the end of the message was received, if RH_RX_METADATA_TIMESTAMP
+	int32_t         frequencyError; ///< Frequency error of the message in Hz, as estimated by the receiver, if RH_RX_METADATA_FREQUENCY_ERROR
+    } RxMetadata;
+
     /// Constructor
     RHGenericDriver();
 
@@ -83,6 +240,16 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool recv(uint8_t* buf, uint8_t* len) = 0;
 
+    /// As recv(buf, len), but also returns the reception details of the message copied to buf.
+    /// The details are captured by the driver when the message is received, so unlike lastRssi() they
+    /// are correct for this message even when the driver has received or queued others since.
+    /// Drivers that hide this overload by declaring their own recv() bring it back with a using declaration.
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Pointer to available space in buf. Set to the actual number of octets copied.
+    /// \param[out] metadata If not NULL, and a message is copied, set to the reception details of the message
+    /// \return true if a valid message was copied to buf
+    bool recv(uint8_t* buf, uint8_t* len, RxMetadata* metadata);
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then optionally waits for Channel Activity Detection (CAD) 
     /// to show the channnel is clear (if the radio supports CAD) by calling waitCAD().
@@ -101,6 +268,15 @@ public:
     /// \return The maximum legal message length
     virtual uint8_t maxMessageLength() = 0;
 
+    /// Returns how long a message of the given length would occupy the channel when sent with send(),
+    /// including the preamble, sync words, RadioHead headers, CRC and any other framing added by the driver,
+    /// with the current radio configuration. Managers use this to size acknowledgement timeouts and to
+    /// schedule transmissions.
+    /// The default implementation returns 0, meaning unknown. Drivers that know their bit rate override this.
+    /// \param[in] len Length of the message data in octets, as would be passed to send()
+    /// \return Time on air in microseconds, or 0 if not known
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// Starts the receiver and blocks until a valid received 
     /// message is available.
     virtual void            waitAvailable();
@@ -122,15 +298,15 @@ public:
 
     // Bent G Christensen (bentor@gmail.com), 08/15/2016
     /// Channel Activity Detection (CAD).
-    /// Blocks until channel activity is finished or CAD timeout occurs.
+    /// Blocks until csmaPoll() says the channel is clear, or the CAD timeout occurs.
     /// Uses the radio's CAD function (if supported) to detect channel activity.
-    /// Implements random delays of 100 to 1000ms while activity is detected and until timeout.
     /// Caution: the random() function is not seeded. If you want non-deterministic behaviour, consider
     /// using something like randomSeed(analogRead(A0)); in your sketch.
     /// Permits the implementation of listen-before-talk mechanism (Collision Avoidance).
     /// Calls the isChannelActive() member function for the radio (if supported) 
     /// to determine if the channel is active. If the radio does not support isChannelActive(),
-    /// always returns true immediately
+    /// always returns true immediately.
+    /// If csmaPoll() has just returned CsmaClear, returns true without sensing the channel again.
     /// \return true if the radio-specific CAD (as returned by isChannelActive())
     /// shows the channel is clear within the timeout period (or the timeout period is 0), else returns false.
     virtual bool            waitCAD();
@@ -140,15 +316,70 @@ public:
     /// CAD detection depends on support for isChannelActive() by your particular radio.
     void setCADTimeout(unsigned long cad_timeout);
 
+    /// Non-blocking CSMA/CA (Carrier Sense Multiple Access with Collision Avoidance) channel access.
+    /// The first call senses the channel with isChannelActive(). If the channel is busy, the contention 
+    /// window grows and the driver backs off for a random number of slots (see slotTime()) before
+    /// sensing it again. Calls during the backoff return CsmaWait straight away without touching the radio, 
+    /// so the caller can keep receiving with available() and recv() while it waits.
+    /// When the channel is found clear, the contention window halves (down to its minimum) and the next
+    /// send() (via waitCAD()) goes ahead without sensing the channel again.
+    /// \code
+    /// RHGenericDriver::CsmaStatus status;
+    /// while ((status = driver.csmaPoll()) == RHGenericDriver::CsmaWait)
+    ///     if (driver.available())
+    ///         driver.recv(buf, &len); // Handle incoming messages meanwhile
+    /// if (status == RHGenericDriver::CsmaClear)
+    ///     driver.send(data, sizeof(data));
+    /// \endcode
+    /// Does nothing and returns CsmaClear if the CAD timeout (see setCADTimeout()) is 0.
+    /// \return CsmaClear if the channel is clear, CsmaWait if the caller should call again later, or 
+    /// CsmaTimeout if the channel has not been clear for the CAD timeout since this access attempt began
+    CsmaStatus              csmaPoll();
+
+    /// Tells CSMA/CA how the last transmission went, so it can adjust the contention window.
+    /// RHReliableDatagram calls this when an acknowledgement arrives or times out.
+    /// On success the contention window goes back to its minimum. On failure (eg no acknowledgement, 
+    /// which suggests a collision) it grows, and the next access attempt starts with a backoff. The CAD
+    /// timeout of that attempt counts from the end of the backoff, however long after it begins.
+    /// \param[in] success true if the message was delivered
+    void                    csmaResult(bool success);
+
+    /// Sets the limits of the CSMA/CA contention window, in slots. The window starts at cwMin.
+    /// Values of the form 2^n - 1 are usual.
+    /// \param[in] cwMin Minimum contention window. Defaults to RH_CSMA_CW_MIN
+    /// \param[in] cwMax Maximum contention window. Defaults to RH_CSMA_CW_MAX
+    void                    setContentionWindow(uint16_t cwMin, uint16_t cwMax);
+
+    /// Returns the CSMA/CA slot time: how long it takes this radio to sense the channel and turn around
+    /// to transmit with the current configuration. Backoffs are whole numbers of slots.
+    /// The default returns RH_CSMA_DEFAULT_SLOT_TIME. Drivers with channel sensing override this.
+    /// \return The slot time in microseconds
+    virtual uint32_t        slotTime();
+
     /// Determine if the currently selected radio channel is active.
     /// This is expected to be subclassed by specific radios to implement their Channel Activity Detection
     /// if supported. If the radio does not support CAD, returns true immediately. If a RadioHead radio 
     /// supports isChannelActive() it will be documented in the radio specific documentation.
     /// This is called automatically by waitCAD().
+    /// The default does an RSSI clear channel assessment if the driver can measure the channel RSSI 
+    /// (see readChannelRssi()): the channel is active if the RSSI is above the threshold set by setCCAThreshold(),
+    /// or by default above the noise floor plus a margin. The noise floor is found from the first 
+    /// RH_CCA_CALIBRATION_SAMPLES measurements, and then tracks the RSSI each time the channel is clear.
     /// \return true if the radio-specific CAD (as returned by override of isChannelActive()) shows the
     /// current radio channel as active, else false. If there is no radio-specific CAD, returns false.
     virtual bool            isChannelActive();
 
+    /// Sets the RSSI threshold for clear channel assessment by isChannelActive(), for drivers that use 
+    /// RSSI (see readChannelRssi()).
+    /// \param[in] threshold RSSI in dBm above which the channel is considered active. If 0 (the default)
+    /// the threshold follows the measured noise floor plus margin.
+    /// \param[in] margin When threshold is 0, how far above the noise floor the threshold is, in dB
+    void                    setCCAThreshold(int8_t threshold, uint8_t margin = RH_CCA_DEFAULT_MARGIN);
+
+    /// Returns the noise floor measured by the RSSI clear channel assessment in isChannelActive().
+    /// \return The noise floor in dBm, or 0 if it has not been measured yet
+    int8_t                  noiseFloor();
+
     /// Sets the address of this node. Defaults to 0xFF. Subclasses or the user may want to change this.
     /// This will be used to test the adddress in incoming messages. In non-promiscuous mode,
     /// only messages with a TO header the same as thisAddress or the broadcast addess (0xFF) will be accepted.
@@ -208,11 +439,28 @@ public:
     /// \return The most recent RSSI measurement in dBm.
     int8_t        lastRssi();
 
+    /// Returns the time at which the radio finished receiving the most recent message, as latched by the
+    /// driver interrupt handler when the radio signalled it (eg RX_DONE, PAYLOADREADY). Drivers that poll the radio
+    /// (such as RH_NRF24) latch it when they notice. The message may not have been collected by recv() yet.
+    /// Drivers that do not latch it (or are built without interrupts, such as RH_RF95_IRQLESS) return 0.
+    /// \return micros() when the last message was received, or 0 if not known
+    uint32_t      lastRxTime();
+
+    /// Returns the time at which the radio finished transmitting the most recent message, as latched by the
+    /// driver interrupt handler when the radio signalled it (eg TX_DONE, PACKETSENT). Drivers that poll the radio
+    /// (such as RH_NRF24) latch it when waitPacketSent() notices.
+    /// Drivers that do not latch it (or are built without interrupts) return 0.
+    /// \return micros() when the last message was sent, or 0 if not known
+    uint32_t      lastTxTime();
+
     /// Returns the operating mode of the library.
     /// \return the current mode, one of RF69_MODE_*
     RHMode          mode();
 
     /// Sets the operating mode of the transport.
+    /// Drivers call this whenever the radio changes mode. It also accounts the time in each mode (see modeTime())
+    /// and the transmit time for duty cycle limits (see setDutyCycle()), unless they are left out by
+    /// RH_ENABLE_ENERGY_ACCOUNTING or RH_DUTY_CYCLE_MAX_BANDS.
     void            setMode(RHMode mode);
 
     /// Sets the transport hardware into low-power sleep mode
@@ -223,6 +471,56 @@ public:
     ///         was successfully entered. If sleep mode is not suported, return false.
     virtual bool    sleep();
 
+    /// Enables or disables low power listening (wake on radio), if supported by the radio and driver.
+    /// While in receive mode, the radio then sleeps, waking every interval to sample the channel
+    /// for a preamble. It only stays awake (and only interrupts) when it finds one, so
+    /// the receive current is a small fraction of continuous receive. Senders must use a preamble at least
+    /// as long as the interval, plus a few ms, so the receiver wakes during it: see setWakeupPreamble().
+    /// Call it after configuring the modem. The default implementation only supports disabling it.
+    /// \param[in] interval Time between channel samples in milliseconds, or 0 to receive continuously
+    /// \return true if the interval is supported
+    virtual bool    setLowPowerListening(uint16_t interval);
+
+    /// Sets the length of the preamble sent before every message, so that receivers using low power
+    /// listening (see setLowPowerListening()) wake up to receive it. Every message takes that much longer
+    /// to send, so only use it when sending to low power listening nodes.
+    /// Call it after configuring the modem. The default implementation only supports disabling it.
+    /// \param[in] duration Length of the preamble in milliseconds, or 0 for the normal preamble
+    /// \return true if the duration is supported
+    virtual bool    setWakeupPreamble(uint16_t duration);
+
+    /// Sets the channels selected by setChannel(), for drivers that select channels by frequency
+    /// (RH_RF95, RH_RF69, RH_RF24 and RH_RF22): channel n is at base + n * spacing.
+    /// Drivers with numbered channels (RH_NRF24, RH_NRF51) ignore this.
+    /// \param[in] base Frequency of channel 0 in MHz
+    /// \param[in] spacing Channel spacing in MHz
+    /// \return true if the channels are supported
+    virtual bool    setChannels(float base, float spacing);
+
+    /// Selects a channel, such as for frequency hopping (see RHFrequencyHopping). With drivers that select
+    /// channels by frequency, the channels are set by setChannels(). Others have their own channel numbers.
+    /// If the receiver is on, it continues on the new channel. The default implementation returns false.
+    /// \param[in] channel The channel number
+    /// \return true if the channel was selected
+    virtual bool    setChannel(uint8_t channel);
+
+    /// Selects one of the driver's canned modem configurations by its index, such as a
+    /// ModemConfigChoice of RH_RF95, so that managers like RHGatewayNode can change the modem
+    /// configuration without knowing the driver. The default implementation returns false.
+    /// \param[in] index The index of the modem configuration
+    /// \return true if the configuration was selected
+    virtual bool    setModemConfigIndex(uint8_t index);
+
+    /// Tells whether the radio acknowledges packets in hardware. If true, the radio automatically 
+    /// acknowledges each addressed packet it receives, and waitPacketSent() only returns true when
+    /// the destination acknowledged the packet (after any automatic retransmissions). Drivers must only
+    /// return true if the acknowledgement can only have come from the destination node, not from another
+    /// radio listening on the same address.
+    /// Managers such as RHReliableDatagram use this to skip their own acknowledgements.
+    /// The default implementation returns false. Drivers that support hardware acknowledgement override this.
+    /// \return true if hardware acknowledgement is enabled
+    virtual bool    hardwareAcknowledgement();
+
     /// Prints a data buffer in HEX.
     /// For diagnostic use
     /// \param[in] prompt string to preface the print
@@ -247,6 +545,66 @@ public:
     /// \return The number of packets successfully transmitted
     uint16_t       txGood();
 
+    /// Limits the fraction of time this driver may transmit on frequencies in a band, as required by
+    /// regulations such as ETSI EN 300 220 (1% or 10% in the EU868 sub-bands).
+    /// The time the transmitter is on (from entering RHModeTx until the driver leaves it at the end of the
+    /// packet) is accounted to the band containing the current frequency. When there is not enough of the
+    /// budget left in the current window for the next message, send() waits for up to the time set by
+    /// setDutyCycleMaxDefer(), and then fails (returns false).
+    /// The sub-GHz drivers that know their frequency (RH_RF95, RH_RF69, RH_RF22, RH_RF24, RH_CC110 and RH_MRF89)
+    /// enforce the limit. Call this after their init(), which sets the frequency. Other drivers
+    /// cannot enforce it, so this fails for them rather than silently allowing any duty cycle.
+    /// If RH_DUTY_CYCLE_MAX_BANDS is defined as 0, there are no limits and this always
+    /// returns false unless removing one.
+    /// \param[in] minFrequency Lowest frequency of the band in MHz
+    /// \param[in] maxFrequency Highest frequency of the band in MHz
+    /// \param[in] percent Maximum percentage of the window that may be used for transmitting.
+    /// 100 or more removes the limit for the band.
+    /// \param[in] window Length of the sliding window in ms
+    /// \return true if the limit was set, false if there are already RH_DUTY_CYCLE_MAX_BANDS bands with limits,
+    /// or the driver does not know its frequency
+    bool           setDutyCycle(float minFrequency, float maxFrequency, float percent, uint32_t window = RH_DUTY_CYCLE_DEFAULT_WINDOW);
+
+    /// Sets the longest time send() may wait for the duty cycle budget to allow a message to be sent.
+    /// Defaults to 0: send() fails immediately when over budget.
+    /// \param[in] maxDefer Maximum time to wait in ms
+    void           setDutyCycleMaxDefer(uint32_t maxDefer);
+
+    /// Returns the transmit time remaining in the current duty cycle window for the band containing
+    /// the current frequency. Managers can use this to decide which messages to send.
+    /// \return Remaining transmit time in ms, or 0xffffffff if the band has no limit
+    uint32_t       dutyCycleRemaining();
+
+    /// Returns the total time the radio has spent in an operating mode, as changed by setMode(),
+    /// since the driver was created or the last call to clearModeTimes(). Includes the time so far in the current mode.
+    /// Use this to measure the cost of retries, CAD and idle listening.
+    /// Always 0 if RH_ENABLE_ENERGY_ACCOUNTING is 0 (the default on AVR).
+    /// \param[in] mode The operating mode
+    /// \return Time in the mode in ms
+    uint32_t       modeTime(RHMode mode);
+
+    /// Sets the supply current drawn by the radio in an operating mode, for chargeUsed().
+    /// Drivers set typical datasheet figures in init(), and some update the RHModeTx current in
+    /// setTxPower(). Call this after them if you have measured your module, or if it uses another configuration
+    /// (such as a different RX gain, data rate or supply voltage).
+    /// \param[in] mode The operating mode
+    /// \param[in] current The current in mA
+    void           setModeCurrent(RHMode mode, float current);
+
+    /// Returns the supply current drawn by the radio in an operating mode, as set by setModeCurrent()
+    /// \param[in] mode The operating mode
+    /// \return The current in mA, 0 if not known
+    float          modeCurrent(RHMode mode);
+
+    /// Estimates the charge used by the radio from the time spent in each mode (see modeTime())
+    /// and the current drawn in each mode (see setModeCurrent()). Multiply by the supply voltage for the energy.
+    /// Time spent in a mode while its current was different is not accounted separately.
+    /// \return The charge used in mAh
+    float          chargeUsed();
+
+    /// Restarts the accounting of time in each mode for modeTime() and chargeUsed()
+    void           clearModeTimes();
+
 protected:
 
     /// The current transport operating mode
@@ -285,6 +643,12 @@ protected:
     /// The value of the last received RSSI value, in some transport specific units
     volatile int8_t     _lastRssi;
 
+    /// micros() when the last message was received, as latched by the interrupt handler. 0 if not known
+    volatile uint32_t   _rxTime;
+
+    /// micros() when the last message was sent, as latched by the interrupt handler. 0 if not known
+    volatile uint32_t   _txTime;
+
     /// Count of the number of bad messages (eg bad checksum etc) received
     volatile uint16_t   _rxBad;
 
@@ -297,9 +661,233 @@ protected:
     /// Channel activity detected
     volatile bool       _cad;
     unsigned int        _cad_timeout;
+
+    /// Frequency of channel 0 in MHz, see setChannels()
+    float               _channelBase;
+
+    /// Channel spacing in MHz, see setChannels()
+    float               _channelSpacing;
+
+    /// Low power listening interval in ms, 0 if receiving continuously
+    uint16_t            _lplInterval;
+
+    /// Wakeup preamble length in ms, 0 for the normal preamble
+    uint16_t            _wakeupPreamble;
+
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    /// Current frequency in MHz, for duty cycle accounting. Drivers that know their frequency set this.
+    /// 0 if unknown
+    float               _frequency;
+#endif
+
+    /// Waits, for up to the time set by setDutyCycleMaxDefer(), until the duty cycle budget for the
+    /// current frequency allows a message of len octets (using timeOnAir()) to be sent.
+    /// Drivers call this in send() before loading the transmitter.
+    /// \param[in] len Length of the message data in octets, as passed to send()
+    /// \return true if the message may be sent
+    bool                waitDutyCycle(uint8_t len);
+
+    /// Measures the RSSI on the current channel for clear channel assessment by isChannelActive(). 
+    /// Drivers that can measure RSSI override this. They turn the receiver on if necessary (waiting
+    /// RH_CCA_SETTLE_TIME for it to measure), and leave the radio in the mode they found it in.
+    /// The default returns false, meaning the radio cannot measure RSSI.
+    /// \param[out] rssi The RSSI in dBm
+    /// \return true if rssi was measured
+    virtual bool        readChannelRssi(int8_t* rssi);
+
+    /// Waits for a number of microseconds, calling YIELD.
+    /// \param[in] us Time to wait in microseconds
+    void                waitMicros(uint32_t us);
+
+    /// Gets the reception details of the message that available() has just said is ready to be
+    /// collected by recv(). Drivers that capture more than the RSSI override this.
+    /// The default sets rssi from _lastRssi and the timestamp from _rxTime (if known), and clears everything else.
+    /// \param[out] metadata Where to put the details
+    virtual void        rxMetadata(RxMetadata* metadata);
+
+    /// Low level interrupt handler for this driver instance. Called (via the low level interrupt
+    /// routines) when the interrupt pin given to attachInterruptHandler() signals. 
+    /// Drivers that use interrupts override this. Since interrupt pins may be shared by several radios,
+    /// an implementation should check its radio's status before acting.
+    /// The default does nothing.
+    virtual void        handleInterrupt();
+
+    /// Connects this driver instance to the interrupt on a pin, so that handleInterrupt() will be called 
+    /// when that interrupt occurs. If other driver instances are already connected to the same pin, the
+    /// pin is shared, and the mode must be the same for all of them.
+    /// Can be called more than once for the same instance (eg by repeated calls to init()).
+    /// An instance may also be connected to several pins (one entry in RH_MAX_INTERRUPT_DEVICES each), 
+    /// in which case handleInterrupt() is called when any of them signals.
+    /// \param[in] interruptPin The pin connected to the radio interrupt output. 
+    /// \param[in] mode The attachInterrupt() mode to use, such as RISING or FALLING
+    /// \return true if the interrupt was successfully attached. false if the pin cannot be used as an 
+    /// interrupt, the platform does not have pin interrupts, or there are already 
+    /// RH_MAX_INTERRUPT_DEVICES instances or RH_MAX_INTERRUPT_PINS pins in use.
+    bool                attachInterruptHandler(uint8_t interruptPin, int mode);
+
+    /// Disconnects this driver instance from its interrupt pins, if any.
+    /// The low level interrupt routine stays attached to the pin.
+    void                detachInterruptHandler();
+
+    /// Tells any thread blocked in waitEvent() that the driver state may have changed.
+    /// Drivers should call this at the end of their interrupt handler.
+    /// Does nothing on platforms without RH_HAVE_EVENT_WAIT.
+#ifdef RH_HAVE_EVENT_WAIT
+    void                signalEvent();
+#else
+    void                signalEvent() {}
+#endif
+
+    /// Returns a count of the calls to signalEvent(), for later use by waitEvent().
+    /// Take the count _before_ checking the driver state, so that an event that happens between the check
+    /// and the wait is not missed.
+    /// \return The number of events signalled so far
+    uint32_t            eventCount();
+
+    /// Waits until signalEvent() has been called since eventCount() returned count, or until
+    /// timeout ms have passed, or until RH_EVENT_POLL_INTERVAL ms have passed, whichever is first.
+    /// On platforms without RH_HAVE_EVENT_WAIT, this does YIELD and returns immediately, except on
+    /// RH_PLATFORM_RASPI and RH_PLATFORM_UNIX, where it sleeps for up to RH_EVENT_POLL_INTERVAL ms.
+    /// \param[in] count Value previously returned by eventCount()
+    /// \param[in] timeout Maximum time to wait in milliseconds
+    void                waitEvent(uint32_t count, unsigned long timeout);
     
 private:
 
+#ifdef RH_HAVE_PIN_INTERRUPTS
+    /// Calls handleInterrupt() for all instances connected to the interrupt pin in the given slot
+    static void         dispatchInterrupt(uint8_t slot);
+
+    /// Low level interrupt routine for interrupt pin slot
+    template <uint8_t slot>
+    static void         isr() { dispatchInterrupt(slot); }
+
+    /// The low level interrupt routines, indexed by pin slot
+    static void         (* const _isrForSlot[RH_MAX_INTERRUPT_PINS])();
+
+    /// The interrupt pins in use, in the order they were first attached
+    static uint8_t      _interruptPins[RH_MAX_INTERRUPT_PINS];
+
+    /// The attachInterrupt() mode used for each pin in _interruptPins
+    static uint8_t      _interruptModes[RH_MAX_INTERRUPT_PINS];
+
+    /// Number of entries in use in _interruptPins
+    static uint8_t      _interruptPinCount;
+
+    /// Instances connected to interrupts. NULL if the entry is free
+    static RHGenericDriver* volatile _interruptDevices[RH_MAX_INTERRUPT_DEVICES];
+
+    /// The index into _interruptPins of the pin used by each entry in _interruptDevices
+    static volatile uint8_t _interruptDeviceSlots[RH_MAX_INTERRUPT_DEVICES];
+#endif
+
+    /// States of the CSMA/CA access attempt in csmaPoll()
+    typedef enum
+    {
+	CsmaIdle = 0,           ///< No access attempt in progress. Sense the channel straight away
+	CsmaBackoff,            ///< Backing off until _csmaBackoffEnd
+	CsmaGranted,            ///< The channel was found clear at _csmaBackoffEnd
+	CsmaRetry               ///< Backing off after a failed transmission until _csmaBackoffEnd. The next access attempt begins when it ends
+    } CsmaState;
+
+    /// Starts a random backoff of up to _cw slots
+    void                csmaBackoff();
+
+    /// Current CSMA/CA access attempt state
+    CsmaState           _csmaState;
+
+    /// micros() at the end of the backoff, or when the channel was found clear
+    uint32_t            _csmaBackoffEnd;
+
+    /// millis() when the current access attempt began, or in CsmaRetry when the backoff began
+    unsigned long       _csmaStart;
+
+    /// Current CSMA/CA contention window in slots
+    uint16_t            _cw;
+
+    /// Minimum CSMA/CA contention window in slots
+    uint16_t            _cwMin;
+
+    /// Maximum CSMA/CA contention window in slots
+    uint16_t            _cwMax;
+
+    /// RSSI clear channel assessment threshold in dBm, or 0 to follow the noise floor
+    int8_t              _ccaThreshold;
+
+    /// RSSI clear channel assessment margin above the noise floor in dB
+    uint8_t             _ccaMargin;
+
+    /// Measured noise floor in units of 1/16 dBm
+    int16_t             _noiseFloor;
+
+    /// True once the noise floor has been measured
+    bool                _noiseFloorValid;
+
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    /// Duty cycle limit and transmit time accounting for a frequency band
+    typedef struct
+    {
+	float           minFrequency;               ///< Lowest frequency in MHz
+	float           maxFrequency;               ///< Highest frequency in MHz. 0 if this entry is free
+	uint32_t        budget;                     ///< Transmit time allowed per window in ms
+	uint32_t        slotLength;                 ///< Window length / (RH_DUTY_CYCLE_SLOTS - 1) in ms
+	unsigned long   slotStart;                  ///< millis() at the start of the current slot
+	uint8_t         slot;                       ///< Index of the current slot in used
+	uint32_t        used[RH_DUTY_CYCLE_SLOTS];  ///< Transmit time in ms accounted to each slot
+    } DutyCycleBand;
+
+    /// Finds the duty cycle band containing a frequency
+    /// \return Pointer to the band, or NULL if frequency is not in a band with a limit
+    DutyCycleBand*      dutyCycleBand(float frequency);
+
+    /// Forgets slots of band that are more than one window old, and totals the rest
+    /// \return Transmit time used in the last window in ms
+    uint32_t            dutyCycleUsed(DutyCycleBand* band);
+
+    /// Duty cycle limits, see setDutyCycle()
+    DutyCycleBand       _dutyCycleBands[RH_DUTY_CYCLE_MAX_BANDS];
+
+    /// Maximum time send() waits for the duty cycle budget in ms
+    uint32_t            _dutyCycleMaxDefer;
+
+    /// millis() when the transmitter was turned on
+    unsigned long       _txStartTime;
+
+    /// Frequency the transmitter was turned on at
+    float               _txFrequency;
+#endif
+
+#if RH_ENABLE_ENERGY_ACCOUNTING
+    /// Adds the time since the last mode change to the time in the current mode
+    void                accountModeTime();
+
+    /// Time in each mode in ms
+    uint32_t            _modeTime[RH_NUM_MODES];
+
+    /// Time in each mode in us, less _modeTime
+    uint16_t            _modeTimeMicros[RH_NUM_MODES];
+
+    /// Current drawn in each mode in mA
+    float               _modeCurrent[RH_NUM_MODES];
+
+    /// micros() at the last mode change
+    unsigned long       _modeStartMicros;
+
+    /// millis() at the last mode change
+    unsigned long       _modeStartMillis;
+#endif
+
+#ifdef RH_HAVE_EVENT_WAIT
+    /// Protects _eventCount and _eventCond
+    pthread_mutex_t     _eventLock;
+
+    /// Signalled by signalEvent()
+    pthread_cond_t      _eventCond;
+
+    /// Number of calls to signalEvent()
+    uint32_t            _eventCount;
+#endif
+
 };
 
 
@@ -12,6 +12,27 @@ RHGenericSPI::RHGenericSPI(Frequency frequency, BitOrder bitOrder, DataMode data
     _bitOrder(bitOrder),
     _dataMode(dataMode)
 {
+#ifdef RH_HAVE_SPI_LOCK
+    // Transactions are only a few microseconds, so where available, use a mutex
+    // that spins for a while before sleeping when there is contention
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#ifdef __USE_GNU
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+#endif
+    pthread_mutex_init(&_busLock, &attr);
+    pthread_mutexattr_destroy(&attr);
+#endif
+}
+
+void RHGenericSPI::transfer(const uint8_t* src, uint8_t* dest, size_t len)
+{
+    while (len--)
+    {
+	uint8_t val = transfer((uint8_t)(src ? *src++ : 0));
+	if (dest)
+	    *dest++ = val;
+    }
 }
 
 void RHGenericSPI::setBitOrder(BitOrder bitOrder)
@@ -9,6 +9,24 @@
 
 #include <RadioHead.h>
 
+// On Linux, drivers for radios on the same bus may run in different threads, and each
+// SPI bus has a lock to keep their transactions apart
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) || (RH_PLATFORM == RH_PLATFORM_UNIX)
+ #define RH_HAVE_SPI_LOCK
+ #include <pthread.h>
+#endif
+
+// Brackets an SPI transaction: everything from asserting a slave select to releasing it.
+// On Linux, this holds the bus lock of the RHGenericSPI. Elsewhere the only concurrency is from interrupts,
+// so it is an ATOMIC_BLOCK
+#ifdef RH_HAVE_SPI_LOCK
+ #define RH_SPI_TRANSACTION_START(spi) (spi).lock(); {
+ #define RH_SPI_TRANSACTION_END(spi) } (spi).unlock();
+#else
+ #define RH_SPI_TRANSACTION_START(spi) ATOMIC_BLOCK_START
+ #define RH_SPI_TRANSACTION_END(spi) ATOMIC_BLOCK_END
+#endif
+
 /////////////////////////////////////////////////////////////////////
 /// \class RHGenericSPI RHGenericSPI.h <RHGenericSPI.h>
 /// \brief Base class for SPI interfaces
@@ -27,6 +45,21 @@
 /// - begin()
 /// - end() 
 /// - transfer()
+///
+/// Subclasses whose underlying bus can move a whole buffer in one operation 
+/// (such as Linux spidev, or the BCM2835 on Raspberry Pi) should also override the
+/// block transfer(const uint8_t*, uint8_t*, size_t), which is used by the drivers for burst
+/// register and FIFO access. The default implementation calls the single octet transfer() for each octet.
+///
+/// \par Threads
+///
+/// On Linux (RH_HAVE_SPI_LOCK is defined), each RHGenericSPI has a lock, and drivers hold it for the whole
+/// of each SPI transaction, from asserting their slave select until releasing it 
+/// (see RH_SPI_TRANSACTION_START). So several radios on the same bus can be run from
+/// different threads, such as one thread per radio in a multi radio gateway. All the radios on one
+/// physical bus must be given the same RHGenericSPI instance. The lock is held only for the duration of one 
+/// transaction, and does not make the drivers themselves thread safe: each driver instance 
+/// must still be used from only one thread (plus its interrupt handler).
 class RHGenericSPI 
 {
 public:
@@ -89,6 +122,15 @@ public:
     /// \return The octet read from SPI while the data octet was sent
     virtual uint8_t transfer(uint8_t data) = 0;
 
+    /// Transfer a block of octets to and from the SPI interface in one operation.
+    /// The default implementation calls transfer(uint8_t) for each octet. Subclasses should
+    /// override this if the underlying interface can transfer a buffer more efficiently.
+    /// \param[in] src Array of octets to send. If NULL, 0 is sent for each octet.
+    /// \param[out] dest Array where the received octets are written. If NULL, received octets are discarded.
+    ///            May be the same as src.
+    /// \param[in] len Number of octets to transfer
+    virtual void transfer(const uint8_t* src, uint8_t* dest, size_t len);
+
     /// SPI Configuration methods
     /// Enable SPI interrupts (if supported)
     /// This can be used in an SPI slave to indicate when an SPI message has been received
@@ -124,6 +166,15 @@ public:
     /// \param[in] frequency The data rate to use: one of RHGenericSPI::Frequency
     virtual void setFrequency(Frequency frequency);
 
+#ifdef RH_HAVE_SPI_LOCK
+    /// Waits for, then takes, the lock for this bus. Used by drivers (through RH_SPI_TRANSACTION_START) to
+    /// keep the bus to themselves for the whole of an SPI transaction. Not recursive.
+    void lock() { pthread_mutex_lock(&_busLock); }
+
+    /// Releases the lock taken by lock()
+    void unlock() { pthread_mutex_unlock(&_busLock); }
+#endif
+
 protected:
     /// The configure SPI Bus frequency, one of RHGenericSPI::Frequency
     Frequency    _frequency; // Bus frequency, one of RHGenericSPI::Frequency
@@ -133,5 +184,11 @@ protected:
 
     /// SPI bus mode, one of RHGenericSPI::DataMode
     DataMode     _dataMode;  
+
+#ifdef RH_HAVE_SPI_LOCK
+private:
+    /// Held for the duration of each SPI transaction
+    pthread_mutex_t _busLock;
+#endif
 };
 #endif
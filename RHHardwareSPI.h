@@ -34,6 +34,14 @@ public:
     /// \return The octet read from SPI while the data octet was sent
     uint8_t transfer(uint8_t data);
 
+    /// Transfer a block of octets to and from the SPI interface.
+    /// On Raspberry Pi the whole block is transferred in one BCM2835 SPI transaction. On other platforms
+    /// this falls back to RHGenericSPI::transfer(), one octet at a time.
+    /// \param[in] src Array of octets to send. If NULL, 0 is sent for each octet.
+    /// \param[out] dest Array where the received octets are written. If NULL, received octets are discarded.
+    /// \param[in] len Number of octets to transfer
+    void transfer(const uint8_t* src, uint8_t* dest, size_t len);
+
     // SPI Configuration methods
     /// Enable SPI interrupts
     /// This can be used in an SPI slave to indicate when an SPI message has been received
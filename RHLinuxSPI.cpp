@@ -0,0 +1,120 @@
+// RHLinuxSPI.cpp
+//
+// Copyright (C) 2017 Mike McCauley
+
+#include <RHLinuxSPI.h>
+
+#ifdef RH_HAVE_LINUX_SPI
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+RHLinuxSPI::RHLinuxSPI(const char* device, Frequency frequency, BitOrder bitOrder, DataMode dataMode)
+    :
+    RHGenericSPI(frequency, bitOrder, dataMode),
+    _device(device),
+    _fd(-1),
+    _speed(1000000)
+{
+}
+
+uint8_t RHLinuxSPI::transfer(uint8_t data)
+{
+    uint8_t val = 0;
+    transfer(&data, &val, 1);
+    return val;
+}
+
+void RHLinuxSPI::transfer(const uint8_t* src, uint8_t* dest, size_t len)
+{
+    if (_fd < 0 || len == 0)
+	return;
+
+    // spidev sends zeros if tx_buf is 0 and discards input if rx_buf is 0
+    struct spi_ioc_transfer tr;
+    memset(&tr, 0, sizeof(tr));
+    tr.tx_buf = (unsigned long)src;
+    tr.rx_buf = (unsigned long)dest;
+    tr.len = len;
+    tr.speed_hz = _speed;
+    tr.bits_per_word = 8;
+    if (ioctl(_fd, SPI_IOC_MESSAGE(1), &tr) < 0)
+	perror("RHLinuxSPI: SPI_IOC_MESSAGE");
+}
+
+void RHLinuxSPI::begin()
+{
+    if (_fd >= 0)
+	end();
+
+    _fd = open(_device, O_RDWR);
+    if (_fd < 0)
+    {
+	perror(_device);
+	return;
+    }
+
+    uint8_t mode;
+    if (_dataMode == DataMode0)
+	mode = SPI_MODE_0;
+    else if (_dataMode == DataMode1)
+	mode = SPI_MODE_1;
+    else if (_dataMode == DataMode2)
+	mode = SPI_MODE_2;
+    else if (_dataMode == DataMode3)
+	mode = SPI_MODE_3;
+    else
+	mode = SPI_MODE_0;
+
+    // RadioHead drivers control slave select themselves. Not all controllers support SPI_NO_CS,
+    // in which case the kernel keeps driving the device chip select
+    uint8_t nocs_mode = mode | SPI_NO_CS;
+    if (ioctl(_fd, SPI_IOC_WR_MODE, &nocs_mode) < 0
+	&& ioctl(_fd, SPI_IOC_WR_MODE, &mode) < 0)
+	perror("RHLinuxSPI: SPI_IOC_WR_MODE");
+
+    uint8_t lsbFirst = (_bitOrder == BitOrderLSBFirst) ? 1 : 0;
+    if (ioctl(_fd, SPI_IOC_WR_LSB_FIRST, &lsbFirst) < 0)
+	perror("RHLinuxSPI: SPI_IOC_WR_LSB_FIRST");
+
+    uint8_t bits = 8;
+    if (ioctl(_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0)
+	perror("RHLinuxSPI: SPI_IOC_WR_BITS_PER_WORD");
+
+    switch (_frequency)
+    {
+	case Frequency1MHz:
+	default:
+	    _speed = 1000000;
+	    break;
+
+	case Frequency2MHz:
+	    _speed = 2000000;
+	    break;
+
+	case Frequency4MHz:
+	    _speed = 4000000;
+	    break;
+
+	case Frequency8MHz:
+	    _speed = 8000000;
+	    break;
+
+	case Frequency16MHz:
+	    _speed = 16000000;
+	    break;
+    }
+    if (ioctl(_fd, SPI_IOC_WR_MAX_SPEED_HZ, &_speed) < 0)
+	perror("RHLinuxSPI: SPI_IOC_WR_MAX_SPEED_HZ");
+}
+
+void RHLinuxSPI::end()
+{
+    if (_fd >= 0)
+	close(_fd);
+    _fd = -1;
+}
+
+#endif
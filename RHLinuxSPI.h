@@ -0,0 +1,91 @@
+// RHLinuxSPI.h
+//
+// Copyright (C) 2017 Mike McCauley
+
+#ifndef RHLinuxSPI_h
+#define RHLinuxSPI_h
+
+#include <RHGenericSPI.h>
+
+// The Linux spidev interface is only available on Linux hosts
+#if defined(__linux__) && ((RH_PLATFORM == RH_PLATFORM_RASPI) || (RH_PLATFORM == RH_PLATFORM_UNIX))
+ #define RH_HAVE_LINUX_SPI
+#endif
+
+// Default spidev device to open
+#define RH_LINUX_SPI_DEFAULT_DEVICE "/dev/spidev0.0"
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHLinuxSPI RHLinuxSPI.h <RHLinuxSPI.h>
+/// \brief Encapsulate a Linux spidev SPI bus interface
+///
+/// This concrete subclass of RHGenericSPI uses the Linux kernel spidev interface (/dev/spidevX.Y)
+/// to talk to the SPI bus. Unlike RHHardwareSPI on Raspberry Pi, which calls the BCM2835
+/// library for each octet, this issues a single SPI_IOC_MESSAGE ioctl for each block transfer, so
+/// the burst register and FIFO accesses made by RHSPIDriver cost one kernel transaction
+/// instead of one per octet.
+///
+/// RadioHead drivers drive their slave select pin themselves with digitalWrite(). RHLinuxSPI therefore
+/// asks the kernel not to drive the chip select line of the spidev device (SPI_NO_CS). If the kernel SPI
+/// controller does not support SPI_NO_CS, the device chip select is left under kernel control, and you should
+/// connect your radio slave select to some other GPIO pin.
+///
+/// Only available on Linux (RH_HAVE_LINUX_SPI is defined).
+///
+/// \par Usage
+///
+/// \code
+/// #include <RHLinuxSPI.h>
+/// RHLinuxSPI spi("/dev/spidev0.0", RHGenericSPI::Frequency8MHz);
+/// RH_RF95 driver(RPI_V2_GPIO_P1_24, RPI_V2_GPIO_P1_22, spi);
+/// \endcode
+class RHLinuxSPI : public RHGenericSPI
+{
+#ifdef RH_HAVE_LINUX_SPI
+public:
+    /// Constructor
+    /// Creates an instance of a Linux spidev SPI interface. The device is not opened until begin() is called.
+    /// \param[in] device Path to the spidev device to use, such as "/dev/spidev0.0". The string is not copied
+    /// and must remain valid for the life of this object.
+    /// \param[in] frequency One of RHGenericSPI::Frequency to select the SPI bus frequency.
+    /// \param[in] bitOrder Select the SPI bus bit order, one of RHGenericSPI::BitOrderMSBFirst or
+    /// RHGenericSPI::BitOrderLSBFirst.
+    /// \param[in] dataMode Selects the SPI bus data mode. One of RHGenericSPI::DataMode
+    RHLinuxSPI(const char* device = RH_LINUX_SPI_DEFAULT_DEVICE, Frequency frequency = Frequency1MHz, BitOrder bitOrder = BitOrderMSBFirst, DataMode dataMode = DataMode0);
+
+    /// Transfer a single octet to and from the SPI interface
+    /// \param[in] data The octet to send
+    /// \return The octet read from SPI while the data octet was sent
+    uint8_t transfer(uint8_t data);
+
+    /// Transfer a block of octets to and from the SPI interface with a single SPI_IOC_MESSAGE.
+    /// \param[in] src Array of octets to send. If NULL, 0 is sent for each octet.
+    /// \param[out] dest Array where the received octets are written. If NULL, received octets are discarded.
+    /// \param[in] len Number of octets to transfer
+    void transfer(const uint8_t* src, uint8_t* dest, size_t len);
+
+    /// Opens and configures the spidev device with the current frequency, bit order and data mode.
+    /// Prints an error to stderr if the device cannot be opened or configured.
+    void begin();
+
+    /// Closes the spidev device
+    void end();
+
+private:
+    /// Path to the spidev device
+    const char*  _device;
+
+    /// File descriptor of the open spidev device, or -1 if not open
+    int          _fd;
+
+    /// Bus speed in Hz, derived from _frequency by begin()
+    uint32_t     _speed;
+#else
+    // not supported on this platform
+    uint8_t transfer(uint8_t /*data*/) {return 0;}
+    void begin(){}
+    void end(){}
+#endif
+};
+
+#endif
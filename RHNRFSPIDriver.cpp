@@ -31,30 +31,30 @@ bool RHNRFSPIDriver::init()
 uint8_t RHNRFSPIDriver::spiCommand(uint8_t command)
 {
     uint8_t status;
-    ATOMIC_BLOCK_START;
+    RH_SPI_TRANSACTION_START(_spi);
     digitalWrite(_slaveSelectPin, LOW);
     status = _spi.transfer(command);
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return status;
 }
 
 uint8_t RHNRFSPIDriver::spiRead(uint8_t reg)
 {
     uint8_t val;
-    ATOMIC_BLOCK_START;
+    RH_SPI_TRANSACTION_START(_spi);
     digitalWrite(_slaveSelectPin, LOW);
     _spi.transfer(reg); // Send the address, discard the status
     val = _spi.transfer(0); // The written value is ignored, reg value is read
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return val;
 }
 
 uint8_t RHNRFSPIDriver::spiWrite(uint8_t reg, uint8_t val)
 {
     uint8_t status = 0;
-    ATOMIC_BLOCK_START;
+    RH_SPI_TRANSACTION_START(_spi);
     digitalWrite(_slaveSelectPin, LOW);
     status = _spi.transfer(reg); // Send the address
     _spi.transfer(val); // New value follows
@@ -65,33 +65,31 @@ uint8_t RHNRFSPIDriver::spiWrite(uint8_t reg, uint8_t val)
 delayMicroseconds(5);
 #endif
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return status;
 }
 
 uint8_t RHNRFSPIDriver::spiBurstRead(uint8_t reg, uint8_t* dest, uint8_t len)
 {
     uint8_t status = 0;
-    ATOMIC_BLOCK_START;
+    RH_SPI_TRANSACTION_START(_spi);
     digitalWrite(_slaveSelectPin, LOW);
     status = _spi.transfer(reg); // Send the start address
-    while (len--)
-	*dest++ = _spi.transfer(0);
+    _spi.transfer(NULL, dest, len);
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return status;
 }
 
 uint8_t RHNRFSPIDriver::spiBurstWrite(uint8_t reg, const uint8_t* src, uint8_t len)
 {
     uint8_t status = 0;
-    ATOMIC_BLOCK_START;
+    RH_SPI_TRANSACTION_START(_spi);
     digitalWrite(_slaveSelectPin, LOW);
     status = _spi.transfer(reg); // Send the start address
-    while (len--)
-	_spi.transfer(*src++);
+    _spi.transfer(src, NULL, len);
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return status;
 }
 
@@ -52,10 +52,15 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
     uint8_t retries = 0;
     while (retries++ <= _retries)
     {
+	// Dont retransmit if the driver does not have enough duty cycle budget left for it. The budget
+	// is better used for other messages than for a retry storm
+	if (retries > 1 && _driver.dutyCycleRemaining() < (_driver.timeOnAir(len) + 999) / 1000)
+	    return false;
+
 	setHeaderId(thisSequenceNumber);
 	setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_ACK); // Clear the ACK flag
 	sendto(buf, len, address);
-	waitPacketSent();
+	bool delivered = waitPacketSent();
 
 	// Never wait for ACKS to broadcasts:
 	if (address == RH_BROADCAST_ADDRESS)
@@ -63,6 +68,15 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 
 	if (retries > 1)
 	    _retransmissions++;
+
+	// If the radio acknowledges in hardware, it has already told us whether it was delivered
+	if (_driver.hardwareAcknowledgement())
+	{
+	    _driver.csmaResult(delivered);
+	    if (delivered)
+		return true;
+	    continue;
+	}
 	unsigned long thisSendTime = millis(); // Timeout does not include original transmit time
 
 	// Compute a new timeout, random between _timeout and _timeout*2
@@ -73,6 +87,9 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 #else
 	uint16_t timeout = _timeout + (_timeout * random(0, 256) / 256);
 #endif
+	// Also allow for the time the ACK spends on the air, if the driver knows it. On slow radios
+	// (such as LoRa at high spreading factors) this can be much longer than _timeout
+	timeout += _driver.timeOnAir(sizeof(uint8_t)) / 1000;
 	int32_t timeLeft;
         while ((timeLeft = timeout - (millis() - thisSendTime)) > 0)
 	{
@@ -88,6 +105,7 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 			   && (id == thisSequenceNumber))
 		    {
 			// Its the ACK we are waiting for
+			_driver.csmaResult(true);
 			return true;
 		    }
 		    else if (   !(flags & RH_FLAGS_ACK)
@@ -102,7 +120,8 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 	    // Not the one we are waiting for, maybe keep waiting until timeout exhausted
 	    YIELD;
 	}
-	// Timeout exhausted, maybe retry
+	// Timeout exhausted, maybe retry. Perhaps it collided, so back off before the retry
+	_driver.csmaResult(false);
 	YIELD;
     }
     // Retries exhausted
@@ -110,22 +129,22 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 }
 
 ////////////////////////////////////////////////////////////////////
-bool RHReliableDatagram::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
+bool RHReliableDatagram::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags, RHGenericDriver::RxMetadata* metadata)
 {  
     uint8_t _from;
     uint8_t _to;
     uint8_t _id;
     uint8_t _flags;
     // Get the message before its clobbered by the ACK (shared rx and tx buffer in some drivers
-    if (available() && recvfrom(buf, len, &_from, &_to, &_id, &_flags))
+    if (available() && recvfrom(buf, len, &_from, &_to, &_id, &_flags, metadata))
     {
 	// Never ACK an ACK
 	if (!(_flags & RH_FLAGS_ACK))
 	{
 	    // Its a normal message for this node, not an ACK
-	    if (_to != RH_BROADCAST_ADDRESS)
+	    if (_to != RH_BROADCAST_ADDRESS && !_driver.hardwareAcknowledgement())
 	    {
-		// Its not a broadcast, so ACK it
+		// Its not a broadcast, and the radio has not already ACKed it, so ACK it
 		// Acknowledge message with ACK set in flags and ID set to received ID
 		acknowledge(_id, _from);
 	    }
@@ -146,7 +165,7 @@ bool RHReliableDatagram::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from,
     return false;
 }
 
-bool RHReliableDatagram::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t timeout, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
+bool RHReliableDatagram::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t timeout, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags, RHGenericDriver::RxMetadata* metadata)
 {
     unsigned long starttime = millis();
     int32_t timeLeft;
@@ -154,7 +173,7 @@ bool RHReliableDatagram::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t
     {
 	if (waitAvailableTimeout(timeLeft))
 	{
-	    if (recvfromAck(buf, len, from, to, id, flags))
+	    if (recvfromAck(buf, len, from, to, id, flags, metadata))
 		return true;
 	}
 	YIELD;
@@ -48,6 +48,13 @@
 /// - FLAGS with the RH_FLAGS_ACK bit set
 /// - 1 octet of payload containing ASCII '!' (since some drivers cannot handle 0 length payloads)
 ///
+/// If the driver reports that the radio acknowledges packets in hardware, and that only the destination node
+/// can acknowledge (see RHGenericDriver::hardwareAcknowledgement(), eg RH_NRF24::setAutoAck() with
+/// RH_NRF24::setUniqueAddresses()), no ack messages are sent: 
+/// sendtoWait() relies on the result of waitPacketSent(), which tells whether the radio at the
+/// destination acknowledged the message, and recvfromAck() does not send an ack. All the nodes in the network must
+/// then be configured the same way.
+///
 /// \par Media Access Strategy
 ///
 /// RHReliableDatagram and the underlying drivers always transmit as soon as
@@ -91,7 +98,9 @@ public:
     /// For fast modulation schemes you can considerably shorten this time.
     /// Caution: if you are using slow packet rates and long packets 
     /// you may need to change the timeout for reliable operations.
-    /// The actual timeout is randomly varied between timeout and timeout*2.
+    /// The actual timeout is randomly varied between timeout and timeout*2. If the driver can report
+    /// RHGenericDriver::timeOnAir(), the time on air of the acknowledgement is added to that, so the timeout
+    /// need only cover the latency/poll time of the receiver.
     /// \param[in] timeout The new timeout period in milliseconds
     void setTimeout(uint16_t timeout);
 
@@ -113,6 +122,8 @@ public:
     /// If the destination address is the broadcast address RH_BROADCAST_ADDRESS (255), the message will 
     /// be sent as a broadcast, but receiving nodes do not acknowledge, and sendtoWait() returns true immediately
     /// without waiting for any acknowledgements.
+    /// If the driver has a duty cycle limit (see RHGenericDriver::setDutyCycle()), retransmissions are
+    /// abandoned when there is not enough of the budget left for them.
     /// \param[in] address The address to send the message to.
     /// \param[in] buf Pointer to the binary message to send
     /// \param[in] len Number of octets to send
@@ -136,8 +147,10 @@ public:
     /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
     /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
     /// (not just those addressed to this node).
+    /// \param[out] metadata If present and not NULL, set to the RSSI, SNR, timestamp and frequency error of 
+    /// the message, as captured by the driver. See RHGenericDriver::RxMetadata
     /// \return true if a valid message was copied to buf
-    bool recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
+    bool recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL, RHGenericDriver::RxMetadata* metadata = NULL);
 
     /// Similar to recvfromAck(), this will block until either a valid message available for this node
     /// or the timeout expires. Starts the receiver automatically.
@@ -151,8 +164,10 @@ public:
     /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
     /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
     /// (not just those addressed to this node).
+    /// \param[out] metadata If present and not NULL, set to the RSSI, SNR, timestamp and frequency error of 
+    /// the message, as captured by the driver. See RHGenericDriver::RxMetadata
     /// \return true if a valid message was copied to buf
-    bool recvfromAckTimeout(uint8_t* buf, uint8_t* len,  uint16_t timeout, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
+    bool recvfromAckTimeout(uint8_t* buf, uint8_t* len,  uint16_t timeout, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL, RHGenericDriver::RxMetadata* metadata = NULL);
 
     /// Returns the number of retransmissions 
     /// we have had to send since starting or since the last call to resetRetransmissions().
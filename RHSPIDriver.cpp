@@ -30,54 +30,52 @@ bool RHSPIDriver::init()
 uint8_t RHSPIDriver::spiRead(uint8_t reg)
 {
     uint8_t val;
+    RH_SPI_TRANSACTION_START(_spi);
     RPI_CE0_CE1_FIX;
-    ATOMIC_BLOCK_START;
     digitalWrite(_slaveSelectPin, LOW);
     _spi.transfer(reg & ~RH_SPI_WRITE_MASK); // Send the address with the write mask off
     val = _spi.transfer(0); // The written value is ignored, reg value is read
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return val;
 }
 
 uint8_t RHSPIDriver::spiWrite(uint8_t reg, uint8_t val)
 {
     uint8_t status = 0;
+    RH_SPI_TRANSACTION_START(_spi);
     RPI_CE0_CE1_FIX;
-    ATOMIC_BLOCK_START;
     digitalWrite(_slaveSelectPin, LOW);
     status = _spi.transfer(reg | RH_SPI_WRITE_MASK); // Send the address with the write mask on
     _spi.transfer(val); // New value follows
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return status;
 }
 
 uint8_t RHSPIDriver::spiBurstRead(uint8_t reg, uint8_t* dest, uint8_t len)
 {
     uint8_t status = 0;
+    RH_SPI_TRANSACTION_START(_spi);
     RPI_CE0_CE1_FIX;
-    ATOMIC_BLOCK_START;
     digitalWrite(_slaveSelectPin, LOW);
     status = _spi.transfer(reg & ~RH_SPI_WRITE_MASK); // Send the start address with the write mask off
-    while (len--)
-	*dest++ = _spi.transfer(0);
+    _spi.transfer(NULL, dest, len);
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return status;
 }
 
 uint8_t RHSPIDriver::spiBurstWrite(uint8_t reg, const uint8_t* src, uint8_t len)
 {
     uint8_t status = 0;
+    RH_SPI_TRANSACTION_START(_spi);
     RPI_CE0_CE1_FIX;
-    ATOMIC_BLOCK_START;
     digitalWrite(_slaveSelectPin, LOW);
     status = _spi.transfer(reg | RH_SPI_WRITE_MASK); // Send the start address with the write mask on
-    while (len--)
-	_spi.transfer(*src++);
+    _spi.transfer(src, NULL, len);
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return status;
 }
 
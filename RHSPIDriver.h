@@ -42,6 +42,9 @@ class RHGenericSPI;
 ///
 /// SPI bus access is protected by ATOMIC_BLOCK_START and ATOMIC_BLOCK_END, which will ensure interrupts 
 /// are disabled during access.
+///
+/// Burst reads and writes pass the whole data block to RHGenericSPI::transfer(const uint8_t*, uint8_t*, size_t), 
+/// so SPI interfaces that support block transfers (such as RHLinuxSPI) can move a complete FIFO in one operation.
 /// 
 /// The read and write routines implement commonly used SPI conventions: specifically that the MSB
 /// of the first byte transmitted indicates that it is a write and the remaining bits indicate the rehgister to access)
@@ -0,0 +1,309 @@
+// RHTdma.cpp
+//
+// Copyright (C) 2017 Mike McCauley
+
+#include <RHTdma.h>
+
+// Beacon times are sent least significant octet first on every platform
+static void putUint32(uint8_t* p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static uint32_t getUint32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+////////////////////////////////////////////////////////////////////
+// Constructors
+RHTdma::RHTdma(RHGenericDriver& driver, uint8_t thisAddress)
+    : RHDatagram(driver, thisAddress)
+{
+    _coordinator = false;
+    _synchronised = false;
+    _listening = false;
+    _asleep = false;
+    _sequence = 0;
+    _numSlots = 0;
+    _maxMessageLen = 0;
+    _beaconSlotLength = 0;
+    _slotLength = 0;
+    _guardTime = 0;
+    _beaconAirtime = 0;
+    _frameStart = 0;
+    _lastBeacon = 0;
+    _timeOffset = 0;
+    _txTo = RH_BROADCAST_ADDRESS;
+    _txLen = 0;
+}
+
+////////////////////////////////////////////////////////////////////
+// Public methods
+bool RHTdma::setCoordinator(uint8_t numSlots, uint8_t maxMessageLen, uint32_t guardTime, uint32_t slotLength)
+{
+    uint8_t beaconLen = RH_TDMA_BEACON_HEADER_LEN + 2 * numSlots;
+    if (   numSlots == 0
+	|| numSlots > RH_TDMA_MAX_SLOTS
+#if RH_TDMA_MAX_MESSAGE_LEN < 255
+	|| maxMessageLen > RH_TDMA_MAX_MESSAGE_LEN
+#endif
+	|| maxMessageLen > _driver.maxMessageLength()
+	|| beaconLen > _driver.maxMessageLength())
+	return false;
+
+    uint32_t beaconAirtime = _driver.timeOnAir(beaconLen);
+    uint32_t beaconSlotLength = slotLength;
+    if (!slotLength)
+    {
+	// Size the slots from the time on air
+	uint32_t airtime = _driver.timeOnAir(maxMessageLen);
+	if (!airtime || !beaconAirtime)
+	    return false;
+	slotLength = airtime + guardTime;
+	beaconSlotLength = beaconAirtime + guardTime;
+    }
+
+    _coordinator = true;
+    _numSlots = numSlots;
+    _maxMessageLen = maxMessageLen;
+    _guardTime = guardTime;
+    _slotLength = slotLength;
+    _beaconSlotLength = beaconSlotLength;
+    _beaconAirtime = beaconAirtime;
+    _timeOffset = 0;
+    uint8_t i;
+    for (i = 0; i < RH_TDMA_MAX_SLOTS; i++)
+    {
+	_slots[i].owner = RH_BROADCAST_ADDRESS;
+	_slots[i].destination = RH_BROADCAST_ADDRESS;
+    }
+    // Start a new frame at the next poll()
+    _synchronised = true;
+    _frameStart = micros() - frameLength();
+    return true;
+}
+
+bool RHTdma::assignSlot(uint8_t slot, uint8_t owner, uint8_t destination)
+{
+    if (!_coordinator || slot >= _numSlots)
+	return false;
+    _slots[slot].owner = owner;
+    _slots[slot].destination = destination;
+    return true;
+}
+
+bool RHTdma::sendto(uint8_t* buf, uint8_t len, uint8_t address)
+{
+    if (   _txLen
+	|| len == 0
+#if RH_TDMA_MAX_MESSAGE_LEN < 255
+	|| len > RH_TDMA_MAX_MESSAGE_LEN
+#endif
+	|| (_maxMessageLen && len > _maxMessageLen))
+	return false;
+    memcpy(_txBuf, buf, len);
+    _txTo = address;
+    _txLen = len;
+    return true;
+}
+
+bool RHTdma::available()
+{
+    poll();
+    while (_listening && _driver.available())
+    {
+	if (!(_driver.headerFlags() & RH_FLAGS_CONTROL))
+	    return true;
+	handleBeacon();
+    }
+    return false;
+}
+
+bool RHTdma::recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags, RHGenericDriver::RxMetadata* metadata)
+{
+    if (!available())
+	return false;
+    return RHDatagram::recvfrom(buf, len, from, to, id, flags, metadata);
+}
+
+void RHTdma::poll()
+{
+    uint32_t now = micros();
+    uint32_t frame = frameLength();
+    if (_synchronised)
+    {
+	if (now - _frameStart >= frame)
+	{
+	    // Next frame
+	    _frameStart += frame;
+	    if (now - _frameStart >= frame)
+		_frameStart = now - (now - _frameStart) % frame; // Fell behind
+	    if (_coordinator)
+		sendBeacon();
+	}
+	if (!_coordinator && now - _lastBeacon > (uint32_t)RH_TDMA_MAX_MISSED_BEACONS * frame)
+	    _synchronised = false; // Lost the coordinator: listen for it
+    }
+
+    now = micros();
+    uint32_t offset = now - _frameStart;
+    if (_synchronised && _txLen && offset >= _beaconSlotLength)
+    {
+	// Is it a good time to send the queued message?
+	uint32_t slot = (offset - _beaconSlotLength) / _slotLength;
+	uint32_t inSlot = (offset - _beaconSlotLength) % _slotLength;
+	uint32_t airtime = _driver.timeOnAir(_txLen);
+	if (!airtime)
+	    airtime = _slotLength - _guardTime; // Assume it fills the slot
+	if (   slot < _numSlots
+	    && _slots[slot].owner == _thisAddress
+	    && (_slots[slot].destination == _txTo || _slots[slot].destination == RH_BROADCAST_ADDRESS)
+	    && inSlot >= _guardTime / 2
+	    && inSlot + airtime <= _slotLength)
+	{
+	    RHDatagram::sendto(_txBuf, _txLen, _txTo);
+	    _driver.waitPacketSent();
+	    _txLen = 0;
+	    _asleep = false;
+	    offset = micros() - _frameStart;
+	}
+    }
+
+    _listening = listenAt(offset);
+    if (_listening)
+	_asleep = false; // available() wakes it
+    else if (!_asleep && _driver.mode() != RHGenericDriver::RHModeTx)
+	_asleep = _driver.sleep();
+}
+
+bool RHTdma::txPending()
+{
+    return _txLen != 0;
+}
+
+bool RHTdma::synchronised()
+{
+    return _synchronised;
+}
+
+uint32_t RHTdma::frameLength()
+{
+    if (!_synchronised)
+	return 0;
+    return _beaconSlotLength + (uint32_t)_numSlots * _slotLength;
+}
+
+uint32_t RHTdma::networkTime()
+{
+    return micros() + _timeOffset;
+}
+
+////////////////////////////////////////////////////////////////////
+// Protected methods
+void RHTdma::sendBeacon()
+{
+    uint32_t start = micros();
+    uint32_t delay = start - _frameStart;
+    // Too late to fit in the beacon slot? Skip this frame
+    if (delay + _beaconAirtime + _guardTime / 2 > _beaconSlotLength)
+	return;
+
+    uint8_t buf[RH_TDMA_BEACON_HEADER_LEN + 2 * RH_TDMA_MAX_SLOTS];
+    buf[0] = RH_CONTROL_TDMA_BEACON;
+    buf[1] = _numSlots;
+    buf[2] = _sequence++;
+    buf[3] = _maxMessageLen;
+    putUint32(buf + 4, _beaconSlotLength);
+    putUint32(buf + 8, _slotLength);
+    putUint32(buf + 12, _guardTime);
+    putUint32(buf + 16, _beaconAirtime);
+    putUint32(buf + 20, delay);
+    putUint32(buf + 24, _frameStart);
+    uint8_t i;
+    uint8_t len = RH_TDMA_BEACON_HEADER_LEN;
+    for (i = 0; i < _numSlots; i++)
+    {
+	buf[len++] = _slots[i].owner;
+	buf[len++] = _slots[i].destination;
+    }
+
+    setHeaderFlags(RH_FLAGS_CONTROL);
+    RHDatagram::sendto(buf, len, RH_BROADCAST_ADDRESS);
+    _driver.waitPacketSent();
+    setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_CONTROL);
+    _asleep = false;
+
+    // Drivers that cannot compute the time on air may still have latched when the beacon ended
+    uint32_t txTime = _driver.lastTxTime();
+    if (!_beaconAirtime && txTime && txTime - start < _beaconSlotLength)
+	_beaconAirtime = txTime - start;
+}
+
+void RHTdma::handleBeacon()
+{
+    uint8_t buf[RH_TDMA_BEACON_HEADER_LEN + 2 * RH_TDMA_MAX_SLOTS];
+    uint8_t len = sizeof(buf);
+    RHGenericDriver::RxMetadata metadata;
+    if (!_driver.recv(buf, &len, &metadata) || _coordinator)
+	return; // Another coordinator? Ignore it
+    // When did it end?
+    uint32_t rxTime = (metadata.valid & RH_RX_METADATA_TIMESTAMP) ? metadata.timestamp : micros();
+
+    if (len < RH_TDMA_BEACON_HEADER_LEN || buf[0] != RH_CONTROL_TDMA_BEACON)
+	return; // Some other manager's control message
+    uint8_t numSlots = buf[1];
+    if (numSlots == 0 || numSlots > RH_TDMA_MAX_SLOTS || len < RH_TDMA_BEACON_HEADER_LEN + 2 * numSlots)
+	return;
+    uint32_t beaconSlotLength = getUint32(buf + 4);
+    uint32_t slotLength = getUint32(buf + 8);
+    if (!beaconSlotLength || !slotLength)
+	return;
+
+    _numSlots = numSlots;
+    _sequence = buf[2];
+    _maxMessageLen = buf[3];
+    _beaconSlotLength = beaconSlotLength;
+    _slotLength = slotLength;
+    _guardTime = getUint32(buf + 12);
+    _beaconAirtime = getUint32(buf + 16);
+    uint32_t delay = getUint32(buf + 20);
+    // The beacon started delay after the coordinator frame start, and lasted _beaconAirtime
+    _frameStart = rxTime - _beaconAirtime - delay;
+    _timeOffset = getUint32(buf + 24) - _frameStart;
+    _lastBeacon = _frameStart;
+    uint8_t i;
+    for (i = 0; i < numSlots; i++)
+    {
+	_slots[i].owner = buf[RH_TDMA_BEACON_HEADER_LEN + 2 * i];
+	_slots[i].destination = buf[RH_TDMA_BEACON_HEADER_LEN + 2 * i + 1];
+    }
+    _synchronised = true;
+}
+
+bool RHTdma::listenAt(uint32_t offset)
+{
+    if (!_synchronised)
+	return true; // Listen for a beacon
+    // Wake early for the next slot, and stay awake for the end of the last one
+    uint32_t halfGuard = _guardTime / 2;
+    return receivesAt(offset + halfGuard) || (offset >= halfGuard && receivesAt(offset - halfGuard));
+}
+
+bool RHTdma::receivesAt(uint32_t offset)
+{
+    // In the beacon slot, the coordinator sends and all the others receive
+    if (offset < _beaconSlotLength || offset >= frameLength())
+	return !_coordinator;
+    uint32_t slot = (offset - _beaconSlotLength) / _slotLength;
+    if (slot >= _numSlots)
+	return false;
+    uint8_t owner = _slots[slot].owner;
+    uint8_t destination = _slots[slot].destination;
+    return    owner != _thisAddress
+	   && owner != RH_BROADCAST_ADDRESS
+	   && (destination == _thisAddress || destination == RH_BROADCAST_ADDRESS);
+}
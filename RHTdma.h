@@ -0,0 +1,263 @@
+// RHTdma.h
+//
+// Copyright (C) 2017 Mike McCauley
+
+#ifndef RHTdma_h
+#define RHTdma_h
+
+#include <RHDatagram.h>
+
+// Maximum number of data slots in a frame. Each costs 2 octets of RAM and 2 octets in every beacon.
+// The beacon must also fit in the driver maxMessageLength()
+#ifndef RH_TDMA_MAX_SLOTS
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_TDMA_MAX_SLOTS 8
+ #else
+  #define RH_TDMA_MAX_SLOTS 32
+ #endif
+#endif
+
+// Longest message that can be queued by RHTdma::sendto()
+#ifndef RH_TDMA_MAX_MESSAGE_LEN
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_TDMA_MAX_MESSAGE_LEN 60
+ #else
+  #define RH_TDMA_MAX_MESSAGE_LEN RH_MAX_MESSAGE_LEN
+ #endif
+#endif
+
+// Default guard time in each slot in microseconds, half at each end, to allow for clock drift, beacon
+// timestamping jitter and radio turnaround
+#define RH_TDMA_DEFAULT_GUARD_TIME 5000
+
+// Number of frames without a beacon after which a node stops transmitting and listens
+// continuously for the coordinator
+#define RH_TDMA_MAX_MISSED_BEACONS 3
+
+// Length of the fixed part of a beacon, including the control message type
+#define RH_TDMA_BEACON_HEADER_LEN 28
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHTdma RHTdma.h <RHTdma.h>
+/// \brief RHDatagram subclass for collision free, beacon synchronised, time slotted (TDMA) messages
+///
+/// Manager class that extends RHDatagram to share a channel by Time Division Multiple Access.
+/// One node, the coordinator, divides time into frames. Each frame starts with a beacon slot, in
+/// which the coordinator broadcasts a beacon, followed by a number of data slots. Each data slot
+/// belongs to one node (its owner), which is the only node that may transmit in it, and has a
+/// destination, which may be RH_BROADCAST_ADDRESS. The beacon carries the schedule (the owner and
+/// destination of each slot), the slot lengths and a time reference, so the coordinator can change
+/// the schedule at any time, and nodes need no configuration other than their address.
+///
+/// Nodes set their frame timing from the time at which the beacon was received
+/// (see RHGenericDriver::lastRxTime()), less the time the beacon spent on the air. Each node:
+/// - listens in the beacon slot
+/// - listens in data slots that are addressed to it (or broadcast), except its own
+/// - transmits a queued message in the next of its own slots addressed to the destination of the
+/// message (or broadcast)
+/// - puts the radio to sleep (with RHGenericDriver::sleep(), if the driver supports it) at all other times.
+///
+/// Since only one node ever transmits in a slot, there are no collisions, and throughput and latency
+/// are deterministic however many nodes there are. Nodes that have not heard a beacon for
+/// RH_TDMA_MAX_MISSED_BEACONS frames stop transmitting and listen continuously until they hear one again.
+///
+/// \par Slot lengths
+///
+/// Data slots are long enough for a message of the maximum length given to setCoordinator(), as computed by
+/// RHGenericDriver::timeOnAir(), plus a guard time. The beacon slot is sized for the beacon in the same way.
+/// Messages are sent no earlier than half the guard time after the start of a slot, and must end
+/// before the end of the slot. Drivers that cannot compute timeOnAir() (which returns 0) need the slot
+/// length given explicitly, and then messages must start within the first guard time of a slot.
+/// All the nodes must use the same radio configuration.
+///
+/// \par Usage
+///
+/// RHTdma is not interrupt or thread driven: call available() (or recvfrom()) frequently, such as
+/// every time round loop(), and at least several times per slot. These run the schedule: sending beacons,
+/// sending queued messages in the right slots, and turning the radio on and off. sendto() only queues
+/// a message. Do not use the blocking wait functions inherited from RHDatagram, and do not set a CAD
+/// timeout on the driver (RHGenericDriver::setCADTimeout()), since the slots are already collision free.
+///
+/// \code
+/// // Coordinator, address 1, and 3 nodes that each send to it
+/// RHTdma manager(driver, 1);
+/// manager.init();
+/// manager.setCoordinator(3, 20);
+/// manager.assignSlot(0, 2, 1);
+/// manager.assignSlot(1, 3, 1);
+/// manager.assignSlot(2, 4, 1);
+/// ...
+/// void loop()
+/// {
+///   if (manager.recvfrom(buf, &len, &from))
+///   ...
+/// }
+/// \endcode
+///
+/// The simulator sketch examples/simulator/simulator_tdma runs a coordinator and 3 nodes that
+/// send to it in their slots, while it broadcasts in its own.
+///
+/// \par Headers
+///
+/// Beacons are broadcast with the RH_FLAGS_CONTROL bit set in the FLAGS header. They are handled
+/// by RHTdma and never returned by recvfrom(), nor are other manager control messages. The beacon contains:
+/// - control message type RH_CONTROL_TDMA_BEACON (1 octet)
+/// - number of data slots (1 octet)
+/// - sequence number (1 octet)
+/// - maximum message length (1 octet)
+/// - beacon slot length, data slot length, guard time, beacon time on air, delay from the start of the frame to
+/// the start of the beacon, and the coordinator micros() at the start of the frame, in microseconds
+/// (4 octets each, least significant first)
+/// - owner and destination of each data slot (2 octets each)
+class RHTdma : public RHDatagram
+{
+public:
+    /// Constructor.
+    /// \param[in] driver The RadioHead driver to use to transport messages.
+    /// \param[in] thisAddress The address to assign to this node. Defaults to 0
+    RHTdma(RHGenericDriver& driver, uint8_t thisAddress = 0);
+
+    /// Makes this node the coordinator, which sends the beacons, with a new, empty schedule.
+    /// Use assignSlot() to give the slots to nodes.
+    /// \param[in] numSlots Number of data slots in each frame, up to RH_TDMA_MAX_SLOTS, and few enough
+    /// for the beacon to fit in the driver maxMessageLength()
+    /// \param[in] maxMessageLen Longest message that may be sent in a data slot
+    /// \param[in] guardTime Time in microseconds added to each slot, half at each end, for clock drift
+    /// and turnaround
+    /// \param[in] slotLength If not 0, the length of each data slot (and the beacon slot) in microseconds,
+    /// instead of computing it with RHGenericDriver::timeOnAir()
+    /// \return true if the schedule is possible with this driver
+    bool setCoordinator(uint8_t numSlots, uint8_t maxMessageLen, uint32_t guardTime = RH_TDMA_DEFAULT_GUARD_TIME, uint32_t slotLength = 0);
+
+    /// Assigns a data slot. Only meaningful on the coordinator. The change goes out with the next beacon.
+    /// \param[in] slot The data slot number, from 0 to numSlots-1
+    /// \param[in] owner Address of the node that may transmit in the slot. RH_BROADCAST_ADDRESS leaves the
+    /// slot unused
+    /// \param[in] destination Address of the node(s) that listen in the slot. Messages to other nodes
+    /// cannot be sent in it
+    /// \return true if slot is valid
+    bool assignSlot(uint8_t slot, uint8_t owner, uint8_t destination = RH_BROADCAST_ADDRESS);
+
+    /// Queues a message to be sent in the next suitable slot owned by this node.
+    /// Only one message can be queued at a time.
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send, up to RH_TDMA_MAX_MESSAGE_LEN and the maximum message length
+    /// in the schedule (if known yet). Messages that do not fit in any slot are never sent.
+    /// \param[in] address The address to send the message to
+    /// \return true if the message was queued. false if it is too long, or another message is still queued
+    bool sendto(uint8_t* buf, uint8_t len, uint8_t address);
+
+    /// Runs the schedule, and tests whether a new message is available. Beacons are handled here.
+    /// The radio is only turned on in slots where this node listens.
+    /// \return true if a new message is available to be retrieved by recvfrom()
+    bool available();
+
+    /// Runs the schedule, and if there is a valid message available for this node, copies it to buf
+    /// and returns true. Arguments are as for RHDatagram::recvfrom().
+    /// \return true if a valid message was copied to buf
+    bool recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL, RHGenericDriver::RxMetadata* metadata = NULL);
+
+    /// Runs the schedule without receiving anything: sends the beacon or the queued message when it is
+    /// time, and turns the radio on or off. Called by available().
+    void poll();
+
+    /// Tests whether a message queued by sendto() is still waiting for its slot
+    /// \return true if a message is queued
+    bool txPending();
+
+    /// Tests whether this node is following the schedule of a coordinator. The coordinator is
+    /// always synchronised once it has sent its first beacon.
+    /// \return true if synchronised
+    bool synchronised();
+
+    /// Returns the length of a frame: the beacon slot and all the data slots
+    /// \return Frame length in microseconds, or 0 if not synchronised
+    uint32_t frameLength();
+
+    /// Returns the time of the coordinator, as found from the time reference in the last beacon.
+    /// On the coordinator this is micros()
+    /// \return Coordinator micros()
+    uint32_t networkTime();
+
+protected:
+    /// Builds and broadcasts a beacon for the frame starting at _frameStart
+    void sendBeacon();
+
+    /// Collects a beacon from the driver and follows its schedule
+    void handleBeacon();
+
+    /// Decides whether to have the receiver on at a point in the frame, allowing for the guard time
+    /// \param[in] offset Time since the start of the frame in microseconds
+    /// \return true if this node listens then
+    bool listenAt(uint32_t offset);
+
+    /// Decides whether the schedule has this node receiving at a point in the frame
+    /// \param[in] offset Time since the start of the frame in microseconds, which may be up to half
+    /// a guard time into the next frame
+    /// \return true if this node receives then
+    bool receivesAt(uint32_t offset);
+
+private:
+    /// Owner and destination of a data slot
+    typedef struct
+    {
+	uint8_t         owner;       ///< Address of the node that may transmit
+	uint8_t         destination; ///< Address of the node(s) that listen
+    } Slot;
+
+    /// True if this node is the coordinator
+    bool                _coordinator;
+
+    /// True if we know the frame timing
+    bool                _synchronised;
+
+    /// True if the radio should be on now
+    bool                _listening;
+
+    /// True if we have put the radio to sleep
+    bool                _asleep;
+
+    /// Beacon sequence number
+    uint8_t             _sequence;
+
+    /// Number of data slots in the schedule
+    uint8_t             _numSlots;
+
+    /// Longest message that may be sent in a data slot
+    uint8_t             _maxMessageLen;
+
+    /// Length of the beacon slot in microseconds
+    uint32_t            _beaconSlotLength;
+
+    /// Length of each data slot in microseconds
+    uint32_t            _slotLength;
+
+    /// Guard time at each end of a slot in microseconds
+    uint32_t            _guardTime;
+
+    /// Time on air of the beacon in microseconds
+    uint32_t            _beaconAirtime;
+
+    /// micros() at the start of the current frame
+    uint32_t            _frameStart;
+
+    /// micros() at the start of the frame of the last beacon we heard
+    uint32_t            _lastBeacon;
+
+    /// Coordinator time less our micros()
+    uint32_t            _timeOffset;
+
+    /// The schedule
+    Slot                _slots[RH_TDMA_MAX_SLOTS];
+
+    /// Destination of the queued message
+    uint8_t             _txTo;
+
+    /// Length of the queued message, 0 if none
+    uint8_t             _txLen;
+
+    /// The queued message
+    uint8_t             _txBuf[RH_TDMA_MAX_MESSAGE_LEN];
+};
+
+#endif
@@ -0,0 +1,238 @@
+// RHTimeSync.cpp
+//
+// Copyright (C) 2017 Mike McCauley
+
+#include <RHTimeSync.h>
+
+// Sync times are sent least significant octet first on every platform
+static void putUint32(uint8_t* p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static uint32_t getUint32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+////////////////////////////////////////////////////////////////////
+// Constructors
+RHTimeSync::RHTimeSync(RHGenericDriver& driver, uint8_t thisAddress)
+    : RHDatagram(driver, thisAddress)
+{
+    _numEntries = 0;
+    _nextEntry = 0;
+    _errors = 0;
+    _rootAddress = RH_BROADCAST_ADDRESS;
+    _sequence = 0;
+    _period = RH_TIMESYNC_DEFAULT_PERIOD;
+    _lastSend = 0;
+    _lastHeard = 0;
+    _txLatency = 0;
+    _localAverage = 0;
+    _offsetAverage = 0;
+    _skew = 0.0;
+}
+
+////////////////////////////////////////////////////////////////////
+// Public methods
+void RHTimeSync::setSyncPeriod(uint16_t period)
+{
+    _period = period;
+}
+
+void RHTimeSync::setRoot()
+{
+    // Keep the current estimate, so the global time carries on smoothly
+    _rootAddress = _thisAddress;
+    _lastHeard = millis();
+}
+
+bool RHTimeSync::available()
+{
+    poll();
+    while (_driver.available())
+    {
+	if (!(_driver.headerFlags() & RH_FLAGS_CONTROL))
+	    return true;
+	handleSync();
+    }
+    return false;
+}
+
+bool RHTimeSync::recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags, RHGenericDriver::RxMetadata* metadata)
+{
+    if (!available())
+	return false;
+    return RHDatagram::recvfrom(buf, len, from, to, id, flags, metadata);
+}
+
+void RHTimeSync::poll()
+{
+    unsigned long now = millis();
+    if (_rootAddress != _thisAddress && now - _lastHeard > (unsigned long)RH_TIMESYNC_ROOT_TIMEOUT * _period)
+	setRoot(); // Nobody else is doing it
+    if (synchronised() && now - _lastSend >= _period)
+	sendSync();
+}
+
+uint32_t RHTimeSync::globalMicros()
+{
+    return localToGlobal(micros());
+}
+
+uint32_t RHTimeSync::localToGlobal(uint32_t local)
+{
+    return local + _offsetAverage + (int32_t)(_skew * (int32_t)(local - _localAverage));
+}
+
+uint32_t RHTimeSync::globalToLocal(uint32_t global)
+{
+    // Solve global = local + _offsetAverage + _skew * (local - _localAverage) for local
+    return _localAverage + (int32_t)((int32_t)(global - _offsetAverage - _localAverage) / (1.0 + _skew));
+}
+
+bool RHTimeSync::synchronised()
+{
+    return _rootAddress == _thisAddress || _numEntries >= RH_TIMESYNC_MIN_ENTRIES;
+}
+
+uint8_t RHTimeSync::rootAddress()
+{
+    return _rootAddress;
+}
+
+float RHTimeSync::skew()
+{
+    return _skew;
+}
+
+////////////////////////////////////////////////////////////////////
+// Protected methods
+void RHTimeSync::sendSync()
+{
+    // Do any channel access backoff now, rather than between the stamp and the transmission
+    _driver.waitCAD();
+
+    if (_rootAddress == _thisAddress)
+	_sequence++;
+    uint8_t buf[RH_TIMESYNC_MESSAGE_LEN];
+    buf[0] = RH_CONTROL_TIMESYNC;
+    buf[1] = _rootAddress;
+    buf[2] = _sequence;
+    uint32_t start = micros();
+    putUint32(buf + 3, localToGlobal(start + _txLatency));
+
+    setHeaderFlags(RH_FLAGS_CONTROL);
+    bool sent = RHDatagram::sendto(buf, sizeof(buf), RH_BROADCAST_ADDRESS);
+    _driver.waitPacketSent();
+    setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_CONTROL);
+
+    // Jitter the period a little so neighbours do not stay in step
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) // use standard library random(), bugs in random(min, max)
+    _lastSend = millis() - (random() % (_period / 8 + 1));
+#else
+    _lastSend = millis() - random(0, _period / 8 + 1);
+#endif
+    if (_rootAddress == _thisAddress)
+	_lastHeard = millis();
+
+    // Measure how long it took to start transmitting, for the next stamp
+    uint32_t txTime = _driver.lastTxTime();
+    uint32_t airtime = _driver.timeOnAir(sizeof(buf));
+    if (sent && txTime && txTime - start < 1000000 && txTime - start >= airtime)
+    {
+	uint32_t latency = txTime - start - airtime;
+	_txLatency = _txLatency ? (3 * _txLatency + latency) / 4 : latency;
+    }
+}
+
+void RHTimeSync::handleSync()
+{
+    uint8_t buf[RH_TIMESYNC_MESSAGE_LEN];
+    uint8_t len = sizeof(buf);
+    RHGenericDriver::RxMetadata metadata;
+    if (!_driver.recv(buf, &len, &metadata) || len < RH_TIMESYNC_MESSAGE_LEN || buf[0] != RH_CONTROL_TIMESYNC)
+	return; // Not a sync, some other manager's control message
+    // When did it start?
+    uint32_t rxTime = (metadata.valid & RH_RX_METADATA_TIMESTAMP) ? metadata.timestamp : micros();
+    rxTime -= _driver.timeOnAir(len);
+
+    uint8_t root = buf[1];
+    uint8_t sequence = buf[2];
+    if (root == RH_BROADCAST_ADDRESS || root > _rootAddress)
+	return; // We know a better root
+    if (root == _rootAddress)
+    {
+	// Only learn from the first copy of each new sync flooded from our root
+	if (root == _thisAddress || (int8_t)(sequence - _sequence) <= 0)
+	    return;
+    }
+    else
+    {
+	// A new root with a lower address: follow it instead
+	_rootAddress = root;
+	clearTable();
+    }
+    _sequence = sequence;
+    _lastHeard = millis();
+    addEntry(rxTime, getUint32(buf + 3));
+}
+
+void RHTimeSync::addEntry(uint32_t local, uint32_t global)
+{
+    uint32_t offset = global - local;
+    if (synchronised())
+    {
+	int32_t error = global - localToGlobal(local);
+	if (error > RH_TIMESYNC_MAX_ERROR || error < -RH_TIMESYNC_MAX_ERROR)
+	{
+	    if (++_errors <= RH_TIMESYNC_MAX_OUTLIERS)
+		return; // Drop it
+	    clearTable(); // Our estimate must be wrong
+	}
+    }
+    _errors = 0;
+    _table[_nextEntry].local = local;
+    _table[_nextEntry].offset = offset;
+    _nextEntry = (_nextEntry + 1) % RH_TIMESYNC_TABLE_SIZE;
+    if (_numEntries < RH_TIMESYNC_TABLE_SIZE)
+	_numEntries++;
+
+    // Linear regression of offset against local time. Work relative to the newest entry
+    // to keep the numbers small
+    float localMean = 0.0;
+    float offsetMean = 0.0;
+    uint8_t i;
+    for (i = 0; i < _numEntries; i++)
+    {
+	localMean += (int32_t)(_table[i].local - local);
+	offsetMean += (int32_t)(_table[i].offset - offset);
+    }
+    localMean /= _numEntries;
+    offsetMean /= _numEntries;
+    _localAverage = local + (int32_t)localMean;
+    _offsetAverage = offset + (int32_t)offsetMean;
+
+    float num = 0.0;
+    float den = 0.0;
+    for (i = 0; i < _numEntries; i++)
+    {
+	float dl = (int32_t)(_table[i].local - _localAverage);
+	float doff = (int32_t)(_table[i].offset - _offsetAverage);
+	num += dl * doff;
+	den += dl * dl;
+    }
+    _skew = den > 0.0 ? num / den : 0.0;
+}
+
+void RHTimeSync::clearTable()
+{
+    // Keep the old estimate until the first new entry replaces it
+    _numEntries = 0;
+    _nextEntry = 0;
+    _errors = 0;
+}
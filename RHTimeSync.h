@@ -0,0 +1,225 @@
+// RHTimeSync.h
+//
+// Copyright (C) 2017 Mike McCauley
+
+#ifndef RHTimeSync_h
+#define RHTimeSync_h
+
+#include <RHDatagram.h>
+
+// Number of sync points kept for the clock skew regression. Each costs 8 octets of RAM
+#ifndef RH_TIMESYNC_TABLE_SIZE
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_TIMESYNC_TABLE_SIZE 4
+ #else
+  #define RH_TIMESYNC_TABLE_SIZE 8
+ #endif
+#endif
+
+// Number of sync points needed before a node trusts its estimate of the global time,
+// and forwards it to others
+#define RH_TIMESYNC_MIN_ENTRIES 3
+
+// Default interval between sync messages in milliseconds
+#define RH_TIMESYNC_DEFAULT_PERIOD 10000
+
+// Number of periods without hearing the root after which a node makes itself the root
+#define RH_TIMESYNC_ROOT_TIMEOUT 3
+
+// Largest difference in microseconds between a sync point and our estimate that is accepted
+// as clock drift, once synchronised. Larger differences are dropped
+#define RH_TIMESYNC_MAX_ERROR 10000
+
+// Number of consecutive sync points that may be dropped by RH_TIMESYNC_MAX_ERROR before the estimate
+// is discarded and relearned, such as after the root has been reset
+#define RH_TIMESYNC_MAX_OUTLIERS 3
+
+// Length of a sync message, including the control message type
+#define RH_TIMESYNC_MESSAGE_LEN 7
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHTimeSync RHTimeSync.h <RHTimeSync.h>
+/// \brief RHDatagram subclass that gives all the nodes in a network a common clock
+///
+/// Manager class that extends RHDatagram with a flooding time synchronisation protocol,
+/// similar to the Flooding Time Synchronization Protocol (FTSP) of Maroti et al.
+/// Each node estimates a linear relationship between its own micros() clock and the global time,
+/// which is the clock of one node, the root. globalMicros() then returns the global time on any node,
+/// for scheduling, coordinated sleep or correlating events across nodes.
+///
+/// Every sync period, each synchronised node broadcasts a short sync message with its estimate of the
+/// global time at the moment the message was sent. Nodes that receive it pair that with their own
+/// micros() at the same moment, as latched by the driver when the message arrived (see
+/// RHGenericDriver::lastRxTime()). A linear regression over the last RH_TIMESYNC_TABLE_SIZE such
+/// pairs gives both the offset and the relative rate (skew) of the clocks, so the estimate stays good
+/// between sync messages even when crystals differ by tens of ppm. Nodes forward the time once they have
+/// RH_TIMESYNC_MIN_ENTRIES sync points, so it floods across multi-hop networks.
+///
+/// The root is the node with the lowest address that is heard. Nodes that do not hear any sync
+/// messages from the root for RH_TIMESYNC_ROOT_TIMEOUT periods make themselves the root, continuing from
+/// their current estimate, so the network recovers if the root disappears. You can force a node to be the
+/// root with setRoot().
+///
+/// \par Timestamps
+///
+/// Sync messages are stamped with the global time at which the transmission starts. The delay between
+/// calling send() and the start of transmission is measured on each send from
+/// RHGenericDriver::lastTxTime() and RHGenericDriver::timeOnAir(), and added to the next stamp.
+/// The receiver takes the arrival time less the time on air. Drivers that cannot compute timeOnAir()
+/// use the end of the message at both ends instead. Drivers that do not latch RX and TX times
+/// (lastRxTime() is 0) fall back to micros() when the message is polled, which is much less accurate:
+/// call available() frequently. The accuracy is best with drivers that latch the times in their interrupt
+/// handler, such as RH_RF95, RH_RF69 and RH_RF22.
+///
+/// \par Usage
+///
+/// RHTimeSync is not interrupt or thread driven: call available() (or recvfrom()) frequently,
+/// such as every time round loop(). It sends the sync messages when they are due, and consumes the
+/// sync messages it receives. Other messages are sent and received as with RHDatagram.
+///
+/// \code
+/// RHTimeSync manager(driver, MY_ADDRESS);
+/// manager.init();
+/// ...
+/// void loop()
+/// {
+///   if (manager.recvfrom(buf, &len, &from))
+///   ...
+///   if (manager.synchronised())
+///     uint32_t now = manager.globalMicros();
+///   ...
+/// }
+/// \endcode
+///
+/// The simulator sketch examples/simulator/simulator_timesync lets you run several nodes with clocks
+/// that are offset and skewed, and watch them converge.
+///
+/// \par Headers
+///
+/// Sync messages are broadcast with the RH_FLAGS_CONTROL bit set in the FLAGS header. They are handled
+/// by RHTimeSync and never returned by recvfrom(), nor are other manager control messages. The sync message contains:
+/// - control message type RH_CONTROL_TIMESYNC (1 octet)
+/// - root address (1 octet)
+/// - sequence number, set by the root and forwarded unchanged (1 octet)
+/// - global time at the start of transmission in microseconds (4 octets, least significant first)
+class RHTimeSync : public RHDatagram
+{
+public:
+    /// Constructor.
+    /// \param[in] driver The RadioHead driver to use to transport messages.
+    /// \param[in] thisAddress The address to assign to this node. Defaults to 0
+    RHTimeSync(RHGenericDriver& driver, uint8_t thisAddress = 0);
+
+    /// Sets how often this node sends sync messages. All the nodes should use the same period.
+    /// Shorter periods track changing clock rates (eg with temperature) more closely, but cost air time.
+    /// \param[in] period Interval between sync messages in milliseconds. Defaults to RH_TIMESYNC_DEFAULT_PERIOD
+    void setSyncPeriod(uint16_t period);
+
+    /// Makes this node the root, whose clock is the global time, until it hears a root with a lower address.
+    /// The global time continues from the current estimate, so it does not jump.
+    void setRoot();
+
+    /// Sends a sync message if one is due, and tests whether a new message is available.
+    /// Sync messages are handled here.
+    /// \return true if a new message is available to be retrieved by recvfrom()
+    bool available();
+
+    /// Sends a sync message if one is due, and if there is a valid message available for this node,
+    /// copies it to buf and returns true. Arguments are as for RHDatagram::recvfrom().
+    /// \return true if a valid message was copied to buf
+    bool recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL, RHGenericDriver::RxMetadata* metadata = NULL);
+
+    /// Sends a sync message if one is due. Called by available().
+    void poll();
+
+    /// Returns the current global time
+    /// \return The global time in microseconds. Wraps around like micros()
+    uint32_t globalMicros();
+
+    /// Converts a local micros() time to global time, such as an RX timestamp
+    /// \param[in] local A time from micros() on this node
+    /// \return The equivalent global time
+    uint32_t localToGlobal(uint32_t local);
+
+    /// Converts a global time to local micros() time, such as to wake up at an agreed global time
+    /// \param[in] global A global time
+    /// \return The equivalent time from micros() on this node
+    uint32_t globalToLocal(uint32_t global);
+
+    /// Tests whether this node knows the global time: it is the root, or it has enough sync points
+    /// \return true if synchronised
+    bool synchronised();
+
+    /// Returns the address of the root, whose clock is the global time
+    /// \return The root address, or RH_BROADCAST_ADDRESS if none has been heard yet
+    uint8_t rootAddress();
+
+    /// Returns the estimated rate of the global clock relative to the micros() clock on this node,
+    /// less 1. Eg 20e-6 means the root clock runs 20ppm faster than ours.
+    /// \return The clock skew
+    float skew();
+
+protected:
+    /// Broadcasts a sync message with our estimate of the global time
+    void sendSync();
+
+    /// Collects a sync message from the driver and learns from it
+    void handleSync();
+
+    /// Adds a sync point to the table and recomputes the regression
+    /// \param[in] local Our micros() at the moment
+    /// \param[in] global The global time at the same moment
+    void addEntry(uint32_t local, uint32_t global);
+
+    /// Forgets all the sync points
+    void clearTable();
+
+private:
+    /// A sync point: our clock and the global clock less ours, at the same moment
+    typedef struct
+    {
+	uint32_t        local;       ///< Our micros()
+	uint32_t        offset;      ///< Global time less local
+    } Entry;
+
+    /// The sync points. _numEntries are in use, the next to be replaced is _nextEntry
+    Entry               _table[RH_TIMESYNC_TABLE_SIZE];
+
+    /// Number of valid entries in _table
+    uint8_t             _numEntries;
+
+    /// Index of the next entry in _table to be replaced
+    uint8_t             _nextEntry;
+
+    /// Consecutive sync points rejected as outliers
+    uint8_t             _errors;
+
+    /// Address of the root node, RH_BROADCAST_ADDRESS if none yet
+    uint8_t             _rootAddress;
+
+    /// Highest sequence number heard from the root (or sent, on the root)
+    uint8_t             _sequence;
+
+    /// Interval between sync messages in ms
+    uint16_t            _period;
+
+    /// millis() when we last sent a sync message
+    unsigned long       _lastSend;
+
+    /// millis() when we last learned something new from the root (or when we last sent, on the root)
+    unsigned long       _lastHeard;
+
+    /// Measured delay from calling send() to the start of transmission in microseconds
+    uint32_t            _txLatency;
+
+    /// Regression: local time at the centre of the sync points
+    uint32_t            _localAverage;
+
+    /// Regression: global time less local time at _localAverage
+    uint32_t            _offsetAverage;
+
+    /// Regression: rate of the global clock relative to ours, less 1
+    float               _skew;
+};
+
+#endif
@@ -572,6 +572,13 @@ uint8_t RH_ASK::maxMessageLength()
     return RH_ASK_MAX_MESSAGE_LEN;
 }
 
+uint32_t RH_ASK::timeOnAir(uint8_t len)
+{
+    // Preamble, then the count octet, headers, message and FCS as 2 symbols per octet, 6 bits per symbol
+    uint32_t bits = (RH_ASK_PREAMBLE_LEN + (len + 3 + RH_ASK_HEADER_LEN) * 2) * 6;
+    return (bits * 1000000) / _speed;
+}
+
 #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) 
  #if defined(RH_PLATFORM_ATTINY)
   #define RH_ASK_TIMER_VECTOR TIM0_COMPA_vect
@@ -274,6 +274,9 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool    recv(uint8_t* buf, uint8_t* len);
 
+    /// Brings in RHGenericDriver::recv(buf, len, metadata), which this recv() would otherwise hide
+    using RHGenericDriver::recv;
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. 
@@ -287,6 +290,12 @@ public:
     /// \return The maximum legal message length
     virtual uint8_t maxMessageLength();
 
+    /// Computes the time on air of a message at the current bit rate. Each octet is sent as 2 6-bit symbols
+    /// after a preamble of RH_ASK_PREAMBLE_LEN symbols
+    /// \param[in] len Length of the message data in octets, as would be passed to send()
+    /// \return Time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// If current mode is Rx or Tx changes it to Idle. If the transmitter or receiver is running, 
     /// disables them.
     void           setModeIdle();
@@ -7,12 +7,6 @@
 
 #include <RH_CC110.h>
 
-// Interrupt vectors for the 3 Arduino interrupt pins
-// Each interrupt can be handled by a different instance of RH_CC110, allowing you to have
-// 2 or more LORAs per Arduino
-RH_CC110* RH_CC110::_deviceForInterrupt[RH_CC110_NUM_INTERRUPTS] = {0, 0, 0};
-uint8_t RH_CC110::_interruptCount = 0; // Index into _deviceForInterrupt for next device
-
 // We need 2 tables of modem configuration registers, since some values change depending on the Xtal frequency
 // These are indexed by the values of ModemConfigChoice
 // Canned modem configurations generated with the TI SmartRF Studio v7 version 2.3.0 on boodgie
@@ -67,11 +61,12 @@ PROGMEM static const uint8_t paPowerValues[] =
 RH_CC110::RH_CC110(uint8_t slaveSelectPin, uint8_t interruptPin, bool is27MHz, RHGenericSPI& spi)
     :
     RHNRFSPIDriver(slaveSelectPin, spi),
+    _rxLen(0),
+    _txBufSentIndex(0),
     _rxBufValid(false),
     _is27MHz(is27MHz)
 {
     _interruptPin = interruptPin;
-    _myInterruptIndex = 0xff; // Not allocated yet
 }
 
 bool RH_CC110::init()
@@ -79,13 +74,6 @@ bool RH_CC110::init()
     if (!RHNRFSPIDriver::init())
 	return false;
 
-    // Determine the interrupt number that corresponds to the interruptPin
-    int interruptNumber = digitalPinToInterrupt(_interruptPin);
-    if (interruptNumber == NOT_AN_INTERRUPT)
-	return false;
-#ifdef RH_ATTACHINTERRUPT_TAKES_PIN_NUMBER
-    interruptNumber = _interruptPin;
-#endif
 
     // Reset the chip
     // Strobe the reset
@@ -101,32 +89,16 @@ bool RH_CC110::init()
     pinMode(_interruptPin, INPUT); 
 
     // Set up interrupt handler
-    // Since there are a limited number of interrupt glue functions isr*() available,
-    // we can only support a limited number of devices simultaneously
-    // ON some devices, notably most Arduinos, the interrupt pin passed in is actuallt the 
+    // On some devices, notably most Arduinos, the interrupt pin passed in is actually the 
     // interrupt number. You have to figure out the interruptnumber-to-interruptpin mapping
-    // yourself based on knwledge of what Arduino board you are running on.
-    if (_myInterruptIndex == 0xff)
-    {
-	// First run, no interrupt allocated yet
-	if (_interruptCount <= RH_CC110_NUM_INTERRUPTS)
-	    _myInterruptIndex = _interruptCount++;
-	else
-	    return false; // Too many devices, not enough interrupt vectors
-    }
-    _deviceForInterrupt[_myInterruptIndex] = this;
-    if (_myInterruptIndex == 0)
-	attachInterrupt(interruptNumber, isr0, RISING);
-    else if (_myInterruptIndex == 1)
-	attachInterrupt(interruptNumber, isr1, RISING);
-    else if (_myInterruptIndex == 2)
-	attachInterrupt(interruptNumber, isr2, RISING);
-    else
-	return false; // Too many devices, not enough interrupt vectors
-
-    spiWriteRegister(RH_CC110_REG_02_IOCFG0, RH_CC110_GDO_CFG_CRC_OK_AUTORESET);  // gdo0 interrupt on CRC_OK
-    spiWriteRegister(RH_CC110_REG_06_PKTLEN, RH_CC110_MAX_PAYLOAD_LEN); // max packet length
-    spiWriteRegister(RH_CC110_REG_07_PKTCTRL1, RH_CC110_CRC_AUTOFLUSH); // no append status, crc autoflush, no addr check
+    // yourself based on knowledge of what Arduino board you are running on.
+    if (!attachInterruptHandler(_interruptPin, RISING))
+	return false; // Not an interrupt pin, or too many devices
+
+    spiWriteRegister(RH_CC110_REG_02_IOCFG0, RH_CC110_GDO_CFG_RX_FIFO_THR);  // gdo0 interrupt on RX FIFO threshold
+    spiWriteRegister(RH_CC110_REG_06_PKTLEN, sizeof(_buf)); // max packet length
+    // Append status, no addr check. No crc autoflush, since we may already have read part of the packet
+    spiWriteRegister(RH_CC110_REG_07_PKTCTRL1, RH_CC110_APPEND_STATUS);
     spiWriteRegister(RH_CC110_REG_08_PKTCTRL0, RH_CC110_PKT_FORMAT_NORMAL | RH_CC110_CRC_EN | RH_CC110_LENGTH_CONFIG_VARIABLE);
     spiWriteRegister(RH_CC110_REG_13_MDMCFG1, RH_CC110_NUM_PREAMBLE_4); // 4 preamble bytes, chan spacing not used
     spiWriteRegister(RH_CC110_REG_17_MCSM1, RH_CC110_CCA_MODE_RSSI_PACKET | RH_CC110_RXOFF_MODE_RX | RH_CC110_TXOFF_MODE_IDLE);
@@ -139,6 +111,10 @@ bool RH_CC110::init()
     // Set some reasonable default values
     uint8_t syncWords[] = { 0xd3, 0x91 };
     setSyncWords(syncWords, sizeof(syncWords));
+    // Approximate currents from the CC110L datasheet. setTxPower() sets the transmit current
+    setModeCurrent(RHModeSleep, 0.0002);
+    setModeCurrent(RHModeIdle, 1.7);
+    setModeCurrent(RHModeRx, 16.0);
     setTxPower(TransmitPower5dBm);
     setFrequency(915.0);
     setModemConfig(GFSK_Rb1_2Fd5_2);
@@ -151,49 +127,174 @@ void RH_CC110::setIs27MHz(bool is27MHz)
 }
 
 // C++ level interrupt handler for this instance
-// We use this to get RxDone and TxDone interrupts
+// We use this to get RX and TX FIFO threshold interrupts, and the end of packet interrupt after
+// the last of a transmitted packet has been loaded into the TX FIFO
 void RH_CC110::handleInterrupt()
 {
 //    Serial.println("I");
     if (_mode == RHModeRx)
+	readNextFragment();
+    else if (_mode == RHModeTx)
+    {
+	if (_txBufSentIndex < _bufLen)
+	    sendNextFragment();
+	else
+	    _txTime = micros(); // End of packet. waitPacketSent() will notice the radio has gone idle
+    }
+}
+
+uint8_t RH_CC110::spiReadFifoBytes(uint8_t reg)
+{
+    uint8_t val = spiBurstReadRegister(reg);
+    uint8_t last;
+    do
+    {
+	last = val;
+	val = spiBurstReadRegister(reg);
+    } while (val != last);
+    return val;
+}
+
+void RH_CC110::sendNextFragment()
+{
+    if (_txBufSentIndex < _bufLen)
     {
-	// Radio is confgigured to stay in RX until we move it to IDLE after a CRC_OK message for us
-	// We only get interrupts in RX mode, on CRC_OK
-	// CRC OK
-	_lastRssi = spiBurstReadRegister(RH_CC110_REG_34_RSSI); // Was set when sync word was detected
-	_bufLen = spiReadRegister(RH_CC110_REG_3F_FIFO);
-	if (_bufLen < 4)
+	// Some left to send?
+	uint8_t len = _bufLen - _txBufSentIndex;
+	// But dont send more than there is room for
+	uint8_t space = RH_CC110_FIFO_SIZE - (spiReadFifoBytes(RH_CC110_REG_3A_TXBYTES) & RH_CC110_NUM_TXBYTES);
+	if (len > space)
+	    len = space;
+	spiBurstWriteRegister(RH_CC110_REG_3F_FIFO, _buf + _txBufSentIndex, len);
+	_txBufSentIndex += len;
+	if (_txBufSentIndex >= _bufLen)
+	    // All loaded. Now interrupt when the sync word signal deasserts at the end of the packet
+	    spiWriteRegister(RH_CC110_REG_02_IOCFG0, RH_CC110_GDO_CFG_SYNC | RH_CC110_GDO_INV);
+    }
+}
+
+// Radio is configured to stay in RX until we move it to IDLE after a good message for us.
+// The CC110L errata says the RX FIFO must not be emptied before the last octet of the packet
+// has been received, so we always leave at least one octet behind until then. The RX FIFO threshold
+// is then chosen so that the next interrupt comes exactly when the last octet of the packet 
+// (including the 2 appended status octets) arrives, or, for a long packet, when the FIFO is half full
+void RH_CC110::readNextFragment()
+{
+    while (1)
+    {
+	uint8_t avail = spiReadFifoBytes(RH_CC110_REG_3B_RXBYTES);
+	if (avail & RH_CC110_RXFIFO_UNDERFLOW) // The RXFIFO_OVERFLOW bit in the data sheet
 	{
-	    // Something wrong there, flush the FIFO
-	    spiCommand(RH_CC110_STROBE_3A_SFRX);
-	    clearRxBuf();
+	    // We did not keep up
+	    _rxBad++;
+	    restartRx();
+	    return;
+	}
+	// If the interrupt line is shared, the interrupt may have been for some other radio
+	if (avail == 0)
 	    return;
+
+	if (_rxLen == 0)
+	{
+	    // Start of a new packet
+	    _rxLen = spiReadRegister(RH_CC110_REG_3F_FIFO);
+	    avail--;
+	    _bufLen = 0;
+	    if (   _rxLen < RH_CC110_HEADER_LEN
+#if (RH_CC110_MAX_MESSAGE_LEN + RH_CC110_HEADER_LEN) < 255
+		|| _rxLen > RH_CC110_MAX_MESSAGE_LEN + RH_CC110_HEADER_LEN
+#endif
+		)
+	    {
+		// Something wrong there, flush the FIFO
+		_rxBad++;
+		restartRx();
+		return;
+	    }
+	}
+
+	// Octets of this packet still to be read from the FIFO, including the 2 appended status octets
+	uint16_t remaining = _rxLen - _bufLen + 2;
+	if (avail >= remaining)
+	{
+	    // The whole packet has arrived
+	    uint32_t now = micros();
+	    uint8_t status[2];
+	    spiBurstRead(RH_CC110_REG_3F_FIFO | RH_CC110_SPI_BURST_MASK | RH_CC110_SPI_READ_MASK, _buf + _bufLen, _rxLen - _bufLen);
+	    spiBurstRead(RH_CC110_REG_3F_FIFO | RH_CC110_SPI_BURST_MASK | RH_CC110_SPI_READ_MASK, status, sizeof(status));
+	    _bufLen = _rxLen;
+	    _rxLen = 0;
+	    setRxFifoThreshold(4);
+	    if (status[1] & RH_CC110_APPENDED_CRC_OK)
+	    {
+		_lastRssi = status[0]; // RSSI when the sync word was detected
+		_rxTime = now;
+		// All good so far. See if its for us
+		validateRxBuf(); 
+		if (_rxBufValid)
+		{
+		    setModeIdle(); // Done
+		    return;
+		}
+	    }
+	    else
+		_rxBad++;
+	    if (_lplInterval)
+	    {
+		// The radio is idle after the packet: go back to sleeping between wakeups
+		restartRx();
+		return;
+	    }
+	    _bufLen = 0;
+	    continue; // The next packet may already be arriving
+	}
+
+	// Choose how many octets to leave in the FIFO so that the number of octets left plus those still 
+	// to come is a multiple of 4, which is the granularity of the RX FIFO threshold
+	uint16_t toCome = remaining - avail;
+	uint8_t keep = 4 - (toCome & 3);
+	uint8_t threshold;
+	if (keep + toCome > RH_CC110_FIFO_SIZE)
+	{
+	    // Rest of the packet will not fit in the FIFO
+	    keep = 1;
+	    threshold = RH_CC110_RX_FIFO_STREAM_THRESHOLD;
+	}
+	else if (keep > avail)
+	{
+	    // Only just started, come back when some more has arrived
+	    keep = avail;
+	    threshold = 4;
 	}
-	spiBurstRead(RH_CC110_REG_3F_FIFO | RH_CC110_SPI_BURST_MASK | RH_CC110_SPI_READ_MASK, _buf, _bufLen);
-	// All good so far. See if its for us
-	validateRxBuf(); 
-	if (_rxBufValid)
-	    setModeIdle(); // Done
+	else
+	    threshold = keep + toCome;
+
+	if (avail > keep)
+	{
+	    spiBurstRead(RH_CC110_REG_3F_FIFO | RH_CC110_SPI_BURST_MASK | RH_CC110_SPI_READ_MASK, _buf + _bufLen, avail - keep);
+	    _bufLen += avail - keep;
+	}
+	setRxFifoThreshold(threshold);
+	// More may have arrived while we were reading, in which case the threshold may already have been passed
+	if ((spiReadFifoBytes(RH_CC110_REG_3B_RXBYTES) & RH_CC110_NUM_RXBYTES) < threshold)
+	    return;
     }
 }
 
-// These are low level functions that call the interrupt handler for the correct
-// instance of RH_CC110.
-// 3 interrupts allows us to have 3 different devices
-void RH_CC110::isr0()
-{
-    if (_deviceForInterrupt[0])
-	_deviceForInterrupt[0]->handleInterrupt();
-}
-void RH_CC110::isr1()
+void RH_CC110::setRxFifoThreshold(uint8_t octets)
 {
-    if (_deviceForInterrupt[1])
-	_deviceForInterrupt[1]->handleInterrupt();
+    // RX FIFO threshold is 4 * (FIFO_THR + 1) octets
+    spiWriteRegister(RH_CC110_REG_03_FIFOTHR, ((octets / 4) - 1) & RH_CC110_FIFO_THR);
 }
-void RH_CC110::isr2()
+
+void RH_CC110::restartRx()
 {
-    if (_deviceForInterrupt[2])
-	_deviceForInterrupt[2]->handleInterrupt();
+    spiCommand(RH_CC110_STROBE_36_SIDLE);
+    spiCommand(RH_CC110_STROBE_3A_SFRX);
+    _rxLen = 0;
+    _bufLen = 0;
+    setRxFifoThreshold(4);
+    spiCommand(_lplInterval ? RH_CC110_STROBE_38_SWOR : RH_CC110_STROBE_34_SRX);
 }
 
 uint8_t RH_CC110::spiReadRegister(uint8_t reg)
@@ -301,15 +402,41 @@ bool RH_CC110::send(const uint8_t* data, uint8_t len)
     waitPacketSent(); // Make sure we dont interrupt an outgoing message
     setModeIdle();
 
+    if (!waitDutyCycle(len))
+	return false; // Over the duty cycle budget for this band
+
     if (!waitCAD()) 
 	return false;  // Check channel activity
 
-    spiWriteRegister(RH_CC110_REG_3F_FIFO, len + RH_CC110_HEADER_LEN);
-    spiWriteRegister(RH_CC110_REG_3F_FIFO,_txHeaderTo);
-    spiWriteRegister(RH_CC110_REG_3F_FIFO,_txHeaderFrom);
-    spiWriteRegister(RH_CC110_REG_3F_FIFO,_txHeaderId);
-    spiWriteRegister(RH_CC110_REG_3F_FIFO,_txHeaderFlags);
-    spiBurstWriteRegister(RH_CC110_REG_3F_FIFO, data, len);
+    // The whole message is kept in _buf, so the interrupt handler can top up the TX FIFO
+    // as it drains. This discards any unread received message
+    ATOMIC_BLOCK_START;
+    _rxBufValid = false;
+    _buf[0] = _txHeaderTo;
+    _buf[1] = _txHeaderFrom;
+    _buf[2] = _txHeaderId;
+    _buf[3] = _txHeaderFlags;
+    memcpy(_buf + RH_CC110_HEADER_LEN, data, len);
+    _bufLen = len + RH_CC110_HEADER_LEN;
+    _txBufSentIndex = 0;
+    ATOMIC_BLOCK_END;
+
+    spiCommand(RH_CC110_STROBE_3B_SFTX);
+    // Interrupt when the TX FIFO drains below the threshold, so we can send the rest.
+    // sendNextFragment() changes this once the whole message is in the FIFO
+    spiWriteRegister(RH_CC110_REG_03_FIFOTHR, RH_CC110_TX_FIFO_THR_33);
+    spiWriteRegister(RH_CC110_REG_02_IOCFG0, RH_CC110_GDO_CFG_TX_FIFO_THR | RH_CC110_GDO_INV);
+    if (_wakeupPreamble)
+    {
+	// The transmitter sends preamble for as long as the TX FIFO is empty
+	setModeTx();
+	delay(_wakeupPreamble);
+	spiWriteRegister(RH_CC110_REG_3F_FIFO, _bufLen);
+	sendNextFragment(); // Actually the first fragment
+	return true;
+    }
+    spiWriteRegister(RH_CC110_REG_3F_FIFO, _bufLen);
+    sendNextFragment(); // Actually the first fragment
 
     // Radio returns to Idle when TX is finished
     // need waitPacketSent() to detect change of _mode and TX completion
@@ -323,12 +450,56 @@ uint8_t RH_CC110::maxMessageLength()
     return RH_CC110_MAX_MESSAGE_LEN;
 }
 
+float RH_CC110::bitRate()
+{
+    // R = (256 + DRATE_M) * 2^DRATE_E * fXOSC / 2^28
+    float fxosc = _is27MHz ? 27000000.0 : 26000000.0;
+    uint8_t drate_e = spiReadRegister(RH_CC110_REG_10_MDMCFG4) & RH_CC110_DRATE_E;
+    uint16_t drate_m = spiReadRegister(RH_CC110_REG_11_MDMCFG3);
+    return (256 + drate_m) * (float)(1UL << drate_e) * fxosc / 268435456.0;
+}
+
+uint32_t RH_CC110::timeOnAir(uint8_t len)
+{
+    static const uint8_t preambles[] = { 2, 3, 4, 6, 8, 12, 16, 24 };
+    float bps = bitRate();
+    uint8_t mdmcfg2 = spiReadRegister(RH_CC110_REG_12_MDMCFG2);
+
+    // Preamble + sync words + length octet + headers and message + CRC
+    uint32_t octets = preambles[(spiReadRegister(RH_CC110_REG_13_MDMCFG1) & RH_CC110_NUM_PREAMBLE) >> 4];
+    switch (mdmcfg2 & RH_CC110_SYNC_MODE)
+    {
+    case RH_CC110_SYNC_MODE_NONE:
+    case RH_CC110_SYNC_MODE_NONE_CARRIER:
+	break;
+    case RH_CC110_SYNC_MODE_30_32:
+    case RH_CC110_SYNC_MODE_30_32_CARRIER:
+	octets += 4;
+	break;
+    default:
+	octets += 2;
+	break;
+    }
+    octets += 1 + RH_CC110_HEADER_LEN + len;
+    if (spiReadRegister(RH_CC110_REG_08_PKTCTRL0) & RH_CC110_CRC_EN)
+	octets += 2;
+    // Manchester coding sends 2 chips per bit, and the data rate is in chips
+    if (mdmcfg2 & RH_CC110_MANCHESTER_EN)
+	octets *= 2;
+    return (uint32_t)(octets * 8 * 1000000.0 / bps);
+}
+
+uint32_t RH_CC110::slotTime()
+{
+    return RH_CCA_SETTLE_TIME + (uint32_t)(RH_CSMA_SLOT_BITS * 1000000.0 / bitRate());
+}
+
 void RH_CC110::setModeIdle()
 {
     if (_mode != RHModeIdle)
     {
 	spiCommand(RH_CC110_STROBE_36_SIDLE);
-	_mode = RHModeIdle;
+	setMode(RHModeIdle);
     }
 }
 
@@ -337,19 +508,99 @@ bool RH_CC110::sleep()
     if (_mode != RHModeSleep)
     {
 	spiCommand(RH_CC110_STROBE_39_SPWD);
-	_mode = RHModeSleep;
+	setMode(RHModeSleep);
     }
     return true;
 }
 
+bool RH_CC110::setLowPowerListening(uint16_t interval)
+{
+    setModeIdle();
+    _lplInterval = interval;
+    if (!interval)
+    {
+	spiWriteRegister(RH_CC110_REG_07_PKTCTRL1, RH_CC110_APPEND_STATUS);
+	spiWriteRegister(RH_CC110_REG_16_MCSM2, RH_CC110_RX_TIME_UNTIL_END);
+	spiWriteRegister(RH_CC110_REG_17_MCSM1, RH_CC110_CCA_MODE_RSSI_PACKET | RH_CC110_RXOFF_MODE_RX | RH_CC110_TXOFF_MODE_IDLE);
+	spiWriteRegister(RH_CC110_REG_20_WORCTRL, 0xfb); // from smartrf
+	return true;
+    }
+
+    // WOR event 0 period is 750 / fxosc * EVENT0 * 2^(5 * WOR_RES) (CC1101 datasheet 19.5)
+    uint8_t fxosc = _is27MHz ? 27 : 26;
+    uint32_t event0 = (uint32_t)interval * 1000 * fxosc / 750;
+    uint8_t res = 0;
+    while (event0 > 0xffff && res < 3)
+    {
+	event0 >>= 5;
+	res++;
+    }
+    if (event0 > 0xffff)
+	event0 = 0xffff;
+    // RX timeout is EVENT0 * C(RX_TIME, WOR_RES) * 26 / fxosc us, where C(0, WOR_RES) is 93.75 * (1 + 4 * WOR_RES) / 26
+    // and halves with each step of RX_TIME. Use the shortest that still listens for RH_CC110_LPL_RX_TIME
+    uint32_t timeout = event0 * 375 * (1 + 4 * res) / 4 / fxosc;
+    uint8_t rxTime = 0;
+    while (rxTime < 6 && (timeout >> (rxTime + 1)) >= RH_CC110_LPL_RX_TIME)
+	rxTime++;
+
+    spiWriteRegister(RH_CC110_REG_1E_WOREVT1, event0 >> 8);
+    spiWriteRegister(RH_CC110_REG_1F_WOREVT0, event0 & 0xff);
+    spiWriteRegister(RH_CC110_REG_20_WORCTRL, RH_CC110_EVENT1 | RH_CC110_RC_CAL | res);
+    // Stay in RX past the timeout only if a preamble is detected, and then only until the end of the packet
+    spiWriteRegister(RH_CC110_REG_16_MCSM2, RH_CC110_RX_TIME_RSSI | RH_CC110_RX_TIME_QUAL | rxTime);
+    spiWriteRegister(RH_CC110_REG_07_PKTCTRL1, RH_CC110_PQT_4 | RH_CC110_APPEND_STATUS);
+    spiWriteRegister(RH_CC110_REG_17_MCSM1, RH_CC110_CCA_MODE_RSSI_PACKET | RH_CC110_RXOFF_MODE_IDLE | RH_CC110_TXOFF_MODE_IDLE);
+    return true;
+}
+
+bool RH_CC110::setWakeupPreamble(uint16_t duration)
+{
+    _wakeupPreamble = duration;
+    return true;
+}
+
+bool RH_CC110::readChannelRssi(int8_t* rssi)
+{
+    bool wasRx = (_mode == RHModeRx);
+    if (!wasRx || _lplInterval)
+    {
+	// The receiver must be on continuously, even when low power listening
+	uint16_t interval = _lplInterval;
+	_lplInterval = 0;
+	setModeIdle();
+	setModeRx();
+	_lplInterval = interval;
+	waitMicros(RH_CCA_SETTLE_TIME);
+    }
+    // RSSI is a 2s complement number in units of 0.5dB, with an offset of 74dB (CC110L datasheet 5.18.2)
+    *rssi = (int8_t)spiBurstReadRegister(RH_CC110_REG_34_RSSI) / 2 - 74;
+    if (wasRx && _lplInterval && _mode == RHModeRx)
+    {
+	// Back to sleeping between wakeups
+	setModeIdle();
+	setModeRx();
+    }
+    else if (!wasRx && _mode == RHModeRx)
+	setModeIdle();
+    return true;
+}
+
 void RH_CC110::setModeRx()
 {
     if (_mode != RHModeRx)
     {
 	// Radio is configuewd to stay in RX mode
 	// only receipt of a CRC_OK wil cause us to return it to IDLE
-	spiCommand(RH_CC110_STROBE_34_SRX);
-	_mode = RHModeRx;
+	// Discard anything left in the RX FIFO from before, such as part of a packet we stopped receiving
+	spiCommand(RH_CC110_STROBE_36_SIDLE);
+	spiCommand(RH_CC110_STROBE_3A_SFRX);
+	_rxLen = 0;
+	setRxFifoThreshold(4);
+	spiWriteRegister(RH_CC110_REG_02_IOCFG0, RH_CC110_GDO_CFG_RX_FIFO_THR);
+	// With low power listening, the WOR timer wakes the receiver from sleep
+	spiCommand(_lplInterval ? RH_CC110_STROBE_38_SWOR : RH_CC110_STROBE_34_SRX);
+	setMode(RHModeRx);
     }
 }
 
@@ -358,7 +609,7 @@ void RH_CC110::setModeTx()
     if (_mode != RHModeTx)
     {
 	spiCommand(RH_CC110_STROBE_35_STX);
-	_mode = RHModeTx;
+	setMode(RHModeTx);
     }
 }
 
@@ -375,10 +626,21 @@ bool RH_CC110::waitPacketSent()
 	return false;
 
     // Caution: may transition through CALIBRATE
-    while ((statusRead() & RH_CC110_STATUS_STATE) != RH_CC110_STATUS_IDLE)
+    uint8_t state;
+    while ((state = (statusRead() & RH_CC110_STATUS_STATE)) != RH_CC110_STATUS_IDLE)
+    {
+	if (state == RH_CC110_STATUS_TXFIFO_UNDERFLOW)
+	{
+	    // The TX FIFO was not topped up in time, and the rest of the packet is lost
+	    spiCommand(RH_CC110_STROBE_3B_SFTX);
+	    spiCommand(RH_CC110_STROBE_36_SIDLE);
+	    setMode(RHModeIdle);
+	    return false;
+	}
 	YIELD;
+    }
 
-    _mode = RHModeIdle;
+    setMode(RHModeIdle);
     return true;
 }
 
@@ -391,6 +653,12 @@ bool RH_CC110::setTxPower(TransmitPower power)
     memcpy_P(&patable[0], (void*)&paPowerValues[power], sizeof(uint8_t));
     patable[1] = 0x00;
     setPaTable(patable, sizeof(patable));
+    if (power >= TransmitPower7dBm)
+	setModeCurrent(RHModeTx, 30.0);
+    else if (power >= TransmitPower0dBm)
+	setModeCurrent(RHModeTx, 17.0);
+    else
+	setModeCurrent(RHModeTx, 13.0);
     return true;
 }
 
@@ -411,6 +679,9 @@ bool RH_CC110::setFrequency(float centre)
     spiWriteRegister(RH_CC110_REG_0D_FREQ2, (FREQ >> 16) & 0xff);
     spiWriteRegister(RH_CC110_REG_0E_FREQ1, (FREQ >> 8) & 0xff);
     spiWriteRegister(RH_CC110_REG_0F_FREQ0, FREQ & 0xff);
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    _frequency = centre;
+#endif
 
     // Radio is configured to calibrate automatically whenever it enters RX or TX mode
     // so no need to check for PLL lock here
@@ -16,26 +16,41 @@
 
 #include <RHNRFSPIDriver.h>
 
-// This is the maximum number of interrupts the driver can support
-// Most Arduinos can handle 2, Megas can handle more
-#define RH_CC110_NUM_INTERRUPTS 3
-
 // Max number of octets the FIFO can hold
 #define RH_CC110_FIFO_SIZE 64
 
-// This is the maximum number of bytes that can be carried by the chip
+// This is the maximum number of bytes that can be carried by the chip after the length byte
+// in variable length packet mode. Packets longer than the FIFO are streamed through it.
 // We use some for headers, keeping fewer for RadioHead messages
-#define RH_CC110_MAX_PAYLOAD_LEN RH_CC110_FIFO_SIZE
+#define RH_CC110_MAX_PAYLOAD_LEN 255
 
 // The length of the headers we add.
 // The headers are inside the chip payload
 #define RH_CC110_HEADER_LEN 4
 
 // This is the maximum message length that can be supported by this driver. 
-// Can be pre-defined to a smaller size (to save SRAM) prior to including this header
-// Here we allow for 1 byte message length, 4 bytes headers, user data 
+// Can be pre-defined to a different size prior to including this header
+// Here we allow for 4 bytes headers, user data. The message length byte is not counted by the chip.
+// The message buffer is this long, so on AVRs (short of SRAM) it defaults to what fits in the FIFO
 #ifndef RH_CC110_MAX_MESSAGE_LEN
- #define RH_CC110_MAX_MESSAGE_LEN (RH_CC110_MAX_PAYLOAD_LEN - RH_CC110_HEADER_LEN - 1)
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_CC110_MAX_MESSAGE_LEN (RH_CC110_FIFO_SIZE - RH_CC110_HEADER_LEN - 1)
+ #else
+  #define RH_CC110_MAX_MESSAGE_LEN (RH_CC110_MAX_PAYLOAD_LEN - RH_CC110_HEADER_LEN)
+ #endif
+#endif
+
+// RX FIFO threshold used while streaming the middle of a packet that will not fit in the FIFO
+#define RH_CC110_RX_FIFO_STREAM_THRESHOLD 32
+
+// FIFOTHR value used while transmitting: the TX FIFO threshold is 33 octets, so there is
+// room for at least 31 more octets when the GDO0 interrupt asks for a refill
+#define RH_CC110_TX_FIFO_THR_33 0x07
+
+// Minimum time in microseconds the receiver stays on at each low power listening wakeup to look for a preamble.
+// Increase it for slow data rates, so that it covers a few octets of preamble
+#ifndef RH_CC110_LPL_RX_TIME
+ #define RH_CC110_LPL_RX_TIME 8000
 #endif
 
 #define RH_CC110_SPI_READ_MASK  0x80
@@ -99,6 +114,7 @@
 #define RH_CC110_STROBE_34_SRX                 0x34
 #define RH_CC110_STROBE_35_STX                 0x35
 #define RH_CC110_STROBE_36_SIDLE               0x36
+#define RH_CC110_STROBE_38_SWOR                0x38
 
 #define RH_CC110_STROBE_39_SPWD                0x39
 #define RH_CC110_STROBE_3A_SFRX                0x3a
@@ -148,6 +164,7 @@
 // #define RH_CC110_REG_00_IOCFG2                 0x00
 // #define RH_CC110_REG_01_IOCFG1                 0x01
 // #define RH_CC110_REG_02_IOCFG0                 0x02
+#define RH_CC110_GDO_INV                          0x40
 #define RH_CC110_GDO_CFG_RX_FIFO_THR              0x00
 #define RH_CC110_GDO_CFG_RX_FIFO_FULL             0x01
 #define RH_CC110_GDO_CFG_TX_FIFO_THR              0x02
@@ -202,8 +219,12 @@
 // #define RH_CC110_REG_05_SYNC0                  0x05
 // #define RH_CC110_REG_06_PKTLEN                 0x06
 // #define RH_CC110_REG_07_PKTCTRL1               0x07
+#define RH_CC110_PQT                              0xe0
+#define RH_CC110_PQT_4                            0x20
 #define RH_CC110_CRC_AUTOFLUSH                    0x08
 #define RH_CC110_APPEND_STATUS                    0x04
+// Second appended status octet: CRC OK flag and LQI
+#define RH_CC110_APPENDED_CRC_OK                  0x80
 #define RH_CC110_ADDR_CHK                         0x03
 // can or the next 2:
 #define RH_CC110_ADDR_CHK_ADDRESS                 0x01
@@ -275,6 +296,9 @@
 
 // #define RH_CC110_REG_16_MCSM2                  0x16
 #define RH_CC110_RX_TIME_RSSI                     0x10
+#define RH_CC110_RX_TIME_QUAL                     0x08
+#define RH_CC110_RX_TIME                          0x07
+#define RH_CC110_RX_TIME_UNTIL_END                0x07
 
 // #define RH_CC110_REG_17_MCSM1                  0x17
 #define RH_CC110_CCA_MODE                         0x30
@@ -387,6 +411,10 @@
 // #define RH_CC110_REG_1E_WOREVT1                0x1e
 // #define RH_CC110_REG_1F_WOREVT0                0x1f
 // #define RH_CC110_REG_20_WORCTRL                0x20
+#define RH_CC110_RC_PD                            0x80
+#define RH_CC110_EVENT1                           0x70
+#define RH_CC110_RC_CAL                           0x08
+#define RH_CC110_WOR_RES                          0x03
 // #define RH_CC110_REG_21_FREND1                 0x21
 #define RH_CC110_LNA_CURRENT                      0xc0
 #define RH_CC110_LNA2MIX_CURRENT                  0x30
@@ -485,7 +513,7 @@
 /// - Anaren AIR BoosterPack 430BOOST-CC110L 
 ///
 /// This base class provides basic functions for sending and receiving unaddressed, unreliable datagrams
-/// of arbitrary length to 59 octets per packet at a selected data rate and modulation type. 
+/// of arbitrary length to 251 octets per packet at a selected data rate and modulation type. 
 /// Use one of the Manager classes to get addressing and 
 /// acknowledgement reliability, routing, meshes etc.
 ///
@@ -522,14 +550,31 @@
 ///
 /// - 2 octets sync (a configurable network address)
 /// - 1 octet message length
-/// - 4 to 63 octets of payload consisting of:
+/// - 4 to 255 octets of payload consisting of:
 ///   - 1 octet TO header
 ///   - 1 octet FROM header
 ///   - 1 octet ID header
 ///   - 1 octet FLAGS header
-///   - 0 to 59 octets of user message
+///   - 0 to 251 octets of user message
 /// - 2 octets CRC 
 ///
+/// \par Packets longer than the FIFO
+///
+/// The CC110L has 64 octet TX and RX FIFOs, but in variable length mode a packet can carry up to 255 octets.
+/// Longer packets are streamed through the FIFOs from the GDO0 interrupt, much as RH_RF22 does:
+/// while transmitting, GDO0 signals when the TX FIFO drains below its threshold and the driver tops it up
+/// from the message buffer. While receiving, GDO0 signals the RX FIFO threshold and the driver drains the FIFO,
+/// then moves the threshold so that the next interrupt comes either when more of a long packet has
+/// arrived or exactly when the last octet of the packet has arrived. The chip appends RSSI and CRC status 
+/// octets to each received packet, which the driver uses to check the CRC.
+/// At slow data rates, the interrupt latency of your processor is not critical, but at 250kbps the 31 octets
+/// of TX FIFO headroom last only about 1ms, so long packets need prompt interrupt handling.
+/// Since the message buffer is shared between transmit and receive, send() discards any received message
+/// that has not yet been read by recv().
+/// On AVR, RH_CC110_MAX_MESSAGE_LEN defaults to 59, so that packets fit in the FIFO and the message buffer
+/// does not use up the SRAM. Define it larger before including RH_CC110.h to send longer messages there.
+/// If you need to save SRAM on other platforms, you can define it to something smaller.
+///
 /// \par Connecting CC110L to Arduino
 /// 
 /// Warning: the CC110L is a 3.3V part, and exposing it to 5V on any pin will damage it. Ensure you are using a 3.3V 
@@ -659,8 +704,8 @@ public:
 
     /// Constructor. You can have multiple instances, but each instance must have its own
     /// interrupt and slave select pin. After constructing, you must call init() to initialise the interface
-    /// and the radio module. A maximum of 3 instances can co-exist on one processor, provided there are sufficient
-    /// distinct interrupt lines, one for each instance.
+    /// and the radio module. Up to RH_MAX_INTERRUPT_DEVICES instances (of any RadioHead driver) can co-exist on one processor.
+    /// Each instance needs an interrupt line, but several instances can share one line: see RHGenericDriver.
     /// \param[in] slaveSelectPin the Arduino pin number of the output to use to select the CC110L before
     /// accessing it. Defaults to the normal SS pin for your Arduino (D10 for Diecimila, Uno etc, D53 for Mega, D10 for Maple)
     /// \param[in] interruptPin The interrupt Pin number that is connected to the CC110L GDO0 interrupt line. 
@@ -719,6 +764,9 @@ public:
     /// \return true if a valid message was copied to buf. The message cannot be retreived again.
     virtual bool    recv(uint8_t* buf, uint8_t* len);
 
+    /// Brings in RHGenericDriver::recv(buf, len, metadata), which this recv() would otherwise hide
+    using RHGenericDriver::recv;
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is permitted. 
@@ -732,6 +780,18 @@ public:
     /// \return The maximum legal message length
     virtual uint8_t maxMessageLength();
 
+    /// Computes the time on air of a message from the data rate, Manchester coding, preamble and
+    /// sync word lengths and CRC currently set in the radio.
+    /// \param[in] len Length of the message data in octets, as would be passed to send()
+    /// (the RadioHead headers are added)
+    /// \return Time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
+    /// Returns the CSMA/CA slot time used by csmaPoll(): RH_CCA_SETTLE_TIME for readChannelRssi(),
+    /// plus RH_CSMA_SLOT_BITS at the data rate in RH_CC110_REG_10_MDMCFG4 and RH_CC110_REG_11_MDMCFG3.
+    /// \return The slot time in microseconds
+    virtual uint32_t slotTime();
+
     /// If current mode is Sleep, Rx or Tx changes it to Idle. If the transmitter or receiver is running, 
     /// disables them.
     void           setModeIdle();
@@ -753,6 +813,25 @@ public:
     /// \return true if sleep mode was successfully entered.
     virtual bool    sleep();
 
+    /// Enables or disables low power listening with the Wake On Radio (WOR) timer.
+    /// While in receive mode, the radio then sleeps, and the WOR timer wakes it every interval to listen for
+    /// at least RH_CC110_LPL_RX_TIME. It only stays in RX if it detects a preamble (RH_CC110_PQT_4),
+    /// and returns to sleep after each packet that is not for this node.
+    /// Senders must use setWakeupPreamble() with a duration a little longer than the interval.
+    /// Caution: WOR and the RC oscillator are CC1101 features. They are not documented for the CC110L,
+    /// so this needs a CC1101 or compatible part.
+    /// Caution: the sleeping chip loses the values of registers 0x29 through 0x2e and the PATABLE, as with sleep().
+    /// \param[in] interval Time between wakeups in milliseconds, or 0 to receive continuously
+    /// \return true
+    virtual bool    setLowPowerListening(uint16_t interval);
+
+    /// Sets the length of the preamble sent before every message, for receivers using setLowPowerListening().
+    /// The transmitter is started with an empty TX FIFO, so it sends preamble until the message is written
+    /// to the FIFO after duration.
+    /// \param[in] duration Length of the preamble in milliseconds, or 0 for the normal 4 octets
+    /// \return true
+    virtual bool    setWakeupPreamble(uint16_t duration);
+
     /// Set the Power Amplifier power setting.
     /// The PaTable settings are based on are based on the suggested optimum values for 
     /// multilayer inductors in the 915MHz frequency band. Per table 5-15.
@@ -801,8 +880,19 @@ public:
     void setSyncWords(const uint8_t* syncWords, uint8_t len);
 
 protected:
+    /// Measures the RSSI for clear channel assessment by isChannelActive() from RH_CC110_REG_34_RSSI, 
+    /// turning the receiver on for RH_CCA_SETTLE_TIME first if it is not already on.
+    /// The radio also does its own clear channel assessment before transmitting (see RH_CC110_REG_17_MCSM1)
+    /// \param[out] rssi The RSSI in dBm
+    /// \return true
+    virtual bool   readChannelRssi(int8_t* rssi);
+
+    /// Returns the data rate set in RH_CC110_REG_10_MDMCFG4 and RH_CC110_REG_11_MDMCFG3
+    /// \return The data rate in bits per second (chips per second when Manchester coded)
+    float          bitRate();
+
     /// This is a low level function to handle the interrupts for one instance of RH_RF95.
-    /// Called automatically by isr*()
+    /// Called automatically by the interrupt dispatcher in RHGenericDriver
     /// Should not need to be called by user code.
     void           handleInterrupt();
 
@@ -846,35 +936,44 @@ protected:
     /// Ensure you use suitable PATABLE values per Tbale 5-15 or 5-16
     /// You may need to do this to implement an OOK modulation scheme.
     void setPaTable(uint8_t* patable, uint8_t patablesize);
-    
-private:
-    /// Low level interrupt service routine for device connected to interrupt 0
-    static void         isr0();
 
-    /// Low level interrupt service routine for device connected to interrupt 1
-    static void         isr1();
+    /// Reads RXBYTES or TXBYTES. Per the CC110L errata, these can be wrong if the FIFO count changes
+    /// while they are being read, so they are read repeatedly until two successive reads agree.
+    /// \param[in] reg RH_CC110_REG_3A_TXBYTES or RH_CC110_REG_3B_RXBYTES
+    /// \return The value of the register
+    uint8_t spiReadFifoBytes(uint8_t reg);
 
-    /// Low level interrupt service routine for device connected to interrupt 1
-    static void         isr2();
+    /// Writes as much of the rest of the message in _buf as will fit into the TX FIFO.
+    /// Called by send() and then on each TX FIFO threshold interrupt.
+    void sendNextFragment();
 
-    /// Array of instances connected to interrupts 0 and 1
-    static RH_CC110*     _deviceForInterrupt[];
+    /// Drains the RX FIFO into _buf and sets the RX FIFO threshold for the next interrupt.
+    /// Called on each RX FIFO threshold interrupt. When the whole packet has been read, checks the CRC
+    /// and calls validateRxBuf()
+    void readNextFragment();
 
-    /// Index of next interrupt number to use in _deviceForInterrupt
-    static uint8_t      _interruptCount;
+    /// Sets the RX FIFO threshold
+    /// \param[in] octets Number of octets in the RX FIFO to assert GDO0 at. Must be a multiple of 4, 4 to 64.
+    void setRxFifoThreshold(uint8_t octets);
 
+    /// Flushes the RX FIFO, discards any partially received packet, and restarts the receiver
+    void restartRx();
+    
+private:
     /// The configured interrupt pin connected to this instance
     uint8_t             _interruptPin;
 
-    /// The index into _deviceForInterrupt[] for this device (if an interrupt is already allocated)
-    /// else 0xff
-    uint8_t             _myInterruptIndex;
-
     /// Number of octets in the buffer
     volatile uint8_t    _bufLen;
     
     /// The receiver/transmitter buffer
-    uint8_t             _buf[RH_CC110_MAX_PAYLOAD_LEN];
+    uint8_t             _buf[RH_CC110_MAX_MESSAGE_LEN + RH_CC110_HEADER_LEN];
+
+    /// Length of the packet being received, from its length octet. 0 if waiting for a new packet
+    volatile uint8_t    _rxLen;
+
+    /// Index into _buf of the next octet to write to the TX FIFO
+    volatile uint8_t    _txBufSentIndex;
 
     /// True when there is a valid message in the buffer
     volatile bool       _rxBufValid;
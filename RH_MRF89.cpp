@@ -9,12 +9,6 @@
 #define LNA_GAIN LNA_GAIN_0_DB
 #define TX_POWER TX_POWER_13_DB
 
-// Interrupt vectors for the 3 Arduino interrupt pins
-// Each interrupt can be handled by a different instance of RH_MRF89, allowing you to have
-// 2 or more LORAs per Arduino
-RH_MRF89* RH_MRF89::_deviceForInterrupt[RH_MRF89_NUM_INTERRUPTS] = {0, 0, 0};
-uint8_t RH_MRF89::_interruptCount = 0; // Index into _deviceForInterrupt for next device
-
 // These are indexed by the values of ModemConfigChoice
 // Values based on sample modulation values from MRF89XA.h
 // TXIPOLFV set to be more than Fd
@@ -40,9 +34,10 @@ RH_MRF89::RH_MRF89(uint8_t csconPin, uint8_t csdatPin, uint8_t interruptPin, RHG
     RHNRFSPIDriver(csconPin, spi),
     _csconPin(csconPin),
     _csdatPin(csdatPin),
-    _interruptPin(interruptPin)
+    _interruptPin(interruptPin),
+    _rxLen(0),
+    _rxCrcWait(false)
 {
-    _myInterruptIndex = 0xff; // Not allocated yet
 }
 
 bool RH_MRF89::init()
@@ -59,13 +54,6 @@ bool RH_MRF89::init()
     pinMode(_csdatPin, OUTPUT);
     digitalWrite(_csdatPin, HIGH);
 
-    // Determine the interrupt number that corresponds to the interruptPin
-    int interruptNumber = digitalPinToInterrupt(_interruptPin);
-    if (interruptNumber == NOT_AN_INTERRUPT)
-	return false;
-#ifdef RH_ATTACHINTERRUPT_TAKES_PIN_NUMBER
-    interruptNumber = _interruptPin;
-#endif
 
     // Make sure we are not in some unexpected mode from a previous run    
     setOpMode(RH_MRF89_CMOD_STANDBY); 
@@ -85,28 +73,11 @@ bool RH_MRF89::init()
     pinMode(_interruptPin, INPUT); 
 
     // Set up interrupt handler
-    // Since there are a limited number of interrupt glue functions isr*() available,
-    // we can only support a limited number of devices simultaneously
     // On some devices, notably most Arduinos, the interrupt pin passed in is actually the 
     // interrupt number. You have to figure out the interruptnumber-to-interruptpin mapping
     // yourself based on knowledge of what Arduino board you are running on.
-    if (_myInterruptIndex == 0xff)
-    {
-	// First run, no interrupt allocated yet
-	if (_interruptCount <= RH_MRF89_NUM_INTERRUPTS)
-	    _myInterruptIndex = _interruptCount++;
-	else
-	    return false; // Too many devices, not enough interrupt vectors
-    }
-    _deviceForInterrupt[_myInterruptIndex] = this;
-    if (_myInterruptIndex == 0)
-	attachInterrupt(interruptNumber, isr0, RISING);
-    else if (_myInterruptIndex == 1)
-	attachInterrupt(interruptNumber, isr1, RISING);
-    else if (_myInterruptIndex == 2)
-	attachInterrupt(interruptNumber, isr2, RISING);
-    else
-	return false; // Too many devices, not enough interrupt vectors
+    if (!attachInterruptHandler(_interruptPin, RISING))
+	return false; // Not an interrupt pin, or too many devices
 
     // When used with the MRF89XAM9A module, per 75017B.pdf section 1.3, need:
     // crystal freq = 12.8MHz
@@ -129,7 +100,7 @@ bool RH_MRF89::init()
     spiWriteRegister(RH_MRF89_REG_0B_S2CREG, 0); // Frequency set 2 not used
     spiWriteRegister(RH_MRF89_REG_0C_PACREG, RH_MRF89_PARC_23);
     // IRQ0 rx mode: SYNC (not used)
-    // IRQ1 rx mode: CRCOK
+    // IRQ1 rx mode: FIFO threshold or CRCOK, set by setRxInterrupt()
     // IRQ1 tx mode: TXDONE
     spiWriteRegister(RH_MRF89_REG_0D_FTXRXIREG, RH_MRF89_IRQ0RXS_PACKET_SYNC | RH_MRF89_IRQ1RXS_PACKET_CRCOK | RH_MRF89_IRQ1TX);
     spiWriteRegister(RH_MRF89_REG_0E_FTPRIREG, RH_MRF89_LENPLL);
@@ -148,7 +119,7 @@ bool RH_MRF89::init()
     // TXIPOLFV set by setModemConfig. power set by setTxPower
     spiWriteRegister(RH_MRF89_REG_1A_TXCONREG, 0xf0 | RH_MRF89_TXOPVAL_13DBM); // TX cutoff freq=375kHz,
     spiWriteRegister(RH_MRF89_REG_1B_CLKOREG, 0x00); // Disable clock output to save power
-    spiWriteRegister(RH_MRF89_REG_1C_PLOADREG, 0x40); // payload=64bytes (no RX-filtering on packet length)
+    spiWriteRegister(RH_MRF89_REG_1C_PLOADREG, sizeof(_buf)); // max payload, longer packets are filtered out
     spiWriteRegister(RH_MRF89_REG_1D_NADDSREG, 0x00); // Node Address (0=default) Not used
     spiWriteRegister(RH_MRF89_REG_1E_PKTCREG, RH_MRF89_PKTLENF | RH_MRF89_PRESIZE_4 | RH_MRF89_WHITEON | RH_MRF89_CHKCRCEN | RH_MRF89_ADDFIL_OFF);
     spiWriteRegister(RH_MRF89_REG_1F_FCRCREG, 0x00); // default (FIFO access in standby=write, clear FIFO on CRC mismatch)
@@ -186,69 +157,145 @@ bool RH_MRF89::printRegisters()
 // MRF89XA is unusual in that it has 2 interrupt lines, and not a single, combined one.
 // Only one of the several interrupt lines (IRQ1) from the RFM95 needs to be
 // connnected to the processor.
-// We use this to get CRCOK and TXDONE  interrupts
+// We use this to get FIFO threshold, CRCOK and TXDONE  interrupts
 void RH_MRF89::handleInterrupt()
 {
+    uint32_t now = micros(); // Before anything else, so the timestamps are as close to the event as possible
 //    Serial.println("I");
     if (_mode == RHModeTx)
     {
 //    Serial.println("T");
 	// TXDONE
+	// If the interrupt line is shared, the interrupt may have been for some other radio
+	if (!(spiReadRegister(RH_MRF89_REG_0E_FTPRIREG) & RH_MRF89_TXDONE))
+	    return;
 	// Transmit is complete
+	_txTime = now;
 	_txGood++;
 	setModeIdle();
     }
     else if (_mode == RHModeRx)
     {
 //	Serial.println("R");
-	// CRCOK
-	// We have received a packet.
-        // First byte in FIFO is packet length
+	readNextFragment();
+    }
+}
 
-	// REVISIT: Capture last rssi from RSTSREG
-	// based roughly on Figure 3-9
-	_lastRssi = (spiReadRegister(RH_MRF89_REG_14_RSTSREG) >> 1) - 120;
+// The FIFO threshold interrupt lets us drain the FIFO as a packet arrives, but the CRC is 
+// only checked after the last octet of the payload, so once we have read all the payload 
+// we switch IRQ1 to CRCOK. If the CRC fails, there is no CRCOK interrupt,
+// and the next CRCOK will be for a later packet, which will then be in the FIFO.
+void RH_MRF89::readNextFragment()
+{
+    while (1)
+    {
+	uint8_t irq = spiReadRegister(RH_MRF89_REG_0D_FTXRXIREG);
+	if (irq & RH_MRF89_FOVRUN)
+	{
+	    // We did not keep up
+	    _rxBad++;
+	    restartRx();
+	    return;
+	}
 
-	_bufLen = spiReadData();
-	if (_bufLen < 4)
+	if (_rxCrcWait)
 	{
-	    // Drain the FIFO
-	    uint8_t i;
-	    for (i = 0; spiReadRegister(RH_MRF89_REG_0D_FTXRXIREG) & RH_MRF89_FIFOEMPTY; i++)
-		spiReadData();
-	    clearRxBuf();
+	    // Caution: RH_MRF89_FIFOEMPTY is set when the FIFO is _not_ empty
+	    if (irq & RH_MRF89_FIFOEMPTY)
+	    {
+		// The packet we read failed its CRC, and the FIFO now holds the whole of a later packet
+		// whose CRC is OK
+		_rxBad++;
+		_rxLen = 0;
+		if (!readFifo() || _bufLen != _rxLen)
+		{
+		    restartRx();
+		    return;
+		}
+	    }
+	    else if (!(spiReadRegister(RH_MRF89_REG_1E_PKTCREG) & RH_MRF89_STSCRCEN))
+	    {
+		// If the interrupt line is shared, the interrupt may have been for some other radio
+		// Or CRCOK has not happened yet
+		return;
+	    }
+	    // CRCOK comes at the end of the packet
+	    _rxTime = micros();
+	    _rxCrcWait = false;
+	    _rxLen = 0;
+	    setRxInterrupt(RH_MRF89_IRQ1RXS_PACKET_FIFO_THRESH, 1);
+	    // All good. See if its for us
+	    validateRxBuf(); 
+	    if (_rxBufValid)
+		setModeIdle(); // Got one 
 	    return;
 	}
-	
-	// Now drain all the data from the FIFO into _buf
-	uint8_t i;
-	for (i = 0; spiReadRegister(RH_MRF89_REG_0D_FTXRXIREG) & RH_MRF89_FIFOEMPTY; i++)
-	    _buf[i] = spiReadData();
 
-	// All good. See if its for us
-	validateRxBuf(); 
-	if (_rxBufValid)
-	    setModeIdle(); // Got one 
+	// If the interrupt line is shared, the interrupt may have been for some other radio
+	if (!(irq & RH_MRF89_FIFOEMPTY))
+	    return;
+	if (!readFifo())
+	{
+	    _rxBad++;
+	    restartRx();
+	    return;
+	}
+
+	uint8_t remaining = _rxLen - _bufLen;
+	if (remaining == 0)
+	{
+	    // Got all the payload, now wait for the CRC to be checked
+	    _rxCrcWait = true;
+	    setRxInterrupt(RH_MRF89_IRQ1RXS_PACKET_CRCOK, 1);
+	}
+	else if (remaining > RH_MRF89_RX_FIFO_STREAM_THRESHOLD)
+	    setRxInterrupt(RH_MRF89_IRQ1RXS_PACKET_FIFO_THRESH, RH_MRF89_RX_FIFO_STREAM_THRESHOLD);
+	else
+	    setRxInterrupt(RH_MRF89_IRQ1RXS_PACKET_FIFO_THRESH, remaining); // Interrupt on the last octet
+	
+	// The new interrupt condition may already be true, in which case there will be no new edge
+	if (digitalRead(_interruptPin) == LOW)
+	    return;
     }
 }
 
-// These are low level functions that call the interrupt handler for the correct
-// instance of RH_MRF89.
-// 3 interrupts allows us to have 3 different devices
-void RH_MRF89::isr0()
+bool RH_MRF89::readFifo()
 {
-    if (_deviceForInterrupt[0])
-	_deviceForInterrupt[0]->handleInterrupt();
+    if (_rxLen == 0)
+    {
+	// First byte in FIFO is packet length
+	_rxLen = spiReadData();
+	_bufLen = 0;
+	if (_rxLen < RH_MRF89_HEADER_LEN || _rxLen > sizeof(_buf))
+	    return false;
+
+	// REVISIT: Capture last rssi from RSTSREG
+	// based roughly on Figure 3-9
+	_lastRssi = (spiReadRegister(RH_MRF89_REG_14_RSTSREG) >> 1) - 120;
+    }
+    // Now drain the available data from the FIFO into _buf
+    while (_bufLen < _rxLen && (spiReadRegister(RH_MRF89_REG_0D_FTXRXIREG) & RH_MRF89_FIFOEMPTY))
+	_buf[_bufLen++] = spiReadData();
+    return true;
 }
-void RH_MRF89::isr1()
+
+void RH_MRF89::setRxInterrupt(uint8_t source, uint8_t threshold)
 {
-    if (_deviceForInterrupt[1])
-	_deviceForInterrupt[1]->handleInterrupt();
+    spiWriteRegister(RH_MRF89_REG_05_FIFOCREG, RH_MRF89_FSIZE_64 | (threshold & RH_MRF89_FTINT));
+    spiWriteRegister(RH_MRF89_REG_0D_FTXRXIREG, RH_MRF89_IRQ0RXS_PACKET_SYNC | source | RH_MRF89_IRQ1TX);
 }
-void RH_MRF89::isr2()
+
+void RH_MRF89::restartRx()
 {
-    if (_deviceForInterrupt[2])
-	_deviceForInterrupt[2]->handleInterrupt();
+    // Drain the FIFO
+    while (spiReadRegister(RH_MRF89_REG_0D_FTXRXIREG) & RH_MRF89_FIFOEMPTY)
+	spiReadData();
+    _rxLen = 0;
+    _bufLen = 0;
+    _rxCrcWait = false;
+    // Also clears FOVRUN
+    spiWriteRegister(RH_MRF89_REG_05_FIFOCREG, RH_MRF89_FSIZE_64 | 1);
+    spiWriteRegister(RH_MRF89_REG_0D_FTXRXIREG, RH_MRF89_IRQ0RXS_PACKET_SYNC | RH_MRF89_IRQ1RXS_PACKET_FIFO_THRESH | RH_MRF89_IRQ1TX | RH_MRF89_FOVRUN);
 }
 
 uint8_t RH_MRF89::spiReadRegister(uint8_t reg)
@@ -285,12 +332,12 @@ uint8_t RH_MRF89::spiWriteData(const uint8_t* data, uint8_t len)
     digitalWrite(_csconPin, HIGH);
 
     uint8_t status = 0;
-    ATOMIC_BLOCK_START;
+    RH_SPI_TRANSACTION_START(_spi);
     digitalWrite(_slaveSelectPin, LOW);
     while (len--)
 	_spi.transfer(*data++);
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return status;
 
 }
@@ -316,7 +363,7 @@ void RH_MRF89::setModeIdle()
     if (_mode != RHModeIdle)
     {
 	setOpMode(RH_MRF89_CMOD_STANDBY);
-	_mode = RHModeIdle;
+	setMode(RHModeIdle);
     }
 }
 
@@ -325,7 +372,7 @@ bool RH_MRF89::sleep()
     if (_mode != RHModeSleep)
     {
 	setOpMode(RH_MRF89_CMOD_SLEEP);
-	_mode = RHModeSleep;
+	setMode(RHModeSleep);
     }
     return true;
 }
@@ -334,8 +381,10 @@ void RH_MRF89::setModeRx()
 {
     if (_mode != RHModeRx)
     {
+	// Interrupt when the length octet of the next packet arrives
+	restartRx();
 	setOpMode(RH_MRF89_CMOD_RECEIVE);
-	_mode = RHModeRx;
+	setMode(RHModeRx);
     }
 }
 
@@ -344,7 +393,7 @@ void RH_MRF89::setModeTx()
     if (_mode != RHModeTx)
     {
 	setOpMode(RH_MRF89_CMOD_TRANSMIT);
-	_mode = RHModeTx;
+	setMode(RHModeTx);
     }
 }
 
@@ -391,9 +440,15 @@ bool RH_MRF89::send(const uint8_t* data, uint8_t len)
     waitPacketSent(); // Make sure we dont interrupt an outgoing message
     setModeIdle();
     
+    if (!waitDutyCycle(len))
+	return false; // Over the duty cycle budget for this band
+
     if (!waitCAD()) 
 	return false;  // Check channel activity
 
+    // TX starts when the FIFO threshold is exceeded
+    spiWriteRegister(RH_MRF89_REG_05_FIFOCREG, RH_MRF89_FSIZE_64);
+
     // First octet is the length of the chip payload
     // 0 length messages are transmitted but never trigger a receive!
     spiWriteData(len + RH_MRF89_HEADER_LEN);
@@ -401,9 +456,40 @@ bool RH_MRF89::send(const uint8_t* data, uint8_t len)
     spiWriteData(_txHeaderFrom);
     spiWriteData(_txHeaderId);
     spiWriteData(_txHeaderFlags);
-    spiWriteData(data, len);
+    // Write as much as will fit in the FIFO
+    uint8_t fragment = len;
+    if (fragment > RH_MRF89_FIFO_SIZE - RH_MRF89_HEADER_LEN - 1)
+	fragment = RH_MRF89_FIFO_SIZE - RH_MRF89_HEADER_LEN - 1;
+    spiWriteData(data, fragment);
+    // The rest of the message must be in the FIFO well before the whole packet has been sent.
+    // Allow a few ms more for the transmitter to start
+    uint32_t timeout = timeOnAir(len) / 1000 + 10;
     setModeTx(); // Start transmitting
 
+    // IRQ0 is not connected, so there is no TX FIFO threshold interrupt to tell us when
+    // to top up the FIFO. Poll for room for the rest of the message
+    data += fragment;
+    len -= fragment;
+    unsigned long start = millis();
+    while (len)
+    {
+	if (!(spiReadRegister(RH_MRF89_REG_0D_FTXRXIREG) & RH_MRF89_FIFOFULL))
+	{
+	    spiWriteData(*data++);
+	    len--;
+	}
+	else if (millis() - start > timeout)
+	{
+	    // The transmitter is not draining the FIFO
+	    setModeIdle();
+	    return false;
+	}
+	else
+	{
+	    YIELD;
+	}
+    }
+
     return true;
 }
 
@@ -412,6 +498,30 @@ uint8_t RH_MRF89::maxMessageLength()
     return RH_MRF89_MAX_MESSAGE_LEN;
 }
 
+float RH_MRF89::bitRate()
+{
+    // Bit rate is XTAL / (64 * (BRVAL + 1)), eg 0x63 gives 2kbps
+    return RH_MRF89_XTAL_FREQ * 1000000.0 / (64.0 * (spiReadRegister(RH_MRF89_REG_03_BRSREG) + 1));
+}
+
+uint32_t RH_MRF89::timeOnAir(uint8_t len)
+{
+    uint8_t pktcreg = spiReadRegister(RH_MRF89_REG_1E_PKTCREG);
+    uint8_t syncreg = spiReadRegister(RH_MRF89_REG_12_SYNCREG);
+
+    // Preamble + sync words + length octet + headers and message + CRC
+    uint32_t octets = ((pktcreg & RH_MRF89_PRESIZE) >> 5) + 1;
+    if (syncreg & RH_MRF89_SYNCREN)
+	octets += ((syncreg & RH_MRF89_SYNCWSZ) >> 3) + 1;
+    octets += 1 + RH_MRF89_HEADER_LEN + len;
+    if (pktcreg & RH_MRF89_CHKCRCEN)
+	octets += 2;
+    // Manchester coding sends 2 chips per bit
+    if (spiReadRegister(RH_MRF89_REG_1C_PLOADREG) & RH_MRF89_MCHSTREN)
+	octets *= 2;
+    return (uint32_t)(octets * 8 * 1000000.0 / bitRate());
+}
+
 // Check whether the latest received message is complete and uncorrupted
 void RH_MRF89::validateRxBuf()
 {
@@ -505,6 +615,9 @@ bool RH_MRF89::setFrequency(float centre)
     spiWriteRegister(RH_MRF89_REG_06_R1CREG, R); 
     spiWriteRegister(RH_MRF89_REG_07_P1CREG, P); 
     spiWriteRegister(RH_MRF89_REG_08_S1CREG, S); 
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    _frequency = centre;
+#endif
 
     return verifyPLLLock();
 }
@@ -14,29 +14,33 @@
 
 #include <RHNRFSPIDriver.h>
 
-// This is the maximum number of interrupts the driver can support
-// Most Arduinos can handle 2, Megas can handle more
-#define RH_MRF89_NUM_INTERRUPTS 3
-
 // Max number of octets the MRF89XA Rx/Tx FIFO can hold
 #define RH_MRF89_FIFO_SIZE 64
 
-// This is the maximum number of bytes that can be carried by the MRF89XA.
+// This is the maximum number of bytes that can be carried by the MRF89XA after the length byte
+// in variable length packet mode. Packets longer than the FIFO are streamed through it.
 // We use some for headers, keeping fewer for RadioHead messages
-#define RH_MRF89_MAX_PAYLOAD_LEN RH_MRF89_FIFO_SIZE
+#define RH_MRF89_MAX_PAYLOAD_LEN 127
 
 // The length of the headers we add.
 // The headers are inside the MRF89XA payload
 #define RH_MRF89_HEADER_LEN 4
     
 // This is the maximum user message length that can be supported by this driver. 
-// Can be pre-defined to a smaller size (to save SRAM) prior to including this header
+// Can be pre-defined to a different size prior to including this header
 // Here we allow for 4 bytes headers, user data. Message length and CRC are automatically encoded and decoded by 
-// the MRF89XA
+// the MRF89XA. The message buffer is this long, so on AVRs (short of SRAM) it defaults to what fits in the FIFO
 #ifndef RH_MRF89_MAX_MESSAGE_LEN
- #define RH_MRF89_MAX_MESSAGE_LEN (RH_MRF89_MAX_PAYLOAD_LEN - RH_MRF89_HEADER_LEN)
+ #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)
+  #define RH_MRF89_MAX_MESSAGE_LEN (RH_MRF89_FIFO_SIZE - RH_MRF89_HEADER_LEN)
+ #else
+  #define RH_MRF89_MAX_MESSAGE_LEN (RH_MRF89_MAX_PAYLOAD_LEN - RH_MRF89_HEADER_LEN)
+ #endif
 #endif
 
+// RX FIFO threshold used while streaming the middle of a packet that will not fit in the FIFO
+#define RH_MRF89_RX_FIFO_STREAM_THRESHOLD 48
+
 // Bits that must be set to do a SPI read
 #define RH_MRF89_SPI_READ_MASK              0x40
 
@@ -321,7 +325,7 @@
 /// This class supports all such modules
 ///
 /// This base class provides basic functions for sending and receiving unaddressed, unreliable datagrams
-/// of arbitrary length to 59 octets per packet. Use one of the Manager classes to get addressing and 
+/// of arbitrary length to 123 octets per packet. Use one of the Manager classes to get addressing and 
 /// acknowledgement reliability, routing, meshes etc.
 ///
 /// Several MRF89XA modules can be connected to an Arduino, permitting the construction of translators
@@ -337,16 +341,32 @@
 /// - 3 octets PREAMBLE
 /// - 2 to 4 octets NETWORK ADDRESS (also call Sync Word)
 /// - 1 octet message length bits packet control field
-/// - 4 to 63 octets PAYLOAD, consisting of:
+/// - 4 to 127 octets PAYLOAD, consisting of:
 ///   - 1 octet TO header
 ///   - 1 octet FROM header
 ///   - 1 octet ID header
 ///   - 1 octet FLAGS header
-///   - 0 to 59 octets of user message
+///   - 0 to 123 octets of user message
 /// - 2 octets CRC 
 ///
 /// The payload is whitened. No Manchester encoding is used.
 ///
+/// \par Packets longer than the FIFO
+///
+/// The MRF89XA has a 64 octet FIFO, but in variable length packet mode a packet can carry up to 127 octets.
+/// Received packets are streamed out of the FIFO by the IRQ1 interrupt: IRQ1 first signals the FIFO threshold,
+/// which the driver moves as the packet arrives so that it can drain the FIFO before it overflows and read the
+/// last octet of the payload as soon as it arrives. IRQ1 is then switched to CRCOK to get the verdict on the CRC.
+/// So each received packet causes at least 3 interrupts.
+/// IRQ0 is not connected, so there is no interrupt to say when the TX FIFO needs topping up. send() therefore
+/// fills the FIFO, starts transmitting, and then polls for room in the FIFO until it has written the rest of a
+/// long message, so send() does not return until the last part of the message has been written to the FIFO.
+/// Since the MRF89XA data SPI interface is limited to 1MHz, at the highest data rates the host may not be
+/// able to keep up with long packets.
+/// On AVR, RH_MRF89_MAX_MESSAGE_LEN defaults to 60, so that packets fit in the FIFO and the message buffer
+/// does not use up the SRAM. Define it larger before including RH_MRF89.h to send longer messages there.
+/// If you need to save SRAM on other platforms, you can define it to something smaller.
+///
 /// \par Connecting MRF89XA to Arduino
 ///
 /// The electrical connection between the MRF89XA and the Arduino require 3.3V, the 3 x SPI pins (SCK, SDI, SDO), 
@@ -415,8 +435,8 @@ public:
     /// Constructor.
     /// Constructor. You can have multiple instances, but each instance must have its own
     /// interrupt and 2 slave select pins. After constructing, you must call init() to initialise the interface
-    /// and the radio module. A maximum of 3 instances can co-exist on one processor, provided there are sufficient
-    /// distinct interrupt lines, one for each instance.
+    /// and the radio module. Up to RH_MAX_INTERRUPT_DEVICES instances (of any RadioHead driver) can co-exist on one processor.
+    /// Each instance needs an interrupt line, but several instances can share one line: see RHGenericDriver.
     /// \param[in] csconPin the Arduino pin number connected to the CSCON pin of the MRF89XA.
     /// Defaults to the normal SS pin for your Arduino (D10 for Diecimila, Uno etc, D53 for Mega, D10 for Maple)
     /// \param[in] csdatPin the Arduino pin number connected to the CSDAT pin of the MRF89XA.
@@ -494,6 +514,9 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool    recv(uint8_t* buf, uint8_t* len);
 
+    /// Brings in RHGenericDriver::recv(buf, len, metadata), which this recv() would otherwise hide
+    using RHGenericDriver::recv;
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is permitted. 
@@ -507,6 +530,13 @@ public:
     /// \return The maximum legal message length
     virtual uint8_t maxMessageLength();
 
+    /// Computes the time on air of a message from the bit rate, Manchester coding, preamble and
+    /// sync word lengths and CRC currently set in the radio.
+    /// \param[in] len Length of the message data in octets, as would be passed to send()
+    /// (the RadioHead headers are added)
+    /// \return Time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// Sets the centre frequency in MHz.
     /// Permitted ranges are: 902.0 to 928.0 and 950.0 to 960.0 (inclusive)
     /// Caution not all freqs are supported on all modules: check your module specifications
@@ -536,6 +566,10 @@ public:
 
 protected:
 
+    /// Returns the bit rate set in RH_MRF89_REG_03_BRSREG by setModemConfig()
+    /// \return The bit rate in bits per second
+    float           bitRate();
+
     /// Called automatically when a CRCOK or TXDONE interrupt occurs.
     /// Handles the interrupt.
     void handleInterrupt();
@@ -581,23 +615,25 @@ protected:
     /// Clear our local receive buffer
     void clearRxBuf();
 
+    /// Called on each RX interrupt. Drains the RX FIFO into _buf and sets the source and threshold for
+    /// the next IRQ1 interrupt. When the CRC of a completely read packet is OK, calls validateRxBuf()
+    void readNextFragment();
 
-private:
-    /// Low level interrupt service routine for device connected to interrupt 0
-    static void         isr0();
-
-    /// Low level interrupt service routine for device connected to interrupt 1
-    static void         isr1();
+    /// Reads the length octet of a new packet if necessary, then as much of the packet payload as is in the FIFO
+    /// \return false if the packet length is not valid
+    bool readFifo();
 
-    /// Low level interrupt service routine for device connected to interrupt 1
-    static void         isr2();
+    /// Sets the source of the IRQ1 interrupt in RX mode and the FIFO threshold
+    /// \param[in] source One of RH_MRF89_IRQ1RXS_PACKET_*
+    /// \param[in] threshold FIFO threshold in octets, 0 to 63. The FIFO threshold interrupt is asserted while the
+    /// FIFO holds at least this many octets. Also used as the TX start condition.
+    void setRxInterrupt(uint8_t source, uint8_t threshold);
 
-    /// Array of instances connected to interrupts 0 and 1
-    static RH_MRF89*     _deviceForInterrupt[];
-
-    /// Index of next interrupt number to use in _deviceForInterrupt
-    static uint8_t      _interruptCount;
+    /// Discards anything in the RX FIFO and any partially received packet, and prepares to receive 
+    /// a new packet
+    void restartRx();
 
+private:
     // Sigh: this chip has 2 differnt chip selects.
     // We have to set one or the other as the SPI slave select pin depending
     // on which block of registers we are accessing
@@ -607,15 +643,17 @@ private:
     /// The configured interrupt pin connected to this instance
     uint8_t             _interruptPin;
 
-    /// The index into _deviceForInterrupt[] for this device (if an interrupt is already allocated)
-    /// else 0xff
-    uint8_t             _myInterruptIndex;
-
     /// Number of octets in the buffer
     volatile uint8_t    _bufLen;
     
-    /// The receiver/transmitter buffer
-    uint8_t             _buf[RH_MRF89_MAX_PAYLOAD_LEN];
+    /// The receiver buffer
+    uint8_t             _buf[RH_MRF89_MAX_MESSAGE_LEN + RH_MRF89_HEADER_LEN];
+
+    /// Length of the packet being received, from its length octet. 0 if waiting for a new packet
+    volatile uint8_t    _rxLen;
+
+    /// True when the whole payload of a packet has been read, and we are waiting for CRCOK
+    volatile bool       _rxCrcWait;
 
     /// True when there is a valid message in the buffer
     volatile bool       _rxBufValid;
@@ -8,7 +8,15 @@
 RH_NRF24::RH_NRF24(uint8_t chipEnablePin, uint8_t slaveSelectPin, RHGenericSPI& spi)
     :
     RHNRFSPIDriver(slaveSelectPin, spi),
-    _rxBufValid(0)
+    _rxBufValid(0),
+    _hubMode(false),
+    _lastPipe(0),
+    _txPipe(RH_NRF24_PIPE_LAST_RX),
+    _txAddressPipe(0),
+    _rxAddress0Pipe(0),
+    _autoAck(false),
+    _uniqueAddresses(false),
+    _ackPayloadPending(false)
 {
     _configuration = RH_NRF24_EN_CRC | RH_NRF24_CRCO; // Default: 2 byte CRC enabled
     _chipEnablePin = chipEnablePin;
@@ -50,6 +58,11 @@ bool RH_NRF24::init()
     flushTx();
     flushRx();
 
+    // No auto-ack until setAutoAck(), whatever was left by another app
+    setAutoAck(false);
+    // Remember the network address, so pipe 0 can be restored after sending with auto-ack in hub mode
+    spiBurstReadRegister(RH_NRF24_REG_0A_RX_ADDR_P0, _networkAddress, sizeof(_networkAddress));
+
     setChannel(2); // The default, in case it was set by another app without powering down
     setRF(RH_NRF24::DataRate2Mbps, RH_NRF24::TransmitPower0dBm);
 
@@ -114,9 +127,109 @@ bool RH_NRF24::setNetworkAddress(uint8_t* address, uint8_t len)
     spiWriteRegister(RH_NRF24_REG_03_SETUP_AW, len-2);	// Mapping [3..5] = [1..3]
     spiBurstWriteRegister(RH_NRF24_REG_0A_RX_ADDR_P0, address, len);
     spiBurstWriteRegister(RH_NRF24_REG_10_TX_ADDR, address, len);
+    memcpy(_networkAddress, address, len);
+    _txAddressPipe = 0;
+    _rxAddress0Pipe = 0;
+    return true;
+}
+
+bool RH_NRF24::setHubAddress(uint8_t* address, uint8_t len)
+{
+    if (len < 3 || len > 5)
+	return false;
+
+    // Pipes 2 to 5 share all but the first (least significant) octet with pipe 1
+    spiWriteRegister(RH_NRF24_REG_03_SETUP_AW, len-2);	// Mapping [3..5] = [1..3]
+    spiBurstWriteRegister(RH_NRF24_REG_0B_RX_ADDR_P1, address, len);
+    for (uint8_t pipe = 2; pipe < RH_NRF24_NUM_PIPES; pipe++)
+	spiWriteRegister(RH_NRF24_REG_0A_RX_ADDR_P0 + pipe, address[0] + pipe - 1);
+    spiWriteRegister(RH_NRF24_REG_02_EN_RXADDR, RH_NRF24_ERX_P0 | RH_NRF24_ERX_P1 | RH_NRF24_ERX_P2 
+		     | RH_NRF24_ERX_P3 | RH_NRF24_ERX_P4 | RH_NRF24_ERX_P5);
+    _hubMode = true;
+    return true;
+}
+
+uint8_t RH_NRF24::pipeAddress(uint8_t pipe, uint8_t* address)
+{
+    if (pipe >= RH_NRF24_NUM_PIPES)
+	return 0;
+
+    uint8_t len = (spiReadRegister(RH_NRF24_REG_03_SETUP_AW) & RH_NRF24_AW_5_BYTES) + 2;
+    // RX_ADDR_P0 may be temporarily holding a TX address
+    if (pipe == 0)
+	memcpy(address, _networkAddress, len);
+    else
+	spiBurstReadRegister(RH_NRF24_REG_0B_RX_ADDR_P1, address, len);
+    if (pipe > 1)
+	address[0] = spiReadRegister(RH_NRF24_REG_0A_RX_ADDR_P0 + pipe);
+    return len;
+}
+
+bool RH_NRF24::setTransmitPipe(uint8_t pipe)
+{
+    if (pipe >= RH_NRF24_NUM_PIPES && pipe != RH_NRF24_PIPE_LAST_RX)
+	return false;
+    _txPipe = pipe;
+    return true;
+}
+
+bool RH_NRF24::setAutoAck(bool enable, uint8_t retries, uint16_t delay)
+{
+    if (enable)
+    {
+	// ARD is in units of 250us, 0 meaning 250us
+	uint8_t ard = delay > 4000 ? 15 : (delay <= 250 ? 0 : ((delay + 249) / 250) - 1);
+	spiWriteRegister(RH_NRF24_REG_01_EN_AA, RH_NRF24_ENAA_P0 | RH_NRF24_ENAA_P1 | RH_NRF24_ENAA_P2 
+			 | RH_NRF24_ENAA_P3 | RH_NRF24_ENAA_P4 | RH_NRF24_ENAA_P5);
+	spiWriteRegister(RH_NRF24_REG_04_SETUP_RETR, ((ard << 4) & RH_NRF24_ARD) | (retries & RH_NRF24_ARC));
+	spiWriteRegister(RH_NRF24_REG_1D_FEATURE, RH_NRF24_EN_DPL | RH_NRF24_EN_ACK_PAY | RH_NRF24_EN_DYN_ACK);
+    }
+    else
+    {
+	spiWriteRegister(RH_NRF24_REG_01_EN_AA, 0);
+	spiWriteRegister(RH_NRF24_REG_04_SETUP_RETR, 0);
+	spiWriteRegister(RH_NRF24_REG_1D_FEATURE, RH_NRF24_EN_DPL | RH_NRF24_EN_DYN_ACK);
+    }
+    _autoAck = enable;
     return true;
 }
 
+bool RH_NRF24::setAckPayload(uint8_t pipe, const uint8_t* data, uint8_t len)
+{
+    if (!_autoAck || pipe >= RH_NRF24_NUM_PIPES || len > RH_NRF24_MAX_MESSAGE_LEN)
+	return false;
+    if (statusRead() & RH_NRF24_STATUS_TX_FULL)
+	return false;
+
+    // _buf may be holding a received message, so use our own
+    uint8_t buf[RH_NRF24_MAX_PAYLOAD_LEN];
+    buf[0] = _txHeaderTo;
+    buf[1] = _txHeaderFrom;
+    buf[2] = _txHeaderId;
+    buf[3] = _txHeaderFlags;
+    memcpy(buf+RH_NRF24_HEADER_LEN, data, len);
+    spiBurstWrite(RH_NRF24_COMMAND_W_ACK_PAYLOAD(pipe), buf, len + RH_NRF24_HEADER_LEN);
+    _ackPayloadPending = true;
+    return true;
+}
+
+void RH_NRF24::setUniqueAddresses(bool unique)
+{
+    _uniqueAddresses = unique;
+}
+
+bool RH_NRF24::hardwareAcknowledgement()
+{
+    // Any radio listening on the destination address acknowledges, so the acknowledgement
+    // only tells which node got it if there is only one
+    return _autoAck && _uniqueAddresses;
+}
+
+uint8_t RH_NRF24::lastPipe()
+{
+    return _lastPipe;
+}
+
 bool RH_NRF24::setRF(DataRate data_rate, TransmitPower power)
 {
     uint8_t value = (power << 1) & RH_NRF24_PWR;
@@ -131,8 +244,20 @@ bool RH_NRF24::setRF(DataRate data_rate, TransmitPower power)
     value |= RH_NRF24_LNA_HCURR;
     
     spiWriteRegister(RH_NRF24_REG_06_RF_SETUP, value);
-    // If we were using auto-ack, we would have to set the appropriate timeout in reg 4 here
-    // see NRF24::setRF()
+
+    // Typical currents from the nRF24L01+ datasheet table 13. Idle is Standby-I
+    setModeCurrent(RHModeSleep, 0.0009);
+    setModeCurrent(RHModeIdle, 0.026);
+    if (power == TransmitPower0dBm)
+	setModeCurrent(RHModeTx, 11.3);
+    else if (power == TransmitPowerm6dBm)
+	setModeCurrent(RHModeTx, 9.0);
+    else if (power == TransmitPowerm12dBm)
+	setModeCurrent(RHModeTx, 7.5);
+    else
+	setModeCurrent(RHModeTx, 7.0);
+    setModeCurrent(RHModeRx, data_rate == DataRate250kbps ? 12.6 : (data_rate == DataRate1Mbps ? 13.1 : 13.5));
+    // If using auto-ack, the retransmit delay given to setAutoAck() must be long enough for this data rate
     return true;
 }
 
@@ -142,7 +267,7 @@ void RH_NRF24::setModeIdle()
     {
 	spiWriteRegister(RH_NRF24_REG_00_CONFIG, _configuration);
 	digitalWrite(_chipEnablePin, LOW);
-	_mode = RHModeIdle;
+	setMode(RHModeIdle);
     }
 }
 
@@ -152,7 +277,7 @@ bool RH_NRF24::sleep()
     {
 	spiWriteRegister(RH_NRF24_REG_00_CONFIG, 0); // Power Down mode
 	digitalWrite(_chipEnablePin, LOW);
-	_mode = RHModeSleep;
+	setMode(RHModeSleep);
 	return true;
     }
     return false; // Already there?
@@ -162,9 +287,16 @@ void RH_NRF24::setModeRx()
 {
     if (_mode != RHModeRx)
     {
+	// Put back the network address if pipe 0 was used to receive an ACK from another address
+	if (_rxAddress0Pipe != 0)
+	{
+	    uint8_t len = (spiReadRegister(RH_NRF24_REG_03_SETUP_AW) & RH_NRF24_AW_5_BYTES) + 2;
+	    spiBurstWriteRegister(RH_NRF24_REG_0A_RX_ADDR_P0, _networkAddress, len);
+	    _rxAddress0Pipe = 0;
+	}
 	spiWriteRegister(RH_NRF24_REG_00_CONFIG, _configuration | RH_NRF24_PWR_UP | RH_NRF24_PRIM_RX);
 	digitalWrite(_chipEnablePin, HIGH);
-	_mode = RHModeRx;
+	setMode(RHModeRx);
     }
 }
 
@@ -179,7 +311,7 @@ void RH_NRF24::setModeTx()
 	spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_TX_DS | RH_NRF24_MAX_RT);
 	spiWriteRegister(RH_NRF24_REG_00_CONFIG, _configuration | RH_NRF24_PWR_UP);
 	digitalWrite(_chipEnablePin, HIGH);
-	_mode = RHModeTx;
+	setMode(RHModeTx);
     }
 }
 
@@ -191,17 +323,156 @@ bool RH_NRF24::send(const uint8_t* data, uint8_t len)
     if (!waitCAD()) 
 	return false;  // Check channel activity
 
+    prepareTx();
+    writeTxPayload(data, len);
+    setModeTx();
+    // Radio will return to Standby II mode after transmission is complete
+    _txGood++;
+    return true;
+}
+
+uint8_t RH_NRF24::sendBurst(const uint8_t* const* data, const uint8_t* len, uint8_t count, bool* sent, uint16_t timeout)
+{
+    uint8_t i;
+    for (i = 0; i < count; i++)
+    {
+	if (len[i] > RH_NRF24_MAX_MESSAGE_LEN)
+	    return 0;
+	if (sent)
+	    sent[i] = false;
+    }
+    if (count == 0 || !waitCAD()) 
+	return 0;
+
+    uint32_t maxTime = timeout;
+    if (!maxTime)
+    {
+	// Long enough for every message to use all its automatic retries, each waiting ARD for the ACK
+	uint8_t retr = spiReadRegister(RH_NRF24_REG_04_SETUP_RETR);
+	uint32_t ard = 250 * (((retr & RH_NRF24_ARD) >> 4) + 1);
+	uint32_t total = 0; // us
+	for (i = 0; i < count; i++)
+	    total += ((retr & RH_NRF24_ARC) + 1) * (timeOnAir(len[i]) + ard);
+	maxTime = total / 1000 + 10;
+    }
+
+    prepareTx();
+    uint8_t queued = 0;    // Number of messages written to the TX FIFO so far
+    uint8_t finished = 0;  // Number of messages sent or failed so far
+    uint8_t delivered = 0; // Number of messages successfully sent
+    unsigned long start = millis();
+    while (finished < count)
+    {
+	// Keep the TX FIFO topped up. With CE high the radio sends each one as soon as it can
+	while (queued < count && (queued - finished) < RH_NRF24_TX_FIFO_SIZE)
+	{
+	    writeTxPayload(data[queued], len[queued]);
+	    queued++;
+	    setModeTx(); // Noop after the first one
+	}
+
+	uint8_t status = statusRead();
+	if (status == 0xff)
+	{
+	    // No chip (MISO floating high): nothing was sent. Abandon the rest
+	    flushTx();
+	    break;
+	}
+	else if (status & RH_NRF24_TX_DS)
+	{
+	    // At least one more has been sent. If we missed a TX_DS, an empty FIFO
+	    // tells us they have all gone
+	    spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_TX_DS);
+	    uint8_t last = finished + 1;
+	    if (spiReadRegister(RH_NRF24_REG_17_FIFO_STATUS) & RH_NRF24_TX_EMPTY)
+		last = queued;
+	    while (finished < last && finished < queued)
+	    {
+		if (sent)
+		    sent[finished] = true;
+		finished++;
+		delivered++;
+	    }
+	}
+	else if (status & RH_NRF24_MAX_RT)
+	{
+	    // Auto-ack retries exhausted for the message at the head of the FIFO. Give up on it, 
+	    // and queue the ones behind it again
+	    finished++;
+	    queued = finished;
+	    flushTx();
+	    spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_MAX_RT);
+	    // Must pulse CE to restart transmission
+	    digitalWrite(_chipEnablePin, LOW);
+	    if (queued < count)
+	    {
+		writeTxPayload(data[queued], len[queued]);
+		queued++;
+	    }
+	    digitalWrite(_chipEnablePin, HIGH);
+	}
+	else if (millis() - start > maxTime)
+	{
+	    // The radio has stopped sending. Abandon the rest
+	    flushTx();
+	    break;
+	}
+	else
+	{
+	    YIELD;
+	}
+    }
+    setModeIdle();
+    _txGood += delivered;
+    return delivered;
+}
+
+void RH_NRF24::prepareTx()
+{
+    // In hub mode, send to the address of the selected pipe, only changing TX_ADDR when necessary
+    if (_hubMode)
+    {
+	uint8_t pipe = (_txPipe == RH_NRF24_PIPE_LAST_RX) ? _lastPipe : _txPipe;
+	uint8_t address[5];
+	uint8_t addressLen = 0;
+	if (pipe != _txAddressPipe)
+	{
+	    addressLen = pipeAddress(pipe, address);
+	    spiBurstWriteRegister(RH_NRF24_REG_10_TX_ADDR, address, addressLen);
+	    _txAddressPipe = pipe;
+	}
+	// The ACK comes back to the TX address on pipe 0
+	if (_autoAck && pipe != _rxAddress0Pipe)
+	{
+	    if (!addressLen)
+		addressLen = pipeAddress(pipe, address);
+	    spiBurstWriteRegister(RH_NRF24_REG_0A_RX_ADDR_P0, address, addressLen);
+	    _rxAddress0Pipe = pipe;
+	}
+    }
+
+    // ACK payloads waiting in the TX FIFO would otherwise be transmitted as packets
+    if (_ackPayloadPending)
+    {
+	flushTx();
+	_ackPayloadPending = false;
+    }
+}
+
+void RH_NRF24::writeTxPayload(const uint8_t* data, uint8_t len)
+{
     // Set up the headers
     _buf[0] = _txHeaderTo;
     _buf[1] = _txHeaderFrom;
     _buf[2] = _txHeaderId;
     _buf[3] = _txHeaderFlags;
     memcpy(_buf+RH_NRF24_HEADER_LEN, data, len);
-    spiBurstWrite(RH_NRF24_COMMAND_W_TX_PAYLOAD_NOACK, _buf, len + RH_NRF24_HEADER_LEN);
-    setModeTx();
-    // Radio will return to Standby II mode after transmission is complete
-    _txGood++;
-    return true;
+
+    // Broadcasts are never acknowledged
+    if (_autoAck && _txHeaderTo != RH_BROADCAST_ADDRESS)
+	spiBurstWrite(RH_NRF24_COMMAND_W_TX_PAYLOAD, _buf, len + RH_NRF24_HEADER_LEN);
+    else
+	spiBurstWrite(RH_NRF24_COMMAND_W_TX_PAYLOAD_NOACK, _buf, len + RH_NRF24_HEADER_LEN);
 }
 
 bool RH_NRF24::waitPacketSent()
@@ -212,10 +483,11 @@ bool RH_NRF24::waitPacketSent()
 
     // Wait for either the Data Sent or Max ReTries flag, signalling the 
     // end of transmission
-    // We dont actually use auto-ack, so prob dont expect to see RH_NRF24_MAX_RT
+    // We only see RH_NRF24_MAX_RT if auto-ack is enabled and the packet was not acknowledged
     uint8_t status;
     while (!((status = statusRead()) & (RH_NRF24_TX_DS | RH_NRF24_MAX_RT)))
 	YIELD;
+    _txTime = micros();
 
     // Must clear RH_NRF24_MAX_RT if it is set, else no further comm
     if (status & RH_NRF24_MAX_RT)
@@ -275,6 +547,7 @@ void RH_NRF24::validateRxBuf()
     _rxHeaderFrom  = _buf[1];
     _rxHeaderId    = _buf[2];
     _rxHeaderFlags = _buf[3];
+    // Even in hub mode, the pipe address only tells which leaf it came from, not who it is for
     if (_promiscuous ||
 	_rxHeaderTo == _thisAddress ||
 	_rxHeaderTo == RH_BROADCAST_ADDRESS)
@@ -291,7 +564,10 @@ bool RH_NRF24::available()
 	if (_mode == RHModeTx)
 	    return false;
 	setModeRx();
-	if (spiReadRegister(RH_NRF24_REG_17_FIFO_STATUS) & RH_NRF24_RX_EMPTY)
+	// The status tells us which pipe the next message in the RX FIFO came in on, 
+	// or 7 if the RX FIFO is empty
+	uint8_t pipe = (statusRead() & RH_NRF24_RX_P_NO) >> 1;
+	if (pipe >= RH_NRF24_NUM_PIPES)
 	    return false;
 	// Manual says that messages > 32 octets should be discarded
 	uint8_t len = spiRead(RH_NRF24_COMMAND_R_RX_PL_WID);
@@ -302,11 +578,14 @@ bool RH_NRF24::available()
 	    setModeIdle();
 	    return false;
 	}
+	// No interrupt handler, so this is as close as we can get
+	_rxTime = micros();
 	// Clear read interrupt
 	spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_RX_DR);
 	// Get the message into the RX buffer, so we can inspect the headers
 	spiBurstRead(RH_NRF24_COMMAND_R_RX_PAYLOAD, _buf, len);
 	_bufLen = len;
+	_lastPipe = pipe;
 	// 140 microsecs (32 octet payload)
 	validateRxBuf(); 
 	if (_rxBufValid)
@@ -340,3 +619,21 @@ uint8_t RH_NRF24::maxMessageLength()
 {
     return RH_NRF24_MAX_MESSAGE_LEN;
 }
+
+float RH_NRF24::bitRate()
+{
+    uint8_t rfSetup = spiReadRegister(RH_NRF24_REG_06_RF_SETUP);
+    if (rfSetup & RH_NRF24_RF_DR_LOW)
+	return 250000.0;
+    return (rfSetup & RH_NRF24_RF_DR_HIGH) ? 2000000.0 : 1000000.0;
+}
+
+uint32_t RH_NRF24::timeOnAir(uint8_t len)
+{
+    // Preamble + address + 9 bit packet control field + headers and message + CRC
+    uint16_t bits = 8 * (1 + (spiReadRegister(RH_NRF24_REG_03_SETUP_AW) & 0x03) + 2);
+    bits += 9 + 8 * (RH_NRF24_HEADER_LEN + len);
+    if (_configuration & RH_NRF24_EN_CRC)
+	bits += (_configuration & RH_NRF24_CRCO) ? 16 : 8;
+    return (uint32_t)(bits * 1000000.0 / bitRate());
+}
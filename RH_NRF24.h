@@ -22,6 +22,20 @@
 // the supported message lengths in the nRF24
 #define RH_NRF24_MAX_MESSAGE_LEN (RH_NRF24_MAX_PAYLOAD_LEN-RH_NRF24_HEADER_LEN)
 
+// The number of RX pipes in the nRF24
+#define RH_NRF24_NUM_PIPES 6
+
+// The number of packets the nRF24 TX FIFO can hold
+#define RH_NRF24_TX_FIFO_SIZE 3
+
+// Pass to setTransmitPipe() to send to the pipe the last message was received on
+#define RH_NRF24_PIPE_LAST_RX 0xff
+
+// Default auto retransmit count and delay in microseconds for setAutoAck(). The delay is long
+// enough for an ACK with a full ACK payload at 250kbps
+#define RH_NRF24_DEFAULT_AUTO_ACK_RETRIES 3
+#define RH_NRF24_DEFAULT_AUTO_ACK_DELAY   1500
+
 // SPI Command names
 #define RH_NRF24_COMMAND_R_REGISTER                        0x00
 #define RH_NRF24_COMMAND_W_REGISTER                        0x20
@@ -182,10 +196,9 @@
 /// Several nRF24L01 modules can be connected to an Arduino, permitting the construction of translators
 /// and frequency changers, etc.
 ///
-/// The nRF24 transceiver is configured to use Enhanced Shockburst with no acknowledgement and no retransmits.
+/// The nRF24 transceiver is configured by default to use Enhanced Shockburst with no acknowledgement and no retransmits.
 /// TX_ADDR and RX_ADDR_P0 are set to the network address. If you need the low level auto-acknowledgement
-/// feature supported by this chip, you can use our original NRF24 library 
-/// at http://www.airspayce.com/mikem/arduino/NRF24
+/// feature supported by this chip, see setAutoAck() and "Hardware acknowledgement" below.
 ///
 /// Naturally, for any 2 radios to communicate that must be configured to use the same frequency and 
 /// data rate, and with identical network addresses.
@@ -408,6 +421,60 @@
 /// 2 byte CRC, No Auto-Ack mode. Enhanced shockburst is used. 
 /// TX and P0 are set to the Network address. Node addresses and decoding are handled with the RH_NRF24 module.
 ///
+/// \par Star networks and hub mode
+///
+/// The nRF24 has 6 RX pipes, each of which receives packets sent to its own address, and reports which
+/// pipe each packet arrived on. Normally only pipe 0 is used, with the network address. 
+/// In a star network with one hub and many leaves, the hub can be put in hub mode with setHubAddress().
+/// Pipes 1 to 5 are then given consecutive addresses, and each group of leaves is given one of them
+/// as its network address. The leaves in different groups then have different addresses on air, the hub
+/// can tell from the pipe which group a message came from (see lastPipe()).
+/// The pipe address only identifies the group of the sender, so the RadioHead TO header of messages on every
+/// pipe is still checked against the hub's own address, as usual. Pipe 0 still receives on the network address.
+///
+/// In hub mode, the hub sends to the address of the pipe the last message was received on, so replies
+/// and acknowledgements (eg from RHReliableDatagram) reach the group of the sender. Call setTransmitPipe()
+/// to send to some other group.
+///
+/// The address of pipe N (1 to 5) is the hub address with N-1 added to its first octet.
+/// All the pipe addresses differ only in that first octet, so it should be chosen so that it does not
+/// overflow. For example on the hub:
+/// \code
+/// uint8_t hub[] = {0x10, 0xc2, 0xc2, 0xc2, 0xc2};
+/// nrf24.setHubAddress(hub, sizeof(hub));
+/// \endcode
+/// and on a leaf in group 3 (received on pipe 3):
+/// \code
+/// uint8_t group3[] = {0x12, 0xc2, 0xc2, 0xc2, 0xc2};
+/// nrf24.setNetworkAddress(group3, sizeof(group3));
+/// \endcode
+/// The hub and leaf addresses must all have the same length as the network address of the hub.
+///
+/// \par Hardware acknowledgement
+///
+/// setAutoAck() enables the Enhanced Shockburst auto acknowledgement and auto retransmit features: 
+/// the receiving radio acknowledges each packet within microseconds, and the sending radio
+/// retransmits it until it is acknowledged or the retries are exhausted. waitPacketSent() then 
+/// returns true only if the packet was acknowledged. Broadcasts (TO header RH_BROADCAST_ADDRESS) are 
+/// sent without requesting an acknowledgement. All the nodes in the network must have the same setAutoAck() setting.
+///
+/// Caution: the radio acknowledges every packet received on its addresses, before the
+/// RadioHead headers are examined. So an acknowledgement only confirms delivery to a particular 
+/// node if only that node is listening on the destination address. If several receiving nodes share a
+/// network address, any of them may acknowledge, and their acknowledgements collide. Hub mode (see above) with
+/// one leaf per pipe gives each leaf its own address.
+///
+/// If every node has its own address like that, call setUniqueAddresses(true) on all of them. 
+/// RHReliableDatagram then relies on the hardware acknowledgement (through hardwareAcknowledgement())
+/// instead of sending and waiting for its own acknowledgement messages, which is much faster. Otherwise it
+/// still uses its own acknowledgement messages, and the hardware retransmissions just make each one more
+/// likely to get through.
+///
+/// The receiver can also send data back in the acknowledgement with setAckPayload(). The ACK payload is sent 
+/// with the next acknowledgement on the given pipe, with the RadioHead headers set by setHeaderTo() etc,
+/// and is received by the original sender like any other message, with available() and recv().
+/// Pending ACK payloads are discarded when the receiver sends with send().
+///
 /// \par Memory
 ///
 /// Memory usage of this class is minimal. The compiled client and server sketches are about 6000 bytes on Arduino. 
@@ -501,6 +568,7 @@ public:
   
     /// Sets the transmit and receive channel number.
     /// The frequency used is (2400 + channel) MHz
+    /// Also used by RHFrequencyHopping: RHGenericDriver::setChannels() has no effect.
     /// \return true on success
     bool setChannel(uint8_t channel);
 
@@ -524,6 +592,67 @@ public:
     /// \return true on success, false if len is not in the range 3-5 inclusive.
     bool setNetworkAddress(uint8_t* address, uint8_t len);
 
+    /// Puts the radio in hub mode, for use as the hub of a star network (see "Star networks and hub mode"
+    /// above). Enables all 6 RX pipes, and sets RX_ADDR_P1 to the given address, 
+    /// and RX_ADDR_P2 to RX_ADDR_P5 to the same address with 1 to 4 added to its first octet. 
+    /// Pipe 0 and TX_ADDR are left set to the network address, which must have been set
+    /// by setNetworkAddress() with the same length.
+    /// \param[in] address The address for pipe 1. 
+    /// \param[in] len Number of bytes of address to set (3 to 5). Must be the same as the length of the network address.
+    /// \return true on success, false if len is not in the range 3-5 inclusive.
+    bool setHubAddress(uint8_t* address, uint8_t len);
+
+    /// Gets the address that an RX pipe currently receives on. 
+    /// \param[in] pipe The pipe number, 0 to 5
+    /// \param[out] address Where the address is written. Must be at least 5 octets long
+    /// \return The length of the address, or 0 if pipe is not valid
+    uint8_t pipeAddress(uint8_t pipe, uint8_t* address);
+
+    /// In hub mode, sets which pipe address subsequent messages will be sent to.
+    /// \param[in] pipe The pipe number, 0 to 5, or RH_NRF24_PIPE_LAST_RX (the default) to send
+    /// to the pipe the last message was received on.
+    /// \return true on success, false if pipe is not valid
+    bool setTransmitPipe(uint8_t pipe);
+
+    /// Enables or disables hardware acknowledgement and retransmission (Enhanced Shockburst auto
+    /// acknowledgement), and ACK payloads. See "Hardware acknowledgement" above.
+    /// \param[in] enable true to enable, false to disable (the default after init())
+    /// \param[in] retries The number of times the radio retransmits a packet that was not acknowledged, 0 to 15
+    /// \param[in] delay The time to wait for an acknowledgement before retransmitting, in microseconds. 
+    /// Rounded up to a multiple of 250, in the range 250 to 4000. Must be long enough
+    /// for the acknowledgement, including any ACK payload, to be received at the current data rate.
+    /// \return true on success
+    bool setAutoAck(bool enable, uint8_t retries = RH_NRF24_DEFAULT_AUTO_ACK_RETRIES, 
+		    uint16_t delay = RH_NRF24_DEFAULT_AUTO_ACK_DELAY);
+
+    /// Loads a message to be sent back in the acknowledgement of the next packet received on a pipe.
+    /// The RadioHead headers are added as for send(). Only available if setAutoAck(true) has been called.
+    /// Up to 3 ACK payloads can be pending at a time.
+    /// \param[in] pipe The RX pipe whose next acknowledgement will carry the message, 0 to 5. 
+    /// Unless in hub mode, this is 0.
+    /// \param[in] data Data bytes to send.
+    /// \param[in] len Number of data bytes to send, up to RH_NRF24_MAX_MESSAGE_LEN
+    /// \return true if the payload was loaded, false if auto acknowledgement is not enabled, 
+    /// the arguments are invalid or the TX FIFO is full
+    bool setAckPayload(uint8_t pipe, const uint8_t* data, uint8_t len);
+
+    /// Tells the driver whether each node in the network listens on its own address (pipe), so that
+    /// the hardware acknowledgement of a packet can only come from the node it was sent to. 
+    /// See "Hardware acknowledgement" above. Must be set the same way on all the nodes.
+    /// \param[in] unique true if no two nodes receive on the same address. false (the default) if nodes may share
+    /// an address, such as the network address.
+    void setUniqueAddresses(bool unique);
+
+    /// Tells whether hardware acknowledgement confirms delivery to the destination node: 
+    /// true if it is enabled by setAutoAck() and the addresses are unique (see setUniqueAddresses()).
+    /// \return true if managers may rely on hardware acknowledgement
+    virtual bool hardwareAcknowledgement();
+
+    /// Returns the number of the RX pipe that the most recently received message arrived on.
+    /// 0 unless in hub mode.
+    /// \return The pipe number, 0 to 5
+    uint8_t lastPipe();
+
     /// Sets the data rate and transmitter power to use. Note that the nRF24 and the RFM73 have different
     /// available power levels, and for convenience, 2 different sets of values are available in the 
     /// RH_NRF24::TransmitPower enum. The ones with the RFM73 only have meaning on the RFM73 and compatible
@@ -554,6 +683,26 @@ public:
     /// successfully transmitted).
     bool send(const uint8_t* data, uint8_t len);
 
+    /// Sends several messages back to back, as fast as possible, and waits for them all to be sent.
+    /// Up to 3 messages are kept queued in the radio's TX FIFO, and more are added as each one is sent, 
+    /// so the radio can go straight on to the next one, instead of waiting for each one to be loaded.
+    /// All the messages are sent with the same headers, and to the same address, as send() would use.
+    /// If auto acknowledgement is enabled (see setAutoAck()) and a message is not acknowledged after all
+    /// the automatic retries, it is abandoned and the burst continues with the next one.
+    /// Completion of each message is detected by polling the radio, which is fast enough on most processors to
+    /// see every one. If not, several completions can be seen at once, which is not a problem unless a 
+    /// later message then fails, in which case the wrong message may be reported as failed.
+    /// \param [in] data Array of count pointers to the data to send for each message.
+    /// \param [in] len Array of count message lengths. Each must be no more than RH_NRF24_MAX_MESSAGE_LEN.
+    /// \param [in] count Number of messages to send
+    /// \param [out] sent If not NULL, array of count bools which are set to true for each message that was
+    /// successfully sent (and acknowledged if auto-ack is enabled). 
+    /// \param [in] timeout Maximum time in milliseconds for the whole burst, after which any messages not yet
+    /// sent are abandoned. 0 (the default) allows as long as the messages could take if each one used all its
+    /// automatic retries.
+    /// \return The number of messages successfully sent. 0 if any length is invalid, or the radio does not respond.
+    uint8_t sendBurst(const uint8_t* const* data, const uint8_t* len, uint8_t count, bool* sent = NULL, uint16_t timeout = 0);
+
     /// Blocks until the current message (if any) 
     /// has been transmitted
     /// \return true on success, false if the chip is not in transmit mode or other transmit failure
@@ -587,10 +736,20 @@ public:
     /// \return true if a valid message was copied to buf
     bool        recv(uint8_t* buf, uint8_t* len);
 
+    /// Brings in RHGenericDriver::recv(buf, len, metadata), which this recv() would otherwise hide
+    using RHGenericDriver::recv;
+
     /// The maximum message length supported by this driver
     /// \return The maximum message length supported by this driver
     uint8_t maxMessageLength();
 
+    /// Computes the time on air of an Enhanced ShockBurst packet from the data rate, address width
+    /// and CRC currently set in the radio. Does not include the automatic acknowledgement.
+    /// \param[in] len Length of the message data in octets, as would be passed to send()
+    /// (the RadioHead headers are added)
+    /// \return Time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// Sets the radio into Power Down mode.
     /// If successful, the radio will stay in Power Down mode until woken by 
     /// changing mode it idle, transmit or receive (eg by calling send(), recv(), available() etc)
@@ -599,6 +758,10 @@ public:
     virtual bool    sleep();
 
 protected:
+    /// Returns the data rate set by setRF()
+    /// \return The data rate in bits per second
+    float bitRate();
+
     /// Flush the TX FIFOs
     /// \return the value of the device status register
     uint8_t flushTx();
@@ -613,6 +776,14 @@ protected:
     /// Clear our local receive buffer
     void clearRxBuf();
 
+    /// Sets up the TX address and TX FIFO for sending
+    void prepareTx();
+
+    /// Adds the headers to a message and writes it to the TX FIFO
+    /// \param [in] data Data bytes to send.
+    /// \param [in] len Number of data bytes to send
+    void writeTxPayload(const uint8_t* data, uint8_t len);
+
 private:
     /// This idle mode chip configuration
     uint8_t             _configuration;
@@ -628,6 +799,34 @@ private:
 
     /// True when there is a valid message in the buffer
     bool                _rxBufValid;
+
+    /// True if setHubAddress() has been called
+    bool                _hubMode;
+
+    /// The RX pipe the last message was received on
+    uint8_t             _lastPipe;
+
+    /// The pipe to send to in hub mode, or RH_NRF24_PIPE_LAST_RX
+    uint8_t             _txPipe;
+
+    /// The pipe whose address is currently in TX_ADDR
+    uint8_t             _txAddressPipe;
+
+    /// The pipe whose address is currently in RX_ADDR_P0. With auto acknowledgement, this must 
+    /// be the same as TX_ADDR while transmitting
+    uint8_t             _rxAddress0Pipe;
+
+    /// The network address, as set by setNetworkAddress()
+    uint8_t             _networkAddress[5];
+
+    /// True if setAutoAck(true) has been called
+    bool                _autoAck;
+
+    /// True if each node has its own address, see setUniqueAddresses()
+    bool                _uniqueAddresses;
+
+    /// True if ACK payloads may be waiting in the TX FIFO
+    bool                _ackPayloadPending;
 };
 
 /// @example nrf24_client.pde
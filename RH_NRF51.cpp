@@ -141,7 +141,7 @@ void RH_NRF51::setModeIdle()
 	while (NRF_RADIO->EVENTS_DISABLED == 0U)
 	    ; // wait for the radio to be disabled
 	NRF_RADIO->EVENTS_END = 0U;
-	_mode = RHModeIdle;
+	setMode(RHModeIdle);
     }
 }
 
@@ -163,7 +163,7 @@ void RH_NRF51::setModeRx()
 	NRF_RADIO->EVENTS_READY = 0U;
 	NRF_RADIO->TASKS_RXEN = 1;
 	NRF_RADIO->EVENTS_END = 0U; // So we can detect end of reception
-	_mode = RHModeRx;
+	setMode(RHModeRx);
     }
 }
 
@@ -189,7 +189,7 @@ void RH_NRF51::setModeTx()
 	NRF_RADIO->EVENTS_READY = 0U;
 	NRF_RADIO->TASKS_TXEN = 1;
 	NRF_RADIO->EVENTS_END = 0U; // So we can detect end of transmission
-	_mode = RHModeTx;
+	setMode(RHModeTx);
     }
 }
 
@@ -245,6 +245,9 @@ public:
     /// \return true if a valid message was copied to buf
     bool        recv(uint8_t* buf, uint8_t* len);
 
+    /// Brings in RHGenericDriver::recv(buf, len, metadata), which this recv() would otherwise hide
+    using RHGenericDriver::recv;
+
     /// Enables AES encryption and sets the AES encryption key, used
     /// to encrypt and decrypt all messages using the on-chip AES CCM mode encryption engine. 
     /// The default is disabled.
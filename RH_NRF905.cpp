@@ -113,7 +113,7 @@ void RH_NRF905::setModeIdle()
     {
 	digitalWrite(_chipEnablePin, LOW);
 	digitalWrite(_txEnablePin, LOW);
-	_mode = RHModeIdle;
+	setMode(RHModeIdle);
     }
 }
 
@@ -123,7 +123,7 @@ void RH_NRF905::setModeRx()
     {
 	digitalWrite(_txEnablePin, LOW);
 	digitalWrite(_chipEnablePin, HIGH);
-	_mode = RHModeRx;
+	setMode(RHModeRx);
     }
 }
 
@@ -134,7 +134,7 @@ void RH_NRF905::setModeTx()
 	// Its the high transition that puts us into TX mode
 	digitalWrite(_txEnablePin, HIGH);
 	digitalWrite(_chipEnablePin, HIGH);
-	_mode = RHModeTx;
+	setMode(RHModeTx);
     }
 }
 
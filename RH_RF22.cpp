@@ -5,12 +5,6 @@
 
 #include <RH_RF22.h>
 
-// Interrupt vectors for the 2 Arduino interrupt pins
-// Each interrupt can be handled by a different instance of RH_RF22, allowing you to have
-// 2 RH_RF22s per Arduino
-RH_RF22* RH_RF22::_deviceForInterrupt[RH_RF22_NUM_INTERRUPTS] = {0, 0, 0};
-uint8_t RH_RF22::_interruptCount = 0; // Index into _deviceForInterrupt for next device
-
 // These are indexed by the values of ModemConfigChoice
 // Canned modem configurations generated with 
 // http://www.hoperf.com/upload/rf/RH_RF22B%2023B%2031B%2042B%2043B%20Register%20Settings_RevB1-v5.xls
@@ -63,7 +57,7 @@ RH_RF22::RH_RF22(uint8_t slaveSelectPin, uint8_t interruptPin, RHGenericSPI& spi
     _interruptPin = interruptPin;
     _idleMode = RH_RF22_XTON; // Default idle state is READY mode
     _polynomial = CRC_16_IBM; // Historical
-    _myInterruptIndex = 0xff; // Not allocated yet
+    _opMode2 = 0;
 }
 
 void RH_RF22::setIdleMode(uint8_t idleMode)
@@ -76,13 +70,6 @@ bool RH_RF22::init()
     if (!RHSPIDriver::init())
 	return false;
 
-    // Determine the interrupt number that corresponds to the interruptPin
-    int interruptNumber = digitalPinToInterrupt(_interruptPin);
-    if (interruptNumber == NOT_AN_INTERRUPT)
-	return false;
-#ifdef RH_ATTACHINTERRUPT_TAKES_PIN_NUMBER
-    interruptNumber = _interruptPin;
-#endif
 
     // Software reset the device
     reset();
@@ -107,28 +94,11 @@ bool RH_RF22::init()
     spiWrite(RH_RF22_REG_06_INTERRUPT_ENABLE2, RH_RF22_ENPREAVAL);
 
     // Set up interrupt handler
-    // Since there are a limited number of interrupt glue functions isr*() available,
-    // we can only support a limited number of devices simultaneously
     // On some devices, notably most Arduinos, the interrupt pin passed in is actually the 
     // interrupt number. You have to figure out the interruptnumber-to-interruptpin mapping
     // yourself based on knowledge of what Arduino board you are running on.
-    if (_myInterruptIndex == 0xff)
-    {
-	// First run, no interrupt allocated yet
-	if (_interruptCount <= RH_RF22_NUM_INTERRUPTS)
-	    _myInterruptIndex = _interruptCount++;
-	else
-	    return false; // Too many devices, not enough interrupt vectors
-    }
-    _deviceForInterrupt[_myInterruptIndex] = this;
-    if (_myInterruptIndex == 0)
-	attachInterrupt(interruptNumber, isr0, FALLING);
-    else if (_myInterruptIndex == 1)
-	attachInterrupt(interruptNumber, isr1, FALLING);
-    else if (_myInterruptIndex == 2)
-	attachInterrupt(interruptNumber, isr2, FALLING);
-    else
-	return false; // Too many devices, not enough interrupt vectors
+    if (!attachInterruptHandler(_interruptPin, FALLING))
+	return false; // Not an interrupt pin, or too many devices
 
     setModeIdle();
 
@@ -169,6 +139,11 @@ bool RH_RF22::init()
     setModemConfig(FSK_Rb2_4Fd36);
 //    setModemConfig(FSK_Rb125Fd125);
     setGpioReversed(false);
+    // Typical currents from the Si4432 datasheet, with the default RH_RF22_XTON idle mode.
+    // setTxPower() sets the transmit current
+    setModeCurrent(RHModeSleep, 0.00045);
+    setModeCurrent(RHModeIdle, 0.8);
+    setModeCurrent(RHModeRx, 18.5);
     // Lowish power
     setTxPower(RH_RF22_TXPOW_8DBM);
 
@@ -178,6 +153,7 @@ bool RH_RF22::init()
 // C++ level interrupt handler for this instance
 void RH_RF22::handleInterrupt()
 {
+    uint32_t now = micros(); // Before anything else, so the timestamps are as close to the event as possible
     uint8_t _lastInterruptFlags[2];
     // Read the interrupt flags which clears the interrupt
     spiBurstRead(RH_RF22_REG_03_INTERRUPT_STATUS1, _lastInterruptFlags, 2);
@@ -242,11 +218,12 @@ void RH_RF22::handleInterrupt()
     if (_lastInterruptFlags[0] & RH_RF22_IPKSENT)
     {
 //	Serial.println("IPKSENT");   
+	_txTime = now;
 	_txGood++; 
 	// Transmission does not automatically clear the tx buffer.
 	// Could retransmit if we wanted
 	// RH_RF22 transitions automatically to Idle
-	_mode = RHModeIdle;
+	setMode(RHModeIdle);
     }
     if (_lastInterruptFlags[0] & RH_RF22_IPKVALID)
     {
@@ -261,7 +238,7 @@ void RH_RF22::handleInterrupt()
 	    || len < _bufLen)
 	{
 	    _rxBad++;
-	    _mode = RHModeIdle;
+	    setMode(RHModeIdle);
 	    clearRxBuf();
 	    return; // Hmmm receiver buffer overflow. 
 	}
@@ -271,9 +248,16 @@ void RH_RF22::handleInterrupt()
 	_rxHeaderFrom = spiRead(RH_RF22_REG_48_RECEIVED_HEADER2);
 	_rxHeaderId = spiRead(RH_RF22_REG_49_RECEIVED_HEADER1);
 	_rxHeaderFlags = spiRead(RH_RF22_REG_4A_RECEIVED_HEADER0);
+	_rxTime = now;
 	_rxGood++;
 	_bufLen = len;
-	_mode = RHModeIdle;
+	if (_opMode2)
+	{
+	    // Stop the wakeups until the message has been read
+	    stopLowDutyCycle();
+	    setOpMode(_idleMode);
+	}
+	setMode(RHModeIdle);
 	_rxBufValid = true;
     }
     if (_lastInterruptFlags[0] & RH_RF22_ICRCERROR)
@@ -282,7 +266,7 @@ void RH_RF22::handleInterrupt()
 	_rxBad++;
 	clearRxBuf();
 	resetRxFifo();
-	_mode = RHModeIdle;
+	setMode(RHModeIdle);
 	setModeRx(); // Keep trying
     }
     if (_lastInterruptFlags[1] & RH_RF22_IPREAVAL)
@@ -295,25 +279,6 @@ void RH_RF22::handleInterrupt()
     }
 }
 
-// These are low level functions that call the interrupt handler for the correct
-// instance of RH_RF22.
-// 3 interrupts allows us to have 3 different devices
-void RH_RF22::isr0()
-{
-    if (_deviceForInterrupt[0])
-	_deviceForInterrupt[0]->handleInterrupt();
-}
-void RH_RF22::isr1()
-{
-    if (_deviceForInterrupt[1])
-	_deviceForInterrupt[1]->handleInterrupt();
-}
-void RH_RF22::isr2()
-{
-    if (_deviceForInterrupt[2])
-	_deviceForInterrupt[2]->handleInterrupt();
-}
-
 void RH_RF22::reset()
 {
     spiWrite(RH_RF22_REG_07_OPERATING_MODE1, RH_RF22_SWRES);
@@ -377,6 +342,11 @@ bool RH_RF22::setFrequency(float centre, float afcPullInRange)
     uint8_t afclimiter;
     if (centre < 240.0 || centre > 960.0) // 930.0 for early silicon
 	return false;
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    // The frequency hopping channel is added to the centre frequency
+    _frequency = centre + spiRead(RH_RF22_REG_79_FREQUENCY_HOPPING_CHANNEL_SELECT)
+	* spiRead(RH_RF22_REG_7A_FREQUENCY_HOPPING_STEP_SIZE) * 0.01;
+#endif
     if (centre >= 480.0)
     {
 	if (afcPullInRange < 0.0 || afcPullInRange > 0.318750)
@@ -411,6 +381,10 @@ bool RH_RF22::setFrequency(float centre, float afcPullInRange)
 // Returns true if centre + (fhch * fhs) is within limits
 bool RH_RF22::setFHStepSize(uint8_t fhs)
 {
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    _frequency += spiRead(RH_RF22_REG_79_FREQUENCY_HOPPING_CHANNEL_SELECT)
+	* ((int16_t)fhs - spiRead(RH_RF22_REG_7A_FREQUENCY_HOPPING_STEP_SIZE)) * 0.01;
+#endif
     spiWrite(RH_RF22_REG_7A_FREQUENCY_HOPPING_STEP_SIZE, fhs);
     return !(statusRead() & RH_RF22_FREQERR);
 }
@@ -419,15 +393,55 @@ bool RH_RF22::setFHStepSize(uint8_t fhs)
 // Returns true if centre + (fhch * fhs) is within limits
 bool RH_RF22::setFHChannel(uint8_t fhch)
 {
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    _frequency += ((int16_t)fhch - spiRead(RH_RF22_REG_79_FREQUENCY_HOPPING_CHANNEL_SELECT))
+	* spiRead(RH_RF22_REG_7A_FREQUENCY_HOPPING_STEP_SIZE) * 0.01;
+#endif
     spiWrite(RH_RF22_REG_79_FREQUENCY_HOPPING_CHANNEL_SELECT, fhch);
     return !(statusRead() & RH_RF22_FREQERR);
 }
 
+bool RH_RF22::setChannels(float base, float spacing)
+{
+    if (spacing < 0.0 || spacing > 2.55)
+	return false;
+    RHGenericDriver::setChannels(base, spacing);
+    return setFrequency(base) && setFHStepSize((uint8_t)(spacing * 100.0 + 0.5));
+}
+
+bool RH_RF22::setChannel(uint8_t channel)
+{
+    return setFHChannel(channel);
+}
+
 uint8_t RH_RF22::rssiRead()
 {
     return spiRead(RH_RF22_REG_26_RSSI);
 }
 
+bool RH_RF22::readChannelRssi(int8_t* rssi)
+{
+    bool wasRx = (_mode == RHModeRx);
+    if (!wasRx || _lplInterval)
+    {
+	// The receiver must be on continuously, even when low power listening
+	setModeIdle();
+	setOpMode(_idleMode | RH_RF22_RXON);
+	setMode(RHModeRx);
+	waitMicros(RH_CCA_SETTLE_TIME);
+    }
+    *rssi = (int8_t)(-120 + (rssiRead() / 2));
+    if (wasRx && _lplInterval && _mode == RHModeRx)
+    {
+	// Back to waking up periodically
+	setModeIdle();
+	setModeRx();
+    }
+    else if (!wasRx && _mode == RHModeRx)
+	setModeIdle();
+    return true;
+}
+
 uint8_t RH_RF22::ezmacStatusRead()
 {
     return spiRead(RH_RF22_REG_31_EZMAC_STATUS);
@@ -442,8 +456,9 @@ void RH_RF22::setModeIdle()
 {
     if (_mode != RHModeIdle)
     {
+	stopLowDutyCycle();
 	setOpMode(_idleMode);
-	_mode = RHModeIdle;
+	setMode(RHModeIdle);
     }
 }
 
@@ -451,8 +466,9 @@ bool RH_RF22::sleep()
 {
     if (_mode != RHModeSleep)
     {
+	stopLowDutyCycle();
 	setOpMode(0);
-	_mode = RHModeSleep;
+	setMode(RHModeSleep);
     }
     return true;
 }
@@ -461,8 +477,17 @@ void RH_RF22::setModeRx()
 {
     if (_mode != RHModeRx)
     {
-	setOpMode(_idleMode | RH_RF22_RXON);
-	_mode = RHModeRx;
+	if (_lplInterval)
+	{
+	    // The wakeup timer turns the receiver on and off
+	    resetRxFifo();
+	    setOpMode(_idleMode | RH_RF22_ENWT);
+	    _opMode2 = RH_RF22_ENLDM;
+	    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, _opMode2);
+	}
+	else
+	    setOpMode(_idleMode | RH_RF22_RXON);
+	setMode(RHModeRx);
     }
 }
 
@@ -470,18 +495,77 @@ void RH_RF22::setModeTx()
 {
     if (_mode != RHModeTx)
     {
+	stopLowDutyCycle();
 	setOpMode(_idleMode | RH_RF22_TXON);
 	// Hmmm, if you dont clear the RX FIFO here, then it appears that going
 	// to transmit mode in the middle of a receive can corrupt the
 	// RX FIFO
 	resetRxFifo();
-	_mode = RHModeTx;
+	setMode(RHModeTx);
+    }
+}
+
+void RH_RF22::stopLowDutyCycle()
+{
+    if (_opMode2)
+    {
+	_opMode2 = 0;
+	spiWrite(RH_RF22_REG_08_OPERATING_MODE2, 0);
     }
 }
 
+bool RH_RF22::setLowPowerListening(uint16_t interval)
+{
+    setModeIdle();
+    if (interval)
+    {
+	// Wakeup timer and LDC durations are in units of 4 * 2^R / 32.768kHz, about 122us when R is 0
+	uint32_t m = (uint32_t)interval * 8192 / 1000;
+	uint8_t r = 0;
+	while (m > 0xffff)
+	{
+	    m >>= 1;
+	    r++;
+	}
+	uint32_t ldc = ((uint32_t)RH_RF22_LPL_RX_TIME * 8192 / 1000) >> r;
+	if (ldc == 0)
+	    ldc = 1;
+	if (ldc >= m)
+	    return false; // Would never sleep
+	if (ldc > 255)
+	    ldc = 255;
+	setWutPeriod(m, r, 0);
+	spiWrite(RH_RF22_REG_19_LDC_MODE_DURATION, ldc);
+    }
+    _lplInterval = interval;
+    // Only interrupt for packets while low power listening
+    spiWrite(RH_RF22_REG_06_INTERRUPT_ENABLE2, interval ? 0 : RH_RF22_ENPREAVAL);
+    return true;
+}
+
+bool RH_RF22::setWakeupPreamble(uint16_t duration)
+{
+    uint16_t nibbles = 8;
+    if (duration)
+    {
+	float n = duration * bitRate() / 4000.0;
+	if (n >= 511)
+	    return false; // Too long for the 9 bit preamble length at this data rate
+	nibbles = (uint16_t)n + 1;
+    }
+    _wakeupPreamble = duration;
+    // The top bit of the preamble length is in Header Control 2
+    uint8_t headerControl2 = spiRead(RH_RF22_REG_33_HEADER_CONTROL2) & ~RH_RF22_PREALEN8;
+    spiWrite(RH_RF22_REG_33_HEADER_CONTROL2, headerControl2 | ((nibbles >> 8) & RH_RF22_PREALEN8));
+    spiWrite(RH_RF22_REG_34_PREAMBLE_LENGTH, nibbles & 0xff);
+    return true;
+}
+
 void RH_RF22::setTxPower(uint8_t power)
 {
     spiWrite(RH_RF22_REG_6D_TX_POWER, power | RH_RF22_LNA_SW); // On RF23, LNA_SW must be set.
+    // Datasheet figures for +20 and +11dBm on RF22B
+    setModeCurrent(RHModeTx, (power & RH_RF22_TXPOW) >= RH_RF22_TXPOW_17DBM ? 85.0 : 30.0);
 }
 
 // Sets registers from a canned modem configuration structure
@@ -577,7 +661,7 @@ void RH_RF22::startTransmit()
 // Restart the transmission of a packet that had a problem
 void RH_RF22::restartTransmit()
 {
-    _mode = RHModeIdle;
+    setMode(RHModeIdle);
     _txBufSentIndex = 0;
 //	    Serial.println("Restart");
     startTransmit();
@@ -588,6 +672,9 @@ bool RH_RF22::send(const uint8_t* data, uint8_t len)
     bool ret = true;
     waitPacketSent();
 
+    if (!waitDutyCycle(len))
+	return false; // Over the duty cycle budget for this band
+
     if (!waitCAD()) 
 	return false;  // Check channel activity
 
@@ -656,23 +743,23 @@ void RH_RF22::readNextFragment()
 // Clear the FIFOs
 void RH_RF22::resetFifos()
 {
-    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, RH_RF22_FFCLRRX | RH_RF22_FFCLRTX);
-    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, 0);
+    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, _opMode2 | RH_RF22_FFCLRRX | RH_RF22_FFCLRTX);
+    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, _opMode2);
 }
 
 // Clear the Rx FIFO
 void RH_RF22::resetRxFifo()
 {
-    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, RH_RF22_FFCLRRX);
-    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, 0);
+    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, _opMode2 | RH_RF22_FFCLRRX);
+    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, _opMode2);
     _rxBufValid = false;
 }
 
 // CLear the TX FIFO
 void RH_RF22::resetTxFifo()
 {
-    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, RH_RF22_FFCLRTX);
-    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, 0);
+    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, _opMode2 | RH_RF22_FFCLRTX);
+    spiWrite(RH_RF22_REG_08_OPERATING_MODE2, _opMode2);
 }
 
 // Default implmentation does nothing. Override if you wish
@@ -708,6 +795,44 @@ uint8_t RH_RF22::maxMessageLength()
     return RH_RF22_MAX_MESSAGE_LEN;
 }
 
+float RH_RF22::bitRate()
+{
+    // TX data rate is TXDR * 1MHz / 2^16, or / 2^21 if TXDTRTSCALE is set
+    uint32_t txdr = ((uint16_t)spiRead(RH_RF22_REG_6E_TX_DATA_RATE1) << 8) | spiRead(RH_RF22_REG_6F_TX_DATA_RATE0);
+    return txdr * 1000000.0 / ((spiRead(RH_RF22_REG_70_MODULATION_CONTROL1) & RH_RF22_TXDTRTSCALE) ? 2097152.0 : 65536.0);
+}
+
+uint32_t RH_RF22::timeOnAir(uint8_t len)
+{
+    float bps = bitRate();
+    if (bps <= 0)
+	return 0;
+    uint8_t headerControl2 = spiRead(RH_RF22_REG_33_HEADER_CONTROL2);
+
+    // Preamble nibbles + sync words + headers + length octet + message + CRC
+    uint16_t nibbles = ((uint16_t)(headerControl2 & RH_RF22_PREALEN8) << 8) | spiRead(RH_RF22_REG_34_PREAMBLE_LENGTH);
+    uint32_t bits = 4 * (uint32_t)nibbles;
+    bits += 8 * (((headerControl2 & RH_RF22_SYNCLEN) >> 1) + 1);
+    bits += 8 * ((headerControl2 & RH_RF22_HDLEN) >> 4);
+    if (!(headerControl2 & RH_RF22_FIXPKLEN))
+	bits += 8;
+    bits += 8 * (uint32_t)len;
+    if (spiRead(RH_RF22_REG_30_DATA_ACCESS_CONTROL) & RH_RF22_ENCRC)
+	bits += 16;
+    // Manchester coding sends 2 chips per bit, and the data rate is in chips
+    if (spiRead(RH_RF22_REG_70_MODULATION_CONTROL1) & RH_RF22_ENMANCH)
+	bits *= 2;
+    return (uint32_t)(bits * 1000000.0 / bps);
+}
+
+uint32_t RH_RF22::slotTime()
+{
+    float bps = bitRate();
+    if (bps <= 0)
+	return RHGenericDriver::slotTime();
+    return RH_CCA_SETTLE_TIME + (uint32_t)(RH_CSMA_SLOT_BITS * 1000000.0 / bps);
+}
+
 void RH_RF22::setThisAddress(uint8_t thisAddress)
 {
     RHSPIDriver::setThisAddress(thisAddress);
@@ -10,10 +10,6 @@
 #include <RHGenericSPI.h>
 #include <RHSPIDriver.h>
 
-// This is the maximum number of interrupts the library can support
-// Most Arduinos can handle 2, Megas can handle more
-#define RH_RF22_NUM_INTERRUPTS 3
-
 // This is the bit in the SPI address that marks it as a write
 #define RH_RF22_SPI_WRITE_MASK 0x80
 
@@ -31,6 +27,12 @@
 // Max number of octets the RF22 Rx and Tx FIFOs can hold
 #define RH_RF22_FIFO_SIZE 64
 
+// Minimum time in milliseconds the receiver stays on at each low power listening wakeup to look for a preamble.
+// Increase it for slow data rates, so that it covers the preamble detection threshold
+#ifndef RH_RF22_LPL_RX_TIME
+ #define RH_RF22_LPL_RX_TIME 10
+#endif
+
 // These values we set for FIFO thresholds (4, 55) are actually the same as the POR values
 #define RH_RF22_TXFFAEM_THRESHOLD 4
 #define RH_RF22_RXFFAFULL_THRESHOLD 55
@@ -362,6 +364,10 @@
 #define RH_RF22_RF23BP_TXPOW_29DBM                 0x06 // 29dBm
 #define RH_RF22_RF23BP_TXPOW_30DBM                 0x07 // 30dBm
 
+// RH_RF22_REG_70_MODULATION_CONTROL1              0x70
+#define RH_RF22_TXDTRTSCALE                        0x20
+#define RH_RF22_ENMANCH                            0x02
+
 // RH_RF22_REG_71_MODULATION_CONTROL2              0x71
 #define RH_RF22_TRCLK                              0xc0
 #define RH_RF22_TRCLK_NONE                         0x00
@@ -936,8 +942,8 @@ public:
 
     /// Constructor. You can have multiple instances, but each instance must have its own
     /// interrupt and slave select pin. After constructing, you must call init() to initialise the interface
-    /// and the radio module. A maximum of 3 instances can co-exist on one processor, provided there are sufficient
-    /// distinct interrupt lines, one for each instance.
+    /// and the radio module. Up to RH_MAX_INTERRUPT_DEVICES instances (of any RadioHead driver) can co-exist on one processor.
+    /// Each instance needs an interrupt line, but several instances can share one line: see RHGenericDriver.
     /// \param[in] slaveSelectPin the Arduino pin number of the output to use to select the RH_RF22 before
     /// accessing it. Defaults to the normal SS pin for your Arduino (D10 for Diecimila, Uno etc, D53 for Mega, D10 for Maple)
     /// \param[in] interruptPin The interrupt Pin number that is connected to the RF22 NIRQ interrupt line. 
@@ -1025,6 +1031,18 @@ public:
     /// \return true if the selected frquency centre + (fhch * fhs) is within range
     bool        setFHChannel(uint8_t fhch);
 
+    /// Sets the channels selected by setChannel() with the frequency hopping registers: sets the centre
+    /// frequency to base with setFrequency(), and the step size to spacing with setFHStepSize().
+    /// \param[in] base Frequency of channel 0 in MHz
+    /// \param[in] spacing Channel spacing in MHz, a multiple of 10kHz up to 2.55MHz
+    /// \return true if the channels are within range
+    virtual bool setChannels(float base, float spacing);
+
+    /// Selects a channel with setFHChannel(). The receiver stays on if it is on.
+    /// \param[in] channel The channel number
+    /// \return true if the channel frequency is within range
+    virtual bool setChannel(uint8_t channel);
+
     /// Reads and returns the current RSSI value from register RH_RF22_REG_26_RSSI. Caution: this is
     /// in internal units (see figure 31 of RFM22B/23B documentation), not in dBm. If you want to find the RSSI in dBm
     /// of the last received message, use lastRssi() instead.
@@ -1054,6 +1072,9 @@ public:
     /// Starts the transmitter in the RH_RF22.
     void           setModeTx();
 
+    /// Stops the Low Duty Cycle mode started by setModeRx() when low power listening
+    void           stopLowDutyCycle();
+
     /// Sets the transmitter power output level in register RH_RF22_REG_6D_TX_POWER.
     /// Be a good neighbour and set the lowest power level you need.
     /// After init(), the power will be set to RH_RF22::RH_RF22_TXPOW_8DBM on RF22B
@@ -1097,6 +1118,9 @@ public:
     /// \return true if a valid message was copied to buf
     bool        recv(uint8_t* buf, uint8_t* len);
 
+    /// Brings in RHGenericDriver::recv(buf, len, metadata), which this recv() would otherwise hide
+    using RHGenericDriver::recv;
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. 
@@ -1153,6 +1177,17 @@ public:
     /// \return The maximum message length supported by this driver
     uint8_t maxMessageLength();
 
+    /// Computes the time on air of a message from the data rate, Manchester coding, preamble and
+    /// sync word lengths, header length and CRC currently set in the radio.
+    /// \param[in] len Length of the message data in octets, as would be passed to send()
+    /// \return Time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
+    /// Returns the CSMA/CA slot time used by csmaPoll(): RH_CCA_SETTLE_TIME for readChannelRssi(),
+    /// plus RH_CSMA_SLOT_BITS at the current TX data rate to turn around to transmit.
+    /// \return The slot time in microseconds, or RH_CSMA_DEFAULT_SLOT_TIME if the data rate is not set
+    virtual uint32_t slotTime();
+
     /// Sets the radio into low-power sleep mode.
     /// If successful, the transport will stay in sleep mode until woken by 
     /// changing mode it idle, transmit or receive (eg by calling send(), recv(), available() etc)
@@ -1160,9 +1195,36 @@ public:
     /// \return true if sleep mode was successfully entered.
     virtual bool    sleep();
 
+    /// Enables or disables low power listening with the Low Duty Cycle mode and the wakeup timer.
+    /// While in receive mode, the wakeup timer then turns the receiver on every interval for
+    /// RH_RF22_LPL_RX_TIME. The radio stays in RX if it detects a preamble, and the MCU is only
+    /// interrupted when a packet arrives. The preamble detect interrupt is disabled, so lastRssi() is not updated.
+    /// Senders must use setWakeupPreamble() with a duration a little longer than the interval.
+    /// Uses the wakeup timer, so do not use setWutPeriod() at the same time.
+    /// \param[in] interval Time between wakeups in milliseconds, or 0 to receive continuously
+    /// \return true if the interval is supported
+    virtual bool    setLowPowerListening(uint16_t interval);
+
+    /// Sets the length of the preamble sent before every message, for receivers using setLowPowerListening().
+    /// The preamble can be up to 511 nibbles, so the longest duration depends on the data rate.
+    /// Call this after setModemConfig(), since the length in nibbles depends on the data rate.
+    /// \param[in] duration Length of the preamble in milliseconds, or 0 for the default 8 nibbles
+    /// \return true if the duration is supported at this data rate
+    virtual bool    setWakeupPreamble(uint16_t duration);
+
 protected:
+    /// Measures the RSSI for clear channel assessment by isChannelActive(), turning 
+    /// the receiver on for RH_CCA_SETTLE_TIME first if it is not already on
+    /// \param[out] rssi The RSSI in dBm, converted from rssiRead() in the same way as lastRssi()
+    /// \return true
+    virtual bool   readChannelRssi(int8_t* rssi);
+
+    /// Returns the TX data rate set by setModemConfig() or setModemRegisters()
+    /// \return The data rate in bits per second (chips per second when Manchester coded)
+    float          bitRate();
+
     /// This is a low level function to handle the interrupts for one instance of RH_RF22.
-    /// Called automatically by isr*()
+    /// Called automatically by the interrupt dispatcher in RHGenericDriver
     /// Should not need to be called.
     void           handleInterrupt();
 
@@ -1239,28 +1301,9 @@ protected:
     void setIdleMode(uint8_t idleMode);
 
 protected:
-    /// Low level interrupt service routine for RF22 connected to interrupt 0
-    static void         isr0();
-
-    /// Low level interrupt service routine for RF22 connected to interrupt 1
-    static void         isr1();
-
-    /// Low level interrupt service routine for RF22 connected to interrupt 1
-    static void         isr2();
-
-    /// Array of instances connected to interrupts 0 and 1
-    static RH_RF22*     _deviceForInterrupt[];
-
-    /// Index of next interrupt number to use in _deviceForInterrupt
-    static uint8_t      _interruptCount;
-
     /// The configured interrupt pin connected to this instance
     uint8_t             _interruptPin;
 
-    /// The index into _deviceForInterrupt[] for this device (if an interrupt is already allocated)
-    /// else 0xff
-    uint8_t             _myInterruptIndex;
-
     /// The radio mode to use when mode is idle
     uint8_t             _idleMode; 
 
@@ -1285,6 +1328,9 @@ protected:
   
     /// Time in millis since the last preamble was received (and the last time the RSSI was measured)
     uint32_t            _lastPreambleTime;
+
+    /// Bits kept set in RH_RF22_REG_08_OPERATING_MODE2: RH_RF22_ENLDM while low power listening
+    uint8_t             _opMode2;
 };
 
 /// @example rf22_client.pde
@@ -7,12 +7,6 @@
 // Generated with Silicon Labs WDS software:
 #include "radio_config_Si4460.h"
 
-// Interrupt vectors for the 3 Arduino interrupt pins
-// Each interrupt can be handled by a different instance of RH_RF24, allowing you to have
-// 2 or more RF24s per Arduino
-RH_RF24* RH_RF24::_deviceForInterrupt[RH_RF24_NUM_INTERRUPTS] = {0, 0, 0};
-uint8_t RH_RF24::_interruptCount = 0; // Index into _deviceForInterrupt for next device
-
 // This configuration data is defined in radio_config_Si4460.h 
 // which was generated with the Silicon Labs WDS program
 PROGMEM const uint8_t RFM26_CONFIGURATION_DATA[] = RADIO_CONFIGURATION_DATA_ARRAY;
@@ -66,7 +60,6 @@ RH_RF24::RH_RF24(uint8_t slaveSelectPin, uint8_t interruptPin, uint8_t sdnPin, R
     _interruptPin = interruptPin;
     _sdnPin = sdnPin;
     _idleMode = RH_RF24_DEVICE_STATE_READY;
-    _myInterruptIndex = 0xff; // Not allocated yet
 }
 
 void RH_RF24::setIdleMode(uint8_t idleMode)
@@ -79,13 +72,6 @@ bool RH_RF24::init()
     if (!RHSPIDriver::init())
 	return false;
 
-    // Determine the interrupt number that corresponds to the interruptPin
-    int interruptNumber = digitalPinToInterrupt(_interruptPin);
-    if (interruptNumber == NOT_AN_INTERRUPT)
-	return false;
-#ifdef RH_ATTACHINTERRUPT_TAKES_PIN_NUMBER
-    interruptNumber = _interruptPin;
-#endif
 
     // Initialise the radio
     power_on_reset();
@@ -114,28 +100,11 @@ bool RH_RF24::init()
     pinMode(_interruptPin, INPUT); 
 
     // Set up interrupt handler
-    // Since there are a limited number of interrupt glue functions isr*() available,
-    // we can only support a limited number of devices simultaneously
-    // ON some devices, notably most Arduinos, the interrupt pin passed in is actuallt the 
+    // On some devices, notably most Arduinos, the interrupt pin passed in is actually the 
     // interrupt number. You have to figure out the interruptnumber-to-interruptpin mapping
-    // yourself based on knwledge of what Arduino board you are running on.
-    if (_myInterruptIndex == 0xff)
-    {
-	// First run, no interrupt allocated yet
-	if (_interruptCount <= RH_RF24_NUM_INTERRUPTS)
-	    _myInterruptIndex = _interruptCount++;
-	else
-	    return false; // Too many devices, not enough interrupt vectors
-    }
-    _deviceForInterrupt[_myInterruptIndex] = this;
-    if (_myInterruptIndex == 0)
-	attachInterrupt(interruptNumber, isr0, FALLING);
-    else if (_myInterruptIndex == 1)
-	attachInterrupt(interruptNumber, isr1, FALLING);
-    else if (_myInterruptIndex == 2)
-	attachInterrupt(interruptNumber, isr2, FALLING);
-    else
-	return false; // Too many devices, not enough interrupt vectors
+    // yourself based on knowledge of what Arduino board you are running on.
+    if (!attachInterruptHandler(_interruptPin, FALLING))
+	return false; // Not an interrupt pin, or too many devices
 
     // Ensure we get the interrupts we need, irrespective of whats in the radio_config
     uint8_t int_ctl[] = {RH_RF24_MODEM_INT_STATUS_EN | RH_RF24_PH_INT_STATUS_EN, 0xff, 0xff, 0x00 };
@@ -193,6 +162,7 @@ bool RH_RF24::init()
 // C++ level interrupt handler for this instance
 void RH_RF24::handleInterrupt()
 {
+    uint32_t now = micros(); // Before anything else, so the timestamps are as close to the event as possible
     uint8_t status[8];
     command(RH_RF24_CMD_GET_INT_STATUS, NULL, 0, status, sizeof(status));
 
@@ -205,7 +175,7 @@ void RH_RF24::handleInterrupt()
 	{
 	    // After INVALID_SYNC, sometimes the radio gets into a silly state and subsequently reports it for every packet
 	    // Need to reset the radio and clear the RX FIFO, cause sometimes theres junk there too
-	    _mode = RHModeIdle;
+	    setMode(RHModeIdle);
 	    clearRxFifo();
 	    clearBuffer();
 	}
@@ -216,7 +186,7 @@ void RH_RF24::handleInterrupt()
 	{
 	    // CRC Error
 	    // Radio automatically went to _idleMode
-	    _mode = RHModeIdle;
+	    setMode(RHModeIdle);
 	    _rxBad++;
 
 	    clearRxFifo();
@@ -224,11 +194,12 @@ void RH_RF24::handleInterrupt()
 	}
 	if (status[2] & RH_RF24_INT_STATUS_PACKET_SENT)
 	{
+	    _txTime = now;
 	    _txGood++; 
 	    // Transmission does not automatically clear the tx buffer.
 	    // Could retransmit if we wanted
 	    // RH_RF24 configured to transition automatically to Idle after packet sent
-	    _mode = RHModeIdle;
+	    setMode(RHModeIdle);
 	    clearBuffer();
 	}
 	if (status[2] & RH_RF24_INT_STATUS_PACKET_RX)
@@ -239,13 +210,14 @@ void RH_RF24::handleInterrupt()
 	    command(RH_RF24_CMD_GET_MODEM_STATUS, NULL, 0, modem_status, sizeof(modem_status));
 	    _lastRssi = modem_status[3];
 	    _lastPreambleTime = millis();
+	    _rxTime = now;
 	    
 	    // Save it in our buffer
 	    readNextFragment();
 	    // And see if we have a valid message
 	    validateRxBuf();
 	    // Radio will have transitioned automatically to the _idleMode
-	    _mode = RHModeIdle;
+	    setMode(RHModeIdle);
 	}
 	if (status[2] & RH_RF24_INT_STATUS_TX_FIFO_ALMOST_EMPTY)
 	{
@@ -294,25 +266,6 @@ void RH_RF24::clearBuffer()
     _rxBufValid = false;
 }
 
-// These are low level functions that call the interrupt handler for the correct
-// instance of RH_RF24.
-// 3 interrupts allows us to have 3 different devices
-void RH_RF24::isr0()
-{
-    if (_deviceForInterrupt[0])
-	_deviceForInterrupt[0]->handleInterrupt();
-}
-void RH_RF24::isr1()
-{
-    if (_deviceForInterrupt[1])
-	_deviceForInterrupt[1]->handleInterrupt();
-}
-void RH_RF24::isr2()
-{
-    if (_deviceForInterrupt[2])
-	_deviceForInterrupt[2]->handleInterrupt();
-}
-
 bool RH_RF24::available()
 {
     if (_mode == RHModeTx)
@@ -347,6 +300,9 @@ bool RH_RF24::send(const uint8_t* data, uint8_t len)
     waitPacketSent(); // Make sure we dont interrupt an outgoing message
     setModeIdle(); // Prevent RX while filling the fifo
 
+    if (!waitDutyCycle(len))
+	return false; // Over the duty cycle budget for this band
+
     if (!waitCAD()) 
 	return false;  // Check channel activity
 
@@ -377,7 +333,7 @@ bool RH_RF24::send(const uint8_t* data, uint8_t len)
 // This is different to command() since we must not wait for CTS
 bool RH_RF24::writeTxFifo(uint8_t *data, uint8_t len)
 {
-    ATOMIC_BLOCK_START;
+    RH_SPI_TRANSACTION_START(_spi);
     // First send the command
     digitalWrite(_slaveSelectPin, LOW);
     _spi.transfer(RH_RF24_CMD_TX_FIFO_WRITE);
@@ -385,7 +341,7 @@ bool RH_RF24::writeTxFifo(uint8_t *data, uint8_t len)
     while (len--)
 	_spi.transfer(*data++);
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return true;
 }
 
@@ -427,6 +383,7 @@ void RH_RF24::readNextFragment()
     // So we have room
     // Now read the fifo_len bytes from the RX FIFO
     // This is different to command() since we dont wait for CTS
+    RH_SPI_TRANSACTION_START(_spi);
     digitalWrite(_slaveSelectPin, LOW);
     _spi.transfer(RH_RF24_CMD_RX_FIFO_READ);
     uint8_t* p = _buf + _bufLen;
@@ -434,6 +391,7 @@ void RH_RF24::readNextFragment()
     while (l--)
 	*p++ = _spi.transfer(0);
     digitalWrite(_slaveSelectPin, HIGH);
+    RH_SPI_TRANSACTION_END(_spi);
     _bufLen += fifo_len;
 }
 
@@ -442,6 +400,49 @@ uint8_t RH_RF24::maxMessageLength()
     return RH_RF24_MAX_MESSAGE_LEN;
 }
 
+float RH_RF24::bitRate()
+{
+    // The data rate is MODEM_DATA_RATE divided by the TX oversampling ratio in MODEM_TX_NCO_MODE,
+    // when the NCO runs at the crystal frequency, as in all the canned configurations
+    uint8_t values[4];
+    if (!get_properties(RH_RF24_PROPERTY_MODEM_DATA_RATE_2, values, sizeof(values)))
+	return 0;
+    uint32_t rate = ((uint32_t)values[0] << 16) | ((uint16_t)values[1] << 8) | values[2];
+    uint8_t txosr = (values[3] >> 2) & 0x03;
+    return rate / (txosr == 1 ? 40.0 : txosr == 2 ? 20.0 : 10.0);
+}
+
+uint32_t RH_RF24::timeOnAir(uint8_t len)
+{
+    float bps = bitRate();
+    if (bps <= 0)
+	return 0;
+    uint8_t preamble;
+    uint8_t sync;
+    uint8_t crc;
+    get_properties(RH_RF24_PROPERTY_PREAMBLE_TX_LENGTH, &preamble, 1);
+    get_properties(RH_RF24_PROPERTY_SYNC_CONFIG, &sync, 1);
+    get_properties(RH_RF24_PROPERTY_PKT_CRC_CONFIG, &crc, 1);
+
+    // CRC-8 ITU-T, then 16 bit polynomials, then 32 bit polynomials
+    crc &= RH_RF24_CRC_MASK;
+    uint8_t crcLen = crc == RH_RF24_CRC_NONE ? 0 : crc == RH_RF24_CRC_ITU_T ? 1 : crc < RH_RF24_CRC_KOOPMAN ? 2 : 4;
+
+    // Preamble + sync words + field 1 (length octet and CRC) + field 2 (headers, message and CRC)
+    uint32_t octets = preamble + (sync & RH_RF24_SYNC_CONFIG_LENGTH_MASK) + 1;
+    octets += 1 + crcLen;
+    octets += RH_RF24_HEADER_LEN + len + crcLen;
+    return (uint32_t)(octets * 8 * 1000000.0 / bps);
+}
+
+uint32_t RH_RF24::slotTime()
+{
+    float bps = bitRate();
+    if (bps <= 0)
+	return RHGenericDriver::slotTime();
+    return RH_CCA_SETTLE_TIME + (uint32_t)(RH_CSMA_SLOT_BITS * 1000000.0 / bps);
+}
+
 // Sets registers from a canned modem configuration structure
 void RH_RF24::setModemRegisters(const ModemConfig* config)
 {
@@ -634,7 +635,25 @@ bool RH_RF24::setFrequency(float centre, float afcPullInRange)
 
     // PROP_FREQ_CONTROL_GROUP
     uint8_t freq_control[] = { (uint8_t)n, (uint8_t)m2, (uint8_t)m1, (uint8_t)m0 };
-    return set_properties(RH_RF24_PROPERTY_FREQ_CONTROL_INTE, freq_control, sizeof(freq_control));
+    if (!set_properties(RH_RF24_PROPERTY_FREQ_CONTROL_INTE, freq_control, sizeof(freq_control)))
+	return false;
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    _frequency = centre / 1000000.0;
+#endif
+    return true;
+}
+
+bool RH_RF24::setChannel(uint8_t channel)
+{
+    if (_mode == RHModeTx || (_channelSpacing == 0.0 && _channelBase == 0.0))
+	return false; // Transmitting, or setChannels() has not been called
+    bool wasRx = (_mode == RHModeRx);
+    if (wasRx)
+	setModeIdle();
+    bool ret = setFrequency(_channelBase + channel * _channelSpacing);
+    if (wasRx)
+	setModeRx();
+    return ret;
 }
 
 void RH_RF24::setModeIdle()
@@ -647,7 +666,7 @@ void RH_RF24::setModeIdle()
 
 	uint8_t state[] = { _idleMode };
 	command(RH_RF24_CMD_REQUEST_DEVICE_STATE, state, sizeof(state));
-	_mode = RHModeIdle;
+	setMode(RHModeIdle);
     }
 }
 
@@ -658,11 +677,31 @@ bool RH_RF24::sleep()
 	uint8_t state[] = { RH_RF24_DEVICE_STATE_SLEEP };
 	command(RH_RF24_CMD_REQUEST_DEVICE_STATE, state, sizeof(state));
 
-	_mode = RHModeSleep;
+	setMode(RHModeSleep);
     }
     return true;
 }
 
+bool RH_RF24::readChannelRssi(int8_t* rssi)
+{
+    bool wasRx = (_mode == RHModeRx);
+    if (!wasRx)
+    {
+	setModeRx();
+	waitMicros(RH_CCA_SETTLE_TIME);
+    }
+    // Leave any pending modem interrupts for the interrupt handler
+    uint8_t keep_pending[] = { 0xff };
+    uint8_t modem_status[3];
+    command(RH_RF24_CMD_GET_MODEM_STATUS, keep_pending, sizeof(keep_pending), modem_status, sizeof(modem_status));
+    // CURR_RSSI is in units of 0.5dB, about 134dB above dBm with the default MODEM_RSSI_COMP
+    int16_t dbm = modem_status[2] / 2 - 134;
+    *rssi = dbm < -128 ? -128 : dbm;
+    if (!wasRx && _mode == RHModeRx)
+	setModeIdle();
+    return true;
+}
+
 void RH_RF24::setModeRx()
 {
     if (_mode != RHModeRx)
@@ -680,7 +719,7 @@ void RH_RF24::setModeRx()
 
 	uint8_t rx_config[] = { 0x00, RH_RF24_CONDITION_RX_START_IMMEDIATE, 0x00, 0x00, _idleMode, _idleMode, _idleMode};
 	command(RH_RF24_CMD_START_RX, rx_config, sizeof(rx_config));
-	_mode = RHModeRx;
+	setMode(RHModeRx);
     }
 }
 
@@ -695,7 +734,7 @@ void RH_RF24::setModeTx()
 	uint8_t tx_params[] = { 0x00, 
 				(uint8_t)((_idleMode << 4) | RH_RF24_CONDITION_RETRANSMIT_NO | RH_RF24_CONDITION_START_IMMEDIATE)};
 	command(RH_RF24_CMD_START_TX, tx_params, sizeof(tx_params));
-	_mode = RHModeTx;
+	setMode(RHModeTx);
     }
 }
 
@@ -736,7 +775,7 @@ bool RH_RF24::command(uint8_t cmd, const uint8_t* write_buf, uint8_t write_len,
 {
     bool   done = false;
 
-    ATOMIC_BLOCK_START;
+    RH_SPI_TRANSACTION_START(_spi);
     // First send the command
     digitalWrite(_slaveSelectPin, LOW);
     _spi.transfer(cmd);
@@ -778,7 +817,7 @@ bool RH_RF24::command(uint8_t cmd, const uint8_t* write_buf, uint8_t write_len,
 	// Finalise the read
 	digitalWrite(_slaveSelectPin, HIGH);
     }
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return done; // False if too many attempts at CTS
 }
 
@@ -877,14 +916,14 @@ uint8_t RH_RF24::frr_read(uint8_t reg)
     uint8_t ret;
 
     // Do not wait for CTS
-    ATOMIC_BLOCK_START;
+    RH_SPI_TRANSACTION_START(_spi);
     // First send the command
     digitalWrite(_slaveSelectPin, LOW);
     _spi.transfer(RH_RF24_PROPERTY_FRR_CTL_A_MODE + reg);
     // Get the fast response
     ret = _spi.transfer(0);
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
     return ret;
 }
 
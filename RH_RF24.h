@@ -24,10 +24,6 @@
 #include <RHGenericSPI.h>
 #include <RHSPIDriver.h>
 
-// This is the maximum number of interrupts the driver can support
-// Most Arduinos can handle 2, Megas can handle more
-#define RH_RF24_NUM_INTERRUPTS 3
-
 // Maximum payload length the RF24 can support, limited by our 1 octet message length
 #define RH_RF24_MAX_PAYLOAD_LEN 255
 
@@ -792,8 +788,8 @@ public:
 
     /// Constructor. You can have multiple instances, but each instance must have its own
     /// interrupt and slave select pin. After constructing, you must call init() to initialise the interface
-    /// and the radio module. A maximum of 3 instances can co-exist on one processor, provided there are sufficient
-    /// distinct interrupt lines, one for each instance.
+    /// and the radio module. Up to RH_MAX_INTERRUPT_DEVICES instances (of any RadioHead driver) can co-exist on one processor.
+    /// Each instance needs an interrupt line, but several instances can share one line: see RHGenericDriver.
     /// \param[in] slaveSelectPin the Arduino pin number of the output to use to select the RF24 before
     /// accessing it. Defaults to the normal SS pin for your Arduino (D10 for Diecimila, Uno etc, D53 for Mega, D10 for Maple)
     /// \param[in] interruptPin The interrupt Pin number that is connected to the RF24 DIO0 interrupt line. 
@@ -844,6 +840,13 @@ public:
     ///         setting the new frequency succeeded.
     bool        setFrequency(float centre, float afcPullInRange = 0.05);
 
+    /// Selects channel base + channel * spacing, as set by RHGenericDriver::setChannels(), with setFrequency().
+    /// If the receiver is on, it is restarted on the new frequency.
+    /// \param[in] channel The channel number
+    /// \return true if the frequency is within range. false while transmitting, or if setChannels()
+    /// has not been called
+    virtual bool setChannel(uint8_t channel);
+
     /// Sets all the properties required to configure the data modem in the RF24, including the data rate, 
     /// bandwidths etc. You can use this to configure the modem with custom configurations if none of the 
     /// canned configurations in ModemConfigChoice suit you.
@@ -873,6 +876,9 @@ public:
     /// \return true if a valid message was copied to buf
     bool        recv(uint8_t* buf, uint8_t* len);
 
+    /// Brings in RHGenericDriver::recv(buf, len, metadata), which this recv() would otherwise hide
+    using RHGenericDriver::recv;
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. 
@@ -885,6 +891,17 @@ public:
     /// \return The maximum message length supported by this driver
     uint8_t maxMessageLength();
 
+    /// Computes the time on air of a message from the data rate, preamble and sync word lengths
+    /// and CRC polynomial currently set in the radio, and the 2 packet fields used by this driver
+    /// \param[in] len Length of the message data in octets, as would be passed to send()
+    /// \return Time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
+    /// Returns the CSMA/CA slot time used by csmaPoll(): RH_CCA_SETTLE_TIME for readChannelRssi(),
+    /// plus RH_CSMA_SLOT_BITS at the data rate of the current modem configuration.
+    /// \return The slot time in microseconds
+    virtual uint32_t slotTime();
+
     /// Sets the length of the preamble
     /// in bytes. 
     /// Caution: this should be set to the same 
@@ -999,8 +1016,19 @@ public:
     virtual bool    sleep();
 
 protected:
+    /// Measures the current RSSI for clear channel assessment by isChannelActive(), turning 
+    /// the receiver on for RH_CCA_SETTLE_TIME first if it is not already on
+    /// \param[out] rssi The RSSI in approximate dBm (the absolute value depends on MODEM_RSSI_COMP in the 
+    /// radio configuration, so the default noise floor threshold is recommended)
+    /// \return true
+    virtual bool   readChannelRssi(int8_t* rssi);
+
+    /// Returns the data rate set by setModemConfig() or setModemRegisters()
+    /// \return The data rate in bits per second
+    float          bitRate();
+
     /// This is a low level function to handle the interrupts for one instance of RF24.
-    /// Called automatically by isr*()
+    /// Called automatically by the interrupt dispatcher in RHGenericDriver
     /// Should not need to be called by user code.
     void           handleInterrupt();
 
@@ -1044,28 +1072,9 @@ protected:
 
 private:
 
-    /// Low level interrupt service routine for RF24 connected to interrupt 0
-    static void         isr0();
-
-    /// Low level interrupt service routine for RF24 connected to interrupt 1
-    static void         isr1();
-
-    /// Low level interrupt service routine for RF24 connected to interrupt 1
-    static void         isr2();
-
-    /// Array of instances connected to interrupts 0 and 1
-    static RH_RF24*     _deviceForInterrupt[];
-
-    /// Index of next interrupt number to use in _deviceForInterrupt
-    static uint8_t      _interruptCount;
-
     /// The configured interrupt pin connected to this instance
     uint8_t             _interruptPin;
 
-    /// The index into _deviceForInterrupt[] for this device (if an interrupt is already allocated)
-    /// else 0xff
-    uint8_t             _myInterruptIndex;
-
     /// The configured pin connected to the SDN pin of the radio
     uint8_t             _sdnPin;
 
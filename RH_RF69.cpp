@@ -5,14 +5,6 @@
 
 #include <RH_RF69.h>
 
-// Interrupt vectors for the 3 Arduino interrupt pins
-// Each interrupt can be handled by a different instance of RH_RF69, allowing you to have
-// 2 or more RF69s per Arduino
-#ifndef RH_RF69_IRQLESS
-RH_RF69* RH_RF69::_deviceForInterrupt[RH_RF69_NUM_INTERRUPTS] = {0, 0, 0};
-uint8_t RH_RF69::_interruptCount = 0; // Index into _deviceForInterrupt for next device
-#endif
-
 // These are indexed by the values of ModemConfigChoice
 // Stored in flash (program) memory to save SRAM
 // It is important to keep the modulation index for FSK between 0.5 and 10
@@ -94,9 +86,15 @@ RH_RF69::RH_RF69(uint8_t slaveSelectPin, uint8_t interruptPin, RHGenericSPI& spi
     RHSPIDriver(slaveSelectPin, spi)
 {
     _idleMode = RH_RF69_OPMODE_MODE_STDBY;
+    _rxPayloadLen = 0;
+    _rxPayloadCount = 0;
+    _txBufSentIndex = 0;
+    _txBufLen = 0;
+    _fifoLevelPin = RH_RF69_NO_FIFO_LEVEL_PIN;
+    _encrypted = false;
+    _deviceType = 0; // Not read until init()
 #ifndef RH_RF69_IRQLESS
     _interruptPin = interruptPin;
-    _myInterruptIndex = 0xff; // Not allocated yet
 #endif
 }
 
@@ -110,16 +108,6 @@ bool RH_RF69::init()
     if (!RHSPIDriver::init())
 	return false;
 
-#ifndef RH_RF69_IRQLESS
-    // Determine the interrupt number that corresponds to the interruptPin
-    int interruptNumber = digitalPinToInterrupt(_interruptPin);
-    if (interruptNumber == NOT_AN_INTERRUPT)
-	return false;
-#ifdef RH_ATTACHINTERRUPT_TAKES_PIN_NUMBER
-    interruptNumber = _interruptPin;
-#endif
-#endif // ndef RH_RF69_IRQLESS
-
     // Get the device type and check it
     // This also tests whether we are really connected to a device
     // My test devices return 0x24
@@ -136,28 +124,19 @@ bool RH_RF69::init()
     pinMode(_interruptPin, INPUT); 
 
     // Set up interrupt handler
-    // Since there are a limited number of interrupt glue functions isr*() available,
-    // we can only support a limited number of devices simultaneously
-    // ON some devices, notably most Arduinos, the interrupt pin passed in is actuallt the 
+    // On some devices, notably most Arduinos, the interrupt pin passed in is actually the 
     // interrupt number. You have to figure out the interruptnumber-to-interruptpin mapping
-    // yourself based on knwledge of what Arduino board you are running on.
-    if (_myInterruptIndex == 0xff)
+    // yourself based on knowledge of what Arduino board you are running on.
+    if (!attachInterruptHandler(_interruptPin, RISING))
+	return false; // Not an interrupt pin, or too many devices
+
+    // DIO1 is FifoLevel, which we need on both edges: rising when receiving, falling when transmitting
+    if (_fifoLevelPin != RH_RF69_NO_FIFO_LEVEL_PIN)
     {
-	// First run, no interrupt allocated yet
-	if (_interruptCount <= RH_RF69_NUM_INTERRUPTS)
-	    _myInterruptIndex = _interruptCount++;
-	else
-	    return false; // Too many devices, not enough interrupt vectors
+	pinMode(_fifoLevelPin, INPUT); 
+	if (!attachInterruptHandler(_fifoLevelPin, CHANGE))
+	    return false; // Not an interrupt pin, or too many devices
     }
-    _deviceForInterrupt[_myInterruptIndex] = this;
-    if (_myInterruptIndex == 0)
-	attachInterrupt(interruptNumber, isr0, RISING);
-    else if (_myInterruptIndex == 1)
-	attachInterrupt(interruptNumber, isr1, RISING);
-    else if (_myInterruptIndex == 2)
-	attachInterrupt(interruptNumber, isr2, RISING);
-    else
-	return false; // Too many devices, not enough interrupt vectors
 
 #endif // ndef RH_RF69_IRQLESS
 
@@ -168,17 +147,16 @@ bool RH_RF69::init()
     // 4 bytes preamble
     // 2 SYNC words 2d, d4
     // 2 CRC CCITT octets computed on the header, length and data (this in the modem config data)
-    // 0 to 60 bytes data
+    // 0 to 60 bytes data (up to 251 if streaming through the FIFO, see setFifoLevelPin())
     // RSSI Threshold -114dBm
     // We dont use the RH_RF69s address filtering: instead we prepend our own headers to the beginning
     // of the RH_RF69 payload
-    spiWrite(RH_RF69_REG_3C_FIFOTHRESH, RH_RF69_FIFOTHRESH_TXSTARTCONDITION_NOTEMPTY | 0x0f); // thresh 15 is default
+    spiWrite(RH_RF69_REG_3C_FIFOTHRESH, RH_RF69_FIFOTHRESH_TXSTARTCONDITION_NOTEMPTY | RH_RF69_FIFO_THRESHOLD);
     // RSSITHRESH is default
 //    spiWrite(RH_RF69_REG_29_RSSITHRESH, 220); // -110 dbM
     // SYNCCONFIG is default. SyncSize is set later by setSyncWords()
 //    spiWrite(RH_RF69_REG_2E_SYNCCONFIG, RH_RF69_SYNCCONFIG_SYNCON); // auto, tolerance 0
-    // PAYLOADLENGTH is default
-//    spiWrite(RH_RF69_REG_38_PAYLOADLENGTH, RH_RF69_FIFO_SIZE); // max size only for RX
+    // PAYLOADLENGTH (max size only for RX) is set by setEncryptionKey()
     // PACKETCONFIG 2 is default 
     spiWrite(RH_RF69_REG_6F_TESTDAGC, RH_RF69_TESTDAGC_CONTINUOUSDAGC_IMPROVED_LOWBETAOFF);
     // If high power boost set previously, disable it
@@ -199,6 +177,10 @@ bool RH_RF69::init()
     // No encryption
     setEncryptionKey(NULL);
     // +13dBm, same as power-on default
+    // Typical currents from the RFM69HW datasheet. setTxPower() sets the transmit current
+    setModeCurrent(RHModeSleep, 0.0001);
+    setModeCurrent(RHModeIdle, 1.25);
+    setModeCurrent(RHModeRx, 16.0);
     setTxPower(13); 
 
     return true;
@@ -208,30 +190,53 @@ bool RH_RF69::init()
 // RH_RF69 is unusual in Mthat it has several interrupt lines, and not a single, combined one.
 // On Moteino, only one of the several interrupt lines (DI0) from the RH_RF69 is connnected to the processor.
 // We use this to get PACKETSDENT and PAYLOADRADY interrupts.
+// If DIO1 is also connected, we get FifoLevel interrupts from it, to stream long packets.
 #ifndef RH_RF69_IRQLESS
 void RH_RF69::handleInterrupt()
 {
+    uint32_t now = micros(); // Before anything else, so the timestamps are as close to the event as possible
     // Get the interrupt cause
     uint8_t irqflags2 = spiRead(RH_RF69_REG_28_IRQFLAGS2);
-    if (_mode == RHModeTx && (irqflags2 & RH_RF69_IRQFLAGS2_PACKETSENT))
+    if (_mode == RHModeTx)
     {
-	// A transmitter message has been fully sent
-	setModeIdle(); // Clears FIFO
-	_txGood++;
-//	Serial.println("PACKETSENT");
+	if (irqflags2 & RH_RF69_IRQFLAGS2_PACKETSENT)
+	{
+	    // A transmitter message has been fully sent
+	    _txTime = now;
+	    setModeIdle(); // Clears FIFO
+	    _txGood++;
+//	    Serial.println("PACKETSENT");
+	}
+	else if (!(irqflags2 & RH_RF69_IRQFLAGS2_FIFOLEVEL))
+	    sendNextFragment();
     }
     // Must look for PAYLOADREADY, not CRCOK, since only PAYLOADREADY occurs _after_ AES decryption
     // has been done
-    if (_mode == RHModeRx && (irqflags2 & RH_RF69_IRQFLAGS2_PAYLOADREADY))
+    if (_mode == RHModeRx)
     {
-	// A complete message has been received with good CRC
-	_lastRssi = -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
-	_lastPreambleTime = millis();
-
-	setModeIdle();
-	// Save it in our buffer
-	readFifo();
-//	Serial.println("PAYLOADREADY");
+	if (irqflags2 & RH_RF69_IRQFLAGS2_PAYLOADREADY)
+	{
+	    // A complete message has been received
+	    _lastRssi = -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
+	    _lastPreambleTime = millis();
+	    _rxTime = now;
+
+	    setModeIdle();
+	    // CRCAUTOCLEAROFF means we also get PAYLOADREADY for bad packets, so a long packet
+	    // that we have started to read is always finished
+	    if (!(irqflags2 & RH_RF69_IRQFLAGS2_CRCOK) 
+		&& (spiRead(RH_RF69_REG_37_PACKETCONFIG1) & RH_RF69_PACKETCONFIG1_CRC_ON))
+	    {
+		_rxBad++;
+		_rxPayloadLen = 0;
+		_rxPayloadCount = 0;
+	    }
+	    else
+		readFifo(); // Save it in our buffer
+//	    Serial.println("PAYLOADREADY");
+	}
+	else if ((irqflags2 & RH_RF69_IRQFLAGS2_FIFOLEVEL) && !_encrypted)
+	    readNextFragment(); // Encrypted packets are not decrypted until PAYLOADREADY, and fit in the FIFO
     }
 }
 #endif // ndef RH_RF69_IRQLESS
@@ -242,55 +247,101 @@ void RH_RF69::handleInterrupt()
 // Performance issue?
 void RH_RF69::readFifo()
 {
-    ATOMIC_BLOCK_START;
+    RH_SPI_TRANSACTION_START(_spi);
     digitalWrite(_slaveSelectPin, LOW);
     _spi.transfer(RH_RF69_REG_00_FIFO); // Send the start address with the write mask off
-    uint8_t payloadlen = _spi.transfer(0); // First byte is payload len (counting the headers)
-    if (payloadlen <= RH_RF69_MAX_ENCRYPTABLE_PAYLOAD_LEN &&
-	payloadlen >= RH_RF69_HEADER_LEN)
+    if (!_rxPayloadLen)
+	_rxPayloadLen = _spi.transfer(0); // First byte is payload len (counting the headers)
+    if (_rxPayloadLen <= maxMessageLength() + RH_RF69_HEADER_LEN &&
+	_rxPayloadLen >= RH_RF69_HEADER_LEN)
     {
-	_rxHeaderTo = _spi.transfer(0);
+	readPayload(_rxPayloadLen - _rxPayloadCount);
 	// Check addressing
 	if (_promiscuous ||
 	    _rxHeaderTo == _thisAddress ||
 	    _rxHeaderTo == RH_BROADCAST_ADDRESS)
 	{
-	    // Get the rest of the headers
-	    _rxHeaderFrom  = _spi.transfer(0);
-	    _rxHeaderId    = _spi.transfer(0);
-	    _rxHeaderFlags = _spi.transfer(0);
-	    // And now the real payload
-	    for (_bufLen = 0; _bufLen < (payloadlen - RH_RF69_HEADER_LEN); _bufLen++)
-		_buf[_bufLen] = _spi.transfer(0);
+	    _bufLen = _rxPayloadLen - RH_RF69_HEADER_LEN;
 	    _rxGood++;
 	    _rxBufValid = true;
 	}
     }
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
+    _rxPayloadLen = 0;
+    _rxPayloadCount = 0;
     // Any junk remaining in the FIFO will be cleared next time we go to receive mode.
 }
 
-// These are low level functions that call the interrupt handler for the correct
-// instance of RH_RF69.
-// 3 interrupts allows us to have 3 different devices
-#ifndef RH_RF69_IRQLESS
-void RH_RF69::isr0()
+void RH_RF69::readNextFragment()
 {
-    if (_deviceForInterrupt[0])
-	_deviceForInterrupt[0]->handleInterrupt();
+    bool bad = false;
+    RH_SPI_TRANSACTION_START(_spi);
+    digitalWrite(_slaveSelectPin, LOW);
+    _spi.transfer(RH_RF69_REG_00_FIFO); // Send the start address with the write mask off
+    uint8_t len = RH_RF69_FIFO_THRESHOLD;
+    if (!_rxPayloadLen)
+    {
+	_rxPayloadLen = _spi.transfer(0); // First byte is payload len (counting the headers)
+	len--;
+	bad = _rxPayloadLen > maxMessageLength() + RH_RF69_HEADER_LEN || _rxPayloadLen < RH_RF69_HEADER_LEN;
+    }
+    if (!bad)
+    {
+	// Leave the last part of the packet for readFifo()
+	if (len > _rxPayloadLen - _rxPayloadCount)
+	    len = _rxPayloadLen - _rxPayloadCount;
+	readPayload(len);
+    }
+    digitalWrite(_slaveSelectPin, HIGH);
+    RH_SPI_TRANSACTION_END(_spi);
+
+    if (bad)
+    {
+	// Something wrong there, start again. Going to receive mode clears the FIFO
+	_rxBad++;
+	_rxPayloadLen = 0;
+	setModeIdle();
+	setModeRx();
+    }
 }
-void RH_RF69::isr1()
+
+void RH_RF69::readPayload(uint8_t len)
 {
-    if (_deviceForInterrupt[1])
-	_deviceForInterrupt[1]->handleInterrupt();
+    while (len--)
+    {
+	uint8_t octet = _spi.transfer(0);
+	uint8_t i = _rxPayloadCount++;
+	if (i == 0)
+	    _rxHeaderTo = octet;
+	else if (!(_promiscuous ||
+		   _rxHeaderTo == _thisAddress ||
+		   _rxHeaderTo == RH_BROADCAST_ADDRESS))
+	    continue; // Not for us, dont overwrite anything
+	else if (i == 1)
+	    _rxHeaderFrom = octet;
+	else if (i == 2)
+	    _rxHeaderId = octet;
+	else if (i == 3)
+	    _rxHeaderFlags = octet;
+	else
+	    _buf[i - RH_RF69_HEADER_LEN] = octet;
+    }
 }
-void RH_RF69::isr2()
+
+void RH_RF69::sendNextFragment()
 {
-    if (_deviceForInterrupt[2])
-	_deviceForInterrupt[2]->handleInterrupt();
+    if (_txBufSentIndex < _txBufLen)
+    {
+	// Some left to send?
+	uint8_t len = _txBufLen - _txBufSentIndex;
+	// But dont send too much
+	if (len > (RH_RF69_FIFO_SIZE - RH_RF69_FIFO_THRESHOLD - 1))
+	    len = (RH_RF69_FIFO_SIZE - RH_RF69_FIFO_THRESHOLD - 1);
+	spiBurstWrite(RH_RF69_REG_00_FIFO, _buf + _txBufSentIndex, len);
+	_txBufSentIndex += len;
+    }
 }
-#endif // ndef RH_RF69_IRQLESS
 
 
 int8_t RH_RF69::temperatureRead()
@@ -307,6 +358,9 @@ bool RH_RF69::setFrequency(float centre, float afcPullInRange)
 {
     // Frf = FRF / FSTEP
     uint32_t frf = (uint32_t)((centre * 1000000.0) / RH_RF69_FSTEP);
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    _frequency = centre;
+#endif
     spiWrite(RH_RF69_REG_07_FRFMSB, (frf >> 16) & 0xff);
     spiWrite(RH_RF69_REG_08_FRFMID, (frf >> 8) & 0xff);
     spiWrite(RH_RF69_REG_09_FRFLSB, frf & 0xff);
@@ -315,6 +369,19 @@ bool RH_RF69::setFrequency(float centre, float afcPullInRange)
     return true;
 }
 
+bool RH_RF69::setChannel(uint8_t channel)
+{
+    if (_mode == RHModeTx || (_channelSpacing == 0.0 && _channelBase == 0.0))
+	return false; // Transmitting, or setChannels() has not been called
+    bool wasRx = (_mode == RHModeRx);
+    if (wasRx)
+	setModeIdle();
+    bool ret = setFrequency(_channelBase + channel * _channelSpacing);
+    if (wasRx)
+	setModeRx();
+    return ret;
+}
+
 int8_t RH_RF69::rssiRead()
 {
     // Force a new value to be measured
@@ -327,6 +394,20 @@ int8_t RH_RF69::rssiRead()
     return -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
 }
 
+bool RH_RF69::readChannelRssi(int8_t* rssi)
+{
+    bool wasRx = (_mode == RHModeRx);
+    if (!wasRx)
+    {
+	setModeRx();
+	waitMicros(RH_CCA_SETTLE_TIME);
+    }
+    *rssi = rssiRead();
+    if (!wasRx && _mode == RHModeRx)
+	setModeIdle();
+    return true;
+}
+
 void RH_RF69::setOpMode(uint8_t mode)
 {
     uint8_t opmode = spiRead(RH_RF69_REG_01_OPMODE);
@@ -350,7 +431,7 @@ void RH_RF69::setModeIdle()
 	    spiWrite(RH_RF69_REG_5C_TESTPA2, RH_RF69_TESTPA2_NORMAL);
 	}
 	setOpMode(_idleMode);
-	_mode = RHModeIdle;
+	setMode(RHModeIdle);
     }
 }
 
@@ -359,7 +440,7 @@ bool RH_RF69::sleep()
     if (_mode != RHModeSleep)
     {
 	spiWrite(RH_RF69_REG_01_OPMODE, RH_RF69_OPMODE_MODE_SLEEP);
-	_mode = RHModeSleep;
+	setMode(RHModeSleep);
     }
     return true;
 }
@@ -374,9 +455,11 @@ void RH_RF69::setModeRx()
 	    spiWrite(RH_RF69_REG_5A_TESTPA1, RH_RF69_TESTPA1_NORMAL);
 	    spiWrite(RH_RF69_REG_5C_TESTPA2, RH_RF69_TESTPA2_NORMAL);
 	}
-	spiWrite(RH_RF69_REG_25_DIOMAPPING1, RH_RF69_DIOMAPPING1_DIO0MAPPING_01); // Set interrupt line 0 PayloadReady
+	spiWrite(RH_RF69_REG_25_DIOMAPPING1, RH_RF69_DIOMAPPING1_DIO0MAPPING_01); // Set interrupt line 0 PayloadReady, line 1 FifoLevel
+	_rxPayloadLen = 0;
+	_rxPayloadCount = 0;
 	setOpMode(RH_RF69_OPMODE_MODE_RX); // Clears FIFO
-	_mode = RHModeRx;
+	setMode(RHModeRx);
     }
 }
 
@@ -391,9 +474,9 @@ void RH_RF69::setModeTx()
 	    spiWrite(RH_RF69_REG_5A_TESTPA1, RH_RF69_TESTPA1_BOOST);
 	    spiWrite(RH_RF69_REG_5C_TESTPA2, RH_RF69_TESTPA2_BOOST);
 	}
-	spiWrite(RH_RF69_REG_25_DIOMAPPING1, RH_RF69_DIOMAPPING1_DIO0MAPPING_00); // Set interrupt line 0 PacketSent
+	spiWrite(RH_RF69_REG_25_DIOMAPPING1, RH_RF69_DIOMAPPING1_DIO0MAPPING_00); // Set interrupt line 0 PacketSent, line 1 FifoLevel
 	setOpMode(RH_RF69_OPMODE_MODE_TX); // Clears FIFO
-	_mode = RHModeTx;
+	setMode(RHModeTx);
     }
 }
 
@@ -426,6 +509,20 @@ void RH_RF69::setTxPower(int8_t power)
 	palevel = RH_RF69_PALEVEL_PA1ON | RH_RF69_PALEVEL_PA2ON | ((_power + 14) & RH_RF69_PALEVEL_OUTPUTPOWER);
     }
     spiWrite(RH_RF69_REG_11_PALEVEL, palevel);
+
+    // Datasheet figures for +20, +17, +13, +10 and 0dBm
+    float current;
+    if (_power > 17)
+	current = 130.0;
+    else if (_power > 13)
+	current = 95.0;
+    else if (_power > 10)
+	current = 45.0;
+    else if (_power > 0)
+	current = 33.0;
+    else
+	current = 20.0;
+    setModeCurrent(RHModeTx, current);
 }
 
 // Sets registers from a canned modem configuration structure
@@ -433,7 +530,8 @@ void RH_RF69::setModemRegisters(const ModemConfig* config)
 {
     spiBurstWrite(RH_RF69_REG_02_DATAMODUL,     &config->reg_02, 5);
     spiBurstWrite(RH_RF69_REG_19_RXBW,          &config->reg_19, 2);
-    spiWrite(RH_RF69_REG_37_PACKETCONFIG1,       config->reg_37);
+    // Dont clear the FIFO on CRC errors, so we always get PAYLOADREADY to finish a long packet
+    spiWrite(RH_RF69_REG_37_PACKETCONFIG1,       config->reg_37 | RH_RF69_PACKETCONFIG1_CRCAUTOCLEAROFF);
 }
 
 // Set one of the canned FSK Modem configs
@@ -493,6 +591,18 @@ void RH_RF69::setEncryptionKey(uint8_t* key)
     {
 	spiWrite(RH_RF69_REG_3D_PACKETCONFIG2, spiRead(RH_RF69_REG_3D_PACKETCONFIG2) & ~RH_RF69_PACKETCONFIG2_AESON);
     }
+    _encrypted = key != NULL;
+    // Receiver discards packets that are too long for us
+    spiWrite(RH_RF69_REG_38_PAYLOADLENGTH, maxMessageLength() + RH_RF69_HEADER_LEN);
+}
+
+bool RH_RF69::setFifoLevelPin(uint8_t fifoLevelPin)
+{
+    // After init() the interrupt would not be attached, nor the payload length set for long messages
+    if (_deviceType)
+	return false;
+    _fifoLevelPin = fifoLevelPin;
+    return true;
 }
 
 bool RH_RF69::available()
@@ -503,14 +613,18 @@ bool RH_RF69::available()
 
     if (_mode == RHModeRx && (irqflags2 & RH_RF69_IRQFLAGS2_PAYLOADREADY))
     {
-    // A complete message has been received with good CRC
+    // A complete message has been received
     _lastRssi = -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
     _lastPreambleTime = millis();
 
     setModeIdle();
 
-    // Save it in our buffer
-    readFifo();
+    // CRCAUTOCLEAROFF means we also get PAYLOADREADY for bad packets
+    if (!(irqflags2 & RH_RF69_IRQFLAGS2_CRCOK) 
+	&& (spiRead(RH_RF69_REG_37_PACKETCONFIG1) & RH_RF69_PACKETCONFIG1_CRC_ON))
+	_rxBad++;
+    else
+	readFifo(); // Save it in our buffer
     }
 #endif // defined RH_RF69_IRQLESS
 
@@ -540,16 +654,23 @@ bool RH_RF69::recv(uint8_t* buf, uint8_t* len)
 
 bool RH_RF69::send(const uint8_t* data, uint8_t len)
 {
-    if (len > RH_RF69_MAX_MESSAGE_LEN)
+    if (len > maxMessageLength())
 	return false;
 
     waitPacketSent(); // Make sure we dont interrupt an outgoing message
     setModeIdle(); // Prevent RX while filling the fifo
 
+    if (!waitDutyCycle(len))
+	return false; // Over the duty cycle budget for this band
+
     if (!waitCAD()) 
 	return false;  // Check channel activity
 
-    ATOMIC_BLOCK_START;
+    uint8_t fragment = len;
+    if (fragment > RH_RF69_FIFO_SIZE - RH_RF69_HEADER_LEN - 1)
+	fragment = RH_RF69_FIFO_SIZE - RH_RF69_HEADER_LEN - 1;
+
+    RH_SPI_TRANSACTION_START(_spi);
     digitalWrite(_slaveSelectPin, LOW);
     _spi.transfer(RH_RF69_REG_00_FIFO | RH_RF69_SPI_WRITE_MASK); // Send the start address with the write mask on
     _spi.transfer(len + RH_RF69_HEADER_LEN); // Include length of headers
@@ -558,11 +679,25 @@ bool RH_RF69::send(const uint8_t* data, uint8_t len)
     _spi.transfer(_txHeaderFrom);
     _spi.transfer(_txHeaderId);
     _spi.transfer(_txHeaderFlags);
-    // Now the payload
-    while (len--)
-	_spi.transfer(*data++);
+    // Now the payload, as much as will fit in the FIFO
+    for (uint8_t i = 0; i < fragment; i++)
+	_spi.transfer(data[i]);
     digitalWrite(_slaveSelectPin, HIGH);
-    ATOMIC_BLOCK_END;
+    RH_SPI_TRANSACTION_END(_spi);
+
+    // The rest of a long message goes in _buf, and is added to the FIFO by sendNextFragment()
+    // as FifoLevel interrupts say it drains
+    _txBufSentIndex = 0;
+    if (len > fragment)
+    {
+	ATOMIC_BLOCK_START;
+	_rxBufValid = false;
+	memcpy(_buf, data + fragment, len - fragment);
+	_txBufLen = len - fragment;
+	ATOMIC_BLOCK_END;
+    }
+    else
+	_txBufLen = 0;
 
     setModeTx(); // Start the transmitter
     return true;
@@ -578,7 +713,7 @@ bool RH_RF69::waitPacketSent()
     return false;
 
     while (!(spiRead(RH_RF69_REG_28_IRQFLAGS2) & RH_RF69_IRQFLAGS2_PACKETSENT)){
-      YIELD;
+      waitEvent(eventCount(), RH_EVENT_POLL_INTERVAL); // No interrupts, so just dont spin
     }
 
     // A transmitter message has been fully sent
@@ -588,9 +723,55 @@ bool RH_RF69::waitPacketSent()
 }
 #endif // defined RH_RF69_IRQLESS
 
+float RH_RF69::bitRate()
+{
+    // Bit rate is RH_RF69_FXOSC / bitrate register
+    uint16_t bitrate = (spiRead(RH_RF69_REG_03_BITRATEMSB) << 8) | spiRead(RH_RF69_REG_04_BITRATELSB);
+    return bitrate ? RH_RF69_FXOSC / bitrate : 0;
+}
+
+uint32_t RH_RF69::timeOnAir(uint8_t len)
+{
+    float bps = bitRate();
+    if (bps <= 0)
+	return 0;
+    uint8_t syncconfig = spiRead(RH_RF69_REG_2E_SYNCCONFIG);
+    uint8_t packetconfig1 = spiRead(RH_RF69_REG_37_PACKETCONFIG1);
+
+    // Preamble + sync words + length octet + headers and message (padded to a whole number of AES blocks
+    // when encrypted) + CRC
+    uint32_t octets = (spiRead(RH_RF69_REG_2C_PREAMBLEMSB) << 8) | spiRead(RH_RF69_REG_2D_PREAMBLELSB);
+    if (syncconfig & RH_RF69_SYNCCONFIG_SYNCON)
+	octets += ((syncconfig & RH_RF69_SYNCCONFIG_SYNCSIZE) >> 3) + 1;
+    uint16_t payload = len + RH_RF69_HEADER_LEN;
+    if (_encrypted)
+	payload = (payload + 15) & ~15;
+    octets += 1 + payload;
+    if (packetconfig1 & RH_RF69_PACKETCONFIG1_CRC_ON)
+	octets += 2;
+
+    return (uint32_t)(octets * 8 * 1000000.0 / bps);
+}
+
+uint32_t RH_RF69::slotTime()
+{
+    float bps = bitRate();
+    if (bps <= 0)
+	return RHGenericDriver::slotTime();
+    return RH_CCA_SETTLE_TIME + (uint32_t)(RH_CSMA_SLOT_BITS * 1000000.0 / bps);
+}
+
 uint8_t RH_RF69::maxMessageLength()
 {
+    // Messages longer than the FIFO need the FifoLevel interrupt on DIO1, and the RF69 cant 
+    // encrypt more than 64 octets
+#ifdef RH_RF69_IRQLESS
+    return RH_RF69_MAX_MESSAGE_LEN < RH_RF69_MAX_FIFO_MESSAGE_LEN ? RH_RF69_MAX_MESSAGE_LEN : RH_RF69_MAX_FIFO_MESSAGE_LEN;
+#else
+    if (_fifoLevelPin == RH_RF69_NO_FIFO_LEVEL_PIN || _encrypted)
+	return RH_RF69_MAX_MESSAGE_LEN < RH_RF69_MAX_FIFO_MESSAGE_LEN ? RH_RF69_MAX_MESSAGE_LEN : RH_RF69_MAX_FIFO_MESSAGE_LEN;
     return RH_RF69_MAX_MESSAGE_LEN;
+#endif
 }
 
 bool RH_RF69::printRegister(uint8_t reg)
@@ -14,11 +14,12 @@
 
 // If you don't want to use interupts (mainly to win one I/O pin) then
 // you just need to uncomment this line, if you're on Raspberry PI 
-// it will be set automaticly below
+// it will be set automaticly below, unless you build with RH_LINUX_IRQ
+// to get real interrupts from the kernel (see RHutil/RasPi.h)
 //#define RH_RF69_IRQLESS
 
-#if (RH_PLATFORM == RH_PLATFORM_RASPI)
-// No IRQ used on Raspberry PI
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) && !defined(RH_LINUX_IRQ)
+// No IRQ used on Raspberry PI, unless built with RH_LINUX_IRQ
 #ifndef RH_RF69_IRQLESS
 #define RH_RF69_IRQLESS
 #endif
@@ -30,10 +31,6 @@
 // The Frequency Synthesizer step = RH_RF69_FXOSC / 2^^19
 #define RH_RF69_FSTEP  (RH_RF69_FXOSC / 524288)
 
-// This is the maximum number of interrupts the driver can support
-// Most Arduinos can handle 2, Megas can handle more
-#define RH_RF69_NUM_INTERRUPTS 3
-
 // This is the bit in the SPI address that marks it as a write
 #define RH_RF69_SPI_WRITE_MASK 0x80
 
@@ -47,16 +44,36 @@
 // The headers are inside the RF69's payload and are therefore encrypted if encryption is enabled
 #define RH_RF69_HEADER_LEN 4
 
-// This is the maximum message length that can be supported by this driver. Limited by
-// the size of the FIFO, since we are unable to support on-the-fly filling and emptying 
-// of the FIFO.
-// Can be pre-defined to a smaller size (to save SRAM) prior to including this header
+// Maximum payload length the RF69 can support in variable length packet mode, without encryption
+#define RH_RF69_MAX_PAYLOAD_LEN 255
+
+// This is the maximum message length that can be sent without streaming through the FIFO,
+// and the maximum when encryption is enabled.
 // Here we allow for 4 bytes of address and header and payload to be included in the 64 byte encryption limit.
 // the one byte payload length is not encrpyted
+#define RH_RF69_MAX_FIFO_MESSAGE_LEN (RH_RF69_MAX_ENCRYPTABLE_PAYLOAD_LEN - RH_RF69_HEADER_LEN)
+
+// This is the maximum message length that can be supported by this driver. Messages longer than
+// RH_RF69_MAX_FIFO_MESSAGE_LEN are streamed through the FIFO, which requires the DIO1 
+// interrupt, see setFifoLevelPin(). The receive buffer is this long, so on AVRs (short of SRAM)
+// and without interrupts it defaults to RH_RF69_MAX_FIFO_MESSAGE_LEN.
+// Can be pre-defined to a different size prior to including this header
 #ifndef RH_RF69_MAX_MESSAGE_LEN
-#define RH_RF69_MAX_MESSAGE_LEN (RH_RF69_MAX_ENCRYPTABLE_PAYLOAD_LEN - RH_RF69_HEADER_LEN)
+ #if ((RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__AVR__)) || defined(RH_RF69_IRQLESS)
+  #define RH_RF69_MAX_MESSAGE_LEN RH_RF69_MAX_FIFO_MESSAGE_LEN
+ #else
+  #define RH_RF69_MAX_MESSAGE_LEN (RH_RF69_MAX_PAYLOAD_LEN - RH_RF69_HEADER_LEN)
+ #endif
 #endif
 
+// The FIFO threshold. FifoLevel (on DIO1) is set while the FIFO holds more than this many octets.
+// When receiving long packets, we read this many octets each time FifoLevel is set. When transmitting
+// we add more octets each time FifoLevel is cleared.
+#define RH_RF69_FIFO_THRESHOLD 32
+
+// Indicates no FifoLevel interrupt pin, see setFifoLevelPin()
+#define RH_RF69_NO_FIFO_LEVEL_PIN 0xff
+
 // Keep track of the mode the RF69 is in
 #define RH_RF69_MODE_IDLE         0
 #define RH_RF69_MODE_RX           1
@@ -359,7 +376,7 @@
 /// LowPowerLabs (which is what we used to develop the RH_RF69 driver)
 ///
 /// This Driver provides functions for sending and receiving messages of up
-/// to 60 octets on any frequency supported by the RF69, in a range of
+/// to 60 octets (or 251 octets if DIO1 is connected, see below) on any frequency supported by the RF69, in a range of
 /// predefined data rates and frequency deviations.  Frequency can be set with
 /// 61Hz precision to any frequency from 240.0MHz to 960.0MHz. Caution: most modules only support a more limited
 /// range of frequencies due to antenna tuning.
@@ -386,9 +403,23 @@
 /// - 2 octets SYNC 0x2d, 0xd4 (configurable, so you can use this as a network filter)
 /// - 1 octet RH_RF69 payload length
 /// - 4 octets HEADER: (TO, FROM, ID, FLAGS)
-/// - 0 to 60 octets DATA 
+/// - 0 to 251 octets DATA 
 /// - 2 octets CRC computed with CRC16(IBM), computed on HEADER and DATA
 ///
+/// \par Messages longer than the FIFO
+///
+/// The RF69 has a 66 octet FIFO, but can send and receive packets of up to 255 octets (without encryption)
+/// if the FIFO is refilled while transmitting and drained while receiving. This needs the FifoLevel
+/// signal, which is only available on DIO1. If you connect DIO1 to another interrupt capable pin 
+/// and tell the driver with setFifoLevelPin() before calling init(), messages of up to
+/// RH_RF69_MAX_MESSAGE_LEN octets can be sent and received (251, but 60 on AVR unless you define it larger
+/// to spend the SRAM): the driver adds more to the FIFO each time the TX FIFO drains to
+/// RH_RF69_FIFO_THRESHOLD octets, and reads RH_RF69_FIFO_THRESHOLD octets each time the RX FIFO fills past it. DIO0 still signals PacketSent and PayloadReady. Otherwise, or if encryption is
+/// enabled, messages are limited to RH_RF69_MAX_FIFO_MESSAGE_LEN (60) octets, and maxMessageLength()
+/// reports the limit in force. Sending a long message uses the receive buffer, so any received message 
+/// not yet read by recv() is discarded.
+/// At 250kbps, the FIFO threshold leaves about 1ms to respond to each DIO1 interrupt.
+///
 /// For technical reasons, the message format is not protocol compatible with the
 /// 'HopeRF Radio Transceiver Message Library for Arduino'
 /// http://www.airspayce.com/mikem/arduino/HopeRF from the same author. Nor is
@@ -730,8 +761,8 @@ public:
 
     /// Constructor. You can have multiple instances, but each instance must have its own
     /// interrupt and slave select pin. After constructing, you must call init() to initialise the interface
-    /// and the radio module. A maximum of 3 instances can co-exist on one processor, provided there are sufficient
-    /// distinct interrupt lines, one for each instance.
+    /// and the radio module. Up to RH_MAX_INTERRUPT_DEVICES instances (of any RadioHead driver) can co-exist on one processor.
+    /// Each instance needs an interrupt line, but several instances can share one line: see RHGenericDriver.
     /// \param[in] slaveSelectPin the Arduino pin number of the output to use to select the RF69 before
     /// accessing it. Defaults to the normal SS pin for your Arduino (D10 for Diecimila, Uno etc, D53 for Mega, D10 for Maple)
     /// \param[in] interruptPin The interrupt Pin number that is connected to the RF69 DIO0 interrupt line. 
@@ -775,6 +806,13 @@ public:
     /// \return true if the selected frquency centre is within range
     bool        setFrequency(float centre, float afcPullInRange = 0.05);
 
+    /// Selects channel base + channel * spacing, as set by RHGenericDriver::setChannels(), with setFrequency().
+    /// If the receiver is on, it is restarted on the new frequency.
+    /// \param[in] channel The channel number
+    /// \return true if the frequency is within range. false while transmitting, or if setChannels()
+    /// has not been called
+    virtual bool setChannel(uint8_t channel);
+
     /// Reads and returns the current RSSI value. 
     /// Causes the current signal strength to be measured and returned
     /// If you want to find the RSSI
@@ -846,6 +884,9 @@ public:
     /// \return true if a valid message was copied to buf
     bool        recv(uint8_t* buf, uint8_t* len);
 
+    /// Brings in RHGenericDriver::recv(buf, len, metadata), which this recv() would otherwise hide
+    using RHGenericDriver::recv;
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. 
@@ -892,9 +933,32 @@ public:
     uint32_t getLastPreambleTime();
 
     /// The maximum message length supported by this driver
-    /// \return The maximum message length supported by this driver
+    /// \return The maximum message length supported by this driver: RH_RF69_MAX_MESSAGE_LEN if 
+    /// a FifoLevel pin has been set and encryption is disabled, else RH_RF69_MAX_FIFO_MESSAGE_LEN (or 
+    /// RH_RF69_MAX_MESSAGE_LEN if that is smaller).
     uint8_t maxMessageLength();
 
+    /// Computes the time on air of a message from the bit rate, preamble length, sync word length,
+    /// CRC and encryption currently set in the radio.
+    /// \param[in] len Length of the message data in octets, as would be passed to send()
+    /// \return Time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
+    /// Returns the CSMA/CA slot time used by csmaPoll(): RH_CCA_SETTLE_TIME for readChannelRssi(),
+    /// plus RH_CSMA_SLOT_BITS at the bit rate in RH_RF69_REG_03_BITRATEMSB to turn around to transmit.
+    /// \return The slot time in microseconds, or RH_CSMA_DEFAULT_SLOT_TIME if the bit rate is not set
+    virtual uint32_t slotTime();
+
+    /// Tells the driver which processor pin is connected to the RF69 DIO1 pin, which signals
+    /// FifoLevel. This allows messages longer than the FIFO to be sent and received.
+    /// Must be called before init(). The pin must be interrupt capable (or, on some Arduinos, 
+    /// is the interrupt number, like the interruptPin passed to the constructor).
+    /// Not available with RH_RF69_IRQLESS.
+    /// \param[in] fifoLevelPin The pin connected to DIO1, or RH_RF69_NO_FIFO_LEVEL_PIN 
+    /// (the default) if DIO1 is not connected.
+    /// \return true if the pin was set. false if init() has already been called
+    bool setFifoLevelPin(uint8_t fifoLevelPin);
+
     /// Prints the value of a single register
     /// to the Serial device if RH_HAVE_SERIAL is defined for the current platform
     /// For debugging/testing only
@@ -924,43 +988,50 @@ public:
     virtual bool    sleep();
 
 protected:
+    /// Measures the RSSI for clear channel assessment by isChannelActive() with rssiRead(), turning 
+    /// the receiver on for RH_CCA_SETTLE_TIME first if it is not already on
+    /// \param[out] rssi The RSSI in dBm
+    /// \return true
+    virtual bool   readChannelRssi(int8_t* rssi);
+
+    /// Returns the bit rate set in RH_RF69_REG_03_BITRATEMSB and RH_RF69_REG_04_BITRATELSB
+    /// \return The bit rate in bits per second, or 0 if the registers have not been set
+    float          bitRate();
+
     /// This is a low level function to handle the interrupts for one instance of RF69.
-    /// Called automatically by isr*()
+    /// Called automatically by the interrupt dispatcher in RHGenericDriver
     /// Should not need to be called by user code.
 #ifndef RH_RF69_IRQLESS
     void           handleInterrupt();
 #endif
 
     /// Low level function to read the FIFO and put the received data into the receive buffer
+    /// Called when PayloadReady is signalled. Reads the rest of a packet whose start has already been
+    /// read by readNextFragment().
     /// Should not need to be called by user code.
     void           readFifo();
 
-protected:
-
-#ifndef RH_RF69_IRQLESS
-
-    /// Low level interrupt service routine for RF69 connected to interrupt 0
-    static void         isr0();
+    /// Reads RH_RF69_FIFO_THRESHOLD octets of a long packet from the FIFO, when FifoLevel is set.
+    /// Should not need to be called by user code.
+    void           readNextFragment();
 
-    /// Low level interrupt service routine for RF69 connected to interrupt 1
-    static void         isr1();
+    /// Adds more of a long message to the FIFO, when FifoLevel is cleared while transmitting.
+    /// Should not need to be called by user code.
+    void           sendNextFragment();
 
-    /// Low level interrupt service routine for RF69 connected to interrupt 1
-    static void         isr2();
+    /// Reads octets of the packet being received from the FIFO into the headers and _buf.
+    /// The octets of a packet not addressed to this node are read and discarded.
+    /// Must be called with the FIFO address already sent in an SPI transaction.
+    /// \param[in] len Number of octets to read
+    void           readPayload(uint8_t len);
 
-    /// Array of instances connected to interrupts 0 and 1
-    static RH_RF69*     _deviceForInterrupt[];
+protected:
 
-    /// Index of next interrupt number to use in _deviceForInterrupt
-    static uint8_t      _interruptCount;
+#ifndef RH_RF69_IRQLESS
 
     /// The configured interrupt pin connected to this instance
     uint8_t             _interruptPin;
 
-    /// The index into _deviceForInterrupt[] for this device (if an interrupt is already allocated)
-    /// else 0xff
-    uint8_t             _myInterruptIndex;
-
 #endif
 
     /// The radio OP mode to use when mode is RHModeIdle
@@ -975,9 +1046,27 @@ protected:
     /// The message length in _buf
     volatile uint8_t    _bufLen;
 
-    /// Array of octets of teh last received message or the next to transmit message
+    /// Array of octets of teh last received message or the rest of a long message being transmitted
     uint8_t             _buf[RH_RF69_MAX_MESSAGE_LEN];
 
+    /// Length octet of the packet being received, 0 if none started yet
+    volatile uint8_t    _rxPayloadLen;
+
+    /// Number of payload octets (including headers) of the packet being received read so far
+    volatile uint8_t    _rxPayloadCount;
+
+    /// Index into _buf of the next octet of a long message to write to the FIFO
+    volatile uint8_t    _txBufSentIndex;
+
+    /// Number of octets of a long message in _buf, to be written to the FIFO
+    volatile uint8_t    _txBufLen;
+
+    /// Pin connected to DIO1 (FifoLevel), or RH_RF69_NO_FIFO_LEVEL_PIN
+    uint8_t             _fifoLevelPin;
+
+    /// True if AES encryption is enabled
+    bool                _encrypted;
+
     /// True when there is a valid message in the Rx buffer
     volatile bool    _rxBufValid;
 
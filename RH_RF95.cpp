@@ -5,14 +5,6 @@
 
 #include <RH_RF95.h>
 
-// Interrupt vectors for the 3 Arduino interrupt pins
-// Each interrupt can be handled by a different instance of RH_RF95, allowing you to have
-// 2 or more LORAs per Arduino
-#ifndef RH_RF95_IRQLESS
-RH_RF95* RH_RF95::_deviceForInterrupt[RH_RF95_NUM_INTERRUPTS] = {0, 0, 0};
-uint8_t RH_RF95::_interruptCount = 0; // Index into _deviceForInterrupt for next device
-#endif
-
 // These are indexed by the values of ModemConfigChoice
 // Stored in flash (program) memory to save SRAM
 PROGMEM static const RH_RF95::ModemConfig MODEM_CONFIG_TABLE[] =
@@ -25,14 +17,46 @@ PROGMEM static const RH_RF95::ModemConfig MODEM_CONFIG_TABLE[] =
     
 };
 
+// Bandwidths in Hz indexed by RH_RF95_BW >> 4
+static const float BANDWIDTHS[] = { 7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000 };
+
+// Noise in each bandwidth relative to 125kHz in units of 0.25dB, indexed by RH_RF95_BW >> 4
+static const int8_t BANDWIDTH_NOISE[] = { -48, -43, -36, -31, -24, -19, -12, 0, 12, 24 };
+
+// Get the demodulation SNR floor of a canned configuration, and the noise in its bandwidth
+// relative to 125kHz, both in units of 0.25dB
+static void adrConfigLimits(uint8_t config, int16_t* floor, int16_t* noise)
+{
+    RH_RF95::ModemConfig cfg;
+    memcpy_P(&cfg, &MODEM_CONFIG_TABLE[config], sizeof(cfg));
+    uint8_t bw = (cfg.reg_1d & RH_RF95_BW) >> 4;
+    int16_t sf = (cfg.reg_1e & RH_RF95_SPREADING_FACTOR) >> 4;
+    *noise = (bw < sizeof(BANDWIDTH_NOISE)) ? BANDWIDTH_NOISE[bw] : 0;
+    // -5dB at SF6, 2.5dB lower for each step up in spreading factor
+    *floor = -20 - 10 * (sf - 6);
+}
+
 RH_RF95::RH_RF95(uint8_t slaveSelectPin, uint8_t interruptPin, RHGenericSPI& spi)
     :
     RHSPIDriver(slaveSelectPin, spi),
-    _rxBufValid(0)
+    _rxBufValid(0),
+    _rxContinuous(false),
+    _implicitLength(0),
+    _adr(false),
+    _adrBase(0),
+    _adrListen(0),
+    _adrPending(0),
+    _adrTuned(0),
+    _adrMargin(RH_RF95_ADR_DEFAULT_MARGIN * 4),
+    _adrLastHeard(0)
 {
+    memset(_adrPeers, 0, sizeof(_adrPeers));
+#if RH_RF95_RX_QUEUE_LEN > 1
+    _rxQueueHead = 0;
+    _rxQueueCount = 0;
+#endif
 #ifndef RH_RF95_IRQLESS
     _interruptPin = interruptPin;
-    _myInterruptIndex = 0xff; // Not allocated yet
 #endif
 }
 
@@ -44,16 +68,6 @@ bool RH_RF95::init()
     if (!RHSPIDriver::init())
 	return false;
 
-#ifndef RH_RF95_IRQLESS
-    // Determine the interrupt number that corresponds to the interruptPin
-    int interruptNumber = digitalPinToInterrupt(_interruptPin);
-    if (interruptNumber == NOT_AN_INTERRUPT)
-	return false;
-#ifdef RH_ATTACHINTERRUPT_TAKES_PIN_NUMBER
-    interruptNumber = _interruptPin;
-#endif
-#endif // ndef RH_RF95_IRQLESS
-
     // Get the device type and check it
     // This also tests whether we are really connected to a device
     // My test devices return 0x83
@@ -80,28 +94,11 @@ bool RH_RF95::init()
     pinMode(_interruptPin, INPUT); 
 
     // Set up interrupt handler
-    // Since there are a limited number of interrupt glue functions isr*() available,
-    // we can only support a limited number of devices simultaneously
-    // ON some devices, notably most Arduinos, the interrupt pin passed in is actuallt the 
+    // On some devices, notably most Arduinos, the interrupt pin passed in is actually the 
     // interrupt number. You have to figure out the interruptnumber-to-interruptpin mapping
-    // yourself based on knwledge of what Arduino board you are running on.
-    if (_myInterruptIndex == 0xff)
-    {
-	// First run, no interrupt allocated yet
-	if (_interruptCount <= RH_RF95_NUM_INTERRUPTS)
-	    _myInterruptIndex = _interruptCount++;
-	else
-	    return false; // Too many devices, not enough interrupt vectors
-    }
-    _deviceForInterrupt[_myInterruptIndex] = this;
-    if (_myInterruptIndex == 0)
-	attachInterrupt(interruptNumber, isr0, RISING);
-    else if (_myInterruptIndex == 1)
-	attachInterrupt(interruptNumber, isr1, RISING);
-    else if (_myInterruptIndex == 2)
-	attachInterrupt(interruptNumber, isr2, RISING);
-    else
-	return false; // Too many devices, not enough interrupt vectors
+    // yourself based on knowledge of what Arduino board you are running on.
+    if (!attachInterruptHandler(_interruptPin, RISING))
+	return false; // Not an interrupt pin, or too many devices
 
 #endif // ndef RH_RF95_IRQLESS
 
@@ -127,6 +124,11 @@ bool RH_RF95::init()
     setPreambleLength(8); // Default is 8
     // An innocuous ISM frequency, same as RF22's
     setFrequency(434.0);
+    // Typical currents from the SX1276 datasheet section 2.5. setTxPower() sets the transmit current
+    setModeCurrent(RHModeSleep, 0.0002);
+    setModeCurrent(RHModeIdle, 1.6);
+    setModeCurrent(RHModeRx, 10.8);
+    setModeCurrent(RHModeCad, 10.8);
     // Lowish power
     setTxPower(13);
 
@@ -141,6 +143,7 @@ bool RH_RF95::init()
 #ifndef RH_RF95_IRQLESS
 void RH_RF95::handleInterrupt()
 {
+    uint32_t now = micros(); // Before anything else, so the timestamps are as close to the event as possible
     // Read the interrupt register
     uint8_t irq_flags = spiRead(RH_RF95_REG_12_IRQ_FLAGS);
     if (_mode == RHModeRx && irq_flags & (RH_RF95_RX_TIMEOUT | RH_RF95_PAYLOAD_CRC_ERROR))
@@ -150,28 +153,17 @@ void RH_RF95::handleInterrupt()
     else if (_mode == RHModeRx && irq_flags & RH_RF95_RX_DONE)
     {
 	// Have received a packet
-	uint8_t len = spiRead(RH_RF95_REG_13_RX_NB_BYTES);
-
-	// Reset the fifo read ptr to the beginning of the packet
-	spiWrite(RH_RF95_REG_0D_FIFO_ADDR_PTR, spiRead(RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR));
-	spiBurstRead(RH_RF95_REG_00_FIFO, _buf, len);
-	_bufLen = len;
-	spiWrite(RH_RF95_REG_12_IRQ_FLAGS, 0xff); // Clear all IRQ flags
-
-	// Remember the RSSI of this packet
-	// this is according to the doc, but is it really correct?
-	// weakest receiveable signals are reported RSSI at about -66
-	_lastRssi = spiRead(RH_RF95_REG_1A_PKT_RSSI_VALUE) - 137;
-
-	// We have received a message.
-	validateRxBuf(); 
-	if (_rxBufValid)
-	    setModeIdle(); // Got one 
+	_rxTime = now;
+	handleRxDone();
     }
     else if (_mode == RHModeTx && irq_flags & RH_RF95_TX_DONE)
     {
+	_txTime = now;
 	_txGood++;
-	setModeIdle();
+	if (_rxContinuous)
+	    setModeRx(); // Straight back to listening
+	else
+	    setModeIdle();
     }
     else if (_mode == RHModeCad && irq_flags & RH_RF95_CAD_DONE)
     {
@@ -183,31 +175,106 @@ void RH_RF95::handleInterrupt()
 }
 #endif // ndef RH_RF95_IRQLESS
 
-// These are low level functions that call the interrupt handler for the correct
-// instance of RH_RF95.
-// 3 interrupts allows us to have 3 different devices
-#ifndef RH_RF95_IRQLESS
-void RH_RF95::isr0()
+// Read a packet that the modem has just received (RxDone) out of the FIFO
+// In continuous receive mode the modem is left listening, and messages go through the queue (if any),
+// so that the headers and RSSI of the message most recently returned by recv() are not overwritten
+// by the ISR before the caller has looked at them. available() moves them into the receive buffer.
+void RH_RF95::handleRxDone()
 {
-    if (_deviceForInterrupt[0])
-	_deviceForInterrupt[0]->handleInterrupt();
+    RxMetadata metadata;
+#ifdef RH_RF95_IRQLESS
+    // We only find out when available() is next called, which may be any time later
+    metadata.timestamp = 0;
+    metadata.valid = RH_RX_METADATA_SNR | RH_RX_METADATA_FREQUENCY_ERROR;
+#else
+    metadata.timestamp = _rxTime; // Latched by handleInterrupt()
+    metadata.valid = RH_RX_METADATA_SNR | RH_RX_METADATA_TIMESTAMP | RH_RX_METADATA_FREQUENCY_ERROR;
+#endif
+    uint8_t len = spiRead(RH_RF95_REG_13_RX_NB_BYTES);
+
+    // Remember the RSSI of this packet
+    // this is according to the doc, but is it really correct?
+    // weakest receiveable signals are reported RSSI at about -66
+    metadata.rssi = spiRead(RH_RF95_REG_1A_PKT_RSSI_VALUE) - 137;
+    int8_t snr = (int8_t)spiRead(RH_RF95_REG_19_PKT_SNR_VALUE);
+    metadata.snr = snr / 4;
+
+    // The frequency error is a 20 bit signed number in units of 2^24 / FXOSC * BW / 500kHz Hz
+    uint8_t fei[3];
+    spiBurstRead(RH_RF95_REG_28_FEI_MSB, fei, sizeof(fei));
+    int32_t feiValue = ((int32_t)(fei[0] & 0x0f) << 16) | ((uint16_t)fei[1] << 8) | fei[2];
+    if (feiValue & 0x80000)
+	feiValue -= 0x100000;
+    uint8_t bw = (spiRead(RH_RF95_REG_1D_MODEM_CONFIG1) & RH_RF95_BW) >> 4;
+    if (bw >= sizeof(BANDWIDTHS) / sizeof(BANDWIDTHS[0]))
+	bw = 7;
+    metadata.frequencyError = feiValue * (16777216.0 / RH_RF95_FXOSC) * BANDWIDTHS[bw] / 500000;
+
+    // Reset the fifo read ptr to the beginning of the packet. In RXCONTINUOUS the modem writes each
+    // packet after the previous one, and FifoRxCurrentAddr always points at the latest
+    spiWrite(RH_RF95_REG_0D_FIFO_ADDR_PTR, spiRead(RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR));
+
+#if RH_RF95_RX_QUEUE_LEN > 1
+    if (_rxContinuous)
+    {
+	if (_rxQueueCount >= RH_RF95_RX_QUEUE_LEN - 1)
+	{
+	    _rxBad++; // No room, dropped
+	    return;
+	}
+	RxQueueEntry* entry = &_rxQueue[(_rxQueueHead + _rxQueueCount) % (RH_RF95_RX_QUEUE_LEN - 1)];
+	spiBurstRead(RH_RF95_REG_00_FIFO, entry->buf, len);
+	if (len < headerLen())
+	    return; // Too short to be a real message
+	if (_promiscuous ||
+	    entry->buf[0] == _thisAddress ||
+	    entry->buf[0] == RH_BROADCAST_ADDRESS)
+	{
+	    entry->len = len;
+	    entry->metadata = metadata;
+	    _rxQueueCount++;
+	    _rxGood++;
+	    if (_adr)
+		adrReceived(entry->buf, snr);
+	}
+	return;
+    }
+#else
+    if (_rxContinuous && _rxBufValid)
+    {
+	_rxBad++; // Previous message not collected yet, dropped
+	return;
+    }
+#endif
+
+    spiBurstRead(RH_RF95_REG_00_FIFO, _buf, len);
+    _bufLen = len;
+    _lastRssi = metadata.rssi;
+    _rxMetadata = metadata;
+
+    // We have received a message.
+    validateRxBuf(); 
+    if (_rxBufValid && _adr)
+	adrReceived(_buf, snr);
+    if (_rxBufValid && !_rxContinuous)
+	setModeIdle(); // Got one 
 }
-void RH_RF95::isr1()
+
+// The interrupt handler does not overwrite _rxMetadata while there is a valid message in _buf
+void RH_RF95::rxMetadata(RxMetadata* metadata)
 {
-    if (_deviceForInterrupt[1])
-	_deviceForInterrupt[1]->handleInterrupt();
+    *metadata = _rxMetadata;
 }
-void RH_RF95::isr2()
+
+void RH_RF95::setRxContinuous(bool continuous)
 {
-    if (_deviceForInterrupt[2])
-	_deviceForInterrupt[2]->handleInterrupt();
+    _rxContinuous = continuous;
 }
-#endif // ndef RH_RF95_IRQLESS
 
 // Check whether the latest received message is complete and uncorrupted
 void RH_RF95::validateRxBuf()
 {
-    if (_bufLen < 4)
+    if (_bufLen < headerLen())
 	return; // Too short to be a real message
     // Extract the 4 headers
     _rxHeaderTo    = _buf[0];
@@ -231,23 +298,7 @@ bool RH_RF95::available()
     if (_mode == RHModeRx && irq_flags & RH_RF95_RX_DONE)
     {
     // Have received a packet
-    uint8_t len = spiRead(RH_RF95_REG_13_RX_NB_BYTES);
-
-    // Reset the fifo read ptr to the beginning of the packet
-    spiWrite(RH_RF95_REG_0D_FIFO_ADDR_PTR, spiRead(RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR));
-    spiBurstRead(RH_RF95_REG_00_FIFO, _buf, len);
-    _bufLen = len;
-    spiWrite(RH_RF95_REG_12_IRQ_FLAGS, 0xff); // Clear all IRQ flags
-
-    // Remember the RSSI of this packet
-    // this is according to the doc, but is it really correct?
-    // weakest receiveable signals are reported RSSI at about -66
-    _lastRssi = spiRead(RH_RF95_REG_1A_PKT_RSSI_VALUE) - 137;
-
-    // We have received a message.
-    validateRxBuf(); 
-    if (_rxBufValid)
-        setModeIdle(); // Got one 
+    handleRxDone();
     }
     else if (_mode == RHModeCad && irq_flags & RH_RF95_CAD_DONE)
     {
@@ -261,7 +312,38 @@ bool RH_RF95::available()
 
     if (_mode == RHModeTx)
 	return false;
+    if (   _adr 
+	&& _adrListen != _adrBase 
+	&& millis() - _adrLastHeard > RH_RF95_ADR_LISTEN_TIMEOUT)
+    {
+	// Nobody seems to be able to reach us. Go back to where everyone can find us
+	ATOMIC_BLOCK_START;
+	_adrListen = _adrPending = _adrBase;
+	_adrLastHeard = millis();
+	ATOMIC_BLOCK_END;
+	setModeIdle(); // setModeRx() will retune
+    }
     setModeRx();
+#if RH_RF95_RX_QUEUE_LEN > 1
+    if (!_rxBufValid && _rxQueueCount)
+    {
+	// Move the oldest queued message into the receive buffer
+	ATOMIC_BLOCK_START;
+	RxQueueEntry* entry = &_rxQueue[_rxQueueHead];
+	memcpy(_buf, entry->buf, entry->len);
+	_bufLen = entry->len;
+	_lastRssi = entry->metadata.rssi;
+	_rxMetadata = entry->metadata;
+	_rxHeaderTo    = _buf[0];
+	_rxHeaderFrom  = _buf[1];
+	_rxHeaderId    = _buf[2];
+	_rxHeaderFlags = _buf[3];
+	_rxQueueHead = (_rxQueueHead + 1) % (RH_RF95_RX_QUEUE_LEN - 1);
+	_rxQueueCount--;
+	_rxBufValid = true;
+	ATOMIC_BLOCK_END;
+    }
+#endif
     return _rxBufValid; // Will be set by the interrupt handler when a good message is received
 }
 
@@ -280,10 +362,10 @@ bool RH_RF95::recv(uint8_t* buf, uint8_t* len)
     if (buf && len)
     {
 	ATOMIC_BLOCK_START;
-	// Skip the 4 headers that are at the beginning of the rxBuf
-	if (*len > _bufLen-RH_RF95_HEADER_LEN)
-	    *len = _bufLen-RH_RF95_HEADER_LEN;
-	memcpy(buf, _buf+RH_RF95_HEADER_LEN, *len);
+	// Skip the 4 headers (and adaptive data rate octet) that are at the beginning of the rxBuf
+	if (*len > _bufLen-headerLen())
+	    *len = _bufLen-headerLen();
+	memcpy(buf, _buf+headerLen(), *len);
 	ATOMIC_BLOCK_END;
     }
     clearRxBuf(); // This message accepted and cleared
@@ -292,12 +374,20 @@ bool RH_RF95::recv(uint8_t* buf, uint8_t* len)
 
 bool RH_RF95::send(const uint8_t* data, uint8_t len)
 {
-    if (len > RH_RF95_MAX_MESSAGE_LEN)
+    if (len > maxMessageLength())
 	return false;
 
     waitPacketSent(); // Make sure we dont interrupt an outgoing message
     setModeIdle();
 
+    // Retune for the destination before checking the duty cycle and channel activity
+    uint8_t adrOctet = 0;
+    if (_adr)
+	adrOctet = adrPrepareSend();
+
+    if (!waitDutyCycle(len))
+	return false; // Over the duty cycle budget for this band
+
     if (!waitCAD()) 
 	return false;  // Check channel activity
 
@@ -308,9 +398,14 @@ bool RH_RF95::send(const uint8_t* data, uint8_t len)
     spiWrite(RH_RF95_REG_00_FIFO, _txHeaderFrom);
     spiWrite(RH_RF95_REG_00_FIFO, _txHeaderId);
     spiWrite(RH_RF95_REG_00_FIFO, _txHeaderFlags);
+    if (_adr)
+	spiWrite(RH_RF95_REG_00_FIFO, adrOctet);
     // The message data
     spiBurstWrite(RH_RF95_REG_00_FIFO, data, len);
-    spiWrite(RH_RF95_REG_22_PAYLOAD_LENGTH, len + RH_RF95_HEADER_LEN);
+    // In implicit header mode, pad to the fixed length. The payload length register is already set
+    for (; len < _implicitLength; len++)
+	spiWrite(RH_RF95_REG_00_FIFO, 0);
+    spiWrite(RH_RF95_REG_22_PAYLOAD_LENGTH, len + headerLen());
 
     setModeTx(); // Start the transmitter
     // when Tx is done, interruptHandler will fire and radio mode will return to STANDBY
@@ -327,12 +422,15 @@ bool RH_RF95::waitPacketSent()
     return false;
 
     while (!(spiRead(RH_RF95_REG_12_IRQ_FLAGS) & RH_RF95_TX_DONE)){
-      YIELD;
+      waitEvent(eventCount(), RH_EVENT_POLL_INTERVAL); // No interrupts, so just dont spin
     }
 
     // A transmitter message has been fully sent
     _txGood++;
-    setModeIdle(); // Clears FIFO
+    if (_rxContinuous)
+	setModeRx(); // Straight back to listening
+    else
+	setModeIdle(); // Clears FIFO
     return true;
 }
 #endif // defined RH_RF95_IRQLESS
@@ -355,13 +453,57 @@ bool RH_RF95::printRegisters()
 
 uint8_t RH_RF95::maxMessageLength()
 {
-    return RH_RF95_MAX_MESSAGE_LEN;
+    if (_implicitLength)
+	return _implicitLength;
+    return RH_RF95_MAX_MESSAGE_LEN - (_adr ? 1 : 0);
+}
+
+uint32_t RH_RF95::timeOnAir(uint8_t len)
+{
+    uint8_t reg_1d = spiRead(RH_RF95_REG_1D_MODEM_CONFIG1);
+    uint8_t reg_1e = spiRead(RH_RF95_REG_1E_MODEM_CONFIG2);
+    uint8_t reg_26 = spiRead(RH_RF95_REG_26_MODEM_CONFIG3);
+    uint16_t preamble = (spiRead(RH_RF95_REG_20_PREAMBLE_MSB) << 8) | spiRead(RH_RF95_REG_21_PREAMBLE_LSB);
+
+    uint8_t bw = (reg_1d & RH_RF95_BW) >> 4;
+    if (bw >= sizeof(BANDWIDTHS) / sizeof(BANDWIDTHS[0]))
+	bw = 7; // Reserved value, assume 125kHz
+    int16_t sf = (reg_1e & RH_RF95_SPREADING_FACTOR) >> 4;
+    int16_t cr = (reg_1d & RH_RF95_CODING_RATE) >> 1; // 1 to 4 for 4/5 to 4/8
+    int16_t crc = (reg_1e & RH_RF95_PAYLOAD_CRC_ON) ? 1 : 0;
+    int16_t ih = (reg_1d & RH_RF95_IMPLICIT_HEADER_MODE_ON) ? 1 : 0;
+    int16_t de = (reg_26 & RH_RF95_LOW_DATA_RATE_OPTIMIZE) ? 1 : 0;
+    int16_t pl = (len < _implicitLength ? _implicitLength : len) + headerLen();
+
+    float symbolTime = (float)(1L << sf) / BANDWIDTHS[bw]; // seconds
+    // Number of payload symbols
+    int16_t num = 8 * pl - 4 * sf + 28 + 16 * crc - 20 * ih;
+    int16_t den = 4 * (sf - 2 * de);
+    uint32_t payloadSymbols = 8;
+    if (num > 0 && den > 0)
+	payloadSymbols += ((num + den - 1) / den) * (cr + 4);
+
+    return (uint32_t)((preamble + 4.25 + payloadSymbols) * symbolTime * 1000000.0);
+}
+
+// A CAD takes (2^SF + 32) / BW (Semtech AN1200.21). Allow another symbol to process the result
+// and start transmitting
+uint32_t RH_RF95::slotTime()
+{
+    uint8_t bw = (spiRead(RH_RF95_REG_1D_MODEM_CONFIG1) & RH_RF95_BW) >> 4;
+    if (bw >= sizeof(BANDWIDTHS) / sizeof(BANDWIDTHS[0]))
+	bw = 7;
+    uint8_t sf = (spiRead(RH_RF95_REG_1E_MODEM_CONFIG2) & RH_RF95_SPREADING_FACTOR) >> 4;
+    return (uint32_t)((2 * (1L << sf) + 32) * 1000000.0 / BANDWIDTHS[bw]);
 }
 
 bool RH_RF95::setFrequency(float centre)
 {
     // Frf = FRF / FSTEP
     uint32_t frf = (centre * 1000000.0) / RH_RF95_FSTEP;
+#if RH_DUTY_CYCLE_MAX_BANDS > 0
+    _frequency = centre;
+#endif
     spiWrite(RH_RF95_REG_06_FRF_MSB, (frf >> 16) & 0xff);
     spiWrite(RH_RF95_REG_07_FRF_MID, (frf >> 8) & 0xff);
     spiWrite(RH_RF95_REG_08_FRF_LSB, frf & 0xff);
@@ -369,12 +511,38 @@ bool RH_RF95::setFrequency(float centre)
     return true;
 }
 
+bool RH_RF95::setChannel(uint8_t channel)
+{
+    if (_mode == RHModeTx || (_channelSpacing == 0.0 && _channelBase == 0.0))
+	return false; // Transmitting, or setChannels() has not been called
+    bool wasRx = (_mode == RHModeRx);
+    if (wasRx)
+	setModeIdle();
+    bool ret = setFrequency(_channelBase + channel * _channelSpacing);
+    if (wasRx)
+	setModeRx();
+    return ret;
+}
+
+bool RH_RF95::setModemConfigIndex(uint8_t index)
+{
+    if (_mode == RHModeTx || _adr || index >= sizeof(MODEM_CONFIG_TABLE) / sizeof(ModemConfig))
+	return false;
+    bool wasRx = (_mode == RHModeRx);
+    if (wasRx)
+	setModeIdle();
+    bool ret = setModemConfig((ModemConfigChoice)index);
+    if (wasRx)
+	setModeRx();
+    return ret;
+}
+
 void RH_RF95::setModeIdle()
 {
     if (_mode != RHModeIdle)
     {
 	spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_STDBY);
-	_mode = RHModeIdle;
+	setMode(RHModeIdle);
     }
 }
 
@@ -383,7 +551,7 @@ bool RH_RF95::sleep()
     if (_mode != RHModeSleep)
     {
 	spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_SLEEP);
-	_mode = RHModeSleep;
+	setMode(RHModeSleep);
     }
     return true;
 }
@@ -392,9 +560,11 @@ void RH_RF95::setModeRx()
 {
     if (_mode != RHModeRx)
     {
+	if (_adr)
+	    adrTune(_adrListen);
 	spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_RXCONTINUOUS);
 	spiWrite(RH_RF95_REG_40_DIO_MAPPING1, 0x00); // Interrupt on RxDone
-	_mode = RHModeRx;
+	setMode(RHModeRx);
     }
 }
 
@@ -404,7 +574,7 @@ void RH_RF95::setModeTx()
     {
 	spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_TX);
 	spiWrite(RH_RF95_REG_40_DIO_MAPPING1, 0x40); // Interrupt on TxDone
-	_mode = RHModeTx;
+	setMode(RHModeTx);
     }
 }
 
@@ -419,6 +589,7 @@ void RH_RF95::setTxPower(int8_t power, bool useRFO)
 	if (power < -1)
 	    power = -1;
 	spiWrite(RH_RF95_REG_09_PA_CONFIG, RH_RF95_MAX_POWER | (power + 1));
+	setModeCurrent(RHModeTx, power > 7 ? 29.0 : 20.0); // Datasheet figures for +13 and +7dBm
     }
     else
     {
@@ -426,6 +597,7 @@ void RH_RF95::setTxPower(int8_t power, bool useRFO)
 	    power = 23;
 	if (power < 5)
 	    power = 5;
+	setModeCurrent(RHModeTx, power > 17 ? 120.0 : 87.0); // Datasheet figures for +20 and +17dBm
 
 	// For RH_RF95_PA_DAC_ENABLE, manual says '+20dBm on PA_BOOST when OutputPower=0xf'
 	// RH_RF95_PA_DAC_ENABLE actually adds about 3dBm to all power levels. We will us it
@@ -453,7 +625,10 @@ void RH_RF95::setTxPower(int8_t power, bool useRFO)
 // Sets registers from a canned modem configuration structure
 void RH_RF95::setModemRegisters(const ModemConfig* config)
 {
-    spiWrite(RH_RF95_REG_1D_MODEM_CONFIG1,       config->reg_1d);
+    if (_implicitLength)
+	spiWrite(RH_RF95_REG_1D_MODEM_CONFIG1,   config->reg_1d | RH_RF95_IMPLICIT_HEADER_MODE_ON);
+    else
+	spiWrite(RH_RF95_REG_1D_MODEM_CONFIG1,   config->reg_1d);
     spiWrite(RH_RF95_REG_1E_MODEM_CONFIG2,       config->reg_1e);
     spiWrite(RH_RF95_REG_26_MODEM_CONFIG3,       config->reg_26);
 }
@@ -485,6 +660,223 @@ bool RH_RF95::getModemConfig(ModemConfigChoice index, ModemConfig* config)
 
 
 
+bool RH_RF95::setAdr(bool enable, ModemConfigChoice base, uint8_t margin)
+{
+    if (base >= RH_RF95_NUM_MODEM_CONFIGS || (enable && _implicitLength))
+	return false;
+
+    waitPacketSent();
+    setModeIdle();
+    ATOMIC_BLOCK_START;
+    _adr = enable;
+    _adrBase = _adrListen = _adrPending = base;
+    _adrMargin = margin * 4;
+    _adrLastHeard = millis();
+    memset(_adrPeers, 0, sizeof(_adrPeers));
+    ATOMIC_BLOCK_END;
+
+    // Sort the configurations by bit rate, fastest first
+    float rates[RH_RF95_NUM_MODEM_CONFIGS];
+    uint8_t i, j;
+    for (i = 0; i < RH_RF95_NUM_MODEM_CONFIGS; i++)
+    {
+	ModemConfig cfg;
+	memcpy_P(&cfg, &MODEM_CONFIG_TABLE[i], sizeof(cfg));
+	uint8_t bw = (cfg.reg_1d & RH_RF95_BW) >> 4;
+	if (bw >= sizeof(BANDWIDTHS) / sizeof(BANDWIDTHS[0]))
+	    bw = 7;
+	uint8_t sf = (cfg.reg_1e & RH_RF95_SPREADING_FACTOR) >> 4;
+	uint8_t cr = (cfg.reg_1d & RH_RF95_CODING_RATE) >> 1;
+	float rate = sf * BANDWIDTHS[bw] / (1L << sf) * 4 / (4 + cr);
+	for (j = i; j > 0 && rates[j - 1] < rate; j--)
+	{
+	    rates[j] = rates[j - 1];
+	    _adrOrder[j] = _adrOrder[j - 1];
+	}
+	rates[j] = rate;
+	_adrOrder[j] = i;
+    }
+
+    // Start out with the base configuration
+    setModemConfig(base);
+    _adrTuned = base;
+    return true;
+}
+
+RH_RF95::ModemConfigChoice RH_RF95::adrListenConfig()
+{
+    return (ModemConfigChoice)_adrListen;
+}
+
+uint8_t RH_RF95::headerLen()
+{
+    return RH_RF95_HEADER_LEN + (_adr ? 1 : 0);
+}
+
+void RH_RF95::adrTune(uint8_t config)
+{
+    if (_adrTuned != config)
+    {
+	setModemConfig((ModemConfigChoice)config);
+	_adrTuned = config;
+    }
+}
+
+// Called by the interrupt handler for each message accepted while adaptive data rate is enabled
+void RH_RF95::adrReceived(const uint8_t* buf, int8_t snr)
+{
+    uint8_t from = buf[1];
+    uint8_t listen = buf[RH_RF95_HEADER_LEN] >> 4;
+    uint8_t pending = buf[RH_RF95_HEADER_LEN] & 0x0f;
+    if (listen >= RH_RF95_NUM_MODEM_CONFIGS)
+	listen = _adrBase;
+    if (pending >= RH_RF95_NUM_MODEM_CONFIGS)
+	pending = _adrBase;
+    unsigned long now = millis();
+    _adrLastHeard = now;
+
+    // Find the peer, else a free entry, else the one we heard from longest ago
+    AdrPeer* peer = NULL;
+    AdrPeer* spare = &_adrPeers[0];
+    uint8_t i;
+    for (i = 0; i < RH_RF95_ADR_MAX_PEERS; i++)
+    {
+	AdrPeer* p = &_adrPeers[i];
+	if (p->inUse && p->address == from)
+	{
+	    peer = p;
+	    break;
+	}
+	if (   spare->inUse
+	    && (!p->inUse || now - p->lastHeard > now - spare->lastHeard))
+	    spare = p;
+    }
+
+    // SNR as if received at 125kHz, so it can be compared with the floor of any configuration
+    int16_t floor, noise;
+    adrConfigLimits(_adrTuned, &floor, &noise);
+    int16_t snr125 = snr + noise;
+    if (peer)
+	peer->snr = (3 * peer->snr + snr125) / 4;
+    else
+    {
+	peer = spare;
+	peer->inUse = true;
+	peer->address = from;
+	peer->informed = false;
+	peer->snr = snr125;
+    }
+    peer->listen = listen;
+    peer->pending = pending;
+    peer->misses = 0;
+    peer->lastHeard = now;
+    adrUpdate();
+}
+
+void RH_RF95::adrUpdate()
+{
+    unsigned long now = millis();
+    uint8_t want = _adrBase;
+    uint8_t i, j;
+    for (i = 0; i < RH_RF95_NUM_MODEM_CONFIGS && _adrOrder[i] != _adrBase; i++)
+    {
+	// Can all the peers we have heard from recently reach us with this one?
+	int16_t floor, noise;
+	adrConfigLimits(_adrOrder[i], &floor, &noise);
+	bool ok = false;
+	for (j = 0; j < RH_RF95_ADR_MAX_PEERS; j++)
+	{
+	    AdrPeer* p = &_adrPeers[j];
+	    if (!p->inUse || now - p->lastHeard > RH_RF95_ADR_PEER_TIMEOUT)
+		continue;
+	    ok = (p->snr - noise - floor >= _adrMargin);
+	    if (!ok)
+		break;
+	}
+	if (ok)
+	{
+	    want = _adrOrder[i];
+	    break;
+	}
+    }
+
+    if (want != _adrPending)
+    {
+	// New plan: everyone needs to hear about it
+	_adrPending = want;
+	for (j = 0; j < RH_RF95_ADR_MAX_PEERS; j++)
+	    _adrPeers[j].informed = false;
+    }
+    if (_adrPending != _adrListen)
+    {
+	// Only change when all the peers we have heard from recently know
+	for (j = 0; j < RH_RF95_ADR_MAX_PEERS; j++)
+	{
+	    AdrPeer* p = &_adrPeers[j];
+	    if (p->inUse && now - p->lastHeard <= RH_RF95_ADR_PEER_TIMEOUT && !p->informed)
+		return;
+	}
+	_adrListen = _adrPending;
+	if (_mode == RHModeRx)
+	{
+	    // Retune the receiver
+	    setModeIdle();
+	    setModeRx();
+	}
+    }
+}
+
+uint8_t RH_RF95::adrPrepareSend()
+{
+    uint8_t config = _adrBase;
+    uint8_t octet;
+    ATOMIC_BLOCK_START;
+    if (_txHeaderTo != RH_BROADCAST_ADDRESS)
+    {
+	uint8_t i;
+	for (i = 0; i < RH_RF95_ADR_MAX_PEERS; i++)
+	{
+	    AdrPeer* p = &_adrPeers[i];
+	    if (!p->inUse || p->address != _txHeaderTo)
+		continue;
+	    if (p->misses >= RH_RF95_ADR_MAX_MISSES)
+		p->listen = p->pending = _adrBase; // Give up on it
+	    else if (p->misses && p->pending != p->listen)
+		p->listen = p->pending; // Perhaps it has changed already
+	    if (p->misses < 255)
+		p->misses++;
+	    p->informed = true; // This message tells it our plans
+	    config = p->listen;
+	    break;
+	}
+	adrUpdate(); // Maybe everyone knows now
+    }
+    octet = (_adrListen << 4) | _adrPending;
+    ATOMIC_BLOCK_END;
+    adrTune(config);
+    return octet;
+}
+
+bool RH_RF95::setImplicitHeader(uint8_t len)
+{
+    if (len > RH_RF95_MAX_MESSAGE_LEN || (len && _adr))
+	return false;
+
+    waitPacketSent();
+    setModeIdle();
+    _implicitLength = len;
+    uint8_t reg_1d = spiRead(RH_RF95_REG_1D_MODEM_CONFIG1);
+    if (len)
+    {
+	spiWrite(RH_RF95_REG_1D_MODEM_CONFIG1, reg_1d | RH_RF95_IMPLICIT_HEADER_MODE_ON);
+	// In implicit header mode, the receiver takes the packet length from here
+	spiWrite(RH_RF95_REG_22_PAYLOAD_LENGTH, len + RH_RF95_HEADER_LEN);
+    }
+    else
+	spiWrite(RH_RF95_REG_1D_MODEM_CONFIG1, reg_1d & ~RH_RF95_IMPLICIT_HEADER_MODE_ON);
+    return true;
+}
+
 void RH_RF95::setPreambleLength(uint16_t bytes)
 {
     spiWrite(RH_RF95_REG_20_PREAMBLE_MSB, bytes >> 8);
@@ -498,11 +890,12 @@ bool RH_RF95::isChannelActive()
     {
         spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_CAD);
         spiWrite(RH_RF95_REG_40_DIO_MAPPING1, 0x80); // Interrupt on CadDone
-        _mode = RHModeCad;
+        setMode(RHModeCad);
     }
 
-    while (_mode == RHModeCad)
-        YIELD;
+    uint32_t count;
+    while (count = eventCount(), _mode == RHModeCad)
+        waitEvent(count, RH_EVENT_POLL_INTERVAL);
 
     return _cad;
 }
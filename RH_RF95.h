@@ -16,20 +16,17 @@
 
 // If you don't want to use interupts (mainly to win one I/O pin) then
 // you just need to uncomment this line, if you're on Raspberry PI 
-// it will be set automaticly below
+// it will be set automaticly below, unless you build with RH_LINUX_IRQ
+// to get real interrupts from the kernel (see RHutil/RasPi.h)
 //#define RH_RF69_IRQLESS
 
-#if (RH_PLATFORM == RH_PLATFORM_RASPI)
-// No IRQ used on Raspberry PI
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) && !defined(RH_LINUX_IRQ)
+// No IRQ used on Raspberry PI, unless built with RH_LINUX_IRQ
 #ifndef RH_RF95_IRQLESS
 #define RH_RF95_IRQLESS
 #endif
 #endif // RH_PLATFORM_RASPI PI
 
-// This is the maximum number of interrupts the driver can support
-// Most Arduinos can handle 2, Megas can handle more
-#define RH_RF95_NUM_INTERRUPTS 3
-
 // Max number of octets the LORA Rx/Tx FIFO can hold
 #define RH_RF95_FIFO_SIZE 255
 
@@ -48,6 +45,45 @@
  #define RH_RF95_MAX_MESSAGE_LEN (RH_RF95_MAX_PAYLOAD_LEN - RH_RF95_HEADER_LEN)
 #endif
 
+// The number of received messages that can be held waiting for recv() in continuous receive mode
+// (see RH_RF95::setRxContinuous()), including the one in the receive buffer.
+// Each message beyond the first costs about RH_RF95_MAX_PAYLOAD_LEN octets of SRAM, so the default
+// only allows more than one on Linux hosts. Can be pre-defined prior to including this header
+#ifndef RH_RF95_RX_QUEUE_LEN
+ #if (RH_PLATFORM == RH_PLATFORM_RASPI) || (RH_PLATFORM == RH_PLATFORM_UNIX)
+  #define RH_RF95_RX_QUEUE_LEN 8
+ #else
+  #define RH_RF95_RX_QUEUE_LEN 1
+ #endif
+#endif
+
+// Number of entries in ModemConfigChoice (and MODEM_CONFIG_TABLE)
+#define RH_RF95_NUM_MODEM_CONFIGS 4
+
+// Maximum number of peers whose link quality is tracked for adaptive data rate (see RH_RF95::setAdr())
+// Can be pre-defined prior to including this header
+#ifndef RH_RF95_ADR_MAX_PEERS
+ #if (RH_PLATFORM == RH_PLATFORM_RASPI) || (RH_PLATFORM == RH_PLATFORM_UNIX)
+  #define RH_RF95_ADR_MAX_PEERS 16
+ #else
+  #define RH_RF95_ADR_MAX_PEERS 4
+ #endif
+#endif
+
+// Default link margin in dB required by adaptive data rate above the demodulation SNR floor
+#define RH_RF95_ADR_DEFAULT_MARGIN 10
+
+// Consecutive messages sent to a peer without hearing from it, after which adaptive data rate 
+// gives up on the peer's announced configuration and uses the base configuration
+#define RH_RF95_ADR_MAX_MISSES 2
+
+// Peers not heard from for this long (ms) are ignored when choosing our listen configuration
+#define RH_RF95_ADR_PEER_TIMEOUT 3600000UL
+
+// If nothing has been heard for this long (ms) while listening with a configuration other than the
+// base configuration, go back to listening with the base configuration so peers can find us again
+#define RH_RF95_ADR_LISTEN_TIMEOUT 600000UL
+
 // The crystal oscillator frequency of the module
 #define RH_RF95_FXOSC 32000000.0
 
@@ -95,6 +131,9 @@
 #define RH_RF95_REG_24_HOP_PERIOD                          0x24
 #define RH_RF95_REG_25_FIFO_RX_BYTE_ADDR                   0x25
 #define RH_RF95_REG_26_MODEM_CONFIG3                       0x26
+#define RH_RF95_REG_28_FEI_MSB                             0x28
+#define RH_RF95_REG_29_FEI_MID                             0x29
+#define RH_RF95_REG_2A_FEI_LSB                             0x2a
 
 #define RH_RF95_REG_40_DIO_MAPPING1                        0x40
 #define RH_RF95_REG_41_DIO_MAPPING2                        0x41
@@ -232,6 +271,10 @@
 #define RH_RF95_PAYLOAD_CRC_ON                        0x04
 #define RH_RF95_SYM_TIMEOUT_MSB                       0x03
 
+// RH_RF95_REG_26_MODEM_CONFIG3                       0x26
+#define RH_RF95_LOW_DATA_RATE_OPTIMIZE                0x08
+#define RH_RF95_AGC_AUTO_ON                           0x04
+
 // RH_RF95_REG_4B_TCXO                                0x4b
 #define RH_RF95_TCXO_TCXO_INPUT_ON                    0x10
 
@@ -307,6 +350,13 @@
 /// - 0 to 251 octets DATA 
 /// - CRC (handled internally by the radio)
 ///
+/// If setImplicitHeader() has been called, there is no LoRa explicit header: every packet carries
+/// the 4 octet HEADER and exactly the configured number of DATA octets (shorter messages are padded 
+/// with 0s). The receiver must be configured with the same length, coding rate and CRC setting as the
+/// transmitter, as it has no header to learn them from. This saves the header symbols, which are always 
+/// sent at coding rate 4/8, on every packet, which is worthwhile for fixed size messages at high spreading
+/// factors. RHReliableDatagram works as usual: its 1 octet ACKs are padded to the configured length.
+///
 /// \par Connecting RFM95/96/97/98 and Semtech SX1276/77/78/79 to Arduino
 ///
 /// We tested with Anarduino MiniWirelessLoRA, which is an Arduino Duemilanove compatible with a RFM96W
@@ -446,6 +496,42 @@
 /// and from that other device.  Use cli() to disable interrupts and sei() to
 /// reenable them.
 ///
+/// \par Adaptive data rate
+///
+/// Nodes close to each other can use much faster modem configurations than distant ones. With 
+/// setAdr(true), RH_RF95 chooses, per peer, the fastest of the ModemConfigChoice configurations that the
+/// link can sustain with the required margin, and retunes the modem for each transmission and each receive
+/// window. An SX1276 can only receive with one configuration at a time, so:
+/// - each node listens with one listen configuration, which starts as the base configuration passed to setAdr()
+///   (normally the slowest and most robust one, used by all nodes)
+/// - each message carries one extra octet after the 4 headers, announcing the listen configuration of the
+///   sender, and the configuration it wants to change to
+/// - each message to a peer is sent with the peer's announced listen configuration, and the modem returns to
+///   our own listen configuration afterwards, ready for the reply or acknowledgement
+/// - the SNR of messages received from each peer gives the link margin for each configuration, after allowing for the 
+///   demodulation SNR floor of the spreading factor and the noise in the bandwidth. The listen configuration wanted
+///   is the fastest one with at least the required margin for every peer heard from in the last 
+///   RH_RF95_ADR_PEER_TIMEOUT ms
+/// - a node only changes its listen configuration after it has told each of those peers about the change
+/// - if RH_RF95_ADR_MAX_MISSES messages in a row are sent to a peer without hearing from it, the peer's
+///   announced configuration is abandoned for the base configuration, and a node that has heard nothing for
+///   RH_RF95_ADR_LISTEN_TIMEOUT ms goes back to listening with the base configuration.
+///
+/// All nodes in the network must enable adaptive data rate with the same base configuration. Broadcasts are
+/// always sent with the base configuration, so are only heard by nodes listening with it: adaptive data rate
+/// suits unicast traffic, such as with RHReliableDatagram, rather than RHMesh route discovery.
+/// Do not call setModemConfig() or setModemRegisters() while adaptive data rate is enabled.
+/// Adaptive data rate cannot be used with implicit header mode.
+///
+/// \par Continuous receive
+///
+/// By default the receiver is turned off as soon as a good message arrives, and stays off until your
+/// program next calls available() or recv(). A gateway or other busy receiver can call setRxContinuous(true)
+/// so that the modem never leaves receive mode between frames (except to transmit). Each received packet
+/// is copied out of the FIFO in the interrupt handler as soon as RxDone is signalled, so back-to-back frames
+/// do not overwrite each other, and is queued until you collect it with recv(). Define RH_RF95_RX_QUEUE_LEN
+/// before including RH_RF95.h to change the queue length.
+///
 /// \par Memory
 ///
 /// The RH_RF95 driver requires non-trivial amounts of memory. The sample
@@ -586,8 +672,8 @@ public:
 
     /// Constructor. You can have multiple instances, but each instance must have its own
     /// interrupt and slave select pin. After constructing, you must call init() to initialise the interface
-    /// and the radio module. A maximum of 3 instances can co-exist on one processor, provided there are sufficient
-    /// distinct interrupt lines, one for each instance.
+    /// and the radio module. Up to RH_MAX_INTERRUPT_DEVICES instances (of any RadioHead driver) can co-exist on one processor.
+    /// Each instance needs an interrupt line, but several instances can share one line: see RHGenericDriver.
     /// \param[in] slaveSelectPin the Arduino pin number of the output to use to select the RH_RF22 before
     /// accessing it. Defaults to the normal SS pin for your Arduino (D10 for Diecimila, Uno etc, D53 for Mega, D10 for Maple)
     /// \param[in] interruptPin The interrupt Pin number that is connected to the RFM DIO0 interrupt line. 
@@ -654,6 +740,9 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool    recv(uint8_t* buf, uint8_t* len);
 
+    /// Brings in RHGenericDriver::recv(buf, len, metadata), which this recv() would otherwise hide
+    using RHGenericDriver::recv;
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then optionally waits for Channel Activity Detection (CAD) 
     /// to show the channnel is clear (if the radio supports CAD) by calling waitCAD().
@@ -673,6 +762,39 @@ public:
     virtual bool   waitPacketSent();
 #endif
 
+    /// Enables or disables continuous receive mode.
+    /// Normally, the receiver is turned off (RHModeIdle) as soon as a good message is received, and only
+    /// turned on again by the next call to available() or recv(), so any frame that arrives in between
+    /// is lost. In continuous receive mode, the modem stays in RXCONTINUOUS after each good message, and goes
+    /// straight back to RHModeRx after each transmission. Received messages are queued
+    /// (up to RH_RF95_RX_QUEUE_LEN of them) until collected with recv(). If the queue is full, new messages
+    /// are dropped and counted in rxBad().
+    /// \param[in] continuous true to enable continuous receive mode, false to return to the default
+    void           setRxContinuous(bool continuous);
+
+    /// Enables or disables adaptive data rate (ADR). See the class documentation.
+    /// While enabled, messages carry one more octet of header, and maxMessageLength() is 1 octet smaller.
+    /// \param[in] enable true to enable adaptive data rate, false to disable it, and return to the base configuration
+    /// \param[in] base The configuration used by all nodes to find each other, and for broadcasts
+    /// \param[in] margin Link margin in dB required above the demodulation SNR floor before a faster
+    /// configuration is used for a link
+    /// \return true if successful, false if implicit header mode is in use or base is not valid
+    bool           setAdr(bool enable, ModemConfigChoice base = Bw125Cr48Sf4096, uint8_t margin = RH_RF95_ADR_DEFAULT_MARGIN);
+
+    /// Returns the configuration this node is currently listening with, under adaptive data rate
+    /// \return The listen configuration, one of ModemConfigChoice
+    ModemConfigChoice adrListenConfig();
+
+    /// Selects LoRa implicit header mode with fixed length packets, or returns to the default explicit header
+    /// mode. In implicit header mode, every message is sent with exactly len octets of data: send() pads
+    /// shorter messages with 0s and rejects longer ones, and recv() always returns len octets.
+    /// All nodes in the network must use the same setting, and the same coding rate and CRC setting.
+    /// Survives changes to the modem configuration by setModemConfig() and setModemRegisters().
+    /// \param[in] len The fixed message length (not including the RadioHead headers), 
+    /// up to RH_RF95_MAX_MESSAGE_LEN. 0 selects explicit header mode.
+    /// \return true if len is valid
+    bool           setImplicitHeader(uint8_t len);
+
     /// Sets the length of the preamble
     /// in bytes. 
     /// Caution: this should be set to the same 
@@ -683,9 +805,23 @@ public:
 
     /// Returns the maximum message length 
     /// available in this Driver.
-    /// \return The maximum legal message length
+    /// \return The maximum legal message length: the fixed length in implicit header mode 
+    /// (see setImplicitHeader()), else RH_RF95_MAX_MESSAGE_LEN (less one with adaptive data rate, see setAdr())
     virtual uint8_t maxMessageLength();
 
+    /// Computes the time on air of a message, using the formula in section 4.1.1.7 of the SX1276 datasheet
+    /// and the spreading factor, bandwidth, coding rate, CRC, header mode, low data rate optimisation
+    /// and preamble length currently set in the radio.
+    /// \param[in] len Length of the message data in octets, as would be passed to send()
+    /// (the RadioHead headers are added)
+    /// \return Time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
+    /// Returns the CSMA/CA slot time used by csmaPoll() and waitCAD(): the length of a CAD with
+    /// the current spreading factor and bandwidth, plus a symbol for the turnaround to transmit.
+    /// \return The slot time in microseconds
+    virtual uint32_t slotTime();
+
     /// Sets the transmitter and receiver 
     /// centre frequency.
     /// \param[in] centre Frequency in MHz. 137.0 to 1020.0. Caution: RFM95/96/97/98 comes in several
@@ -693,6 +829,19 @@ public:
     /// \return true if the selected frquency centre is within range
     bool        setFrequency(float centre);
 
+    /// Selects channel base + channel * spacing, as set by RHGenericDriver::setChannels(), with setFrequency().
+    /// If the receiver is on, it is restarted on the new frequency.
+    /// \param[in] channel The channel number
+    /// \return true if the frequency is within range. false while transmitting, or if setChannels()
+    /// has not been called
+    virtual bool setChannel(uint8_t channel);
+
+    /// Selects a modem configuration with setModemConfig(), for RHGatewayNode and other managers that
+    /// do not know the driver. If the receiver is on, it is restarted with the new configuration.
+    /// \param[in] index The ModemConfigChoice
+    /// \return true if the index is valid. false while transmitting or with adaptive data rate enabled
+    virtual bool setModemConfigIndex(uint8_t index);
+
     /// If current mode is Rx or Tx changes it to Idle. If the transmitter or receiver is running, 
     /// disables them.
     void           setModeIdle();
@@ -753,43 +902,53 @@ public:
 
 protected:
     /// This is a low level function to handle the interrupts for one instance of RH_RF95.
-    /// Called automatically by isr*()
+    /// Called automatically by the interrupt dispatcher in RHGenericDriver
     /// Should not need to be called by user code.
 #ifndef RH_RF95_IRQLESS
     void           handleInterrupt();
 #endif
 
+    /// Reads a newly received packet out of the FIFO into the receive buffer or the queue.
+    /// Called when RxDone is signalled
+    void handleRxDone();
+
     /// Examine the revceive buffer to determine whether the message is for this node
     void validateRxBuf();
 
-    /// Clear our local receive buffer
-    void clearRxBuf();
+    /// Number of octets of header at the start of each packet: RH_RF95_HEADER_LEN, plus one 
+    /// when adaptive data rate is enabled
+    uint8_t headerLen();
 
-private:
+    /// Updates the adaptive data rate state of the peer that sent a message to us
+    /// \param[in] buf The received packet, starting with the headers
+    /// \param[in] snr The SNR of the packet in units of 0.25dB, as reported by RH_RF95_REG_19_PKT_SNR_VALUE
+    void adrReceived(const uint8_t* buf, int8_t snr);
 
-#ifndef RH_RF95_IRQLESS
-    /// Low level interrupt service routine for device connected to interrupt 0
-    static void         isr0();
+    /// Retunes the modem for a message to _txHeaderTo under adaptive data rate
+    /// \return The adaptive data rate octet to send after the headers
+    uint8_t adrPrepareSend();
 
-    /// Low level interrupt service routine for device connected to interrupt 1
-    static void         isr1();
+    /// Chooses the listen configuration we want from the link margins of our peers, and changes to
+    /// it if all our peers have been told
+    void adrUpdate();
 
-    /// Low level interrupt service routine for device connected to interrupt 1
-    static void         isr2();
+    /// Loads a configuration into the modem, if not already loaded
+    void adrTune(uint8_t config);
 
-    /// Array of instances connected to interrupts 0 and 1
-    static RH_RF95*     _deviceForInterrupt[];
+    /// Gets the RSSI, SNR, timestamp and frequency error captured when the message in the receive
+    /// buffer was received
+    /// \param[out] metadata Where to put the details
+    virtual void rxMetadata(RxMetadata* metadata);
 
-    /// Index of next interrupt number to use in _deviceForInterrupt
-    static uint8_t      _interruptCount;
+    /// Clear our local receive buffer
+    void clearRxBuf();
+
+private:
 
+#ifndef RH_RF95_IRQLESS
     /// The configured interrupt pin connected to this instance
     uint8_t             _interruptPin;
 
-    /// The index into _deviceForInterrupt[] for this device (if an interrupt is already allocated)
-    /// else 0xff
-    uint8_t             _myInterruptIndex;
-
 #endif
 
     /// Number of octets in the buffer
@@ -800,6 +959,74 @@ private:
 
     /// True when there is a valid message in the buffer
     volatile bool       _rxBufValid;
+
+    /// Reception details of the message in the buffer
+    RxMetadata          _rxMetadata;
+
+    /// True when continuous receive mode is enabled by setRxContinuous()
+    bool                _rxContinuous;
+
+    /// Fixed message length in implicit header mode, see setImplicitHeader(). 0 for explicit header mode
+    uint8_t             _implicitLength;
+
+    /// Adaptive data rate state of a peer
+    typedef struct
+    {
+	uint8_t         address;   ///< Node address of the peer
+	bool            inUse;     ///< True if this entry is in use
+	uint8_t         listen;    ///< Configuration we send to the peer with
+	uint8_t         pending;   ///< Configuration the peer has announced it wants to listen with
+	int16_t         snr;       ///< Average SNR of messages from the peer, as if at 125kHz, in units of 0.25dB
+	uint8_t         misses;    ///< Messages sent to the peer since we last heard from it
+	bool            informed;  ///< True if we have told the peer about _adrPending
+	unsigned long   lastHeard; ///< millis() when we last heard from the peer
+    } AdrPeer;
+
+    /// True if adaptive data rate is enabled
+    bool                _adr;
+
+    /// Adaptive data rate base configuration
+    uint8_t             _adrBase;
+
+    /// Configuration we currently listen with
+    volatile uint8_t    _adrListen;
+
+    /// Configuration we want to listen with
+    volatile uint8_t    _adrPending;
+
+    /// Configuration currently loaded in the modem
+    volatile uint8_t    _adrTuned;
+
+    /// Required link margin in units of 0.25dB
+    int16_t             _adrMargin;
+
+    /// millis() when we last heard any message
+    volatile unsigned long _adrLastHeard;
+
+    /// Configurations, fastest first
+    uint8_t             _adrOrder[RH_RF95_NUM_MODEM_CONFIGS];
+
+    /// Peers we have heard from
+    AdrPeer             _adrPeers[RH_RF95_ADR_MAX_PEERS];
+
+#if RH_RF95_RX_QUEUE_LEN > 1
+    /// A received message waiting to be moved into _buf by available()
+    typedef struct
+    {
+	uint8_t         len;                          ///< Number of octets in buf, including headers
+	RxMetadata      metadata;                     ///< Reception details of the packet
+	uint8_t         buf[RH_RF95_MAX_PAYLOAD_LEN]; ///< The headers and message data
+    } RxQueueEntry;
+
+    /// Queue of received messages in continuous receive mode
+    RxQueueEntry        _rxQueue[RH_RF95_RX_QUEUE_LEN - 1];
+
+    /// Index of the oldest message in _rxQueue
+    volatile uint8_t    _rxQueueHead;
+
+    /// Number of messages in _rxQueue
+    volatile uint8_t    _rxQueueCount;
+#endif
 };
 
 /// @example rf95_client.pde
@@ -21,9 +21,11 @@
 
 RH_TCP::RH_TCP(const char* server)
     : _server(server),
+      _socket(-1),
+      _channel(0),
+      _socketBufLen(0),
       _rxBufLen(0),
-      _rxBufValid(false),
-      _socket(-1)
+      _rxBufValid(false)
 {
 }
     
@@ -59,6 +61,13 @@ bool RH_TCP::connectToServer()
 	port = server.substr(indexOfSeparator+1);
 	server.erase(indexOfSeparator);
     }
+    if (_channel)
+    {
+	// Each channel has its own ether simulator, on the following ports
+	char channelPort[12];
+	snprintf(channelPort, sizeof(channelPort), "%d", atoi(port.c_str()) + _channel);
+	port = channelPort;
+    }
 
     s = getaddrinfo(server.c_str(), port.c_str(), &hints, &result);
     if (s != 0) 
@@ -113,12 +122,8 @@ void RH_TCP::clearRxBuf()
 
 void RH_TCP::checkForEvents()
 {
-    #define RH_TCP_SOCKETBUF_LEN 500
-    static uint8_t socketBuf[RH_TCP_SOCKETBUF_LEN]; // Room for several messages
-    static uint16_t socketBufLen = 0;
-
     // Read at most the amount of space we have left in the buffer
-    ssize_t count = read(_socket, socketBuf + socketBufLen, sizeof(socketBuf) - socketBufLen);
+    ssize_t count = read(_socket, _socketBuf + _socketBufLen, sizeof(_socketBuf) - _socketBufLen);
     if (count < 0)
     {
 	if (errno != EAGAIN)
@@ -135,26 +140,26 @@ void RH_TCP::checkForEvents()
     }
     else
     {
-	socketBufLen += count;
-	while (socketBufLen >= 5)
+	_socketBufLen += count;
+	while (_socketBufLen >= 5)
 	{
-	    RHTcpTypeMessage* message = ((RHTcpTypeMessage*)socketBuf);
+	    RHTcpTypeMessage* message = ((RHTcpTypeMessage*)_socketBuf);
 	    uint32_t len = ntohl(message->length);
 	    uint32_t messageLen = len + sizeof(message->length);
-	    if (len > sizeof(socketBuf) - sizeof(message->length))
+	    if (len > sizeof(_socketBuf) - sizeof(message->length))
 	    {
 		// Bogus length
 		fprintf(stderr, "RH_TCP::checkForEvents read ridiculous length: %d. Corrupt message stream? Aborting\n", len);
 		exit(1);
 	    }
-	    if (socketBufLen >= len + sizeof(message->length))
+	    if (_socketBufLen >= len + sizeof(message->length))
 	    {
 		// Got at least all of this message
 		if (message->type == RH_TCP_MESSAGE_TYPE_PACKET && len >= 5)
 		{
 		    // REVISIT: need to check if we are actually receiving?
 		    // Its a new packet, extract the headers and payload
-		    RHTcpPacket* packet = ((RHTcpPacket*)socketBuf);
+		    RHTcpPacket* packet = ((RHTcpPacket*)_socketBuf);
 		    _rxHeaderTo    = packet->to;
 		    _rxHeaderFrom  = packet->from;
 		    _rxHeaderId    = packet->id;
@@ -166,13 +171,14 @@ void RH_TCP::checkForEvents()
 			memcpy(_rxBuf, packet->payload, payloadLen);
 			_rxBufLen = payloadLen;
 			_rxBufFull = true;
+			_rxTime = micros(); // As near to arrival as we can tell
 		    }
 		}
 		// check for other message types here
 		// Now remove the used message by copying the trailing bytes (maybe start of a new message?)
 		// to the top of the buffer
-		memcpy(socketBuf, socketBuf + messageLen, sizeof(socketBuf) - messageLen);
-		socketBufLen -= messageLen;
+		memcpy(_socketBuf, _socketBuf + messageLen, sizeof(_socketBuf) - messageLen);
+		_socketBufLen -= messageLen;
 	    }
 	}
     }
@@ -210,31 +216,43 @@ void RH_TCP::waitAvailable()
 }
 
 // Block until something is available or timeout expires
+// Sleeps in select() on the socket, so does not spin
 bool RH_TCP::waitAvailableTimeout(uint16_t timeout)
 {
-    int            max_fd;
-    fd_set         input;
-    int            result;
+    unsigned long starttime = millis();
+    while (!available())
+    {
+	int            max_fd;
+	fd_set         input;
+	int            result;
 
-    FD_ZERO(&input);
-    FD_SET(_socket, &input);
-    max_fd = _socket + 1;
+	FD_ZERO(&input);
+	FD_SET(_socket, &input);
+	max_fd = _socket + 1;
 
-    if (timeout)
-    {
-	struct timeval timer;
-	// Timeout is in milliseconds
-	timer.tv_sec  = timeout / 1000;
-	timer.tv_usec = (timeout % 1000) * 1000;
-	result = select(max_fd, &input, NULL, NULL, &timer);
-    }
-    else
-    {
-	result = select(max_fd, &input, NULL, NULL, NULL);
+	if (timeout)
+	{
+	    unsigned long elapsed = millis() - starttime;
+	    if (elapsed >= timeout)
+		return false;
+	    unsigned long remaining = timeout - elapsed;
+	    struct timeval timer;
+	    // Timeout is in milliseconds
+	    timer.tv_sec  = remaining / 1000;
+	    timer.tv_usec = (remaining % 1000) * 1000;
+	    result = select(max_fd, &input, NULL, NULL, &timer);
+	}
+	else
+	{
+	    result = select(max_fd, &input, NULL, NULL, NULL);
+	}
+	if (result < 0)
+	{
+	    fprintf(stderr, "RH_TCP::waitAvailableTimeout: select failed %s\n", strerror(errno));
+	    return false;
+	}
     }
-    if (result < 0)
-	fprintf(stderr, "RH_TCP::waitAvailableTimeout: select failed %s\n", strerror(errno));
-    return result > 0;
+    return true;
 }
 
 bool RH_TCP::recv(uint8_t* buf, uint8_t* len)
@@ -258,6 +276,8 @@ bool RH_TCP::send(const uint8_t* data, uint8_t len)
 	return false;  // Check channel activity (prob not possible for this driver?)
 
     bool ret = sendPacket(data, len);
+    if (ret)
+	_txTime = micros() + timeOnAir(len); // When the ether simulator will deliver it
     delay(10); // Wait for transmit to succeed. REVISIT: depends on length and speed
     return ret;
 }
@@ -267,6 +287,28 @@ uint8_t RH_TCP::maxMessageLength()
     return RH_TCP_MAX_MESSAGE_LEN;
 }
 
+uint32_t RH_TCP::timeOnAir(uint8_t len)
+{
+    return (uint32_t)(RH_TCP_HEADER_LEN + len) * 8 * 1000000 / RH_TCP_SIMULATED_BPS;
+}
+
+bool RH_TCP::setChannel(uint8_t channel)
+{
+    if (channel == _channel && _socket >= 0)
+	return true;
+    // Move to the ether simulator for the channel. Anything still arriving on the old one is lost
+    if (_socket >= 0)
+	close(_socket);
+    _socket = -1;
+    _socketBufLen = 0;
+    _rxBufFull = false;
+    clearRxBuf();
+    _channel = channel;
+    if (!connectToServer())
+	return false;
+    return sendThisAddress(_thisAddress);
+}
+
 void RH_TCP::setThisAddress(uint8_t address)
 {
     RHGenericDriver::setThisAddress(address);
@@ -290,14 +332,14 @@ bool RH_TCP::sendPacket(const uint8_t* data, uint8_t len)
     if (_socket < 0)
 	return false;
     RHTcpPacket m;
-    m.length = htonl(len + 4);
+    m.length = htonl(len + 5); // type, 4 headers and the payload
     m.type  = RH_TCP_MESSAGE_TYPE_PACKET;
     m.to    = _txHeaderTo;
     m.from  = _txHeaderFrom;
     m.id    = _txHeaderId;
     m.flags = _txHeaderFlags;
     memcpy(m.payload, data, len);
-    ssize_t sent = write(_socket, &m, len + 8);
+    ssize_t sent = write(_socket, &m, len + 9);
     return sent > 0;
 }
 
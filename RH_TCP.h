@@ -8,6 +8,14 @@
 #include <RHGenericDriver.h>
 #include <RHTcpProtocol.h>
 
+// Simulated bit rate of the ether, used by timeOnAir(). Must match the -b argument to etherSimulator.pl
+#ifndef RH_TCP_SIMULATED_BPS
+ #define RH_TCP_SIMULATED_BPS 10000
+#endif
+
+// Size of the buffer for messages arriving from the ether simulator. Room for several messages
+#define RH_TCP_SOCKETBUF_LEN 500
+
 /////////////////////////////////////////////////////////////////////
 /// \class RH_TCP RH_TCP.h <RH_TCP.h>
 /// \brief Driver to send and receive unaddressed, unreliable datagrams via sockets on a Linux simulator
@@ -50,6 +58,16 @@
 /// You can change the listen port and the simulated baud rate with 
 /// command line arguments passed to etherSimulator.pl
 ///
+/// \par Channels
+///
+/// Each channel is a separate ether simulator. Channel 0 is the one given to the constructor, and
+/// channel n is on the n'th port after it. setChannel() disconnects from one and connects to the other,
+/// so managers that change channel, such as RHFrequencyHopping and RHGatewayNode, can be simulated:
+/// \code
+/// tools/etherSimulator.pl -p 4000 &
+/// tools/etherSimulator.pl -p 4001 &
+/// \endcode
+///
 /// \par Implementation
 ///
 /// etherServer.pl is a conventional server written in Perl.
@@ -109,6 +127,9 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool recv(uint8_t* buf, uint8_t* len);
 
+    /// Brings in RHGenericDriver::recv(buf, len, metadata), which this recv() would otherwise hide
+    using RHGenericDriver::recv;
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. If the message is too long for the underlying radio technology, send() will
@@ -123,6 +144,18 @@ public:
     /// \return The maximum legal message length
     virtual uint8_t maxMessageLength();
 
+    /// Returns how long etherSimulator.pl holds a message of the given length before delivering it,
+    /// at RH_TCP_SIMULATED_BPS.
+    /// \param[in] len Length of the message data in octets
+    /// \return Simulated time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
+    /// Selects a channel by connecting to its ether simulator: the one on the port given to the
+    /// constructor plus the channel number. Messages still arriving on the old channel are lost.
+    /// \param[in] channel The channel number
+    /// \return true if connected to the ether simulator for the channel
+    virtual bool setChannel(uint8_t channel);
+
     /// Sets the address of this node. Defaults to 0xFF. Subclasses or the user may want to change this.
     /// This will be used to test the adddress in incoming messages. In non-promiscuous mode,
     /// only messages with a TO header the same as thisAddress or the broadcast addess (0xFF) will be accepted.
@@ -167,6 +200,13 @@ private:
     /// The TCP socket used to communicate with the message server
     int         _socket;
 
+    /// The channel selected by setChannel(), added to the server port number
+    uint8_t     _channel;
+
+    /// Buffer for RHTcpProtocol messages arriving on the socket
+    uint8_t     _socketBuf[RH_TCP_SOCKETBUF_LEN];
+    uint16_t    _socketBufLen;
+
     /// Buffer to receive RHTcpProtocol messages
     uint8_t     _rxBuf[RH_TCP_MAX_PAYLOAD_LEN + 5];
     uint16_t    _rxBufLen;
@@ -183,5 +223,8 @@ private:
 
 /// @example simulator_reliable_datagram_client.pde
 /// @example simulator_reliable_datagram_server.pde
+/// @example simulator_tdma.pde
+/// @example simulator_frequency_hopping.pde
+/// @example simulator_gateway.pde
 
 #endif
@@ -13,6 +13,16 @@
 #include <time.h>
 #include "RasPi.h"
 
+#ifdef RH_LINUX_IRQ
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <linux/gpio.h>
+#endif
+
 //Initialize the values for sanity
 timeval RHStartTime;
 
@@ -78,6 +88,40 @@ byte SPIClass::transfer(byte _data)
   return data;
 }
 
+void SPIClass::transfernb(const byte* tbuf, byte* rbuf, uint32_t len)
+{
+  //Set which CS pin to use for next transfers
+  bcm2835_spi_chipSelect(BCM2835_SPI_CS_NONE);
+
+  //Transfer the whole buffer in one go, instead of one call per byte
+  if (tbuf && rbuf)
+  {
+    bcm2835_spi_transfernb((char*)tbuf, (char*)rbuf, len);
+  }
+  else if (tbuf)
+  {
+    bcm2835_spi_writenb((char*)tbuf, len);
+  }
+  else if (rbuf)
+  {
+    // Send zeros, read back in place
+    memset(rbuf, 0, len);
+    bcm2835_spi_transfern((char*)rbuf, len);
+  }
+  else
+  {
+    // Nothing to send or keep, but still clock the bus
+    char zeros[32];
+    while (len)
+    {
+      uint32_t chunk = len > sizeof(zeros) ? sizeof(zeros) : len;
+      memset(zeros, 0, sizeof(zeros));
+      bcm2835_spi_transfern(zeros, chunk);
+      len -= chunk;
+    }
+  }
+}
+
 void pinMode(unsigned char pin, unsigned char mode)
 {
   if (pin == NOT_A_PIN)
@@ -121,12 +165,22 @@ unsigned long millis()
   return difference;
 }
 
+unsigned long micros()
+{
+  //Same as millis(), but in microseconds since the start time
+  struct timeval RHCurrentTime;
+  gettimeofday(&RHCurrentTime,NULL);
+  unsigned long difference = ((RHCurrentTime.tv_sec - RHStartTime.tv_sec) * 1000000);
+  difference += (RHCurrentTime.tv_usec - RHStartTime.tv_usec);
+  return difference;
+}
+
 void delay (unsigned long ms)
 {
   //Implement Delay function
   struct timespec ts;
-  ts.tv_sec=0;
-  ts.tv_nsec=(ms * 1000);
+  ts.tv_sec=ms / 1000;
+  ts.tv_nsec=(ms % 1000) * 1000000;
   nanosleep(&ts,&ts);
 }
 
@@ -166,6 +220,195 @@ void printbuffer(uint8_t buff[], int len)
   }
 }
 
+#ifdef RH_LINUX_IRQ
+//Lock that stands in for 'interrupts disabled'. Recursive so that interrupt routines
+//can use ATOMIC_BLOCK_START themselves, as they do on Arduino
+static pthread_mutex_t RHAtomicLock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+//Per-pin interrupt routines and line event file descriptors
+static void (*RHIsr[RH_LINUX_IRQ_MAX_PINS])(void);
+static int RHIrqFd[RH_LINUX_IRQ_MAX_PINS];
+static bool RHIrqFdInit = false;
+static int RHGpioChipFd = -1;
+static int RHEpollFd = -1;
+static bool RHUseIrqThread = true;
+static bool RHIrqThreadRunning = false;
+static pthread_t RHIrqThread;
+
+void RasPiAtomicBlockStart()
+{
+  pthread_mutex_lock(&RHAtomicLock);
+}
+
+void RasPiAtomicBlockEnd()
+{
+  pthread_mutex_unlock(&RHAtomicLock);
+}
+
+// The IRQ thread sleeps in the kernel until one of the lines has an edge
+static void* irqThreadMain(void* /*arg*/)
+{
+  while (1)
+    RasPiHandleInterrupts(-1);
+  return NULL;
+}
+
+void RasPiInterruptThread(bool enable)
+{
+  RHUseIrqThread = enable;
+}
+
+void attachInterrupt(unsigned char pin, void (*isr)(void), int mode)
+{
+  if (pin >= RH_LINUX_IRQ_MAX_PINS)
+    return;
+
+  if (!RHIrqFdInit)
+  {
+    for (int i = 0; i < RH_LINUX_IRQ_MAX_PINS; i++)
+      RHIrqFd[i] = -1;
+    RHIrqFdInit = true;
+  }
+
+  if (RHGpioChipFd < 0)
+  {
+    RHGpioChipFd = open(RH_LINUX_GPIOCHIP, O_RDWR);
+    if (RHGpioChipFd < 0)
+    {
+      perror(RH_LINUX_GPIOCHIP);
+      return;
+    }
+  }
+
+  if (RHEpollFd < 0)
+  {
+    RHEpollFd = epoll_create1(0);
+    if (RHEpollFd < 0)
+    {
+      perror("epoll_create1");
+      return;
+    }
+  }
+
+  // Replace any previous routine for this pin
+  detachInterrupt(pin);
+
+  struct gpioevent_request req;
+  memset(&req, 0, sizeof(req));
+  req.lineoffset = pin;
+  req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+  if (mode == RISING)
+    req.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+  else if (mode == FALLING)
+    req.eventflags = GPIOEVENT_REQUEST_FALLING_EDGE;
+  else
+    req.eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+  strncpy(req.consumer_label, "RadioHead", sizeof(req.consumer_label) - 1);
+  if (ioctl(RHGpioChipFd, GPIO_GET_LINEEVENT_IOCTL, &req) < 0)
+  {
+    fprintf(stderr, "attachInterrupt: cannot get events for GPIO%d: %s\n", pin, strerror(errno));
+    return;
+  }
+  fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+
+  RasPiAtomicBlockStart();
+  RHIsr[pin] = isr;
+  RHIrqFd[pin] = req.fd;
+  RasPiAtomicBlockEnd();
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLPRI;
+  ev.data.u32 = pin;
+  if (epoll_ctl(RHEpollFd, EPOLL_CTL_ADD, req.fd, &ev) < 0)
+    perror("epoll_ctl");
+
+  if (RHUseIrqThread && !RHIrqThreadRunning)
+  {
+    if (pthread_create(&RHIrqThread, NULL, irqThreadMain, NULL) == 0)
+    {
+      pthread_detach(RHIrqThread);
+      RHIrqThreadRunning = true;
+    }
+    else
+      perror("attachInterrupt: pthread_create");
+  }
+}
+
+void detachInterrupt(unsigned char pin)
+{
+  if (pin >= RH_LINUX_IRQ_MAX_PINS || !RHIrqFdInit)
+    return;
+
+  RasPiAtomicBlockStart();
+  int fd = RHIrqFd[pin];
+  RHIrqFd[pin] = -1;
+  RHIsr[pin] = NULL;
+  RasPiAtomicBlockEnd();
+  if (fd < 0)
+    return; // Not attached
+
+  epoll_ctl(RHEpollFd, EPOLL_CTL_DEL, fd, NULL);
+  close(fd);
+}
+
+int RasPiInterruptFd(unsigned char pin)
+{
+  if (pin >= RH_LINUX_IRQ_MAX_PINS || !RHIrqFdInit)
+    return -1;
+  RasPiAtomicBlockStart();
+  int fd = RHIrqFd[pin];
+  RasPiAtomicBlockEnd();
+  return fd;
+}
+
+int RasPiInterruptPollFd()
+{
+  return RHEpollFd;
+}
+
+// Wait up to timeout ms (-1 for ever, 0 to not wait at all) for GPIO edges
+// and call the interrupt routines of the pins that had one.
+// Returns the number of interrupt routines called, or -1 on error
+int RasPiHandleInterrupts(int timeout)
+{
+  if (RHEpollFd < 0)
+    return -1;
+
+  struct epoll_event events[8];
+  int n = epoll_wait(RHEpollFd, events, sizeof(events) / sizeof(events[0]), timeout);
+  if (n < 0)
+    return (errno == EINTR) ? 0 : -1;
+
+  int handled = 0;
+  for (int i = 0; i < n; i++)
+  {
+    unsigned char pin = events[i].data.u32;
+
+    // Hold the lock so that detachInterrupt() cannot close the line under us
+    RasPiAtomicBlockStart();
+    int fd = RHIrqFd[pin];
+    if (fd >= 0)
+    {
+      // Drain all pending edge events for this line: one call to the
+      // interrupt routine services them all, as on a level-triggered radio IRQ
+      struct gpioevent_data event;
+      bool fired = false;
+      while (read(fd, &event, sizeof(event)) == sizeof(event))
+        fired = true;
+
+      if (fired && RHIsr[pin])
+      {
+        RHIsr[pin]();
+        handled++;
+      }
+    }
+    RasPiAtomicBlockEnd();
+  }
+  return handled;
+}
+#endif
+
 void SerialSimulator::begin(int baud)
 {
   //No implementation neccesary - Serial emulation on Linux = standard console
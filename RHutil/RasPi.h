@@ -37,10 +37,34 @@ typedef unsigned char byte;
 #define memcpy_P memcpy 
 #endif
 
+// Interrupt modes for attachInterrupt(). Only available if RH_LINUX_IRQ is defined
+#ifndef CHANGE
+  #define CHANGE 1
+#endif
+
+#ifndef FALLING
+  #define FALLING 2
+#endif
+
+#ifndef RISING
+  #define RISING 3
+#endif
+
+// The GPIO character device used for interrupts with RH_LINUX_IRQ
+#ifndef RH_LINUX_GPIOCHIP
+  #define RH_LINUX_GPIOCHIP "/dev/gpiochip0"
+#endif
+
+// Highest GPIO line number + 1 that can be used for interrupts with RH_LINUX_IRQ
+#ifndef RH_LINUX_IRQ_MAX_PINS
+  #define RH_LINUX_IRQ_MAX_PINS 64
+#endif
+
 class SPIClass
 {
   public:
     static byte transfer(byte _data);
+    static void transfernb(const byte* tbuf, byte* rbuf, uint32_t len);
     // SPI Configuration methods
     static void begin(); // Default
     static void begin(uint16_t, uint8_t, uint8_t);
@@ -83,10 +107,39 @@ unsigned char digitalRead(unsigned char pin) ;
 
 unsigned long millis();
 
+unsigned long micros();
+
 void delay (unsigned long delay);
 
 long random(long min, long max);
 
 void printbuffer(uint8_t buff[], int len);
 
+#ifdef RH_LINUX_IRQ
+// Real interrupts on Linux, from GPIO edge events delivered by the kernel GPIO character device.
+// Build everything with -DRH_LINUX_IRQ and link with -lpthread to use them.
+// By default, the first attachInterrupt() starts a dedicated IRQ thread which calls the interrupt routines
+// as soon as an edge is reported. Call RasPiInterruptThread(false) before the first attachInterrupt()
+// (ie before driver init()) if you would rather dispatch interrupts from your own loop with
+// RasPiHandleInterrupts(), or by watching RasPiInterruptPollFd() in your own poll()/epoll loop.
+// Interrupt routines are called with the same lock held as ATOMIC_BLOCK_START, so they never
+// run while RadioHead is inside an atomic block.
+
+void attachInterrupt(unsigned char pin, void (*isr)(void), int mode);
+
+void detachInterrupt(unsigned char pin);
+
+void RasPiInterruptThread(bool enable);
+
+int RasPiInterruptFd(unsigned char pin);
+
+int RasPiInterruptPollFd();
+
+int RasPiHandleInterrupts(int timeout);
+
+void RasPiAtomicBlockStart();
+
+void RasPiAtomicBlockEnd();
+#endif
+
 #endif
@@ -18,9 +18,16 @@
 extern int    _simulator_argc;
 extern char** _simulator_argv;
 
+// The clock behind micros() and millis(): returns microseconds since the process started, in 64 bits
+// so that millis() does not wrap with micros(). Defaults to the real time clock. A sketch may point
+// it at its own function to give a simulated node a clock that is offset, runs fast or slow, or is
+// stepped under test control
+extern uint64_t (*_simulator_clock)();
+
 // Definitions for various Arduino functions
 extern void delay(unsigned long ms);
 extern unsigned long millis();
+extern unsigned long micros();
 extern long random(long to);
 extern long random(long from, long to);
 
@@ -142,6 +142,20 @@
 /// - RHMesh
 /// Multi-hop delivery with automatic route discovery and rediscovery.
 ///
+/// - RHTdma
+/// Addressed, collision free, unreliable variable length messages in time slots scheduled by a coordinator's beacons.
+///
+/// - RHTimeSync
+/// Addressed, unreliable variable length messages, plus a network-wide common clock by flooding time synchronisation.
+///
+/// - RHFrequencyHopping
+/// Addressed, unreliable variable length messages, hopping around a set of channels in step with a master.
+/// Needs a driver that supports RHGenericDriver::setChannel().
+///
+/// - RHGatewayNode
+/// Addressed, unreliable variable length messages, following the steer messages of an RHGateway, which
+/// spreads the nodes across the channels of the several radios it has fitted, and merges what they receive.
+///
 /// Any Manager may be used with any Driver.
 ///
 /// \par Platforms
@@ -900,6 +914,10 @@
 // See hardware/esp8266/2.0.0/cores/esp8266/Arduino.h
  #define ATOMIC_BLOCK_START { uint32_t __savedPS = xt_rsil(15);
  #define ATOMIC_BLOCK_END xt_wsr_ps(__savedPS);}
+#elif (RH_PLATFORM == RH_PLATFORM_RASPI) && defined(RH_LINUX_IRQ)
+ // Interrupt routines run in another thread, see RHutil/RasPi.h
+ #define ATOMIC_BLOCK_START RasPiAtomicBlockStart(); {
+ #define ATOMIC_BLOCK_END } RasPiAtomicBlockEnd();
 #else 
  // TO BE DONE:
  #define ATOMIC_BLOCK_START
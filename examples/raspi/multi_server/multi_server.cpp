@@ -1,6 +1,8 @@
 // multi_server.cpp
 //
 // Example program showing how to use multiple module RH_RF69/RH_RF95 on Raspberry Pi
+// as one gateway with RHGateway: nodes are spread across the two RF95 modules,
+// and what all three modules receive is printed in the order it was received
 // Requires bcm2835 library to be already installed
 // http://www.airspayce.com/mikem/bcm2835/
 // Use the Makefile in this directory:
@@ -19,6 +21,7 @@
 #include <RHGenericDriver.h>
 #include <RH_RF69.h>
 #include <RH_RF95.h>
+#include <RHGateway.h>
 
 // Raspberri PI Lora Gateway for multiple modules 
 // see https://github.com/hallard/RPI-Lora-Gateway
@@ -31,16 +34,26 @@
 // User Led on GPIO18 so P1 connector pin #12
 #define LED_PIN  RPI_V2_GPIO_P1_12     
 
+// Address of the gateway, on all the modules
+#define GATEWAY_NODE_ID   1
+
+// The RF95 modules are on channels of the same band, so nodes can be moved between them:
+// channel n is at RF95_CHANNEL_BASE + n * RF95_CHANNEL_SPACING MHz.
+// Nodes (see RHGatewayNode) start on channel 0 with RF95_MODEM_CONFIG, and are steered from there
+#define RF95_CHANNEL_BASE    868.10
+#define RF95_CHANNEL_SPACING 0.20
+#define RF95_MODEM_CONFIG    RH_RF95::Bw125Cr45Sf128
+
 // Our RF95 module 1 Configuration 
-#define RF95_1_NODE_ID    1
-#define RF95_1_FREQUENCY  868.00
+#define RF95_1_CHANNEL    0
+#define RF95_1_FREQUENCY  (RF95_CHANNEL_BASE + RF95_1_CHANNEL * RF95_CHANNEL_SPACING)
 
-// Our RF95 module 3 Configuration 
-#define RF95_2_NODE_ID    1
-#define RF95_2_FREQUENCY  433.00
+// Our RF95 module 2 Configuration 
+#define RF95_2_CHANNEL    1
+#define RF95_2_FREQUENCY  (RF95_CHANNEL_BASE + RF95_2_CHANNEL * RF95_CHANNEL_SPACING)
 
 // Our RFM69 module 3 Configuration 
-#define RF69_3_NODE_ID    1
+// Its nodes cannot move to the RF95 modules, so it has a pool of its own
 #define RF69_3_GROUP_ID   69
 #define RF69_3_FREQUENCY  433.00
 
@@ -54,22 +67,26 @@ uint8_t LED_pins[NB_MODULES] = { MOD1_LED_PIN, MOD2_LED_PIN, MOD3_LED_PIN};
 uint8_t RST_pins[NB_MODULES] = { MOD1_RST_PIN, MOD2_RST_PIN, MOD3_RST_PIN};
 uint8_t CSN_pins[NB_MODULES] = { MOD1_CS_PIN , MOD2_CS_PIN , MOD3_CS_PIN };
 
-const char * MOD_name[]      = { "1 RF95 868",     "2 RF95 433" ,    "3 RFM69HW 433"  };
+const char * MOD_name[]      = { "1 RF95 868",     "2 RF95 868" ,    "3 RFM69HW 433"  };
 float MOD_freq[NB_MODULES]   = { RF95_1_FREQUENCY, RF95_2_FREQUENCY, RF69_3_FREQUENCY };
-uint8_t MOD_id[NB_MODULES]   = { RF95_1_NODE_ID,   RF95_2_NODE_ID,   RF69_3_NODE_ID   };
 
 // Pointer table on radio driver
 RHGenericDriver * drivers[NB_MODULES];
 
 // Create an instance of a driver for 3 modules
-// In our case RadioHead code does not use IRQ
+// By default RadioHead code does not use IRQ
 // callback, bcm2835 does provide such function, 
 // but keep line state providing function to test
 // Rising/falling/change on GPIO Pin
+// If built with RH_LINUX_IRQ (see Makefile), the drivers get real
+// interrupts from the kernel GPIO character device instead
 RH_RF95 rf95_1(MOD1_CS_PIN, MOD1_IRQ_PIN);
 RH_RF95 rf95_2(MOD2_CS_PIN, MOD2_IRQ_PIN);
 RH_RF69 rf69_3(MOD3_CS_PIN, MOD3_IRQ_PIN);
 
+// Schedules the nodes across the modules, and merges what they receive
+RHGateway gateway(GATEWAY_NODE_ID);
+
 //Flag for Ctrl-C
 volatile sig_atomic_t force_exit = 0;
 
@@ -91,42 +108,41 @@ void sig_handler(int sig)
 
 /* ======================================================================
 Function: getReceivedData
-Purpose : Get module received data and display it
-Input   : Module Index from modules table
+Purpose : Get received data from all the modules, in the order
+          it was received, and display it
+Input   : LED blink ms timer table, started for the module that received
 Output  : -
 Comments: -
 ====================================================================== */
-void getReceivedData( uint8_t index) 
+void getReceivedData(unsigned long * led_blink) 
 {
-  RHGenericDriver * driver = drivers[index];
-  if (driver->available()) {
-    // RH_RF95_MAX_MESSAGE_LEN is > RH_RF69_MAX_MESSAGE_LEN, 
-    // So we take the maximum size to be able to handle all
-    uint8_t buf[RH_RF95_MAX_MESSAGE_LEN];
-    uint8_t len  = sizeof(buf);
-    uint8_t from = driver->headerFrom();
-    uint8_t to   = driver->headerTo();
-    uint8_t id   = driver->headerId();
-    uint8_t flags= driver->headerFlags();;
-    int8_t rssi  = driver->lastRssi();
-
-    if (driver->recv(buf, &len)) {
-      time_t timer;
-      char time_buff[16];
-      struct tm* tm_info;
-
-      time(&timer);
-      tm_info = localtime(&timer);
-
-      strftime(time_buff, sizeof(time_buff), "%H:%M:%S", tm_info);
-
-      printf("%s Mod%s [%02d] #%d => #%d %ddB: ", 
-                time_buff, MOD_name[index], len, from, to, rssi);
-      printbuffer(buf, len);
-    } else {
-      printf("receive failed");
-    }
+  // RH_RF95_MAX_MESSAGE_LEN is > RH_RF69_MAX_MESSAGE_LEN, 
+  // So we take the maximum size to be able to handle all
+  uint8_t buf[RH_RF95_MAX_MESSAGE_LEN];
+  uint8_t len  = sizeof(buf);
+  uint8_t from, to, index;
+  RHGenericDriver::RxMetadata metadata;
+
+  while (gateway.recvfrom(buf, &len, &from, &to, NULL, NULL, &index, &metadata)) {
+    time_t timer;
+    char time_buff[16];
+    struct tm* tm_info;
+
+    // Start associated led blink
+    led_blink[index] = millis();
+    digitalWrite(LED_pins[index], HIGH);
+
+    time(&timer);
+    tm_info = localtime(&timer);
+
+    strftime(time_buff, sizeof(time_buff), "%H:%M:%S", tm_info);
+
+    printf("%s Mod%s (%d.%d%% busy) [%02d] #%d => #%d %ddB: ", 
+              time_buff, MOD_name[index], gateway.occupancy(index) / 10, gateway.occupancy(index) % 10,
+              len, from, to, metadata.rssi);
+    printbuffer(buf, len);
     printf("\n");
+    len = sizeof(buf);
   }
 }
 
@@ -149,12 +165,11 @@ bool initRadioModule( uint8_t index) {
   pinMode(LED_pins[index], OUTPUT);
 
   // IRQ Pin, as input with Pull down (in case no module connected)
+  // (with RH_LINUX_IRQ, driver init() asks the kernel for edge events,
+  // else the drivers poll the modules)
   pinMode(IRQ_pins[index], INPUT);
   bcm2835_gpio_set_pud(IRQ_pins[index], BCM2835_GPIO_PUD_DOWN);
 
-  // we enable rising edge detection 
-  bcm2835_gpio_ren(IRQ_pins[index]);
-
   // Reset module and blink the module LED 
   digitalWrite(LED_pins[index], HIGH);
   pinMode(RST_pins[index], OUTPUT);
@@ -176,11 +191,8 @@ bool initRadioModule( uint8_t index) {
     // now we can enable rising edge detection 
     //bcm2835_gpio_ren(IRQ_pins[index]);
 
-    // set Node ID
-    driver->setThisAddress(MOD_id[index]); // filtering address when receiving
-    driver->setHeaderFrom(MOD_id[index]);  // Transmit From Node
-
-    // Get all frame, we're in demo mode
+    // Get all frame, we're in demo mode, and the gateway
+    // measures how busy each channel really is
     driver->setPromiscuous(true);   
 
     // We need to check module type since generic driver does
@@ -206,8 +218,13 @@ bool initRadioModule( uint8_t index) {
         // the CAD timeout to non-zero:
         //rf95.setCADTimeout(10000);
 
-        // Adjust Frequency
-        ((RH_RF95 *) driver)->setFrequency( MOD_freq[index] );
+        // Adjust Frequency and modem configuration
+        driver->setChannels(RF95_CHANNEL_BASE, RF95_CHANNEL_SPACING);
+        driver->setChannel(index == IDX_MOD1 ? RF95_1_CHANNEL : RF95_2_CHANNEL);
+        ((RH_RF95 *) driver)->setModemConfig(RF95_MODEM_CONFIG);
+
+        // Nodes can be steered to this module, the gateway sets the Node ID
+        gateway.addRadio(*driver, index == IDX_MOD1 ? RF95_1_CHANNEL : RF95_2_CHANNEL, RF95_MODEM_CONFIG);
       break;
 
       // RF69
@@ -227,10 +244,13 @@ bool initRadioModule( uint8_t index) {
         syncwords[0] = 0x2d;
         syncwords[1] = RF69_3_GROUP_ID;
         ((RH_RF69 *) driver)->setSyncWords(syncwords, sizeof(syncwords));
+
+        // Its nodes stay on it, the gateway sets the Node ID
+        gateway.addRadio(*driver, RH_GATEWAY_NO_CHANGE, RH_GATEWAY_NO_CHANGE, 1);
       break;
     }
 
-    printf( " OK!, NodeID=%d @ %3.2fMHz\n", MOD_id[index], MOD_freq[index] );
+    printf( " OK!, NodeID=%d @ %3.2fMHz\n", GATEWAY_NODE_ID, MOD_freq[index] );
     return true;
   }
   
@@ -251,6 +271,12 @@ int main (int argc, const char* argv[] )
   
   // caught CTRL-C to do clean-up
   signal(SIGINT, sig_handler);
+
+#ifdef RH_LINUX_IRQ
+  // We dispatch radio interrupts ourselves from the main loop
+  // with RasPiHandleInterrupts(), so no need for an IRQ thread
+  RasPiInterruptThread(false);
+#endif
   
   // Display app name
   printf( "%s\n", __BASEFILE__);
@@ -302,37 +328,33 @@ int main (int argc, const char* argv[] )
   // Begin the main loop code 
   // ========================
   while (!force_exit) { 
-    // Loop thru modules
-    for (uint8_t idx=0 ; idx<NB_MODULES ; idx++) {
-      // Rising edge fired ?
-      if (bcm2835_gpio_eds(IRQ_pins[idx])) {
-        // Now clear the eds flag by setting it to 1
-        bcm2835_gpio_set_eds(IRQ_pins[idx]);
-        //printf("Packet Received, Rising event detect for pin GPIO%d\n", IRQ_pins[idx]);
-  
-        // Start associated led blink
-        led_blink[idx] = millis();
-        digitalWrite(LED_pins[idx], HIGH);
-        getReceivedData(idx); 
-      } // has IRQ
+#ifdef RH_LINUX_IRQ
+    // Sleep in the kernel until a module raises its IRQ line (or it's time
+    // to blink LEDs), then call the drivers interrupt handlers
+    RasPiHandleInterrupts(LED_BLINK_MS/2);
+#endif
 
+    // Get what all the modules received, in order. This also
+    // steers the nodes and balances them across the RF95 modules
+    getReceivedData(led_blink);
+
+    for (uint8_t idx=0 ; idx<NB_MODULES ; idx++) {
       // A module led blink timer expired ? Light off
       if (led_blink[idx] && millis()-led_blink[idx]>LED_BLINK_MS) {
         led_blink[idx] = 0;
         digitalWrite(LED_pins[idx], LOW);
       } // Led timer expired
-
-      getReceivedData(idx); 
-
     } // For Modules
     
     // On board led blink (500ms off / 500ms On)
     digitalWrite(LED_PIN, (millis()%1000)<500?LOW:HIGH);
 
+#ifndef RH_LINUX_IRQ
     // Let OS doing other tasks
     // For timed critical appliation receiver, you can reduce or delete
     // this delay, but this will charge CPU usage, take care and monitor
     bcm2835_delay(5);
+#endif
   }
 
   // We're here because we need to exit, do it clean
@@ -0,0 +1,92 @@
+// simulator_frequency_hopping.pde
+// -*- mode: C++ -*-
+// Example sketch showing how to hop a network of nodes together around several channels
+// with the RHFrequencyHopping class, using the RH_TCP driver to talk to the simulated ether.
+// Each RH_TCP channel is a separate ether simulator, on consecutive ports.
+// Node 1 is the master, which keeps the hop timing. The other nodes send to it every couple of seconds,
+// and it broadcasts to them all.
+// Tested on Linux
+// Build with
+// cd whatever/RadioHead
+// tools/simBuild examples/simulator/simulator_frequency_hopping/simulator_frequency_hopping.pde
+// Run an ether simulator for each channel:
+// tools/etherSimulator.pl -p 4000 &
+// tools/etherSimulator.pl -p 4001 &
+// tools/etherSimulator.pl -p 4002 &
+// tools/etherSimulator.pl -p 4003 &
+// Then run the master and the nodes, each with its address, eg:
+// ./simulator_frequency_hopping 1 &
+// ./simulator_frequency_hopping 2 &
+// ./simulator_frequency_hopping 3 &
+// The nodes print when they synchronise to the master, and everyone prints the messages they
+// receive and the channel they were received on.
+
+#include <RHFrequencyHopping.h>
+#include <RH_TCP.h>
+
+#define MASTER_ADDRESS 1
+
+// The hop sequence: must be the same on all the nodes
+#define NUM_CHANNELS 4
+#define NETWORK_KEY 0x12345678
+#define DWELL_TIME 400
+
+// Singleton instance of the radio driver
+RH_TCP driver;
+
+// Class to manage message delivery and receipt, using the driver declared above
+RHFrequencyHopping manager(driver, MASTER_ADDRESS);
+
+void setup()
+{
+  Serial.begin(9600);
+  if (!manager.init())
+    Serial.println("init failed");
+  // Maybe set this address from the command line
+  if (_simulator_argc >= 2)
+     manager.setThisAddress(atoi(_simulator_argv[1]));
+  if (manager.thisAddress() == MASTER_ADDRESS)
+    manager.setMaster();
+  if (!manager.setHopping(NUM_CHANNELS, NETWORK_KEY, DWELL_TIME))
+    Serial.println("setHopping failed");
+}
+
+// Dont put this on the stack:
+uint8_t buf[RH_FH_MAX_MESSAGE_LEN];
+unsigned long lastSend = 0;
+unsigned long sendInterval = 2000;
+bool wasSynchronised = false;
+uint16_t count = 0;
+
+void loop()
+{
+  // Follow the hops several times per dwell time
+  uint8_t len = sizeof(buf);
+  uint8_t from;
+  if (manager.recvfrom(buf, &len, &from))
+  {
+    buf[len < sizeof(buf) ? len : sizeof(buf) - 1] = 0;
+    printf("node %d got from %d on channel %d: %s\n", manager.thisAddress(), from, manager.channel(), (char*)buf);
+    fflush(stdout);
+  }
+
+  if (manager.synchronised() != wasSynchronised)
+  {
+    wasSynchronised = manager.synchronised();
+    printf("node %d %s\n", manager.thisAddress(), wasSynchronised ? "synchronised" : "lost the master");
+    fflush(stdout);
+  }
+
+  // Blocks until there is room in a hop for the message. There is no channel activity detection
+  // in the simulator, so send at random intervals to avoid colliding with the other nodes
+  if (manager.synchronised() && millis() - lastSend >= sendInterval)
+  {
+    lastSend = millis();
+    sendInterval = random(1000, 3000);
+    uint8_t to = manager.thisAddress() == MASTER_ADDRESS ? RH_BROADCAST_ADDRESS : MASTER_ADDRESS;
+    len = snprintf((char*)buf, sizeof(buf), "Hello %u from %d", count++, manager.thisAddress());
+    if (!manager.sendto(buf, len, to))
+      Serial.println("sendto failed");
+  }
+  delay(1);
+}
@@ -0,0 +1,125 @@
+// simulator_gateway.pde
+// -*- mode: C++ -*-
+// Example sketch showing how a gateway with several radios spreads its nodes across them
+// with the RHGateway and RHGatewayNode classes, using the RH_TCP driver to talk to the simulated ether.
+// Each RH_TCP channel is a separate ether simulator, on consecutive ports.
+// Node 1 is the gateway, with a radio on each of channels 0 and 1. The other nodes start on channel 0
+// and send to the gateway at random intervals. The gateway steers some of them to channel 1.
+// Tested on Linux
+// Build with
+// cd whatever/RadioHead
+// tools/simBuild examples/simulator/simulator_gateway/simulator_gateway.pde
+// Run an ether simulator for each channel:
+// tools/etherSimulator.pl -p 4000 &
+// tools/etherSimulator.pl -p 4001 &
+// Then run the gateway and the nodes, each with its address, eg:
+// ./simulator_gateway 1 &
+// ./simulator_gateway 2 &
+// ./simulator_gateway 3 &
+// ./simulator_gateway 4 &
+// ./simulator_gateway 5 &
+// The gateway prints the messages it receives and the radio they arrived on, and every window the
+// occupancy of each radio. The nodes print when they are steered to another channel.
+
+#include <RHGatewayNode.h>
+#include <RH_TCP.h>
+
+#define GATEWAY_ADDRESS 1
+
+// Time over which the gateway measures the load on each radio
+#define WINDOW 5000
+
+// The radios of the gateway, on channels 0 and 1
+RH_TCP radio0;
+RH_TCP radio1;
+RHGateway gateway(GATEWAY_ADDRESS);
+
+// The radio of a node, which starts on channel 0
+RH_TCP driver;
+RHGatewayNode node(driver);
+
+bool isGateway = false;
+
+void setup()
+{
+  Serial.begin(9600);
+  uint8_t address = GATEWAY_ADDRESS;
+  // Maybe set this address from the command line
+  if (_simulator_argc >= 2)
+     address = atoi(_simulator_argv[1]);
+
+  if (address == GATEWAY_ADDRESS)
+  {
+    isGateway = true;
+    if (!radio0.init() || !radio1.init() || !radio1.setChannel(1))
+      Serial.println("init failed");
+    // The modem configuration is the same on both channels
+    gateway.addRadio(radio0, 0);
+    gateway.addRadio(radio1, 1);
+    gateway.setWindow(WINDOW);
+  }
+  else
+  {
+    if (!node.init())
+      Serial.println("init failed");
+    node.setThisAddress(address);
+  }
+}
+
+// Dont put this on the stack:
+uint8_t buf[RH_TCP_MAX_MESSAGE_LEN];
+unsigned long lastSend = 0;
+unsigned long sendInterval = 1000;
+unsigned long lastReport = 0;
+uint8_t lastChannel = RH_GATEWAY_NO_CHANGE;
+uint16_t count = 0;
+
+void loop()
+{
+  uint8_t len = sizeof(buf) - 1;
+  uint8_t from;
+  if (isGateway)
+  {
+    uint8_t radio;
+    if (gateway.recvfrom(buf, &len, &from, NULL, NULL, NULL, &radio))
+    {
+      buf[len] = 0;
+      printf("gateway got from %d on radio %d: %s\n", from, radio, (char*)buf);
+      fflush(stdout);
+    }
+    if (millis() - lastReport >= WINDOW)
+    {
+      lastReport = millis();
+      printf("gateway %d nodes, occupancy radio 0 %d/1000, radio 1 %d/1000\n",
+	     gateway.numNodes(), gateway.occupancy(0), gateway.occupancy(1));
+      fflush(stdout);
+    }
+  }
+  else
+  {
+    // Steer messages are handled here
+    if (node.recvfrom(buf, &len, &from))
+    {
+      buf[len] = 0;
+      printf("node %d got from %d: %s\n", node.thisAddress(), from, (char*)buf);
+      fflush(stdout);
+    }
+    if (node.channel() != lastChannel)
+    {
+      lastChannel = node.channel();
+      printf("node %d steered to channel %d\n", node.thisAddress(), lastChannel);
+      fflush(stdout);
+    }
+    // There is no channel activity detection in the simulator, so send at random intervals
+    // to avoid colliding with the other nodes
+    if (millis() - lastSend >= sendInterval)
+    {
+      lastSend = millis();
+      sendInterval = random(500, 1500);
+      len = snprintf((char*)buf, sizeof(buf), "Hello %u from %d", count++, node.thisAddress());
+      if (!node.sendto(buf, len, GATEWAY_ADDRESS))
+	Serial.println("sendto failed");
+    }
+  }
+  delay(1);
+}
@@ -0,0 +1,92 @@
+// simulator_tdma.pde
+// -*- mode: C++ -*-
+// Example sketch showing how to share a channel between several nodes without collisions
+// with the RHTdma class, using the RH_TCP driver to talk to the simulated ether.
+// Node 1 is the coordinator. It gives a data slot in each frame to each of nodes 2, 3 and 4,
+// for sending to the coordinator, and keeps one slot for broadcasting to them all.
+// Tested on Linux
+// Build with
+// cd whatever/RadioHead
+// tools/simBuild examples/simulator/simulator_tdma/simulator_tdma.pde
+// Run the coordinator and the nodes, each with its address, eg:
+// ./simulator_tdma 1 &
+// ./simulator_tdma 2 &
+// ./simulator_tdma 3 &
+// ./simulator_tdma 4 &
+// The nodes print when they synchronise to the coordinator's beacons, and everyone prints the
+// messages they receive.
+// Make sure you also have the 'Luminiferous Ether' simulator tools/etherSimulator.pl running
+
+#include <RHTdma.h>
+#include <RH_TCP.h>
+
+#define COORDINATOR_ADDRESS 1
+#define NUM_NODES 3
+
+// Longest message sent in a data slot
+#define MAX_MESSAGE_LEN 20
+
+// Singleton instance of the radio driver
+RH_TCP driver;
+
+// Class to manage message delivery and receipt, using the driver declared above
+RHTdma manager(driver, COORDINATOR_ADDRESS);
+
+void setup()
+{
+  Serial.begin(9600);
+  if (!manager.init())
+    Serial.println("init failed");
+  // Maybe set this address from the command line
+  if (_simulator_argc >= 2)
+     manager.setThisAddress(atoi(_simulator_argv[1]));
+
+  if (manager.thisAddress() == COORDINATOR_ADDRESS)
+  {
+    // A slot for each node to send to us, then one for us to broadcast
+    if (!manager.setCoordinator(NUM_NODES + 1, MAX_MESSAGE_LEN))
+      Serial.println("setCoordinator failed");
+    uint8_t i;
+    for (i = 0; i < NUM_NODES; i++)
+      manager.assignSlot(i, COORDINATOR_ADDRESS + 1 + i, COORDINATOR_ADDRESS);
+    manager.assignSlot(NUM_NODES, COORDINATOR_ADDRESS, RH_BROADCAST_ADDRESS);
+  }
+}
+
+// Dont put this on the stack:
+uint8_t buf[RH_TCP_MAX_MESSAGE_LEN];
+unsigned long lastSend = 0;
+bool wasSynchronised = false;
+uint16_t count = 0;
+
+void loop()
+{
+  // Run the schedule several times per slot
+  uint8_t len = sizeof(buf);
+  uint8_t from;
+  if (manager.recvfrom(buf, &len, &from))
+  {
+    buf[len < sizeof(buf) ? len : sizeof(buf) - 1] = 0;
+    printf("node %d got from %d: %s\n", manager.thisAddress(), from, (char*)buf);
+    fflush(stdout);
+  }
+
+  if (manager.synchronised() != wasSynchronised)
+  {
+    wasSynchronised = manager.synchronised();
+    printf("node %d %s, frame length %u us\n", manager.thisAddress(),
+	   wasSynchronised ? "synchronised" : "lost the coordinator", (unsigned)manager.frameLength());
+    fflush(stdout);
+  }
+
+  // Queue a message every couple of seconds. It goes out in our next slot
+  if (manager.synchronised() && !manager.txPending() && millis() - lastSend >= 2000)
+  {
+    lastSend = millis();
+    uint8_t to = manager.thisAddress() == COORDINATOR_ADDRESS ? RH_BROADCAST_ADDRESS : COORDINATOR_ADDRESS;
+    len = snprintf((char*)buf, MAX_MESSAGE_LEN, "Hello %u from %d", count++, manager.thisAddress());
+    if (!manager.sendto(buf, len, to))
+      Serial.println("sendto failed");
+  }
+  delay(1);
+}
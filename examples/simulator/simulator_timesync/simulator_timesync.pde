@@ -0,0 +1,94 @@
+// simulator_timesync.pde
+// -*- mode: C++ -*-
+// Example sketch showing how to give several nodes a common clock
+// with the RHTimeSync class, using the RH_TCP driver to talk to the simulated ether.
+// Each node can be given a clock that is offset and runs fast or slow, and prints how its
+// estimate of the global time compares with the real time.
+// Tested on Linux
+// Build with
+// cd whatever/RadioHead
+// tools/simBuild examples/simulator/simulator_timesync/simulator_timesync.pde
+// Run several, each with its address, clock skew in ppm and clock offset in ms, eg:
+// ./simulator_timesync 1 &
+// ./simulator_timesync 2 50 1500 &
+// ./simulator_timesync 3 -30 -800 &
+// Node 1 is the root, and its clock is the real time, so the errors printed by the others
+// are the synchronisation errors. Their estimated skew should converge on minus their clock skew.
+// Make sure you also have the 'Luminiferous Ether' simulator tools/etherSimulator.pl running
+
+#include <RHTimeSync.h>
+#include <RH_TCP.h>
+#include <sys/time.h>
+
+#define ROOT_ADDRESS 1
+
+// Singleton instance of the radio driver
+RH_TCP driver;
+
+// Class to manage message delivery and receipt, using the driver declared above
+RHTimeSync manager(driver, ROOT_ADDRESS);
+
+// The injected clock error
+double skewPpm = 0.0;
+double offsetMs = 0.0;
+
+// Real time in microseconds when we started
+double startTime;
+
+// Real time in microseconds
+double realTime()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+// Our clock: the real time, offset and running fast or slow from when we started
+uint64_t skewedClock()
+{
+  double now = realTime();
+  return (uint64_t)(now + (now - startTime) * skewPpm / 1000000.0 + offsetMs * 1000.0);
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  if (_simulator_argc >= 3)
+    skewPpm = atof(_simulator_argv[2]);
+  if (_simulator_argc >= 4)
+    offsetMs = atof(_simulator_argv[3]);
+  startTime = realTime();
+  _simulator_clock = skewedClock;
+
+  if (!manager.init())
+    Serial.println("init failed");
+  // Maybe set this address from the command line
+  if (_simulator_argc >= 2)
+     manager.setThisAddress(atoi(_simulator_argv[1]));
+  if (manager.thisAddress() == ROOT_ADDRESS)
+    manager.setRoot();
+  manager.setSyncPeriod(2000);
+}
+
+// Dont put this on the stack:
+uint8_t buf[RH_TCP_MAX_MESSAGE_LEN];
+unsigned long lastReport = 0;
+
+void loop()
+{
+  // Sleep until something arrives, then let the manager handle it
+  manager.waitAvailableTimeout(10);
+  uint8_t len = sizeof(buf);
+  manager.recvfrom(buf, &len);
+
+  if (millis() - lastReport >= 1000)
+  {
+    lastReport = millis();
+    int32_t error = manager.globalMicros() - (uint32_t)realTime();
+    printf("node %d root %d %s skew %.2f ppm error %d us\n",
+	   manager.thisAddress(), manager.rootAddress(),
+	   manager.synchronised() ? "synchronised" : "unsynchronised",
+	   manager.skew() * 1000000.0, error);
+    fflush(stdout);
+  }
+}
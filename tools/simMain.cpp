@@ -18,28 +18,36 @@ SerialSimulator Serial;
 extern void setup();
 extern void loop();
 
-// Millis at the start of the process
-unsigned long start_millis;
+// Micros at the start of the process
+uint64_t start_micros;
 
 int    _simulator_argc;
 char** _simulator_argv;
 
-// Returns milliseconds since beginning of day
-unsigned long time_in_millis()
+// Returns microseconds since the epoch
+uint64_t time_in_micros()
 {    
     struct timeval te; 
     gettimeofday(&te, NULL); // get current time
-    unsigned long milliseconds = te.tv_sec*1000LL + te.tv_usec/1000; // caclulate milliseconds
-    return milliseconds;
+    uint64_t microseconds = te.tv_sec*1000000LL + te.tv_usec; // caclulate microseconds
+    return microseconds;
 }
 
+// The default clock: real microseconds since process start
+uint64_t real_clock()
+{
+    return time_in_micros() - start_micros;
+}
+
+uint64_t (*_simulator_clock)() = real_clock;
+
 // Run the Arduino standard functions in the main loop
 int main(int argc, char** argv)
 {
     // Let simulated program have access to argc and argv
     _simulator_argc = argc;
     _simulator_argv = argv;
-    start_millis = time_in_millis();
+    start_micros = time_in_micros();
     // Seed the random number generator
     srand(getpid() ^ (unsigned) time(NULL)/2);
     setup();
@@ -52,10 +60,17 @@ void delay(unsigned long ms)
     usleep(ms * 1000);
 }
 
+// Arduino equivalent, microseconds since process start
+unsigned long micros()
+{
+    return _simulator_clock();
+}
+
 // Arduino equivalent, milliseconds since process start
+// Divides the full width clock, so it wraps at the right time even where unsigned long is 32 bits
 unsigned long millis()
 {
-    return time_in_millis() - start_millis;
+    return _simulator_clock() / 1000;
 }
 
 long random(long from, long to)